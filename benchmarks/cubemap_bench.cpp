@@ -0,0 +1,460 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "mesh_data.hpp"
+#include "mipmap.hpp"
+#include "obj_loader.hpp"
+#include "texture.hpp"
+#include "timing.hpp"
+
+// Builds the mip chain of the skybox and models the texture traffic of the exterior pass with and without it.
+//  - Generation: the seamless chain and the one with roughness prefiltered levels, each with the scalar kernels
+//    serially, with the SSE2 kernels serially and on all hardware threads. The scalar and SSE2 levels have to
+//    match byte for byte. Next to them is the old chain of generate_mipmaps on each face.
+//  - Seams: the differences between the texels on both sides of the face edges, over all levels.
+//  - Traffic: the exterior mesh is rasterized at 1080p from a camera circling it at several distances. For every
+//    pixel the reflection vector and its derivatives over the 2x2 quad pick the level like the GPU does. The
+//    texels of the lookups are counted in 4x4 blocks of 64 bytes (RGBA8): the distinct blocks of a frame and
+//    the misses of a 16 KiB 4-way texture cache, walked in 8x8 pixel tiles. Without mipmaps every lookup reads
+//    level 0 (GL_LINEAR), with them two levels (GL_LINEAR_MIPMAP_LINEAR). A mirror sphere of the same size as
+//    the exterior shows the case of curved reflectors.
+// Usage: cubemap_bench
+
+namespace {
+
+const float pi = 3.14159265358979f;
+const int frame_width = 1920, frame_height = 1080;
+
+/// Same layout as the cube map targets
+glm::vec3 face_direction(int face, float u, float v) {
+  const glm::vec3 directions[6] = {glm::vec3(1.f, -v, -u), glm::vec3(-1.f, -v, u), glm::vec3(u, 1.f, v),
+                                   glm::vec3(u, -1.f, -v), glm::vec3(u, -v, 1.f),  glm::vec3(-u, -v, -1.f)};
+  return directions[face];
+}
+
+int direction_face(const glm::vec3 &d) {
+  const glm::vec3 a = glm::abs(d);
+  if (a.x >= a.y && a.x >= a.z) {
+    return d.x >= 0.f ? 0 : 1;
+  }
+  if (a.y >= a.z) {
+    return d.y >= 0.f ? 2 : 3;
+  }
+  return d.z >= 0.f ? 4 : 5;
+}
+
+glm::vec2 face_coordinates(int face, const glm::vec3 &direction) {
+  const glm::vec3 d = direction / std::abs(direction[face / 2]);
+  const glm::vec2 coordinates[6] = {glm::vec2(-d.z, -d.y), glm::vec2(d.z, -d.y), glm::vec2(d.x, d.z),
+                                    glm::vec2(d.x, -d.z),  glm::vec2(d.x, -d.y), glm::vec2(-d.x, -d.y)};
+  return coordinates[face];
+}
+
+int texel_index(float coordinate, int size) {
+  return std::min(std::max(static_cast<int>((coordinate + 1.f) * 0.5f * size), 0), size - 1);
+}
+
+size_t count_differences(const std::vector<std::vector<Image>> &a, const std::vector<std::vector<Image>> &b) {
+  size_t differences = 0;
+  for (size_t face = 0; face < a.size(); face++) {
+    for (size_t level = 0; level < a[face].size(); level++) {
+      differences += a[face][level].pixels != b[face][level].pixels;
+    }
+  }
+  return differences;
+}
+
+struct SeamError {
+  double mean = 0.0;
+  int largest = 0;
+};
+
+/// Differences of the color channels of the texels on both sides of every edge, levels of 2x2 texels and more
+SeamError measure_seams(const std::vector<std::vector<Image>> &chains) {
+  SeamError error;
+  size_t count = 0;
+  for (size_t level = 0; level < chains[0].size(); level++) {
+    const int size = chains[0][level].width;
+    if (size < 2) {
+      continue;
+    }
+    for (int face = 0; face < 6; face++) {
+      for (int i = 1; i < size - 1; i++) {
+        const float along = (i + 0.5f) * 2.f / size - 1.f;
+        const glm::vec2 edges[4] = {glm::vec2(-1.f, along), glm::vec2(1.f, along), glm::vec2(along, -1.f),
+                                    glm::vec2(along, 1.f)};
+        for (const glm::vec2 &edge : edges) {
+          const glm::vec3 point = face_direction(face, edge.x, edge.y);
+          // The other face has the point on its border too
+          int other = 0;
+          while (other == face || point[other / 2] != (other % 2 == 0 ? 1.f : -1.f)) {
+            other++;
+          }
+          const glm::vec2 other_coordinates = face_coordinates(other, point);
+          const uint8_t *texel = &chains[face][level].pixels[4 * (size_t(texel_index(edge.y, size)) * size +
+                                                                  texel_index(edge.x, size))];
+          const uint8_t *other_texel =
+              &chains[other][level].pixels[4 * (size_t(texel_index(other_coordinates.y, size)) * size +
+                                                texel_index(other_coordinates.x, size))];
+          for (int c = 0; c < 3; c++) {
+            const int difference = std::abs(int(texel[c]) - int(other_texel[c]));
+            error.mean += difference;
+            error.largest = std::max(error.largest, difference);
+            count++;
+          }
+        }
+      }
+    }
+  }
+  error.mean /= std::max<size_t>(count, 1);
+  return error;
+}
+
+struct Geometry {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<uint32_t> indices;
+  glm::vec3 center = glm::vec3(0.f);
+  float radius = 0.f;
+};
+
+Geometry load_exterior(const std::string &file_name) {
+  Geometry geometry;
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  std::vector<tinyobj::material_t> materials;
+  std::string err;
+  const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\"));
+  if (!load_obj(&attrib, &shapes, &materials, &err, file_name, base_dir + "/")) {
+    std::cout << err;
+    return geometry;
+  }
+  const MeshData data = build_material_batches(attrib, shapes, materials, base_dir);
+  for (size_t v = 0; v < data.vertices.size() / 3; v++) {
+    geometry.positions.emplace_back(data.vertices[3 * v], data.vertices[3 * v + 1], data.vertices[3 * v + 2]);
+    geometry.normals.emplace_back(data.normals[3 * v], data.normals[3 * v + 1], data.normals[3 * v + 2]);
+  }
+  geometry.indices = data.indices;
+  geometry.center = 0.5f * (data.bounds_min + data.bounds_max);
+  geometry.radius = 0.5f * glm::length(data.bounds_max - data.bounds_min);
+  return geometry;
+}
+
+Geometry make_sphere(const glm::vec3 &center, float radius) {
+  Geometry geometry;
+  const int rings = 64, segments = 128;
+  for (int r = 0; r <= rings; r++) {
+    const float theta = pi * r / rings;
+    for (int s = 0; s <= segments; s++) {
+      const float phi = 2.f * pi * s / segments;
+      const glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+      geometry.positions.push_back(center + radius * normal);
+      geometry.normals.push_back(normal);
+    }
+  }
+  for (int r = 0; r < rings; r++) {
+    for (int s = 0; s < segments; s++) {
+      const uint32_t a = r * (segments + 1) + s, b = a + segments + 1;
+      geometry.indices.insert(geometry.indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+  geometry.center = center;
+  geometry.radius = radius;
+  return geometry;
+}
+
+/// Surface position and normal of every pixel, nearest triangle wins
+struct Frame {
+  std::vector<float> depth;
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+
+  Frame()
+      : depth(size_t(frame_width) * frame_height, 2.f), positions(depth.size()), normals(depth.size()) {}
+  bool covered(int x, int y) const {
+    return x >= 0 && y >= 0 && x < frame_width && y < frame_height && depth[size_t(y) * frame_width + x] < 2.f;
+  }
+};
+
+void rasterize(const Geometry &geometry, const glm::mat4 &view_projection, Frame *frame) {
+  for (size_t t = 0; t + 2 < geometry.indices.size(); t += 3) {
+    glm::vec4 clip[3];
+    glm::vec2 screen[3];
+    bool visible = true;
+    for (int i = 0; i < 3; i++) {
+      clip[i] = view_projection * glm::vec4(geometry.positions[geometry.indices[t + i]], 1.f);
+      // The camera stays outside of the meshes, so no triangle needs clipping at the near plane
+      visible = visible && clip[i].w > 0.1f;
+      screen[i] = glm::vec2((clip[i].x / clip[i].w + 1.f) * 0.5f * frame_width,
+                            (1.f - clip[i].y / clip[i].w) * 0.5f * frame_height);
+    }
+    const float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) -
+                       (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+    if (!visible || std::abs(area) < 1e-8f) {
+      continue;
+    }
+    const int min_x = std::max(0, static_cast<int>(std::floor(std::min({screen[0].x, screen[1].x, screen[2].x}))));
+    const int max_x =
+        std::min(frame_width - 1, static_cast<int>(std::ceil(std::max({screen[0].x, screen[1].x, screen[2].x}))));
+    const int min_y = std::max(0, static_cast<int>(std::floor(std::min({screen[0].y, screen[1].y, screen[2].y}))));
+    const int max_y =
+        std::min(frame_height - 1, static_cast<int>(std::ceil(std::max({screen[0].y, screen[1].y, screen[2].y}))));
+    for (int y = min_y; y <= max_y; y++) {
+      for (int x = min_x; x <= max_x; x++) {
+        const glm::vec2 p(x + 0.5f, y + 0.5f);
+        float w[3];
+        for (int i = 0; i < 3; i++) {
+          const glm::vec2 &a = screen[(i + 1) % 3], &b = screen[(i + 2) % 3];
+          w[i] = ((b.x - a.x) * (p.y - a.y) - (p.x - a.x) * (b.y - a.y)) / area;
+        }
+        if (w[0] < 0.f || w[1] < 0.f || w[2] < 0.f) {
+          continue;
+        }
+        const float depth = (w[0] * clip[0].z / clip[0].w + w[1] * clip[1].z / clip[1].w +
+                             w[2] * clip[2].z / clip[2].w);
+        const size_t index = size_t(y) * frame_width + x;
+        if (depth >= frame->depth[index]) {
+          continue;
+        }
+        // Perspective correct interpolation
+        float b[3], sum = 0.f;
+        for (int i = 0; i < 3; i++) {
+          b[i] = w[i] / clip[i].w;
+          sum += b[i];
+        }
+        glm::vec3 position(0.f), normal(0.f);
+        for (int i = 0; i < 3; i++) {
+          position += (b[i] / sum) * geometry.positions[geometry.indices[t + i]];
+          normal += (b[i] / sum) * geometry.normals[geometry.indices[t + i]];
+        }
+        frame->depth[index] = depth;
+        frame->positions[index] = position;
+        frame->normals[index] = glm::normalize(normal);
+      }
+    }
+  }
+}
+
+/// Set associative cache of 64-byte lines with LRU replacement
+class TextureCacheModel {
+public:
+  void access(uint64_t line) {
+    const size_t set = size_t((line * 0x9E3779B97F4A7C15ull) >> 58) % set_count;
+    uint64_t *tags = &this->tags[set * ways];
+    uint32_t *ages = &this->ages[set * ways];
+    this->clock++;
+    size_t victim = 0;
+    for (size_t way = 0; way < ways; way++) {
+      if (tags[way] == line + 1) {
+        ages[way] = this->clock;
+        return;
+      }
+      if (ages[way] < ages[victim]) {
+        victim = way;
+      }
+    }
+    tags[victim] = line + 1;
+    ages[victim] = this->clock;
+    this->misses++;
+  }
+
+  size_t misses = 0;
+
+private:
+  static const size_t ways = 4;
+  static const size_t set_count = 64;
+  std::vector<uint64_t> tags = std::vector<uint64_t>(ways * set_count, 0);
+  std::vector<uint32_t> ages = std::vector<uint32_t>(ways * set_count, 0);
+  uint32_t clock = 0;
+};
+
+struct Traffic {
+  size_t pixels = 0;
+  size_t blocks = 0;
+  size_t misses = 0;
+  double mean_level = 0.0;
+};
+
+/// Texture blocks the lookups of the covered pixels read, with all levels up to 'max_level'
+Traffic measure_traffic(const Frame &frame, const glm::vec3 &eye, int face_size, int max_level) {
+  auto reflection = [&](int x, int y) {
+    const size_t index = size_t(y) * frame_width + x;
+    return glm::reflect(glm::normalize(frame.positions[index] - eye), frame.normals[index]);
+  };
+  // Difference to the other pixel of the quad, or to the neighbour on the other side when that one is empty
+  auto derivative = [&](int x, int y, int dx, int dy, const glm::vec3 &r) {
+    const int partner_x = dx ? (x ^ 1) : x, partner_y = dy ? (y ^ 1) : y;
+    const float sign = (dx ? partner_x > x : partner_y > y) ? 1.f : -1.f;
+    if (frame.covered(partner_x, partner_y)) {
+      return sign * (reflection(partner_x, partner_y) - r);
+    }
+    const int other_x = x - (partner_x - x), other_y = y - (partner_y - y);
+    if (frame.covered(other_x, other_y)) {
+      return sign * (r - reflection(other_x, other_y));
+    }
+    return glm::vec3(0.f);
+  };
+
+  Traffic traffic;
+  TextureCacheModel cache;
+  std::unordered_set<uint64_t> blocks;
+  for (int tile_y = 0; tile_y < frame_height; tile_y += 8) {
+    for (int tile_x = 0; tile_x < frame_width; tile_x += 8) {
+      for (int y = tile_y; y < std::min(tile_y + 8, frame_height); y++) {
+        for (int x = tile_x; x < std::min(tile_x + 8, frame_width); x++) {
+          if (!frame.covered(x, y)) {
+            continue;
+          }
+          const glm::vec3 r = reflection(x, y);
+          const int face = direction_face(r);
+          const glm::vec2 uv = face_coordinates(face, r);
+          const glm::vec2 du = face_coordinates(face, r + derivative(x, y, 1, 0, r)) - uv;
+          const glm::vec2 dv = face_coordinates(face, r + derivative(x, y, 0, 1, r)) - uv;
+          const float rho = std::max(glm::length(du), glm::length(dv)) * 0.5f * face_size;
+          const float lod = std::min(std::max(std::log2(std::max(rho, 1e-6f)), 0.f), float(max_level));
+          const int first_level = static_cast<int>(lod);
+          const int last_level = lod > first_level ? first_level + 1 : first_level;
+          traffic.pixels++;
+          traffic.mean_level += lod;
+
+          for (int level = first_level; level <= last_level; level++) {
+            const int size = std::max(1, face_size >> level);
+            const float tx = (uv.x + 1.f) * 0.5f * size - 0.5f, ty = (uv.y + 1.f) * 0.5f * size - 0.5f;
+            const int x0 = std::max(0, static_cast<int>(std::floor(tx))), x1 = std::min(size - 1, x0 + 1);
+            const int y0 = std::max(0, static_cast<int>(std::floor(ty))), y1 = std::min(size - 1, y0 + 1);
+            for (int by = y0 / 4; by <= y1 / 4; by++) {
+              for (int bx = x0 / 4; bx <= x1 / 4; bx++) {
+                const uint64_t block = uint64_t(face) | uint64_t(level) << 3 | uint64_t(bx) << 8 | uint64_t(by) << 32;
+                blocks.insert(block);
+                cache.access(block);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  traffic.blocks = blocks.size();
+  traffic.misses = cache.misses;
+  traffic.mean_level /= std::max<size_t>(traffic.pixels, 1);
+  return traffic;
+}
+
+} // namespace
+
+int main() {
+  const std::vector<std::string> files = {"images/cubemap/nightsky_rt.tga", "images/cubemap/nightsky_lt.tga",
+                                          "images/cubemap/nightsky_up.tga", "images/cubemap/nightsky_dn.tga",
+                                          "images/cubemap/nightsky_ft.tga", "images/cubemap/nightsky_bk.tga"};
+  const std::vector<Image> faces = decode_images(files);
+  for (const Image &face : faces) {
+    if (face.empty() || face.width != face.height || face.width != faces[0].width) {
+      std::cout << "The faces make no cube" << std::endl;
+      return 1;
+    }
+  }
+  const int face_size = faces[0].width;
+  const int level_count = static_cast<int>(std::log2(face_size)) + 1;
+
+  const int repeats = 3;
+  const size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+  // Submitted to the only worker, parallel_for runs serially
+  ThreadPool serial_pool(1);
+  ThreadPool pool(std::max<size_t>(1, hardware_threads - 1));
+
+  std::cout << "Skybox " << face_size << "x" << face_size << ", " << level_count << " levels, " << hardware_threads
+            << " hardware threads" << std::endl;
+  std::cout << std::left << std::setw(28) << "chain" << std::right << std::setw(12) << "scalar ms" << std::setw(10)
+            << "sse2 ms" << std::setw(12) << "threads ms" << std::setw(13) << "differences" << std::setw(12)
+            << "seam mean" << std::setw(10) << "seam max" << std::endl;
+
+  std::vector<std::vector<Image>> face_chains(6);
+  const double face_milliseconds = best_milliseconds(repeats, [&]() {
+    for (size_t face = 0; face < 6; face++) {
+      face_chains[face] = generate_mipmaps(faces[face], MipSettings(), pool);
+    }
+  });
+  const SeamError face_seams = measure_seams(face_chains);
+  std::cout << std::left << std::setw(28) << "faces (generate_mipmaps)" << std::right << std::fixed
+            << std::setprecision(2) << std::setw(12) << "-" << std::setw(10) << "-" << std::setw(12)
+            << face_milliseconds << std::setw(13) << "-" << std::setw(12) << face_seams.mean << std::setw(10)
+            << face_seams.largest << std::endl;
+
+  for (bool prefilter : {false, true}) {
+    CubemapMipSettings settings;
+    settings.prefilter = prefilter;
+    CubemapMipSettings scalar_settings = settings;
+    scalar_settings.mip.simd = false;
+
+    std::vector<std::vector<Image>> scalar_chains, simd_chains, threaded_chains;
+    const double scalar_milliseconds = best_milliseconds(repeats, [&]() {
+      serial_pool
+          .submit([&]() { scalar_chains = generate_cubemap_mipmaps(faces, scalar_settings, serial_pool); })
+          .get();
+    });
+    const double simd_milliseconds = best_milliseconds(repeats, [&]() {
+      serial_pool.submit([&]() { simd_chains = generate_cubemap_mipmaps(faces, settings, serial_pool); }).get();
+    });
+    const double threaded_milliseconds =
+        best_milliseconds(repeats, [&]() { threaded_chains = generate_cubemap_mipmaps(faces, settings, pool); });
+    const SeamError seams = measure_seams(threaded_chains);
+    std::cout << std::left << std::setw(28)
+              << (prefilter ? "prefiltered, " + std::to_string(settings.prefilter_samples) + " samples" : "seamless")
+              << std::right << std::setw(12) << scalar_milliseconds << std::setw(10) << simd_milliseconds
+              << std::setw(12) << threaded_milliseconds << std::setw(13)
+              << count_differences(scalar_chains, simd_chains) + count_differences(simd_chains, threaded_chains)
+              << std::setw(12) << seams.mean << std::setw(10) << seams.largest << std::endl;
+  }
+
+  // The camera circles the mesh at a few distances, slightly above it, looking at its center
+  const Geometry exterior = load_exterior("objects/exterior.obj");
+  if (exterior.indices.empty()) {
+    return 1;
+  }
+  const Geometry sphere = make_sphere(exterior.center, exterior.radius);
+  const glm::mat4 projection =
+      glm::perspective(glm::radians(45.f), float(frame_width) / frame_height, 0.1f, 500.f);
+  const int angles = 8;
+  std::cout << std::endl
+            << "Texture traffic per frame at " << frame_width << "x" << frame_height << ", KiB of RGBA8 blocks"
+            << std::endl;
+  std::cout << std::left << std::setw(10) << "mesh" << std::right << std::setw(10) << "distance" << std::setw(10)
+            << "pixels" << std::setw(11) << "lod" << std::setw(14) << "blocks before" << std::setw(13)
+            << "blocks after" << std::setw(14) << "misses before" << std::setw(13) << "misses after" << std::endl;
+  for (const Geometry *geometry : {&exterior, &sphere}) {
+    for (float distance : {1.5f, 3.f, 6.f}) {
+      Traffic before, after;
+      for (int a = 0; a < angles; a++) {
+        const float angle = 2.f * pi * a / angles;
+        const glm::vec3 eye = exterior.center + distance * exterior.radius *
+                                                    glm::normalize(glm::vec3(std::sin(angle), 0.4f, std::cos(angle)));
+        Frame frame;
+        rasterize(*geometry, projection * glm::lookAt(eye, exterior.center, glm::vec3(0.f, 1.f, 0.f)), &frame);
+        const Traffic frame_before = measure_traffic(frame, eye, face_size, 0);
+        const Traffic frame_after = measure_traffic(frame, eye, face_size, level_count - 1);
+        before.pixels += frame_before.pixels;
+        before.blocks += frame_before.blocks;
+        before.misses += frame_before.misses;
+        after.blocks += frame_after.blocks;
+        after.misses += frame_after.misses;
+        after.mean_level += frame_after.mean_level / angles;
+      }
+      std::cout << std::left << std::setw(10) << (geometry == &exterior ? "exterior" : "sphere") << std::right
+                << std::setprecision(1) << std::setw(9) << distance << "r" << std::setw(10) << before.pixels / angles
+                << std::setprecision(2) << std::setw(11) << after.mean_level << std::setprecision(0)
+                << std::setw(14) << before.blocks * 64.0 / 1024 / angles << std::setw(13)
+                << after.blocks * 64.0 / 1024 / angles << std::setw(14) << before.misses * 64.0 / 1024 / angles
+                << std::setw(13) << after.misses * 64.0 / 1024 / angles << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stb_image.h>
+
+#include "image_decoder.hpp"
+#include "mapped_file.hpp"
+#include "timing.hpp"
+
+// Compares the decoders of image_decoder.hpp with stb_image on the texture files of the scene, from memory so
+// reading the files is not part of the timings:
+//  - stb: stbi_load_from_memory into 4 channels, as decode_image did before
+//  - scalar and sse2: decode_png or decode_tga with the scalar and the SSE2 kernels
+// Both have to produce the pixels of stb_image byte for byte. Every file is also cut in half, the decoders have to
+// refuse it (stb_image then decodes it as it can) or match stb_image on it.
+// Usage: image_decode_bench [image ...]
+
+namespace {
+
+/// RGBA pixels of stb_image, empty when it cannot decode the data
+std::vector<uint8_t> decode_stb(const uint8_t *data, size_t size, int *width, int *height) {
+  int channels;
+  unsigned char *pixels = stbi_load_from_memory(data, static_cast<int>(size), width, height, &channels, 4);
+  if (!pixels) {
+    return {};
+  }
+  const std::vector<uint8_t> rgba(pixels, pixels + size_t(*width) * *height * 4);
+  stbi_image_free(pixels);
+  return rgba;
+}
+
+bool decode_fast(const std::string &file, const uint8_t *data, size_t size, Image *image, bool simd) {
+  const bool tga = file.size() >= 4 && file.compare(file.size() - 4, 4, ".tga") == 0;
+  return tga ? decode_tga(data, size, image, simd) : decode_png(data, size, image, simd);
+}
+
+bool same_pixels(const Image &image, int width, int height, const std::vector<uint8_t> &reference) {
+  return image.width == width && image.height == height && image.pixels == reference;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {
+      "objects/interiorSurface_Color.png", "objects/WindowsSurface_Color.png", "objects/ScreenSurface_Color.png",
+      "objects/ExteriorSurface_Color.png", "objects/interior_previewSurface_Color.png", "images/container_diff.png",
+      "images/container_spec.png",         "images/cubemap/nightsky_rt.tga",   "images/cubemap/nightsky_lt.tga",
+      "images/cubemap/nightsky_up.tga",    "images/cubemap/nightsky_dn.tga",   "images/cubemap/nightsky_bk.tga",
+      "images/cubemap/nightsky_ft.tga"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+  const int repeats = 5;
+
+  std::cout << std::left << std::setw(44) << "image" << std::right << std::setw(11) << "size" << std::setw(10)
+            << "stb ms" << std::setw(11) << "scalar ms" << std::setw(10) << "sse2 ms" << std::setw(10) << "speedup"
+            << std::setw(7) << "same" << std::endl;
+
+  double total_stb = 0.0, total_scalar = 0.0, total_simd = 0.0;
+  bool all_same = true;
+  for (const std::string &file : files) {
+    std::unique_ptr<MappedFile> mapped;
+    try {
+      mapped = std::make_unique<MappedFile>(file);
+    } catch (const std::string &error) {
+      std::cout << error << std::endl;
+      all_same = false;
+      continue;
+    }
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(mapped->data());
+    const size_t size = mapped->size();
+
+    int width = 0, height = 0;
+    const std::vector<uint8_t> reference = decode_stb(data, size, &width, &height);
+    Image scalar, simd;
+    const bool decoded = decode_fast(file, data, size, &scalar, false) && decode_fast(file, data, size, &simd, true);
+    bool same = decoded && same_pixels(scalar, width, height, reference) && same_pixels(simd, width, height, reference);
+
+    // Half of the file
+    Image truncated;
+    int truncated_width = 0, truncated_height = 0;
+    const std::vector<uint8_t> truncated_reference = decode_stb(data, size / 2, &truncated_width, &truncated_height);
+    if (decode_fast(file, data, size / 2, &truncated, true) &&
+        !same_pixels(truncated, truncated_width, truncated_height, truncated_reference)) {
+      std::cout << "The decode of half of " << file << " differs from stb_image" << std::endl;
+      same = false;
+    }
+    all_same = all_same && same;
+
+    const double stb_seconds = best_seconds(repeats, [&]() { decode_stb(data, size, &width, &height); });
+    const double scalar_seconds = best_seconds(repeats, [&]() {
+      Image image;
+      decode_fast(file, data, size, &image, false);
+    });
+    const double simd_seconds = best_seconds(repeats, [&]() {
+      Image image;
+      decode_fast(file, data, size, &image, true);
+    });
+    total_stb += stb_seconds;
+    total_scalar += scalar_seconds;
+    total_simd += simd_seconds;
+    std::cout << std::left << std::setw(44) << file << std::right << std::setw(11)
+              << std::to_string(width) + "x" + std::to_string(height) << std::fixed << std::setprecision(2)
+              << std::setw(10) << stb_seconds * 1000.0 << std::setw(11) << scalar_seconds * 1000.0 << std::setw(10)
+              << simd_seconds * 1000.0 << std::setw(9) << stb_seconds / simd_seconds << "x" << std::setw(7)
+              << (same ? "yes" : "NO") << std::endl;
+  }
+  std::cout << std::left << std::setw(55) << "total" << std::right << std::setw(10) << total_stb * 1000.0
+            << std::setw(11) << total_scalar * 1000.0 << std::setw(10) << total_simd * 1000.0 << std::setw(9)
+            << total_stb / std::max(total_simd, 1e-9) << "x" << std::setw(7) << (all_same ? "yes" : "NO") << std::endl;
+  return all_same ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "light_block.hpp"
+#include "uniform_buffer.hpp"
+
+// Replays the light animation of the application for a number of frames and compares the uploads per frame:
+//  - uniforms: one glUniform call per member of every light, as render() made them before the Lights block
+//  - block: the changed rows of the LightBlock, one glBufferSubData per run of consecutive rows after binding the
+//    buffer
+// The CPU time of the block is that of filling it and finding the runs; the GL calls cannot be timed without a
+// context, so they are counted.
+// Usage: light_uniforms_bench
+
+namespace {
+
+const glm::vec3 spot_lights_colors(215 / 255.f, 237 / 255.f, 244 / 255.f);
+const glm::vec3 screen_light_color(164 / 255.f, 80 / 255.f, 1 / 255.f);
+const int screen_spot_light = 4;
+
+/// The constant parameters, set once like init() does
+LightBlock make_lights() {
+  LightBlock lights;
+  for (int i = 0; i < light_block_point_lights; i++) {
+    lights.point_lights[i].position = glm::vec3(i == 0 ? -28.49f : 28.49f, 0.f, 44.27f);
+    lights.point_lights[i].linear = 0.014f;
+    lights.point_lights[i].quadratic = 0.0007f;
+  }
+  lights.dir_light.direction = glm::vec3(-50.f, -52.f, -316.f);
+  for (int i = 0; i < light_block_spot_lights; i++) {
+    SpotLightStd140 &light = lights.spot_lights[i];
+    light.position = glm::vec3(10.f * i, 11.5f, -8.2f);
+    light.direction = glm::vec3(0.f, -11.f, -5.f);
+    light.cut_off = std::cos(glm::radians(i == screen_spot_light ? 20.f : 10.5f));
+    light.outer_cut_off = std::cos(glm::radians(i == screen_spot_light ? 80.f : 30.5f));
+    light.linear = i == screen_spot_light ? 0.022f : 0.09f;
+    light.quadratic = i == screen_spot_light ? 0.0019f : 0.032f;
+    const glm::vec3 color = i == screen_spot_light ? screen_light_color : spot_lights_colors;
+    light.ambient = color * 0.2f;
+    light.diffuse = color * 0.5f;
+    light.specular = color * 0.8f;
+  }
+  return lights;
+}
+
+/// The animated colors at 'time' seconds, like render() sets them
+void animate(float time, LightBlock *lights) {
+  const glm::vec3 colors[2] = {glm::vec3(184 / 255.f * std::sin(time), 57 / 255.f, 153 / 255.f),
+                               glm::vec3(96 / 255.f, 159 / 255.f * std::cos(time), 201 / 255.f)};
+  for (int i = 0; i < light_block_point_lights; i++) {
+    lights->point_lights[i].ambient = colors[i] * 0.2f;
+    lights->point_lights[i].diffuse = colors[i];
+    lights->point_lights[i].specular = colors[i];
+  }
+  const glm::vec3 dir_light_color(44 / 255.f, 104 / 255.f, 195 / 255.f);
+  lights->dir_light.ambient = dir_light_color * 0.2f;
+  lights->dir_light.diffuse = dir_light_color * 0.9f;
+  lights->dir_light.specular = dir_light_color * 0.8f;
+  lights->spot_lights[screen_spot_light].diffuse =
+      screen_light_color * std::sin(time * 4) + screen_light_color * 0.5f;
+}
+
+} // namespace
+
+int main() {
+  const int frames = 100000;
+  const float frame_seconds = 1.f / 60.f;
+
+  // Position and direction are vec3, the attenuation and cut off values floats
+  const size_t uniform_calls = light_block_point_lights * 7 + 4 + light_block_spot_lights * 10;
+  const size_t uniform_bytes = light_block_point_lights * (4 * 12 + 3 * 4) + 4 * 12 +
+                               light_block_spot_lights * (5 * 12 + 5 * 4);
+
+  UniformBlockData data(sizeof(LightBlock));
+  LightBlock lights = make_lights();
+  size_t first_frame_calls = 0, first_frame_bytes = 0, calls = 0, bytes = 0, largest_calls = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < frames; frame++) {
+    animate(frame * frame_seconds, &lights);
+    data.write(0, lights);
+    const std::vector<std::pair<size_t, size_t>> ranges = data.get_dirty_ranges();
+    data.clear_dirty();
+    const size_t frame_calls = ranges.empty() ? 0 : ranges.size() + 1;
+    size_t frame_bytes = 0;
+    for (const auto &range : ranges) {
+      frame_bytes += range.second;
+    }
+    if (frame == 0) {
+      first_frame_calls = frame_calls;
+      first_frame_bytes = frame_bytes;
+      continue;
+    }
+    calls += frame_calls;
+    bytes += frame_bytes;
+    largest_calls = std::max(largest_calls, frame_calls);
+  }
+  const double microseconds =
+      std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / frames;
+
+  std::cout << "Lights block: " << sizeof(LightBlock) << " bytes, " << frames << " frames" << std::endl;
+  std::cout << std::left << std::setw(10) << "" << std::right << std::setw(14) << "GL calls" << std::setw(14)
+            << "bytes" << std::setw(16) << "first frame" << std::endl;
+  std::cout << std::left << std::setw(10) << "uniforms" << std::right << std::fixed << std::setprecision(1)
+            << std::setw(14) << double(uniform_calls) << std::setw(14) << double(uniform_bytes) << std::setw(16)
+            << std::to_string(uniform_calls) + " calls" << std::endl;
+  std::cout << std::left << std::setw(10) << "block" << std::right << std::setw(14)
+            << double(calls) / (frames - 1) << std::setw(14) << double(bytes) / (frames - 1) << std::setw(16)
+            << std::to_string(first_frame_calls) + " calls" << std::endl;
+  std::cout << "The block makes at most " << largest_calls << " calls per frame, " << first_frame_bytes
+            << " bytes in the first one; filling it and finding the ranges takes " << std::setprecision(3)
+            << microseconds << " us per frame" << std::endl;
+  return 0;
+}
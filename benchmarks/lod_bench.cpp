@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mesh_lod.hpp"
+#include "mesh_optimizer.hpp"
+#include "obj_loader.hpp"
+
+// Builds the level of detail chains of the scene meshes and flies a camera from the inside of the room far
+// away and back. Reports the triangles drawn per frame and the number of level switches for several pixel
+// error thresholds, with and without hysteresis. Selection runs on the CPU, so no GPU is needed.
+// Usage: lod_bench [file.obj ...]
+
+namespace {
+
+struct LodMesh {
+  std::string name;
+  MeshData data;
+  std::vector<float> errors;
+  std::vector<size_t> triangles;
+};
+
+size_t triangle_count(const std::vector<Submesh> &submeshes) {
+  size_t indices = 0;
+  for (const Submesh &submesh : submeshes) {
+    indices += submesh.index_count;
+  }
+  return indices / 3;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj", "objects/screen.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  std::vector<LodMesh> meshes;
+  for (const std::string &file_name : files) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\"));
+    if (!load_obj(&attrib, &shapes, &materials, &err, file_name, base_dir + "/")) {
+      std::cout << err;
+      continue;
+    }
+
+    LodMesh mesh;
+    mesh.name = file_name;
+    mesh.data = build_material_batches(attrib, shapes, materials, base_dir);
+    optimize_mesh(&mesh.data);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    build_lods(&mesh.data);
+    const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    mesh.errors.push_back(0.f);
+    mesh.triangles.push_back(triangle_count(mesh.data.submeshes));
+    for (const MeshLod &lod : mesh.data.lods) {
+      mesh.errors.push_back(lod.error);
+      mesh.triangles.push_back(triangle_count(lod.submeshes));
+    }
+
+    std::cout << file_name << ", levels built in " << std::fixed << std::setprecision(2) << seconds * 1000.0
+              << " ms" << std::endl;
+    for (size_t level = 0; level < mesh.errors.size(); level++) {
+      std::cout << "  LOD" << level << std::setw(8) << mesh.triangles[level] << " triangles, error "
+                << std::setprecision(4) << mesh.errors[level] << std::endl;
+    }
+    meshes.push_back(std::move(mesh));
+  }
+
+  // 1080p with the default 45 degree field of view of the camera
+  const float projection_scale = lod_projection_scale(glm::radians(45.f), 1080.f);
+
+  // From the middle of the room out through the front wall to the far plane and back, swaying by a few percent
+  // of the distance so it keeps crossing the switching points
+  const size_t frame_count = 2000;
+  std::vector<glm::vec3> path(frame_count);
+  for (size_t f = 0; f < frame_count; f++) {
+    const float t = static_cast<float>(f) / (frame_count - 1);
+    const float along = t < 0.5f ? 2.f * t : 2.f - 2.f * t;
+    const float z = 20.f + 460.f * along;
+    path[f] = glm::vec3(0.f, 2.f + 20.f * along, z + 0.03f * z * std::sin(static_cast<float>(f) * 0.5f));
+  }
+
+  const float pixel_errors[] = {0.f, 0.5f, 1.f, 2.f, 4.f};
+  const float hysteresis_values[] = {0.f, 0.2f};
+
+  std::cout << std::endl
+            << std::setw(12) << "max error" << std::setw(12) << "hysteresis" << std::setw(12) << "avg tris"
+            << std::setw(10) << "min" << std::setw(10) << "max" << std::setw(10) << "switches" << std::endl;
+  for (float pixel_error : pixel_errors) {
+    for (float hysteresis : hysteresis_values) {
+      if (pixel_error == 0.f && hysteresis > 0.f) {
+        continue;
+      }
+
+      LodSettings settings;
+      settings.max_pixel_error = pixel_error;
+      settings.hysteresis = hysteresis;
+
+      std::vector<size_t> current(meshes.size(), 0);
+      size_t total = 0, min_triangles = ~size_t(0), max_triangles = 0, switches = 0;
+      for (const glm::vec3 &eye : path) {
+        size_t triangles = 0;
+        for (size_t m = 0; m < meshes.size(); m++) {
+          const LodMesh &mesh = meshes[m];
+          const float distance = distance_to_bounds(eye, mesh.data.bounds_min, mesh.data.bounds_max);
+          const size_t level = select_lod(mesh.errors, current[m], distance, projection_scale, settings);
+          switches += level != current[m];
+          current[m] = level;
+          triangles += mesh.triangles[level];
+        }
+        total += triangles;
+        min_triangles = std::min(min_triangles, triangles);
+        max_triangles = std::max(max_triangles, triangles);
+      }
+
+      std::cout << std::setw(12) << std::setprecision(1) << pixel_error << std::setw(12) << hysteresis
+                << std::setw(12) << total / path.size() << std::setw(10) << min_triangles << std::setw(10)
+                << max_triangles << std::setw(10) << switches << std::endl;
+    }
+  }
+
+  return 0;
+}
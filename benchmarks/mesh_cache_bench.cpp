@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "mesh_cache.hpp"
+#include "obj_loader.hpp"
+#include "timing.hpp"
+
+// Compares loading a mesh from OBJ text with loading it from the binary mesh cache,
+// once with the files evicted from the page cache (cold) and once with them in memory (warm).
+// The upload is simulated by copying the buffers, so no OpenGL context is needed.
+// Usage: mesh_cache_bench [file.obj ...]
+
+static void evict_from_page_cache(const std::string &file_name) {
+#if !defined(_WIN32) && !defined(__APPLE__)
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+#endif
+}
+
+static size_t load_text(const std::string &file_name, std::vector<MeshData> *meshes,
+                        std::vector<std::string> *source_files, std::vector<tinyobj::material_t> *materials) {
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  std::string err;
+  const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\"));
+
+  std::vector<std::string> material_files;
+  load_obj(&attrib, &shapes, materials, &err, file_name, base_dir + "/", ThreadPool::shared(), 0, &material_files);
+
+  // Same layout as Mesh::from_file, one mesh with a submesh per material
+  *meshes = {build_material_batches(attrib, shapes, *materials, base_dir)};
+
+  *source_files = {file_name};
+  source_files->insert(source_files->end(), material_files.begin(), material_files.end());
+  return meshes->size();
+}
+
+static size_t load_cache(const std::string &file_name, std::vector<char> *staging) {
+  std::unique_ptr<MeshCache> cache = MeshCache::open(file_name);
+  if (!cache) {
+    return 0;
+  }
+
+  // Stand-in for glBufferData, which reads the mapped bytes once
+  staging->clear();
+  for (const auto &entry : cache->get_meshes()) {
+    const MeshView &view = entry.view;
+    const char *vertices = reinterpret_cast<const char *>(view.vertices);
+    const char *indices = static_cast<const char *>(view.indices);
+    staging->insert(staging->end(), vertices, vertices + view.vertex_count * 3 * sizeof(float));
+    staging->insert(staging->end(), indices, indices + view.index_count * view.index_size);
+    if (view.normals) {
+      const char *normals = reinterpret_cast<const char *>(view.normals);
+      staging->insert(staging->end(), normals, normals + view.vertex_count * 3 * sizeof(float));
+    }
+    if (view.tex_coords) {
+      const char *tex_coords = reinterpret_cast<const char *>(view.tex_coords);
+      staging->insert(staging->end(), tex_coords, tex_coords + view.vertex_count * 2 * sizeof(float));
+    }
+  }
+  return cache->get_meshes().size();
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj", "objects/screen.obj",
+                                    "objects/exterior.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  const int repetitions = 10;
+  std::cout << std::left << std::setw(30) << "file" << std::right << std::setw(12) << "text cold" << std::setw(12)
+            << "text warm" << std::setw(12) << "cache cold" << std::setw(12) << "cache warm" << std::setw(10)
+            << "speedup" << std::endl;
+
+  for (const std::string &file_name : files) {
+    std::vector<MeshData> meshes;
+    std::vector<std::string> source_files;
+    std::vector<tinyobj::material_t> materials;
+    std::remove(MeshCache::path_for(file_name).c_str());
+
+    evict_from_page_cache(file_name);
+    const double text_cold = elapsed_seconds([&]() { load_text(file_name, &meshes, &source_files, &materials); });
+
+    const double text_warm = best_seconds(repetitions, [&]() {
+      materials.clear();
+      load_text(file_name, &meshes, &source_files, &materials);
+    });
+
+    if (!MeshCache::write(file_name, source_files, meshes)) {
+      std::cout << file_name << ": could not write the cache" << std::endl;
+      continue;
+    }
+
+    std::vector<char> staging;
+    for (const std::string &source : source_files) {
+      evict_from_page_cache(source);
+    }
+    evict_from_page_cache(MeshCache::path_for(file_name));
+    size_t cached_meshes = 0;
+    const double cache_cold = elapsed_seconds([&]() { cached_meshes = load_cache(file_name, &staging); });
+
+    const double cache_warm = best_seconds(repetitions, [&]() { load_cache(file_name, &staging); });
+
+    std::cout << std::left << std::setw(30) << file_name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << text_cold * 1000.0 << "ms" << std::setw(10) << text_warm * 1000.0 << "ms"
+              << std::setw(10) << cache_cold * 1000.0 << "ms" << std::setw(10) << cache_warm * 1000.0 << "ms"
+              << std::setw(9) << std::setprecision(1) << text_warm / cache_warm << "x"
+              << (cached_meshes == meshes.size() ? "" : "  CACHE MISS") << std::endl;
+  }
+
+  return 0;
+}
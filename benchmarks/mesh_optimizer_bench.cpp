@@ -0,0 +1,60 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mesh_optimizer.hpp"
+#include "obj_loader.hpp"
+
+// Reports vertex cache (ACMR/ATVR), overdraw and vertex fetch statistics after every optimization step.
+// Everything is simulated on the CPU, so no GPU is needed.
+// Usage: mesh_optimizer_bench [file.obj ...]
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj", "objects/screen.obj",
+                                    "objects/exterior.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  const char *step_names[] = {"loaded", "vertex cache", "overdraw", "vertex fetch"};
+
+  for (const std::string &file_name : files) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\"));
+    if (!load_obj(&attrib, &shapes, &materials, &err, file_name, base_dir + "/")) {
+      std::cout << err;
+      continue;
+    }
+
+    MeshData data = build_material_batches(attrib, shapes, materials, base_dir);
+
+    // Timed separately, the statistics are much slower than the optimization itself
+    MeshData timed = data;
+    auto start = std::chrono::high_resolution_clock::now();
+    optimize_mesh(&timed);
+    const double optimize_seconds =
+        std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::vector<MeshStats> steps;
+    optimize_mesh(&data, &steps);
+
+    std::cout << file_name << " (" << data.indices.size() / 3 << " triangles, " << data.vertex_count()
+              << " vertices, " << data.submeshes.size() << " submeshes), optimized in " << std::fixed
+              << std::setprecision(2) << optimize_seconds * 1000.0 << " ms" << std::endl;
+    std::cout << "  " << std::left << std::setw(14) << "step" << std::right << std::setw(8) << "ACMR" << std::setw(8)
+              << "ATVR" << std::setw(11) << "overdraw" << std::setw(11) << "overfetch" << std::endl;
+    for (size_t s = 0; s < steps.size(); s++) {
+      std::cout << "  " << std::left << std::setw(14) << step_names[s] << std::right << std::setprecision(3)
+                << std::setw(8) << steps[s].vertex_cache.acmr << std::setw(8) << steps[s].vertex_cache.atvr
+                << std::setw(11) << steps[s].overdraw.overdraw << std::setw(11) << steps[s].vertex_fetch.overfetch
+                << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mesh_data.hpp"
+#include "obj_loader.hpp"
+
+// Reports per shape how much vertex welding shrinks the buffers and the vertex shader work.
+// Usage: mesh_welding_bench [file.obj ...]
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj", "objects/screen.obj",
+                                    "objects/exterior.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  for (const std::string &file_name : files) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    if (!load_obj(&attrib, &shapes, &materials, &err, file_name)) {
+      std::cout << err;
+      continue;
+    }
+
+    std::cout << file_name << std::endl;
+    std::cout << "  " << std::left << std::setw(20) << "shape" << std::right << std::setw(9) << "corners"
+              << std::setw(9) << "unique" << std::setw(11) << "bytes" << std::setw(11) << "welded" << std::setw(8)
+              << "saved" << std::setw(11) << "VS before" << std::setw(10) << "VS after" << std::setw(8) << "saved"
+              << std::endl;
+
+    size_t total_before = 0, total_after = 0, total_corners = 0, total_invocations = 0;
+    double weld_seconds = 0.0;
+    for (const auto &shape : shapes) {
+      auto start = std::chrono::high_resolution_clock::now();
+      const MeshData data = weld_shape(attrib, shape);
+      weld_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+      // Without welding every corner is a separate vertex drawn with glDrawArrays
+      const size_t corners = data.indices.size();
+      const size_t floats_per_vertex = 3 + (data.normals.empty() ? 0 : 3) + (data.tex_coords.empty() ? 0 : 2);
+      const size_t bytes_before = corners * floats_per_vertex * sizeof(float);
+      const size_t bytes_after = data.gpu_bytes();
+      const size_t invocations = count_vertex_shader_invocations(data.indices);
+
+      std::cout << "  " << std::left << std::setw(20) << shape.name.substr(0, 19) << std::right << std::setw(9)
+                << corners << std::setw(9) << data.vertex_count() << std::setw(11) << bytes_before << std::setw(11)
+                << bytes_after << std::setw(7) << std::fixed << std::setprecision(1)
+                << 100.0 * (1.0 - double(bytes_after) / bytes_before) << "%" << std::setw(11) << corners
+                << std::setw(10) << invocations << std::setw(7) << 100.0 * (1.0 - double(invocations) / corners) << "%"
+                << (data.has_16bit_indices() ? "" : "  32-bit") << std::endl;
+
+      total_before += bytes_before;
+      total_after += bytes_after;
+      total_corners += corners;
+      total_invocations += invocations;
+    }
+
+    std::cout << "  total: " << total_before << " -> " << total_after << " bytes (" << std::setprecision(1)
+              << 100.0 * (1.0 - double(total_after) / total_before) << "% saved), " << total_corners << " -> "
+              << total_invocations << " vertex shader invocations ("
+              << 100.0 * (1.0 - double(total_invocations) / total_corners) << "% saved), welding took " << std::setprecision(2) << weld_seconds * 1000.0 << " ms" << std::endl;
+  }
+
+  return 0;
+}
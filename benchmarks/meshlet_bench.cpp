@@ -0,0 +1,125 @@
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "mesh_optimizer.hpp"
+#include "meshlet.hpp"
+#include "obj_loader.hpp"
+
+// Splits the scene meshes into meshlets and culls them from a camera turning around inside the room and
+// from a few views outside of it. Reports the meshlet sizes, the culled triangle percentage of frustum and
+// normal cone culling and the time of the SSE2 and the scalar culling paths, whose results have to match (it
+// exits with 1 when they do not, tests/meshlet_test checks the meshlets themselves).
+// Usage: meshlet_bench [file.obj ...]
+
+namespace {
+
+struct View {
+  glm::vec3 eye;
+  glm::vec3 target;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj", "objects/screen.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  // A full turn in the middle of the room, then the room from outside
+  std::vector<View> views;
+  for (int step = 0; step < 36; step++) {
+    const float angle = glm::radians(step * 10.f);
+    const glm::vec3 eye(0.f, 2.f, 20.f);
+    views.push_back({eye, eye + glm::vec3(std::sin(angle), 0.f, -std::cos(angle))});
+  }
+  const glm::vec3 outside[] = {glm::vec3(0.f, 10.f, 150.f), glm::vec3(120.f, 30.f, 20.f), glm::vec3(-80.f, 60.f, -90.f)};
+  for (const glm::vec3 &eye : outside) {
+    views.push_back({eye, glm::vec3(0.f, 4.f, 20.f)});
+  }
+  const glm::mat4 projection = glm::perspective(glm::radians(45.f), 16.f / 9.f, 0.1f, 500.f);
+
+  bool differ = false;
+  for (const std::string &file_name : files) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\"));
+    if (!load_obj(&attrib, &shapes, &materials, &err, file_name, base_dir + "/")) {
+      std::cout << err;
+      continue;
+    }
+
+    MeshData data = build_material_batches(attrib, shapes, materials, base_dir);
+    optimize_mesh(&data);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    const std::vector<Meshlet> meshlets = build_meshlets(data);
+    const double build_seconds =
+        std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    size_t vertices = 0, triangles = 0, cones = 0;
+    for (const Meshlet &meshlet : meshlets) {
+      vertices += meshlet.vertex_count;
+      triangles += meshlet.triangle_count;
+      cones += meshlet.cone_cutoff < 1.f;
+    }
+    std::cout << file_name << ": " << meshlets.size() << " meshlets built in " << std::fixed << std::setprecision(2)
+              << build_seconds * 1000.0 << " ms, " << std::setprecision(1)
+              << static_cast<double>(vertices) / meshlets.size() << " vertices and "
+              << static_cast<double>(triangles) / meshlets.size() << " triangles on average, " << cones
+              << " with a usable normal cone" << std::endl;
+
+    const MeshletCuller culler(meshlets);
+    const char *names[] = {"frustum", "normal cone", "both"};
+    for (int mode = 0; mode < 3; mode++) {
+      MeshletCullSettings settings;
+      settings.frustum = mode != 1;
+      settings.backface = mode != 0;
+
+      MeshletCullSettings scalar_settings = settings;
+      scalar_settings.simd = false;
+
+      size_t total = 0, visible_total = 0, mismatches = 0;
+      double simd_seconds = 0.0, scalar_seconds = 0.0;
+      std::vector<uint32_t> visible, scalar_visible;
+      const int repeats = 200;
+      for (const View &view : views) {
+        const glm::mat4 view_projection = projection * glm::lookAt(view.eye, view.target, glm::vec3(0.f, 1.f, 0.f));
+
+        MeshletCullStats stats;
+        start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++) {
+          stats = culler.cull(view_projection, view.eye, settings, &visible);
+        }
+        simd_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++) {
+          culler.cull(view_projection, view.eye, scalar_settings, &scalar_visible);
+        }
+        scalar_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        mismatches += visible != scalar_visible;
+        differ = differ || visible != scalar_visible;
+        total += stats.triangles;
+        visible_total += stats.visible_triangles;
+      }
+
+      const double calls = static_cast<double>(views.size() * repeats);
+      std::cout << "  " << std::left << std::setw(12) << names[mode] << std::right << std::setprecision(1)
+                << std::setw(6) << 100.0 * (total - visible_total) / total << " % triangles culled, "
+                << std::setprecision(2) << simd_seconds / calls * 1e6 << " us SIMD, " << scalar_seconds / calls * 1e6
+                << " us scalar" << (mismatches ? ", RESULTS DIFFER" : "") << std::endl;
+    }
+  }
+
+  return differ ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mesh.hpp"
+#include "mesh_lod.hpp"
+#include "texel_density.hpp"
+#include "texture.hpp"
+#include "texture_residency.hpp"
+
+// Measures what screen-size-driven mip streaming saves. Startup: the bytes the loader copies and uploads for
+// the textures of the scene meshes with all levels and with only the smallest ones (the copies into the pixel
+// buffers are timed, the GPU uploads need a GL context). Then a camera flies from the middle of the room out
+// to the far plane and back like in lod_bench, and every frame the level each textured submesh needs at its
+// distance is taken, as TextureResidency::request does: reported are the resident bytes the textures need on
+// the way compared to their full chains.
+// Usage: mip_streaming_bench [file.obj ...]
+
+namespace {
+
+struct StreamedTexture {
+  std::string file_name;
+  std::vector<size_t> level_sizes;
+};
+
+struct TexturedSubmesh {
+  size_t texture;
+  TexelDensity density;
+};
+
+size_t bytes_from(const std::vector<size_t> &level_sizes, size_t first_level) {
+  size_t bytes = 0;
+  for (size_t i = first_level; i < level_sizes.size(); i++) {
+    bytes += level_sizes[i];
+  }
+  return bytes;
+}
+
+/// Copies the levels from 'first_level' on into the staging memory, as TextureStreamer::write does
+double copy_milliseconds(const Image &image, size_t first_level, std::vector<unsigned char> *staging) {
+  const auto start = std::chrono::steady_clock::now();
+  size_t offset = 0;
+  for (size_t i = first_level; i < image.levels.size(); i++) {
+    std::memcpy(staging->data() + offset, image.levels[i].data, image.levels[i].size);
+    offset += image.levels[i].size;
+  }
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj", "objects/screen.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  std::vector<StreamedTexture> textures;
+  std::map<std::string, size_t> texture_indices;
+  std::vector<TexturedSubmesh> submeshes;
+  double density_milliseconds = 0.0;
+  for (const std::string &file_name : files) {
+    const MeshFile file = Mesh::load_file(file_name, MESH_BUILD_OPTIMIZE);
+    std::vector<std::vector<Submesh>> mesh_submeshes;
+    std::vector<std::vector<Material>> mesh_materials;
+    std::vector<MeshView> views;
+    std::vector<std::vector<uint16_t>> short_indices(file.meshes.size());
+    if (file.cache) {
+      for (const auto &entry : file.cache->get_meshes()) {
+        mesh_submeshes.push_back(entry.submeshes);
+        mesh_materials.push_back(entry.materials);
+        views.push_back(entry.view);
+      }
+    } else {
+      for (size_t m = 0; m < file.meshes.size(); m++) {
+        mesh_submeshes.push_back(file.meshes[m].submeshes);
+        mesh_materials.push_back(file.meshes[m].materials);
+        views.push_back(make_mesh_view(file.meshes[m], &short_indices[m]));
+      }
+    }
+
+    for (size_t m = 0; m < views.size(); m++) {
+      const auto start = std::chrono::steady_clock::now();
+      const std::vector<TexelDensity> densities = compute_texel_densities(views[m], mesh_submeshes[m]);
+      density_milliseconds +=
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+      for (size_t s = 0; s < mesh_submeshes[m].size() && s < densities.size(); s++) {
+        const std::string &path = mesh_materials[m][mesh_submeshes[m][s].material_id].diffuse_texture;
+        if (path.empty()) {
+          continue;
+        }
+        auto found = texture_indices.find(path);
+        if (found == texture_indices.end()) {
+          found = texture_indices.emplace(path, textures.size()).first;
+          textures.push_back({path, {}});
+        }
+        submeshes.push_back({found->second, densities[s]});
+      }
+    }
+  }
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << submeshes.size() << " textured submeshes, densities computed in " << density_milliseconds << " ms"
+            << std::endl;
+
+  // Startup uploads of all levels against the smallest ones only
+  TextureResidency &residency = TextureResidency::shared();
+  residency.set_streaming(true);
+  size_t full_bytes = 0, streamed_bytes = 0;
+  double full_copy = 0.0, streamed_copy = 0.0;
+  for (StreamedTexture &texture : textures) {
+    const Image image = decode_image(texture.file_name, true);
+    texture.level_sizes = image.level_sizes();
+    std::vector<unsigned char> staging(image.byte_size());
+    const size_t first_level = residency.first_streamed_level(texture.level_sizes.size());
+    full_copy += copy_milliseconds(image, 0, &staging);
+    streamed_copy += copy_milliseconds(image, first_level, &staging);
+    full_bytes += bytes_from(texture.level_sizes, 0);
+    streamed_bytes += bytes_from(texture.level_sizes, first_level);
+    std::cout << "  " << texture.file_name << ": " << texture.level_sizes.size() << " levels, "
+              << bytes_from(texture.level_sizes, 0) / 1024 << " KiB, startup uploads "
+              << bytes_from(texture.level_sizes, first_level) / 1024 << " KiB from level " << first_level
+              << std::endl;
+  }
+  std::cout << "Startup uploads: " << full_bytes / 1024 << " KiB copied in " << full_copy << " ms with all levels, "
+            << streamed_bytes / 1024 << " KiB copied in " << streamed_copy << " ms with the smallest "
+            << TextureResidency::kept_levels << std::endl;
+
+  // 720p with the default 45 degree field of view of the camera
+  const float projection_scale = lod_projection_scale(glm::radians(45.f), 720.f);
+  const size_t frame_count = 2000;
+  size_t total_needed = 0, min_needed = ~size_t(0), max_needed = 0;
+  std::vector<size_t> finest(textures.size(), ~size_t(0));
+  for (size_t f = 0; f < frame_count; f++) {
+    const float t = static_cast<float>(f) / (frame_count - 1);
+    const float along = t < 0.5f ? 2.f * t : 2.f - 2.f * t;
+    const glm::vec3 eye(0.f, 2.f + 20.f * along, 20.f + 460.f * along);
+
+    std::vector<size_t> levels(textures.size(), ~size_t(0));
+    for (const TexturedSubmesh &submesh : submeshes) {
+      const size_t level = TextureResidency::needed_level(textures[submesh.texture].level_sizes.size(),
+                                                          uv_per_pixel(submesh.density, eye, projection_scale));
+      levels[submesh.texture] = std::min(levels[submesh.texture], level);
+    }
+    size_t needed = 0;
+    for (size_t i = 0; i < textures.size(); i++) {
+      needed += bytes_from(textures[i].level_sizes, levels[i]);
+      finest[i] = std::min(finest[i], levels[i]);
+    }
+    total_needed += needed;
+    min_needed = std::min(min_needed, needed);
+    max_needed = std::max(max_needed, needed);
+  }
+  std::cout << "Resident while flying out and back: " << total_needed / frame_count / 1024 << " KiB on average, "
+            << min_needed / 1024 << " KiB at least, " << max_needed / 1024 << " KiB at most, of " << full_bytes / 1024
+            << " KiB for the full chains" << std::endl;
+  for (size_t i = 0; i < textures.size(); i++) {
+    std::cout << "  " << textures[i].file_name << ": finest level needed " << finest[i] << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mipmap.hpp"
+#include "texture.hpp"
+#include "timing.hpp"
+
+// Generates the mip chains of the scene textures with both filters and reports the time of a whole chain:
+//  - scalar: the reference kernels on one thread
+//  - sse2: the SSE2 kernels on one thread
+//  - threads: the SSE2 kernels with the rows spread over all hardware threads
+// It checks that the SSE2 chain matches the scalar one byte for byte. As a quality check it also prints how
+// much the last levels drift in brightness against level 0, filtering in linear light versus on the sRGB
+// values directly.
+// Usage: mipmap_bench [image ...]
+
+namespace {
+
+/// Mean linear luminance of an sRGB image
+double mean_luminance(const Image &image) {
+  double sum = 0.0;
+  const size_t pixel_count = size_t(image.width) * image.height;
+  for (size_t p = 0; p < pixel_count; p++) {
+    const double weights[3] = {0.2126, 0.7152, 0.0722};
+    for (int c = 0; c < 3; c++) {
+      const double value = image.pixels[4 * p + c] / 255.0;
+      sum += weights[c] * (value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4));
+    }
+  }
+  return sum / pixel_count;
+}
+
+size_t count_differences(const std::vector<Image> &a, const std::vector<Image> &b) {
+  size_t differences = a.size() == b.size() ? 0 : 1;
+  for (size_t i = 0; i < std::min(a.size(), b.size()); i++) {
+    for (size_t j = 0; j < std::min(a[i].pixels.size(), b[i].pixels.size()); j++) {
+      differences += a[i].pixels[j] != b[i].pixels[j];
+    }
+  }
+  return differences;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interiorSurface_Color.png", "objects/WindowsSurface_Color.png",
+                                    "objects/ScreenSurface_Color.png", "objects/ExteriorSurface_Color.png"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  const int repeats = 3;
+  const size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+  // A parallel_for started by the only worker of a pool hands nothing to other threads, which makes it serial
+  ThreadPool serial_pool(1);
+  // parallel_for runs on the calling thread too, so the pool gets one worker less
+  ThreadPool pool(std::max<size_t>(1, hardware_threads - 1));
+
+  std::cout << hardware_threads << " hardware threads" << std::endl;
+  std::cout << std::left << std::setw(36) << "image" << std::setw(9) << "filter" << std::right << std::setw(12)
+            << "scalar ms" << std::setw(10) << "sse2 ms" << std::setw(12) << "threads ms" << std::setw(10) << "MPix/s"
+            << std::setw(13) << "differences" << std::endl;
+
+  for (const std::string &file : files) {
+    const Image image = decode_image(file);
+    if (image.empty()) {
+      continue;
+    }
+    const double megapixels = double(image.width) * image.height / 1e6;
+
+    for (MipFilter filter : {MipFilter::Box, MipFilter::Lanczos}) {
+      MipSettings settings;
+      settings.filter = filter;
+      MipSettings scalar_settings = settings;
+      scalar_settings.simd = false;
+
+      std::vector<Image> scalar_chain, simd_chain;
+      const double scalar_milliseconds = best_milliseconds(repeats, [&]() {
+        serial_pool.submit([&]() { scalar_chain = generate_mipmaps(image, scalar_settings, serial_pool); }).get();
+      });
+      const double simd_milliseconds = best_milliseconds(repeats, [&]() {
+        serial_pool.submit([&]() { simd_chain = generate_mipmaps(image, settings, serial_pool); }).get();
+      });
+      const double threaded_milliseconds =
+          best_milliseconds(repeats, [&]() { generate_mipmaps(image, settings, pool); });
+
+      std::cout << std::left << std::setw(36) << file << std::setw(9)
+                << (filter == MipFilter::Box ? "box" : "lanczos") << std::right << std::fixed << std::setprecision(2)
+                << std::setw(12) << scalar_milliseconds << std::setw(10) << simd_milliseconds << std::setw(12)
+                << threaded_milliseconds << std::setw(10) << megapixels / (threaded_milliseconds / 1000.0)
+                << std::setw(13) << count_differences(scalar_chain, simd_chain) << std::endl;
+    }
+  }
+
+  std::cout << std::endl << "Brightness of the 8x8 level relative to level 0 (box filter)" << std::endl;
+  for (const std::string &file : files) {
+    const Image image = decode_image(file);
+    if (image.empty()) {
+      continue;
+    }
+    const double reference = mean_luminance(image);
+    std::cout << std::left << std::setw(36) << file << std::right;
+    for (bool srgb : {true, false}) {
+      MipSettings settings;
+      settings.filter = MipFilter::Box;
+      settings.srgb = srgb;
+      const std::vector<Image> chain = generate_mipmaps(image, settings, pool);
+      const auto level = std::find_if(chain.begin(), chain.end(),
+                                      [](const Image &level) { return std::max(level.width, level.height) <= 8; });
+      std::cout << (srgb ? "  linear light " : "  sRGB values ") << std::setprecision(1)
+                << 100.0 * mean_luminance(*level) / reference << "%";
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
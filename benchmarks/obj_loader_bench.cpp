@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "obj_loader.hpp"
+#include "timing.hpp"
+
+// Measures OBJ parsing throughput of tinyobj::LoadObj and of load_obj with a growing number of threads.
+// Usage: obj_loader_bench [file.obj ...]
+
+struct ObjData {
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  std::vector<tinyobj::material_t> materials;
+};
+
+static bool same_indices(const tinyobj::index_t &a, const tinyobj::index_t &b) {
+  return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index &&
+         a.texcoord_index == b.texcoord_index;
+}
+
+static bool same_data(const ObjData &a, const ObjData &b) {
+  if (a.attrib.vertices != b.attrib.vertices || a.attrib.normals != b.attrib.normals ||
+      a.attrib.texcoords != b.attrib.texcoords || a.shapes.size() != b.shapes.size() ||
+      a.materials.size() != b.materials.size()) {
+    return false;
+  }
+
+  for (size_t s = 0; s < a.shapes.size(); s++) {
+    const tinyobj::mesh_t &mesh_a = a.shapes[s].mesh;
+    const tinyobj::mesh_t &mesh_b = b.shapes[s].mesh;
+    if (a.shapes[s].name != b.shapes[s].name || mesh_a.num_face_vertices != mesh_b.num_face_vertices ||
+        mesh_a.material_ids != mesh_b.material_ids ||
+        !std::equal(mesh_a.indices.begin(), mesh_a.indices.end(), mesh_b.indices.begin(), mesh_b.indices.end(),
+                    same_indices)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  const int repetitions = 10;
+  const size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (const std::string &file_name : files) {
+    const double megabytes = MappedFile(file_name).size() / (1024.0 * 1024.0);
+    const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\") + 1);
+
+    ObjData reference;
+    std::string err;
+    const double reference_time = best_seconds(repetitions, [&]() {
+      reference = ObjData();
+      tinyobj::LoadObj(&reference.attrib, &reference.shapes, &reference.materials, &err, file_name.c_str(),
+                       base_dir.c_str());
+    });
+
+    std::cout << file_name << " (" << std::fixed << std::setprecision(2) << megabytes << " MB)" << std::endl;
+    std::cout << "  tinyobj::LoadObj      " << std::setw(8) << megabytes / reference_time << " MB/s" << std::endl;
+
+    for (size_t threads = 1; threads <= max_threads * 2; threads *= 2) {
+      ThreadPool pool(threads);
+      ObjData data;
+      const double time = best_seconds(repetitions, [&]() {
+        data = ObjData();
+        load_obj(&data.attrib, &data.shapes, &data.materials, &err, file_name, base_dir, pool, threads * 4);
+      });
+
+      std::cout << "  load_obj " << std::setw(2) << threads << " threads  " << std::setw(8) << megabytes / time
+                << " MB/s  x" << std::setprecision(2) << reference_time / time
+                << (same_data(reference, data) ? "" : "  MISMATCH") << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stb_image.h>
+
+#include "pixel_format.hpp"
+#include "texture.hpp"
+#include "timing.hpp"
+
+// Reports what uploading textures with only the channels they use saves, and how fast the pixel conversions are.
+//  - For every image: the channels of the file, the format pack_channels picks from the content and the video
+//    memory of the whole mip chain with it next to RGBA8. The packed pixels are expanded again and compared,
+//    the conversion has to be lossless.
+//  - The throughput of the scalar and the SSE2 kernels in MPix/s on the largest image, whose results have to
+//    match byte for byte, and the decode of its file with the RGBA expansion of stb_image and with
+//    expand_to_rgba.
+// Usage: pixel_format_bench [image ...]
+
+namespace {
+
+/// Bytes of the mip chain down to 1x1 of an image with pixels of 'channels' bytes
+size_t chain_bytes(int width, int height, size_t channels) {
+  size_t bytes = 0;
+  for (;;) {
+    bytes += size_t(width) * height * channels;
+    if (width == 1 && height == 1) {
+      return bytes;
+    }
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+  }
+}
+
+const char *format_name(GLenum format) {
+  switch (format) {
+  case GL_RED:
+    return "R8";
+  case GL_RG:
+    return "RG8";
+  case GL_RGB:
+  case GL_BGR:
+    return "RGB8";
+  default:
+    return "RGBA8";
+  }
+}
+
+/// Packed pixels expanded back to RGBA, with the swizzle the uploads set
+std::vector<uint8_t> unpack(const std::vector<uint8_t> &packed, GLenum format, size_t pixel_count) {
+  // Gray and gray with alpha expand like (r, r, r, 1) and (r, r, r, g)
+  std::vector<uint8_t> rgba(4 * pixel_count);
+  expand_to_rgba(packed.data(), static_cast<int>(channel_count(format)), pixel_count, rgba.data());
+  return rgba;
+}
+
+struct Kernel {
+  const char *name;
+  /// Runs the kernel on the pixels with or without SIMD, the output is compared between both
+  std::function<void(bool simd, std::vector<uint8_t> *output)> run;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {
+      "objects/interiorSurface_Color.png", "objects/WindowsSurface_Color.png", "objects/ScreenSurface_Color.png",
+      "objects/ExteriorSurface_Color.png", "objects/interior_previewSurface_Color.png", "images/container_diff.png",
+      "images/container_spec.png",         "images/cubemap/nightsky_rt.tga",   "images/cubemap/nightsky_lt.tga",
+      "images/cubemap/nightsky_up.tga",    "images/cubemap/nightsky_dn.tga",   "images/cubemap/nightsky_bk.tga",
+      "images/cubemap/nightsky_ft.tga"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  std::cout << std::left << std::setw(44) << "image" << std::right << std::setw(11) << "size" << std::setw(10)
+            << "channels" << std::setw(8) << "format" << std::setw(11) << "RGBA8 KiB" << std::setw(12)
+            << "packed KiB" << std::setw(10) << "saved" << std::endl;
+
+  size_t total_rgba = 0, total_packed = 0;
+  Image largest;
+  std::string largest_file;
+  bool lossless = true;
+  for (const std::string &file : files) {
+    int width, height, channels;
+    if (!stbi_info(file.c_str(), &width, &height, &channels)) {
+      std::cout << "Could not read " << file << std::endl;
+      continue;
+    }
+    Image image = decode_image(file);
+    const size_t pixel_count = size_t(image.width) * image.height;
+    const std::vector<uint8_t> original = image.pixels;
+    if (pixel_count > size_t(largest.width) * largest.height) {
+      largest = image;
+      largest_file = file;
+    }
+
+    image = pack_channels(std::move(image));
+    if (unpack(image.pixels, image.pixel_format, pixel_count) != original) {
+      std::cout << "Packing " << file << " lost information" << std::endl;
+      lossless = false;
+    }
+
+    const size_t rgba = chain_bytes(image.width, image.height, 4);
+    const size_t packed = chain_bytes(image.width, image.height, channel_count(image.pixel_format));
+    total_rgba += rgba;
+    total_packed += packed;
+    std::cout << std::left << std::setw(44) << file << std::right << std::setw(11)
+              << std::to_string(image.width) + "x" + std::to_string(image.height) << std::setw(10) << channels
+              << std::setw(8) << format_name(image.pixel_format) << std::setw(11) << rgba / 1024 << std::setw(12)
+              << packed / 1024 << std::setw(9) << (rgba - packed) / 1024 << "K" << std::endl;
+  }
+  std::cout << "Video memory with all mip levels: " << total_rgba / 1024 << " KiB as RGBA8, " << total_packed / 1024
+            << " KiB packed, " << std::fixed << std::setprecision(1)
+            << 100.0 * (1.0 - double(total_packed) / std::max<size_t>(1, total_rgba)) << "% saved"
+            << (lossless ? "" : ", NOT LOSSLESS") << std::endl;
+  if (largest.empty()) {
+    return 1;
+  }
+
+  // Kernels on the largest image, with sources of every channel count made from it
+  const size_t pixel_count = size_t(largest.width) * largest.height;
+  const std::vector<uint8_t> &rgba = largest.pixels;
+  std::vector<uint8_t> rgb(3 * pixel_count), gray_alpha(2 * pixel_count), gray(pixel_count);
+  pack_pixels(rgba.data(), pixel_count, GL_RGB, rgb.data());
+  pack_pixels(rgba.data(), pixel_count, GL_RG, gray_alpha.data());
+  pack_pixels(rgba.data(), pixel_count, GL_RED, gray.data());
+
+  std::vector<Kernel> kernels = {
+      {"RGB to RGBA",
+       [&](bool simd, std::vector<uint8_t> *output) {
+         output->resize(4 * pixel_count);
+         expand_to_rgba(rgb.data(), 3, pixel_count, output->data(), simd);
+       }},
+      {"gray and alpha to RGBA",
+       [&](bool simd, std::vector<uint8_t> *output) {
+         output->resize(4 * pixel_count);
+         expand_to_rgba(gray_alpha.data(), 2, pixel_count, output->data(), simd);
+       }},
+      {"gray to RGBA",
+       [&](bool simd, std::vector<uint8_t> *output) {
+         output->resize(4 * pixel_count);
+         expand_to_rgba(gray.data(), 1, pixel_count, output->data(), simd);
+       }},
+      {"RGBA to RGB",
+       [&](bool simd, std::vector<uint8_t> *output) {
+         output->resize(3 * pixel_count);
+         pack_pixels(rgba.data(), pixel_count, GL_RGB, output->data(), simd);
+       }},
+      {"RGBA to RG",
+       [&](bool simd, std::vector<uint8_t> *output) {
+         output->resize(2 * pixel_count);
+         pack_pixels(rgba.data(), pixel_count, GL_RG, output->data(), simd);
+       }},
+      {"RGBA to R",
+       [&](bool simd, std::vector<uint8_t> *output) {
+         output->resize(pixel_count);
+         pack_pixels(rgba.data(), pixel_count, GL_RED, output->data(), simd);
+       }},
+      {"RGBA to BGRA",
+       [&](bool simd, std::vector<uint8_t> *output) {
+         *output = rgba;
+         swap_red_blue(output->data(), pixel_count, simd);
+       }},
+      {"premultiply alpha",
+       [&](bool simd, std::vector<uint8_t> *output) {
+         // Varying alpha, the image itself may be opaque
+         *output = rgba;
+         for (size_t p = 0; p < pixel_count; p++) {
+           (*output)[4 * p + 3] = static_cast<uint8_t>(p * 7);
+         }
+         premultiply_alpha(output->data(), pixel_count, simd);
+       }},
+      {"classify",
+       [&](bool simd, std::vector<uint8_t> *output) {
+         // A gray image with alpha is scanned to the end
+         static std::vector<uint8_t> gray_rgba;
+         if (gray_rgba.empty()) {
+           gray_rgba.resize(4 * pixel_count);
+           expand_to_rgba(gray_alpha.data(), 2, pixel_count, gray_rgba.data());
+         }
+         const PixelContent content = classify_pixels(gray_rgba.data(), pixel_count, simd);
+         *output = {uint8_t(content.gray), uint8_t(content.opaque)};
+       }},
+  };
+
+  const int repeats = 5;
+  std::cout << std::endl << "Kernels on " << largest_file << ", MPix/s" << std::endl;
+  std::cout << std::left << std::setw(26) << "kernel" << std::right << std::setw(10) << "scalar" << std::setw(10)
+            << "sse2" << std::setw(10) << "speedup" << std::setw(8) << "same" << std::endl;
+  const double megapixels = pixel_count / 1e6;
+  for (const Kernel &kernel : kernels) {
+    std::vector<uint8_t> scalar, simd;
+    kernel.run(false, &scalar);
+    kernel.run(true, &simd);
+    // The setup of the copying kernels is part of both timings
+    const double scalar_seconds = best_seconds(repeats, [&]() { kernel.run(false, &scalar); });
+    const double simd_seconds = best_seconds(repeats, [&]() { kernel.run(true, &simd); });
+    std::cout << std::left << std::setw(26) << kernel.name << std::right << std::setprecision(0) << std::setw(10)
+              << megapixels / scalar_seconds << std::setw(10) << megapixels / simd_seconds << std::setprecision(2)
+              << std::setw(9) << scalar_seconds / simd_seconds << "x" << std::setw(8)
+              << (scalar == simd ? "yes" : "NO") << std::endl;
+  }
+
+  // The decode as before, with stb_image expanding to RGBA, against the channels of the file and expand_to_rgba
+  const double stb_seconds = best_seconds(repeats, [&]() {
+    int width, height, channels;
+    unsigned char *data = stbi_load(largest_file.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    const std::vector<unsigned char> pixels(data, data + size_t(width) * height * 4);
+    stbi_image_free(data);
+  });
+  const double expand_seconds = best_seconds(repeats, [&]() { decode_image(largest_file); });
+  std::cout << std::setprecision(2) << "Decode of " << largest_file << ": " << stb_seconds * 1000.0
+            << " ms with the stb_image expansion, " << expand_seconds * 1000.0 << " ms with expand_to_rgba"
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mesh.hpp"
+#include "mesh_cache.hpp"
+#include "texture.hpp"
+#include "texture_array.hpp"
+
+// Packs the diffuse textures of the interior objects into texture arrays as the application does once loaded,
+// and counts the texture bindings of one frame of the main program: every submesh in drawing order binds the
+// texture of its material unless it is bound already, as bind_texture does. Without a GL context the images are
+// the uncompressed RGBA8 containers, with texture compression the application gets one array per BC format.
+// Usage: texture_array_bench [obj ...]
+
+namespace {
+
+struct Draw {
+  std::string texture;
+};
+
+/// Textures of the submeshes in drawing order
+std::vector<Draw> load_draws(const std::string &file_name) {
+  const MeshFile file = Mesh::load_file(file_name, MESH_BUILD_OPTIMIZE);
+  std::vector<Draw> draws;
+  auto add = [&](const std::vector<Submesh> &submeshes, const std::vector<Material> &materials) {
+    for (const Submesh &submesh : submeshes) {
+      draws.push_back({materials[submesh.material_id].diffuse_texture});
+    }
+  };
+  if (file.cache) {
+    for (const MeshCache::Entry &entry : file.cache->get_meshes()) {
+      add(entry.submeshes, entry.materials);
+    }
+  } else {
+    for (const MeshData &mesh : file.meshes) {
+      add(mesh.submeshes, mesh.materials);
+    }
+  }
+  return draws;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/screen.obj", "objects/Windows.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  std::vector<Draw> draws;
+  std::vector<std::string> paths;
+  for (const std::string &file : files) {
+    for (const Draw &draw : load_draws(file)) {
+      draws.push_back(draw);
+      if (!draw.texture.empty() && std::find(paths.begin(), paths.end(), draw.texture) == paths.end()) {
+        paths.push_back(draw.texture);
+      }
+    }
+  }
+
+  const std::vector<Image> images = decode_images(paths, ThreadPool::shared(), nullptr, true);
+  size_t separate_bytes = 0;
+  for (size_t i = 0; i < images.size(); i++) {
+    separate_bytes += images[i].texture_memory();
+    std::cout << std::left << std::setw(44) << paths[i] << std::right << images[i].width << "x" << images[i].height
+              << std::endl;
+  }
+
+  std::vector<PackedTexture> placements;
+  std::vector<TextureArrayImage> arrays;
+  const auto start = std::chrono::steady_clock::now();
+  arrays = pack_texture_arrays(images, &placements);
+  const double pack_milliseconds =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  size_t array_bytes = 0;
+  for (const TextureArrayImage &array : arrays) {
+    size_t bytes = 0;
+    for (const std::vector<unsigned char> &level : array.levels) {
+      bytes += level.size();
+    }
+    array_bytes += bytes;
+    std::cout << "array " << array.width << "x" << array.height << "x" << array.layers << ", " << array.levels.size()
+              << " levels, " << bytes / 1024 << " KiB" << std::endl;
+  }
+  for (size_t i = 0; i < paths.size(); i++) {
+    std::cout << "  " << paths[i] << ": array " << placements[i].array << " layer " << placements[i].layer
+              << " offset " << placements[i].offset.x << "," << placements[i].offset.y << " scale "
+              << placements[i].scale.x << "," << placements[i].scale.y << std::endl;
+  }
+
+  // Bindings of one frame, the tracked binding is reset at its start
+  size_t separate_binds = 0, packed_binds = 0;
+  std::string bound_texture = "-";
+  long bound_array = -1;
+  for (const Draw &draw : draws) {
+    if (draw.texture != bound_texture) {
+      bound_texture = draw.texture;
+      separate_binds++;
+    }
+    const size_t index = std::find(paths.begin(), paths.end(), draw.texture) - paths.begin();
+    const long array = index < paths.size() ? long(placements[index].array) : -2;
+    if (array != bound_array) {
+      bound_array = array;
+      packed_binds++;
+    }
+  }
+
+  std::cout << std::fixed << std::setprecision(2) << draws.size() << " draws, texture bindings per frame: "
+            << separate_binds << " separate, " << packed_binds << " packed" << std::endl;
+  std::cout << "Packed " << images.size() << " textures into " << arrays.size() << " arrays in " << pack_milliseconds
+            << " ms, " << separate_bytes / 1024 << " KiB as separate textures, " << array_bytes / 1024
+            << " KiB as arrays" << std::endl;
+  return 0;
+}
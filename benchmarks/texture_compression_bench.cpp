@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "block_compression.hpp"
+#include "mipmap.hpp"
+#include "texture.hpp"
+#include "timing.hpp"
+
+// Encodes the material textures of the scene the way decode_image does for texture compression (BC1, or BC3 for
+// images with transparent pixels, all mip levels) and reports:
+//  - the throughput of the encoder in MPix/s with the scalar and the SSE2 index search on one thread, and with
+//    the blocks spread over all hardware threads,
+//  - the quality as PSNR of the decoded level 0 against the source (RGB, and alpha for BC3),
+//  - the video memory of the whole mip chain next to RGBA8 with glGenerateMipmap.
+// Usage: texture_compression_bench [image ...]
+
+namespace {
+
+/// Encodes the image block after block on the calling thread
+void encode_serial(const Image &image, BlockFormat format, bool simd, std::vector<uint8_t> *blocks) {
+  const int blocks_x = (image.width + 3) / 4;
+  const int blocks_y = (image.height + 3) / 4;
+  const size_t bytes = block_bytes(format);
+  blocks->resize(compressed_size(format, image.width, image.height));
+
+  uint8_t block[64];
+  for (int block_y = 0; block_y < blocks_y; block_y++) {
+    for (int block_x = 0; block_x < blocks_x; block_x++) {
+      for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+          const int source_x = std::min(4 * block_x + x, image.width - 1);
+          const int source_y = std::min(4 * block_y + y, image.height - 1);
+          std::memcpy(block + 16 * y + 4 * x, &image.pixels[4 * (size_t(source_y) * image.width + source_x)], 4);
+        }
+      }
+      uint8_t *destination = blocks->data() + (size_t(block_y) * blocks_x + block_x) * bytes;
+      if (format == BlockFormat::BC1) {
+        encode_bc1_block(block, destination, simd);
+      } else {
+        encode_bc3_block(block, destination, simd);
+      }
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interiorSurface_Color.png", "objects/WindowsSurface_Color.png",
+                                    "objects/ScreenSurface_Color.png", "objects/ExteriorSurface_Color.png"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  const int repeats = 3;
+  const size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+  // parallel_for runs on the calling thread too, so the pool gets one worker less
+  ThreadPool pool(std::max<size_t>(1, hardware_threads - 1));
+
+  std::cout << hardware_threads << " hardware threads" << std::endl;
+  std::cout << std::left << std::setw(36) << "image" << std::right << std::setw(11) << "size" << std::setw(7)
+            << "format" << std::setw(11) << "scalar" << std::setw(11) << "sse2" << std::setw(11) << "threads"
+            << std::setw(10) << "PSNR" << std::setw(10) << "alpha" << std::setw(11) << "RGBA8 KiB" << std::setw(10)
+            << "BC KiB" << std::endl;
+
+  size_t total_uncompressed = 0, total_compressed = 0;
+  for (const std::string &file : files) {
+    std::vector<Image> chain = {decode_image(file)};
+    if (chain[0].empty()) {
+      continue;
+    }
+    for (Image &level : generate_mipmaps(chain[0])) {
+      chain.push_back(std::move(level));
+    }
+
+    const Image &image = chain[0];
+    const size_t pixel_count = size_t(image.width) * image.height;
+    const bool transparent = has_transparency(image.pixels.data(), pixel_count);
+    const BlockFormat format = transparent ? BlockFormat::BC3 : BlockFormat::BC1;
+
+    // Throughput on level 0, the mip chain only adds a third
+    std::vector<uint8_t> blocks;
+    const double scalar_seconds = best_seconds(repeats, [&]() { encode_serial(image, format, false, &blocks); });
+    const double simd_seconds = best_seconds(repeats, [&]() { encode_serial(image, format, true, &blocks); });
+    const double threaded_seconds = best_seconds(
+        repeats, [&]() { blocks = compress_image(image.pixels.data(), image.width, image.height, format, pool); });
+
+    const std::vector<uint8_t> decoded = decompress_image(blocks.data(), image.width, image.height, format);
+    const double psnr = compute_psnr(image.pixels.data(), decoded.data(), pixel_count, 3);
+
+    size_t uncompressed = 0, compressed = 0;
+    for (const Image &level : chain) {
+      uncompressed += level.pixels.size();
+      compressed += compressed_size(format, level.width, level.height);
+    }
+    total_uncompressed += uncompressed;
+    total_compressed += compressed;
+
+    const double megapixels = pixel_count / 1e6;
+    std::cout << std::left << std::setw(36) << file << std::right << std::setw(11)
+              << std::to_string(image.width) + "x" + std::to_string(image.height) << std::setw(7)
+              << (transparent ? "BC3" : "BC1") << std::fixed << std::setprecision(1) << std::setw(11)
+              << megapixels / scalar_seconds << std::setw(11) << megapixels / simd_seconds << std::setw(11)
+              << megapixels / threaded_seconds << std::setprecision(2) << std::setw(10) << psnr << std::setw(10);
+    if (transparent) {
+      // Alpha PSNR on its own, the color channels would dilute it
+      std::vector<uint8_t> alpha_reference(pixel_count * 4), alpha_decoded(pixel_count * 4);
+      for (size_t p = 0; p < pixel_count; p++) {
+        alpha_reference[4 * p] = image.pixels[4 * p + 3];
+        alpha_decoded[4 * p] = decoded[4 * p + 3];
+      }
+      std::cout << compute_psnr(alpha_reference.data(), alpha_decoded.data(), pixel_count, 1);
+    } else {
+      std::cout << "-";
+    }
+    std::cout << std::setw(11) << uncompressed / 1024 << std::setw(10) << compressed / 1024 << std::endl;
+  }
+
+  std::cout << "Throughput in MPix/s of level 0, PSNR in dB of level 0" << std::endl;
+  std::cout << "Video memory with all mip levels: " << total_uncompressed / 1024 << " KiB as RGBA8, "
+            << total_compressed / 1024 << " KiB compressed, " << std::setprecision(1)
+            << 100.0 * (1.0 - double(total_compressed) / std::max<size_t>(1, total_uncompressed)) << "% saved"
+            << std::endl;
+  return 0;
+}
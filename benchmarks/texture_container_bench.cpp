@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "dds.hpp"
+#include "mipmap.hpp"
+#include "texture.hpp"
+#include "timing.hpp"
+#include "utility.hpp"
+
+// Compares the CPU side of loading a texture from its source image with loading it from a DDS container:
+//  - source: stb_image decode plus the mip chain, which glGenerateMipmap would otherwise build at upload
+//  - container: mapping the DDS file and reading every level once, as the upload does from the mapping
+// The containers are RGBA8 with all mip levels, written next to the images in the working folder first
+// ('<image>.dds', the cubemap as 'images/cubemap/nightsky.dds') and removed at the end unless --keep is given.
+// They carry the load parameters without texture compression, so copied next to the images of the application
+// they are picked up by load_texture_2d/load_texture_cubemap (which pack them, see texture_startup_bench for the
+// containers the loader writes itself).
+// The files were just written, so the container numbers are for a warm page cache.
+// Usage: texture_container_bench [--keep]
+
+namespace {
+
+/// Source image and its mip chain in the layout of DdsFile::write
+std::vector<std::vector<uint8_t>> build_levels(const Image &image) {
+  std::vector<std::vector<uint8_t>> levels = {image.pixels};
+  for (const Image &level : generate_mipmaps(image)) {
+    levels.push_back(level.pixels);
+  }
+  return levels;
+}
+
+/// Reads every byte of the levels, like the driver copying them during the upload
+uint64_t read_levels(const DdsFile &dds) {
+  uint64_t hash = 0;
+  for (size_t face = 0; face < (dds.is_cubemap() ? 6u : 1u); face++) {
+    for (const DdsFile::Level &level : dds.get_levels(face)) {
+      hash = hash_bytes(level.data, level.size, hash);
+    }
+  }
+  return hash;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const bool keep = argc > 1 && std::string(argv[1]) == "--keep";
+  const int repeats = 3;
+
+  const std::vector<std::string> textures = {"objects/interiorSurface_Color.png", "objects/WindowsSurface_Color.png",
+                                             "objects/ScreenSurface_Color.png", "objects/ExteriorSurface_Color.png"};
+  const std::vector<std::string> faces = {"images/cubemap/nightsky_rt.tga", "images/cubemap/nightsky_lt.tga",
+                                          "images/cubemap/nightsky_up.tga", "images/cubemap/nightsky_dn.tga",
+                                          "images/cubemap/nightsky_ft.tga", "images/cubemap/nightsky_bk.tga"};
+  std::vector<std::string> written;
+
+  std::cout << std::left << std::setw(36) << "texture" << std::right << std::setw(12) << "source ms" << std::setw(14)
+            << "container ms" << std::setw(10) << "speedup" << std::setw(14) << "container KiB" << std::endl;
+  double total_source = 0.0, total_container = 0.0;
+  uint64_t checksum = 0;
+
+  auto report = [&](const std::string &name, double source_milliseconds, double container_milliseconds,
+                    size_t bytes) {
+    total_source += source_milliseconds;
+    total_container += container_milliseconds;
+    std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << source_milliseconds << std::setw(14) << container_milliseconds << std::setw(9)
+              << source_milliseconds / container_milliseconds << "x" << std::setw(14) << bytes / 1024 << std::endl;
+  };
+
+  for (const std::string &texture : textures) {
+    const Image image = decode_image(texture);
+    if (image.empty()) {
+      continue;
+    }
+    const std::string path = DdsFile::path_for(texture);
+    const uint32_t parameters = texture_load_parameters();
+    if (!DdsFile::write(path, DdsFormat::RGBA8, image.width, image.height, build_levels(image), {texture}, false,
+                        parameters)) {
+      std::cout << "Could not write " << path << std::endl;
+      continue;
+    }
+    written.push_back(path);
+
+    const double source_milliseconds = best_milliseconds(repeats, [&]() { generate_mipmaps(decode_image(texture)); });
+    size_t bytes = 0;
+    const double container_milliseconds = best_milliseconds(repeats, [&]() {
+      std::unique_ptr<DdsFile> dds = DdsFile::open_for(texture, parameters);
+      checksum += read_levels(*dds);
+      bytes = 0;
+      for (const DdsFile::Level &level : dds->get_levels()) {
+        bytes += level.size;
+      }
+    });
+    report(texture, source_milliseconds, container_milliseconds, bytes);
+  }
+
+  // The skybox: six faces, each with its mip chain
+  std::vector<std::vector<uint8_t>> cube_levels;
+  int face_size = 0;
+  for (const std::string &face : faces) {
+    const Image image = decode_image(face);
+    const std::vector<std::vector<uint8_t>> levels = build_levels(image);
+    cube_levels.insert(cube_levels.end(), levels.begin(), levels.end());
+    face_size = image.width;
+  }
+  const std::string cube_path = DdsFile::cubemap_path_for(faces);
+  if (DdsFile::write(cube_path, DdsFormat::RGBA8, face_size, face_size, cube_levels, faces, true,
+                     cubemap_load_parameters())) {
+    written.push_back(cube_path);
+
+    const double source_milliseconds = best_milliseconds(repeats, [&]() {
+      for (const std::string &face : faces) {
+        generate_mipmaps(decode_image(face));
+      }
+    });
+    size_t bytes = 0;
+    const double container_milliseconds = best_milliseconds(repeats, [&]() {
+      std::unique_ptr<DdsFile> dds = DdsFile::open_for_cubemap(faces, cubemap_load_parameters());
+      checksum += read_levels(*dds);
+      bytes = 0;
+      for (size_t face = 0; face < 6; face++) {
+        for (const DdsFile::Level &level : dds->get_levels(face)) {
+          bytes += level.size;
+        }
+      }
+    });
+    report(cube_path, source_milliseconds, container_milliseconds, bytes);
+  }
+
+  std::cout << "Total: " << std::setprecision(2) << total_source << " ms from the sources, " << total_container
+            << " ms from the containers (checksum " << std::hex << checksum % 65536 << std::dec << ")" << std::endl;
+
+  if (!keep) {
+    for (const std::string &path : written) {
+      std::remove(path.c_str());
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "texture.hpp"
+
+// Decodes the skybox faces and the material textures of the scene with decode_images on pools of different
+// sizes and reports the wall-clock time of the whole batch, which bounds the texture part of startup. The
+// per-image decode time and sizes come from the single threaded run. Only decoding is measured, the GL
+// upload stays on the main thread either way.
+// Usage: texture_decode_bench [image ...]
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {
+      "images/cubemap/nightsky_rt.tga",     "images/cubemap/nightsky_lt.tga",     "images/cubemap/nightsky_up.tga",
+      "images/cubemap/nightsky_dn.tga",     "images/cubemap/nightsky_ft.tga",     "images/cubemap/nightsky_bk.tga",
+      "objects/interiorSurface_Color.png",  "objects/WindowsSurface_Color.png",   "objects/ScreenSurface_Color.png",
+      "objects/ExteriorSurface_Color.png"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  const int repeats = 3;
+  const size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<size_t> thread_counts = {1, 2, 4, 8};
+  thread_counts.erase(std::remove_if(thread_counts.begin(), thread_counts.end(),
+                                     [&](size_t count) { return count > 2 * hardware_threads; }),
+                      thread_counts.end());
+
+  std::cout << hardware_threads << " hardware threads" << std::endl;
+
+  // One thread: the images one after another, which is also where the per-image numbers come from
+  double single_thread_seconds = 0.0;
+  std::vector<ImageDecodeStats> stats;
+  {
+    ThreadPool pool(1);
+    for (int r = 0; r < repeats; r++) {
+      std::vector<ImageDecodeStats> run_stats;
+      const auto start = std::chrono::high_resolution_clock::now();
+      for (const std::string &file : files) {
+        // A batch of one image never hands work to the pool
+        decode_images({file}, pool, &run_stats);
+      }
+      const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+      if (r == 0 || seconds < single_thread_seconds) {
+        single_thread_seconds = seconds;
+        stats = run_stats;
+      }
+    }
+  }
+
+  std::cout << std::left << std::setw(40) << "image" << std::right << std::setw(12) << "file KiB" << std::setw(12)
+            << "pixel KiB" << std::setw(10) << "ms" << std::endl;
+  for (const ImageDecodeStats &entry : stats) {
+    std::cout << std::left << std::setw(40) << entry.filename << std::right << std::setw(12) << entry.file_bytes / 1024
+              << std::setw(12) << entry.decoded_bytes / 1024 << std::setw(10) << std::fixed << std::setprecision(2)
+              << entry.decode_milliseconds << std::endl;
+  }
+  std::cout << std::endl;
+
+  for (size_t thread_count : thread_counts) {
+    double best_seconds = single_thread_seconds;
+    if (thread_count > 1) {
+      // parallel_for runs on the calling thread too, so the pool gets one worker less
+      ThreadPool pool(thread_count - 1);
+      for (int r = 0; r < repeats; r++) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        decode_images(files, pool);
+        const double seconds =
+            std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        best_seconds = r == 0 ? seconds : std::min(best_seconds, seconds);
+      }
+    }
+
+    std::cout << std::setw(2) << thread_count << " threads: " << std::fixed << std::setprecision(2)
+              << best_seconds * 1000.0 << " ms, speedup " << single_thread_seconds / best_seconds << "x" << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "dds.hpp"
+#include "pixel_format.hpp"
+#include "texture.hpp"
+#include "utility.hpp"
+
+// Measures the CPU side of loading the textures of the scene as the loaders do (decode_images with containers
+// and pack_channels, decode_cubemap and pack_cubemap_channels for the skybox), without texture compression.
+// Both runs read every level once afterwards, as the uploads do:
+//  - cold: no containers, the images are decoded, mipmapped and written to their containers
+//  - warm: the containers of the cold run are mapped, after hashing the sources to check they are current
+// The warm images have to be the same as the cold ones byte for byte. The containers are removed at the end
+// unless --keep is given.
+// Usage: texture_startup_bench [--keep]
+
+namespace {
+
+struct LoadedTextures {
+  std::vector<Image> images;
+  std::vector<Image> faces;
+};
+
+LoadedTextures load(const std::vector<std::string> &textures, const std::vector<std::string> &faces,
+                    std::vector<ImageDecodeStats> *stats) {
+  LoadedTextures loaded;
+  loaded.images = decode_images(textures, ThreadPool::shared(), stats, true);
+  ThreadPool::shared().parallel_for(loaded.images.size(), [&](size_t i) {
+    loaded.images[i] = pack_channels(std::move(loaded.images[i]));
+  });
+  loaded.faces = pack_cubemap_channels(decode_cubemap(faces, ThreadPool::shared(), stats));
+  return loaded;
+}
+
+uint64_t hash_image(const Image &image, uint64_t hash) {
+  hash = hash_bytes(image.pixels.data(), image.pixels.size(), hash);
+  for (const ImageLevel &level : image.levels) {
+    hash = hash_bytes(level.data, level.size, hash);
+  }
+  return hash_bytes(&image.pixel_format, sizeof(image.pixel_format), hash);
+}
+
+/// Reads every byte of the textures, like the driver copying them during the uploads
+uint64_t hash_textures(const LoadedTextures &loaded) {
+  uint64_t hash = 0;
+  for (const Image &image : loaded.images) {
+    hash = hash_image(image, hash);
+  }
+  for (const Image &face : loaded.faces) {
+    hash = hash_image(face, hash);
+  }
+  return hash;
+}
+
+size_t texture_bytes(const LoadedTextures &loaded) {
+  size_t bytes = 0;
+  for (const Image &image : loaded.images) {
+    bytes += image.byte_size();
+  }
+  for (const Image &face : loaded.faces) {
+    bytes += face.byte_size();
+  }
+  return bytes;
+}
+
+double milliseconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const bool keep = argc > 1 && std::string(argv[1]) == "--keep";
+  const int warm_repeats = 5;
+
+  const std::vector<std::string> textures = {
+      "objects/interiorSurface_Color.png", "objects/WindowsSurface_Color.png", "objects/ScreenSurface_Color.png",
+      "objects/ExteriorSurface_Color.png", "objects/interior_previewSurface_Color.png"};
+  const std::vector<std::string> faces = {"images/cubemap/nightsky_rt.tga", "images/cubemap/nightsky_lt.tga",
+                                          "images/cubemap/nightsky_up.tga", "images/cubemap/nightsky_dn.tga",
+                                          "images/cubemap/nightsky_ft.tga", "images/cubemap/nightsky_bk.tga"};
+  std::vector<std::string> containers;
+  size_t source_bytes = 0;
+  for (const std::string &texture : textures) {
+    containers.push_back(DdsFile::path_for(texture));
+  }
+  containers.push_back(DdsFile::cubemap_path_for(faces));
+  for (const std::vector<std::string> *files : {&textures, &faces}) {
+    for (const std::string &file : *files) {
+      uint64_t size;
+      int64_t time;
+      if (get_file_info(file, &size, &time)) {
+        source_bytes += size;
+      }
+    }
+  }
+  for (const std::string &container : containers) {
+    std::remove(container.c_str());
+  }
+
+  std::vector<ImageDecodeStats> cold_stats;
+  auto start = std::chrono::steady_clock::now();
+  const LoadedTextures cold = load(textures, faces, &cold_stats);
+  const uint64_t cold_hash = hash_textures(cold);
+  const double cold_milliseconds = milliseconds_since(start);
+
+  double warm_milliseconds = 0.0;
+  std::vector<ImageDecodeStats> warm_stats;
+  bool same = true;
+  for (int r = 0; r < warm_repeats; r++) {
+    std::vector<ImageDecodeStats> stats;
+    start = std::chrono::steady_clock::now();
+    const LoadedTextures warm = load(textures, faces, &stats);
+    const uint64_t warm_hash = hash_textures(warm);
+    const double milliseconds = milliseconds_since(start);
+    same = same && warm_hash == cold_hash;
+    if (r == 0 || milliseconds < warm_milliseconds) {
+      warm_milliseconds = milliseconds;
+      warm_stats = stats;
+    }
+  }
+
+  std::cout << std::left << std::setw(40) << "file" << std::right << std::setw(11) << "cold ms" << std::setw(11)
+            << "warm ms" << std::endl;
+  for (size_t i = 0; i < cold_stats.size(); i++) {
+    // The cold skybox is decoded face by face, the warm one is a single container
+    std::cout << std::left << std::setw(40) << cold_stats[i].filename << std::right << std::fixed
+              << std::setprecision(2) << std::setw(11) << cold_stats[i].decode_milliseconds;
+    if (i < warm_stats.size() && warm_stats[i].filename == cold_stats[i].filename) {
+      std::cout << std::setw(11) << warm_stats[i].decode_milliseconds;
+    }
+    std::cout << std::endl;
+  }
+  for (const ImageDecodeStats &stats : warm_stats) {
+    if (std::none_of(cold_stats.begin(), cold_stats.end(),
+                     [&](const ImageDecodeStats &cold_entry) { return cold_entry.filename == stats.filename; })) {
+      std::cout << std::left << std::setw(40) << stats.filename << std::right << std::setw(11) << "-"
+                << std::setw(11) << stats.decode_milliseconds << std::endl;
+    }
+  }
+
+  size_t container_bytes = 0;
+  for (const std::string &container : containers) {
+    uint64_t size;
+    int64_t time;
+    if (get_file_info(container, &size, &time)) {
+      container_bytes += size;
+    }
+  }
+  std::cout << "Sources: " << source_bytes / 1024 << " KiB, containers: " << container_bytes / 1024
+            << " KiB, texture data with all levels: " << texture_bytes(cold) / 1024 << " KiB" << std::endl;
+  std::cout << "Startup: " << cold_milliseconds << " ms cold (decode, mip levels, containers written), "
+            << warm_milliseconds << " ms warm (mapped, sources hashed), " << std::setprecision(1)
+            << cold_milliseconds / warm_milliseconds << "x" << (same ? "" : ", WARM IMAGES DIFFER") << std::endl;
+
+  if (!keep) {
+    for (const std::string &container : containers) {
+      std::remove(container.c_str());
+    }
+  }
+  return same ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+// Timing helpers shared by the benchmarks
+
+/// Wall time of one call of the function in seconds
+template <typename F> double elapsed_seconds(F &&function) {
+  const auto start = std::chrono::high_resolution_clock::now();
+  function();
+  return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/// Shortest wall time of 'repeats' calls of the function in seconds, so a preempted call does not count
+template <typename F> double best_seconds(int repeats, F &&function) {
+  double best = 0.0;
+  for (int r = 0; r < repeats; r++) {
+    const double seconds = elapsed_seconds(function);
+    best = r == 0 ? seconds : std::min(best, seconds);
+  }
+  return best;
+}
+
+template <typename F> double best_milliseconds(int repeats, F &&function) {
+  return best_seconds(repeats, function) * 1000.0;
+}
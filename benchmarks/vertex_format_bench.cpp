@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mesh_optimizer.hpp"
+#include "obj_loader.hpp"
+#include "timing.hpp"
+#include "vertex_format.hpp"
+
+// Compares the float vertex streams with the compact interleaved format: buffer sizes, worst-case
+// quantization error and the speed of a bandwidth-bound vertex fetch. The fetch is simulated on the CPU
+// by streaming the vertex buffers of many copies of the mesh, so the working set misses the caches.
+// Usage: vertex_format_bench [file.obj ...]
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj", "objects/screen.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  // Enough copies of the mesh to exceed the last level cache
+  const size_t target_bytes = size_t(256) << 20;
+  const int repetitions = 5;
+
+  for (const std::string &file_name : files) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\"));
+    if (!load_obj(&attrib, &shapes, &materials, &err, file_name, base_dir + "/")) {
+      std::cout << err;
+      continue;
+    }
+
+    MeshData data = build_material_batches(attrib, shapes, materials, base_dir);
+    optimize_mesh(&data);
+    std::vector<uint16_t> short_indices;
+    const MeshView view = make_mesh_view(data, &short_indices);
+
+    glm::vec3 offset, scale;
+    const std::vector<CompactVertex> compact = compact_vertices(view, &offset, &scale);
+    const QuantizationError error = measure_quantization_error(view, compact, offset, scale);
+
+    const size_t vertex_count = data.vertex_count();
+    const size_t index_bytes = view.index_count * view.index_size;
+    const size_t float_bytes = (data.vertices.size() + data.normals.size() + data.tex_coords.size()) * sizeof(float);
+    const size_t compact_bytes = compact.size() * sizeof(CompactVertex);
+
+    std::cout << file_name << " (" << vertex_count << " vertices)" << std::endl;
+    std::cout << "  vertex buffers: " << float_bytes << " -> " << compact_bytes << " bytes ("
+              << std::fixed << std::setprecision(1) << 100.0 * (1.0 - double(compact_bytes) / float_bytes)
+              << "% less), with indices " << float_bytes + index_bytes << " -> " << compact_bytes + index_bytes
+              << " bytes (" << 100.0 * (1.0 - double(compact_bytes + index_bytes) / (float_bytes + index_bytes))
+              << "% less)" << std::endl;
+    std::cout << std::setprecision(6) << "  worst error: position " << error.position << " ("
+              << error.position_relative * 100.0 << "% of the diagonal), normal " << error.normal_degrees
+              << " degrees, texture coordinate " << error.tex_coord << std::endl;
+
+    // Copies of the buffers, together larger than the caches
+    const size_t copies = std::max<size_t>(1, target_bytes / float_bytes);
+    // The bits are kept as integers, only the memory traffic matters
+    auto copy_words = [&](const void *source, size_t words) {
+      std::vector<uint32_t> result(words * copies);
+      for (size_t c = 0; c < copies; c++) {
+        std::memcpy(result.data() + c * words, source, words * sizeof(uint32_t));
+      }
+      return result;
+    };
+    const std::vector<uint32_t> positions = copy_words(data.vertices.data(), data.vertices.size());
+    const std::vector<uint32_t> normals = copy_words(data.normals.data(), data.normals.size());
+    const std::vector<uint32_t> tex_coords = copy_words(data.tex_coords.data(), data.tex_coords.size());
+    const std::vector<uint32_t> compact_words = copy_words(compact.data(), compact.size() * 4);
+
+    // The GPU decodes normalized and half attributes in fixed function hardware, so only the fetched bytes are
+    // modelled. After the vertex fetch optimization the vertices are read almost in order, so the buffers are
+    // streamed linearly. Checksums keep the loops alive.
+    auto sum_words = [](const std::vector<uint32_t> &words) {
+      uint64_t sum = 0;
+      for (uint32_t word : words) {
+        sum += word;
+      }
+      return sum;
+    };
+
+    uint64_t float_sum = 0;
+    const double float_seconds = best_seconds(
+        repetitions, [&]() { float_sum = sum_words(positions) + sum_words(normals) + sum_words(tex_coords); });
+
+    uint64_t compact_sum = 0;
+    const double compact_seconds = best_seconds(repetitions, [&]() { compact_sum = sum_words(compact_words); });
+
+    const double fetched = double(vertex_count) * copies;
+    std::cout << std::setprecision(2) << "  vertex fetch of " << copies << " copies: float "
+              << float_seconds * 1000.0 << " ms (" << fetched / float_seconds / 1e6 << " M vertices/s), compact "
+              << compact_seconds * 1000.0 << " ms (" << fetched / compact_seconds / 1e6
+              << " M vertices/s), speedup " << float_seconds / compact_seconds << "x"
+              << "  [checksums " << float_sum % 1000 << " / " << compact_sum % 1000 << "]" << std::endl;
+  }
+
+  return 0;
+}
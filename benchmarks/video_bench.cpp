@@ -0,0 +1,121 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "video_texture.hpp"
+
+// Plays videos through VideoSource as the application plays the screen video: a render loop at the target rate
+// takes the frame due at its time and copies it into a staging buffer, the part of VideoTexture::update that
+// runs on the CPU (the texture uploads from the pixel buffers need a GL context). Both kinds of sources are
+// measured at 30 and 60 fps: a generated Y4M file and an image sequence of copies of the screen image.
+// Usage: video_bench [width height [seconds]]
+
+namespace {
+
+/// Moving gradients, so consecutive frames differ
+void write_y4m(const std::string &file_name, int width, int height, int fps, int frames) {
+  std::ofstream file(file_name, std::ios::binary);
+  file << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+  const int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+  std::vector<char> plane(size_t(width) * height);
+  for (int f = 0; f < frames; f++) {
+    file << "FRAME\n";
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        plane[size_t(y) * width + x] = static_cast<char>(16 + (x + y + f * 8) % 220);
+      }
+    }
+    file.write(plane.data(), plane.size());
+    for (int c = 0; c < 2; c++) {
+      for (int i = 0; i < chroma_width * chroma_height; i++) {
+        plane[i] = static_cast<char>(128 + ((i / chroma_width + f * 4 * (c + 1)) % 64) - 32);
+      }
+      file.write(plane.data(), size_t(chroma_width) * chroma_height);
+    }
+  }
+}
+
+void copy_file(const std::string &from, const std::string &to) {
+  std::ifstream in(from, std::ios::binary);
+  std::ofstream out(to, std::ios::binary);
+  out << in.rdbuf();
+}
+
+void play(const std::string &name, const std::string &file_name, double fps, double seconds) {
+  VideoSource source(file_name, fps);
+  VideoFrame frame;
+  std::vector<uint8_t> staging;
+  size_t shown = 0, copied_bytes = 0;
+  double copy_milliseconds = 0.0;
+
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t tick = 0;; tick++) {
+    const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (time >= seconds) {
+      break;
+    }
+    if (source.take_frame(time, &frame)) {
+      const auto copy_start = std::chrono::steady_clock::now();
+      staging.resize(frame.planes.size());
+      std::memcpy(staging.data(), frame.planes.data(), frame.planes.size());
+      copy_milliseconds +=
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - copy_start).count();
+      copied_bytes += frame.planes.size();
+      shown++;
+    }
+    std::this_thread::sleep_until(start + std::chrono::duration<double>((tick + 1) / source.get_fps()));
+  }
+
+  const VideoStats stats = source.get_stats();
+  const double decode_fps =
+      stats.decode_milliseconds > 0.0 ? stats.decoded_frames * 1000.0 / stats.decode_milliseconds : 0.0;
+  const double copy_mib = copy_milliseconds > 0.0 ? copied_bytes / 1048576.0 * 1000.0 / copy_milliseconds : 0.0;
+  std::cout << std::left << std::setw(14) << name << std::right << std::setw(4) << source.get_fps() << " fps: "
+            << std::setw(5) << shown << " shown of " << std::setw(5) << size_t(seconds * source.get_fps())
+            << ", decode " << std::setw(8) << decode_fps << " frames/s, copy " << std::setw(8) << copy_mib
+            << " MiB/s, " << stats.dropped_frames << " dropped, " << stats.late_frames << " late" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int width = 1280, height = 720;
+  double seconds = 3.0;
+  if (argc > 2) {
+    width = std::atoi(argv[1]);
+    height = std::atoi(argv[2]);
+  }
+  if (argc > 3) {
+    seconds = std::atof(argv[3]);
+  }
+
+  std::cout << std::fixed << std::setprecision(1);
+  const int sequence_frames = 30;
+  for (int i = 0; i < sequence_frames; i++) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "video_bench_%04d.png", i);
+    copy_file("objects/ScreenSurface_Color.png", name);
+  }
+
+  for (int fps : {30, 60}) {
+    const std::string y4m = "video_bench_" + std::to_string(fps) + ".y4m";
+    write_y4m(y4m, width, height, fps, sequence_frames);
+    play("Y4M " + std::to_string(width) + "x" + std::to_string(height), y4m, fps, seconds);
+    std::remove(y4m.c_str());
+    play("PNG sequence", "video_bench_%04d.png", fps, seconds);
+  }
+
+  for (int i = 0; i < sequence_frames; i++) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "video_bench_%04d.png", i);
+    std::remove(name);
+  }
+  return 0;
+}
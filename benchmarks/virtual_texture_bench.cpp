@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "virtual_texture.hpp"
+
+// Builds the page file of an image and runs the page cache of a virtual texture through a camera flight without a
+// GL context. Every frame the 1/8 resolution feedback of a 1280x720 view is computed on the CPU as the feedback
+// shader does for a flat view of the texture: the view pans across it while zooming in and out, and jumps to
+// another spot now and then. The pages the cache loads are copied out of the mapped file into a staging page,
+// standing in for the texture uploads.
+// Usage: virtual_texture_bench [image [slots_across [frames]]]
+
+namespace {
+
+double milliseconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const std::string image = argc > 1 ? argv[1] : "objects/interiorSurface_Color.png";
+  const int slots_across = argc > 2 ? std::atoi(argv[2]) : 16;
+  const int frames = argc > 3 ? std::atoi(argv[3]) : 600;
+  const size_t pages_per_frame = 16;
+  const int feedback_width = 1280 / 8, feedback_height = 720 / 8;
+
+  std::remove(PageFile::path_for(image).c_str());
+  auto start = std::chrono::steady_clock::now();
+  std::shared_ptr<PageFile> file = PageFile::open_for(image);
+  const double build_milliseconds = milliseconds_since(start);
+  start = std::chrono::steady_clock::now();
+  file = PageFile::open_for(image);
+  const double open_milliseconds = milliseconds_since(start);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << image << ": " << file->get_width() << "x" << file->get_height() << ", " << file->get_level_count()
+            << " levels, " << file->get_total_bytes() / 1024 << " KiB of pages, built in " << build_milliseconds
+            << " ms, opened in " << open_milliseconds << " ms" << std::endl;
+
+  PageCache cache(file, size_t(slots_across) * slots_across);
+  std::vector<uint8_t> staging(PageFile::page_bytes);
+  size_t max_faults = 0, frames_with_faults = 0, copied_pages = 0;
+  double request_milliseconds = 0.0, update_milliseconds = 0.0, copy_milliseconds = 0.0;
+  PageCacheStats previous = cache.get_stats();
+
+  for (int frame = 0; frame < frames; frame++) {
+    const double time = frame / 60.0;
+    // Texels of level 0 per window pixel, from 0.25 (magnified) to 16
+    const double texels_per_pixel = std::exp2(2.0 * std::sin(time * 0.7) + 1.0);
+    const double jump = std::floor(time / 3.0) * 0.37;
+    const double center_u = std::fmod(0.5 + 0.2 * std::sin(time * 0.5) + jump, 1.0);
+    const double center_v = std::fmod(0.5 + 0.2 * std::cos(time * 0.3) + jump * 1.3, 1.0);
+
+    start = std::chrono::steady_clock::now();
+    // The feedback texels are 8 window pixels apart, their level still comes from the window derivatives
+    const int level = std::min(file->get_level_count() - 1,
+                               std::max(0, int(std::floor(std::log2(texels_per_pixel)))));
+    const double level_scale = std::exp2(level);
+    for (int y = 0; y < feedback_height; y++) {
+      for (int x = 0; x < feedback_width; x++) {
+        const double u = center_u + (x - feedback_width / 2) * 8 * texels_per_pixel / file->get_width();
+        const double v = center_v + (y - feedback_height / 2) * 8 * texels_per_pixel / file->get_height();
+        // Mirrored repeat as the shader wraps
+        const double wrapped_u = 1.0 - std::abs(std::fmod(std::abs(u), 2.0) - 1.0);
+        const double wrapped_v = 1.0 - std::abs(std::fmod(std::abs(v), 2.0) - 1.0);
+        cache.request(level, int(wrapped_u * file->get_width() / level_scale / PageFile::page_content),
+                      int(wrapped_v * file->get_height() / level_scale / PageFile::page_content));
+      }
+    }
+    request_milliseconds += milliseconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    const std::vector<PageCache::Load> loads = cache.update(pages_per_frame);
+    update_milliseconds += milliseconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const PageCache::Load &load : loads) {
+      std::memcpy(staging.data(), file->get_page(load.level, load.x, load.y), PageFile::page_bytes);
+    }
+    copy_milliseconds += milliseconds_since(start);
+    copied_pages += loads.size();
+
+    const PageCacheStats stats = cache.get_stats();
+    const size_t faults = stats.page_faults - previous.page_faults;
+    max_faults = std::max(max_faults, faults);
+    frames_with_faults += faults > 0;
+    previous = stats;
+  }
+
+  const PageCacheStats stats = cache.get_stats();
+  const size_t physical_bytes = size_t(slots_across) * slots_across * PageFile::page_bytes;
+  std::cout << frames << " frames, " << slots_across << "x" << slots_across << " slots: " << stats << std::endl;
+  std::cout << "Page faults per frame: " << double(stats.page_faults) / frames << " average, " << max_faults
+            << " at most, " << frames_with_faults << " frames with faults" << std::endl;
+  std::cout << "CPU per frame: " << request_milliseconds / frames << " ms feedback requests, "
+            << update_milliseconds / frames << " ms cache update, " << copy_milliseconds / frames
+            << " ms copying pages (" << copied_pages << " pages)" << std::endl;
+  std::cout << "Physical texture " << physical_bytes / 1024 << " KiB instead of " << file->get_total_bytes() / 1024
+            << " KiB for the whole mip chain" << std::endl;
+  return 0;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mesh.hpp"
+#include "texture.hpp"
+#include "texture_array.hpp"
+#include "texture_streamer.hpp"
+#include "thread_pool.hpp"
+
+/// Loads meshes and textures in the background. File I/O, OBJ parsing and image decoding run on the pool,
+/// the GL uploads are queued for the thread owning the context, which runs them with process_uploads() under
+/// a time budget per frame. Until then textures are 1x1 placeholders and mesh lists stay empty.
+///
+/// Worker tasks never touch the targets of the uploads, so only the queued uploads must not outlive them:
+/// destroying the loader waits for the running tasks and drops the uploads that did not run.
+class AssetLoader {
+public:
+  explicit AssetLoader(ThreadPool &pool = ThreadPool::shared()) : pool(pool) {}
+  AssetLoader(const AssetLoader &) = delete;
+  AssetLoader &operator=(const AssetLoader &) = delete;
+  ~AssetLoader();
+
+  /// Loads the file like Mesh::from_file. '*meshes' receives the meshes once they are uploaded, their material
+  /// textures start as placeholders and are decoded afterwards.
+  void load_meshes(std::vector<std::unique_ptr<Mesh>> *meshes, const std::string &file_name,
+                   GLint position_location = -1, GLint normal_location = -1, GLint tex_coord_location = -1,
+                   uint32_t build_flags = MESH_BUILD_OPTIMIZE);
+
+  /// Return placeholder textures at once, the decoded images are uploaded into them later.
+  /// The images of one call are decoded concurrently (see decode_images). Textures are shared through
+  /// TextureCache::shared() like those of ::load_texture_2d, so files loaded before return their texture (or
+  /// the placeholder still waiting for it) and every call hands out references to release.
+  GLuint load_texture_2d(const std::string &file_name);
+  std::vector<GLuint> load_textures_2d(const std::vector<std::string> &file_names);
+  GLuint load_texture_cubemap(const std::string file_names[6]);
+  /// Packs the images into texture arrays with pack_texture_arrays. '*arrays' receives the array textures and
+  /// '*placements' the place of every file in the order of the names once they are uploaded. The arrays stream
+  /// their levels like the 2D textures, see TextureResidency::track_array.
+  void load_texture_arrays(std::vector<GLuint> *arrays, std::vector<PackedTexture> *placements,
+                           const std::vector<std::string> &file_names);
+
+  /// Streams the 2D textures through pixel buffer objects from now on (see TextureStreamer): the decode tasks
+  /// copy the images into the buffers and the uploads only issue the copies from them. Images larger than a
+  /// buffer are still uploaded directly. Must be called on the thread of the GL context.
+  void enable_texture_streaming(size_t buffer_count = 4, size_t buffer_bytes = size_t(8) << 20);
+  /// Counters of the streamed uploads, all zero without streaming
+  TextureStreamStats get_stream_stats();
+
+  /// Leaves images at least 'size' texels wide or high to virtual texturing from now on: load_textures_2d does
+  /// not decode them, their textures stay placeholders and get_virtual_textures() lists them. 0 turns it off.
+  void set_virtual_texture_size(int size) { this->virtual_texture_size = size; }
+  /// The files left to virtual texturing so far with their placeholder textures
+  std::vector<std::pair<std::string, GLuint>> get_virtual_textures();
+
+  /// Decode costs of the images loaded so far
+  std::vector<ImageDecodeStats> get_decode_stats();
+
+  /// Runs queued uploads until 'budget_milliseconds' is used up, at least one so loading always progresses.
+  /// Must be called on the thread of the GL context. Uploads bind textures, so call it before
+  /// reset_texture_bindings(). Returns the number of uploads that ran.
+  size_t process_uploads(double budget_milliseconds);
+
+  /// Whether every requested asset has been uploaded
+  bool is_finished();
+
+private:
+  /// Runs the task on the pool, exceptions are printed and end that asset
+  void run_task(const std::string &name, std::function<void()> task);
+  void queue_upload(std::function<void()> upload);
+  void add_decode_stats(const std::vector<ImageDecodeStats> &stats);
+  /// Queues the direct upload of a decoded image into its placeholder, which releases the reference of the load
+  void queue_texture_upload_2d(GLuint texture_id, const std::string &file_name, std::shared_ptr<const Image> image);
+  /// Decodes the file again and uploads it directly, for a streamed upload whose buffer was lost
+  void reload_texture_2d(GLuint texture_id, const std::string &file_name);
+
+  ThreadPool &pool;
+
+  std::mutex mutex;
+  std::condition_variable tasks_finished;
+  std::deque<std::function<void()>> uploads;
+  std::vector<ImageDecodeStats> decode_stats;
+  /// Tasks queued or running on the pool
+  size_t running_tasks = 0;
+  std::unique_ptr<TextureStreamer> streamer;
+  std::atomic<int> virtual_texture_size{0};
+  std::vector<std::pair<std::string, GLuint>> virtual_textures;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+/// Block compressed formats written by the encoder. Both split the image into 4x4 blocks: BC1 (DXT1) stores two
+/// RGB565 endpoints and a 2-bit index per pixel in 8 bytes, BC3 (DXT5) adds 8 bytes of alpha with two 8-bit
+/// endpoints and 3-bit indices. RGBA8 takes 64 bytes per block, so BC1 is 1/8 and BC3 1/4 of it.
+enum class BlockFormat { BC1, BC3 };
+
+size_t block_bytes(BlockFormat format);
+/// Bytes of a whole image, the blocks at the right and bottom edge are padded when the size is not a multiple of 4
+size_t compressed_size(BlockFormat format, int width, int height);
+
+/// Encode one block of 16 RGBA pixels in row order. The BC1 endpoints come from the principal axis of the colors
+/// and are refined by least squares for the chosen indices. Blocks always use the opaque four color mode, so the
+/// color part of BC3 is encoded the same way. 'simd' selects the SSE2 index search where it is available.
+void encode_bc1_block(const uint8_t rgba[64], uint8_t destination[8], bool simd = true);
+void encode_bc3_block(const uint8_t rgba[64], uint8_t destination[16], bool simd = true);
+
+/// Decode one block into 16 RGBA pixels, integer interpolation as in the D3D specification
+void decode_bc1_block(const uint8_t block[8], uint8_t rgba[64]);
+void decode_bc3_block(const uint8_t block[16], uint8_t rgba[64]);
+
+/// Compresses a tightly packed RGBA8 image, rows of blocks are spread over the pool
+std::vector<uint8_t> compress_image(const uint8_t *rgba, int width, int height, BlockFormat format,
+                                    ThreadPool &pool = ThreadPool::shared(), bool simd = true);
+/// Decompresses back to tightly packed RGBA8, e.g. to measure the quality
+std::vector<uint8_t> decompress_image(const uint8_t *blocks, int width, int height, BlockFormat format);
+
+/// Whether any pixel is not fully opaque, such images need BC3
+bool has_transparency(const uint8_t *rgba, size_t pixel_count);
+
+/// Peak signal-to-noise ratio in dB of the first 'channels' channels of two RGBA8 images, infinity when equal
+double compute_psnr(const uint8_t *reference, const uint8_t *image, size_t pixel_count, int channels = 3);
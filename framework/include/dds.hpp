@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+/// Pixel formats of DdsFile. BC1 and BC3 use the DXT1 and DXT5 FourCC codes. RGBA8 and BGRA8 are 32-bit RGB with
+/// alpha and the channel order given by the bit masks, RGB8 is 24-bit RGB. R8 and RG8 are the 8-bit luminance
+/// and the 16-bit luminance with alpha formats, gray images packed as in pack_channels.
+enum class DdsFormat { BC1, BC3, RGBA8, BGRA8, RGB8, RG8, R8 };
+
+bool is_block_compressed(DdsFormat format);
+/// Bytes of a pixel of an uncompressed format
+size_t pixel_bytes(DdsFormat format);
+
+/// DirectDraw Surface file holding a 2D texture or a cubemap with all of its mip levels. The file is mapped, so
+/// the levels can be handed to OpenGL straight from the mapping.
+///
+/// Files written here remember size, modification time and content hash of their source images in the reserved
+/// words of the header, together with the parameters they were made with. Other tools still read them, and a
+/// changed source or other parameters make them stale. Files without that record (e.g. made by other tools) are
+/// always taken as they are.
+class DdsFile {
+public:
+  /// One mip level of one face, the data points into the mapped file
+  struct Level {
+    int width;
+    int height;
+    const uint8_t *data;
+    size_t size;
+  };
+
+  /// Maps the file. Returns nullptr when there is none, when it is broken or uses another format, or when it is
+  /// stale for 'source_file_names' and 'parameters'.
+  static std::unique_ptr<DdsFile> open(const std::string &file_name,
+                                       const std::vector<std::string> &source_file_names = {},
+                                       uint32_t parameters = 0);
+
+  /// Container next to the image: '<image>.dds' as the encoder writes it, or else the image name with the
+  /// extension replaced by '.dds' as most tools write it. Returns nullptr when there is no usable 2D one.
+  static std::unique_ptr<DdsFile> open_for(const std::string &image_file_name, uint32_t parameters = 0);
+  /// Cubemap container of six face images, see cubemap_path_for. Returns nullptr when there is no usable one.
+  static std::unique_ptr<DdsFile> open_for_cubemap(const std::vector<std::string> &face_file_names,
+                                                   uint32_t parameters = 0);
+
+  /// Writes the mip levels, largest first. A cubemap has six faces in the order of cubemap_sides, each with all
+  /// of its levels, so 'levels' holds 6 * level count entries. Returns false when the file could not be written.
+  static bool write(const std::string &file_name, DdsFormat format, int width, int height,
+                    const std::vector<std::vector<uint8_t>> &levels,
+                    const std::vector<std::string> &source_file_names = {}, bool cubemap = false,
+                    uint32_t parameters = 0);
+
+  static std::string path_for(const std::string &image_file_name) { return image_file_name + ".dds"; }
+  /// The common start of the face names without trailing separators plus '.dds', e.g. 'sky.dds' for 'sky_rt.tga',
+  /// 'sky_lt.tga', ... When the names share no file name part, '<first face>.cube.dds'.
+  static std::string cubemap_path_for(const std::vector<std::string> &face_file_names);
+
+  DdsFormat get_format() const { return format; }
+  int get_width() const { return width; }
+  int get_height() const { return height; }
+  bool is_cubemap() const { return faces.size() == 6; }
+  /// Levels of a face, the only face of a 2D texture is 0
+  const std::vector<Level> &get_levels(size_t face = 0) const { return faces[face]; }
+
+private:
+  explicit DdsFile(std::unique_ptr<MappedFile> file) : file(std::move(file)) {}
+  bool parse(const std::vector<std::string> &source_file_names, uint32_t parameters);
+
+  std::unique_ptr<MappedFile> file;
+  DdsFormat format = DdsFormat::BC1;
+  int width = 0;
+  int height = 0;
+  std::vector<std::vector<Level>> faces;
+};
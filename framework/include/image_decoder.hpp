@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "texture.hpp"
+
+// Decoders for the texture files of the scene that are faster than stb_image on them: 8-bit RGB and RGBA PNG files
+// without interlacing, and 24 and 32-bit true color TGA files, uncompressed or RLE. The PNG rows are reconstructed
+// with SSE2 kernels, and both decoders write the RGBA pixels straight into the image. The result matches
+// stb_image decoding to 4 channels byte for byte.
+// The decoders return false and leave the image alone for anything else (other formats and bit depths, palettes,
+// transparent color keys, damaged files). decode_image then falls back to stb_image.
+
+/// Decodes a PNG file in memory into RGBA
+bool decode_png(const uint8_t *data, size_t size, Image *image, bool simd = true);
+/// Decodes a TGA file in memory into RGBA
+bool decode_tga(const uint8_t *data, size_t size, Image *image, bool simd = true);
+/// Decodes the file with decode_png when it has the PNG signature, or with decode_tga when its name ends in .tga
+bool decode_image_fast(const std::string &filename, Image *image, bool simd = true);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+// The Lights uniform block of main.frag with its std140 layout: every vec3 starts a 16-byte row and the floats of
+// a light fill the last 4 bytes of those rows, structures and array elements take whole rows.
+
+struct DirLightStd140 {
+  glm::vec3 direction = glm::vec3(0.f);
+  float padding0 = 0.f;
+  glm::vec3 ambient = glm::vec3(0.f);
+  float padding1 = 0.f;
+  glm::vec3 diffuse = glm::vec3(0.f);
+  float padding2 = 0.f;
+  glm::vec3 specular = glm::vec3(0.f);
+  float padding3 = 0.f;
+};
+
+struct PointLightStd140 {
+  glm::vec3 position = glm::vec3(0.f);
+  float constant = 1.f;
+  glm::vec3 ambient = glm::vec3(0.f);
+  float linear = 0.f;
+  glm::vec3 diffuse = glm::vec3(0.f);
+  float quadratic = 0.f;
+  glm::vec3 specular = glm::vec3(0.f);
+  float padding = 0.f;
+};
+
+struct SpotLightStd140 {
+  glm::vec3 position = glm::vec3(0.f);
+  float cut_off = 1.f;
+  glm::vec3 direction = glm::vec3(0.f, -1.f, 0.f);
+  float outer_cut_off = 0.f;
+  glm::vec3 ambient = glm::vec3(0.f);
+  float constant = 1.f;
+  glm::vec3 diffuse = glm::vec3(0.f);
+  float linear = 0.f;
+  glm::vec3 specular = glm::vec3(0.f);
+  float quadratic = 0.f;
+};
+
+const int light_block_point_lights = 2;
+const int light_block_spot_lights = 5;
+/// Binding point of the uniform buffer with the lights
+const unsigned light_block_binding = 0;
+
+struct LightBlock {
+  DirLightStd140 dir_light;
+  PointLightStd140 point_lights[light_block_point_lights];
+  SpotLightStd140 spot_lights[light_block_spot_lights];
+};
+
+static_assert(sizeof(glm::vec3) == 12, "std140 needs tightly packed vec3");
+static_assert(sizeof(DirLightStd140) == 64 && sizeof(PointLightStd140) == 64 && sizeof(SpotLightStd140) == 80,
+              "light structures must take whole std140 rows");
+static_assert(offsetof(PointLightStd140, specular) == 48 && offsetof(SpotLightStd140, quadratic) == 76,
+              "light members must be at their std140 offsets");
+static_assert(offsetof(LightBlock, point_lights) == 64 && offsetof(LightBlock, spot_lights) == 192 &&
+                  sizeof(LightBlock) == 592,
+              "light arrays must be at their std140 offsets");
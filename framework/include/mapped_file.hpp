@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/// Read-only memory mapping of a whole file. The contents stay valid for the lifetime of the object.
+/// Throws a std::string when the file cannot be opened, same as load_file_to_string.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &file_name);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  const char *data() const { return this->bytes; }
+  size_t size() const { return this->length; }
+
+private:
+  const char *bytes = nullptr;
+  size_t length = 0;
+
+#ifdef _WIN32
+  void *file_handle = nullptr;
+  void *mapping_handle = nullptr;
+#endif
+};
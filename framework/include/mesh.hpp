@@ -2,10 +2,28 @@
 
 #include <glad/glad.h>
 
+#include <algorithm>
+#include <functional>
 #include <vector>
 #include <string>
 #include <memory>
 
+#include "mesh_cache.hpp"
+#include "mesh_data.hpp"
+#include "mesh_lod.hpp"
+#include "meshlet.hpp"
+#include "texel_density.hpp"
+
+/// CPU side of a loaded OBJ file, see Mesh::load_file
+struct MeshFile {
+  /// Set when the mesh cache was up to date, the meshes are then uploaded from its mapping
+  std::unique_ptr<MeshCache> cache;
+  /// Built from the OBJ file otherwise
+  std::vector<MeshData> meshes;
+  /// Texel densities of the submeshes of every mesh, either way
+  std::vector<std::vector<TexelDensity>> texel_densities;
+};
+
 class Mesh {
 public:
   Mesh(std::vector<float> vertices, std::vector<uint32_t> indices, GLenum mode = GL_TRIANGLES,
@@ -23,22 +41,105 @@ public:
        std::vector<uint32_t> indices, GLenum mode = GL_TRIANGLES, GLint position_location = -1,
        GLint normal_location = -1, GLint tex_coord_location = -1);
 
+  /// Keeps the submeshes and materials of the data, so each material can be drawn separately.
+  /// With 'compact_vertices' the vertices are stored as interleaved CompactVertex.
+  Mesh(const MeshData &data, GLenum mode = GL_TRIANGLES, GLint position_location = -1, GLint normal_location = -1,
+       GLint tex_coord_location = -1, bool compact_vertices = false);
+
+  /// Uploads geometry that is already in the GPU layout without any conversion (unless 'compact_vertices' is set)
+  Mesh(const MeshView &view, GLenum mode = GL_TRIANGLES, GLint position_location = -1, GLint normal_location = -1,
+       GLint tex_coord_location = -1, bool compact_vertices = false);
+
   Mesh(const Mesh &other);
+  /// Would have to release the buffers and the texture references of this mesh, no caller needs it
+  Mesh &operator=(const Mesh &) = delete;
 
   void create_vao(GLint position_location = -1, GLint normal_location = -1, GLint tex_coord_location = -1);
   GLuint get_vao_id() { return this->vao_id; }
   GLuint get_texture_id() { return this->texture_id; }
   void set_texture_id(const GLuint texture_id) { this->texture_id = texture_id; }
-  void bind_vao() { glBindVertexArray(this->vao_id); }
-
+  void bind_vao();
+
+  /// Compact positions are normalized to the bounds, shaders decode them as 'offset + position * scale'.
+  /// For float vertices the offset is 0 and the scale 1.
+  bool has_compact_vertices() const { return this->compact_vertices; }
+  const glm::vec3 &get_position_offset() const { return this->position_offset; }
+  const glm::vec3 &get_position_scale() const { return this->position_scale; }
+
+  /// Submeshes of the selected level of detail
+  const std::vector<Submesh> &get_submeshes() const {
+    return this->current_lod > 0 ? this->lods[this->current_lod - 1].submeshes : this->submeshes;
+  }
+  void set_submeshes(const std::vector<Submesh> &submeshes) { this->submeshes = submeshes; }
+  const std::vector<Material> &get_materials() const { return this->materials; }
+  void set_materials(const std::vector<Material> &materials) { this->materials = materials; }
+  /// Shapes of the OBJ file and their triangles in the full detail submeshes (see ShapeRange)
+  const std::vector<std::string> &get_shape_names() const { return this->shape_names; }
+  const std::vector<ShapeRange> &get_shape_ranges() const { return this->shape_ranges; }
+  void set_shapes(const std::vector<std::string> &names, const std::vector<ShapeRange> &ranges) {
+    this->shape_names = names;
+    this->shape_ranges = ranges;
+  }
+
+  void set_lods(const std::vector<MeshLod> &lods);
+  void set_bounds(const glm::vec3 &bounds_min, const glm::vec3 &bounds_max) {
+    this->bounds_min = bounds_min;
+    this->bounds_max = bounds_max;
+  }
+
+  /// Number of levels of detail, the full one included
+  size_t get_lod_count() const { return this->lod_errors.size(); }
+  size_t get_current_lod() const { return this->current_lod; }
+  void set_current_lod(size_t lod) { this->current_lod = std::min(lod, this->lod_errors.size() - 1); }
+  /// Selects the level drawn from now on by its projected error as seen from 'eye' (see select_lod).
+  /// 'projection_scale' comes from lod_projection_scale. Returns the selected level.
+  size_t select_lod(const glm::vec3 &eye, float projection_scale, const LodSettings &settings);
+
+  /// Densities of the submeshes, in their order (see compute_texel_densities)
+  void set_texel_densities(const std::vector<TexelDensity> &densities) { this->texel_densities = densities; }
+  /// Texture coordinate units a pixel covers on the submesh as seen from 'eye' (see ::uv_per_pixel), 0 when the
+  /// density is unknown
+  float uv_per_pixel(size_t submesh, const glm::vec3 &eye, float projection_scale) const;
+
+  void set_meshlets(const std::vector<Meshlet> &meshlets);
+  const std::vector<Meshlet> &get_meshlets() const { return this->meshlets; }
+  /// Culls the meshlets as seen from 'eye', draw_submesh then draws only the visible ones with one multi-draw
+  /// call. Applies to the full detail level, coarser levels are drawn whole. Counts the culled triangles.
+  MeshletCullStats cull_meshlets(const glm::mat4 &view_projection, const glm::vec3 &eye,
+                                 const MeshletCullSettings &settings);
+  /// Draws all meshlets again
+  void reset_meshlet_culling() { this->meshlets_culled = false; }
+
+  /// Draws all submeshes, or the whole buffer when there are none
   void draw();
+  /// Draws only the index range of one submesh in the selected level, expects the VAO to be bound
+  void draw_submesh(size_t submesh);
 
   static Mesh from_interleaved(std::vector<float> interleaved_vertices, std::vector<uint32_t> indices,
                                GLenum mode = GL_TRIANGLES, GLint position_location = -1, GLint normal_location = -1,
                                GLint tex_coord_location = -1);
 
+  /// Loads the OBJ file as one mesh with a submesh per material, diffuse textures of the materials are loaded too.
+  /// 'build_flags' are MeshBuildFlags of the optional steps.
   static std::vector<std::unique_ptr<Mesh>> from_file(const std::string &file_name, GLint position_location = -1,
-                                                      GLint normal_location = -1, GLint tex_coord_location = -1);
+                                                      GLint normal_location = -1, GLint tex_coord_location = -1,
+                                                      uint32_t build_flags = MESH_BUILD_OPTIMIZE);
+
+  /// The CPU part of from_file: reads the mesh cache or parses and builds the OBJ file (and writes the cache).
+  /// Does not touch OpenGL, so it can run on a worker thread.
+  static MeshFile load_file(const std::string &file_name, uint32_t build_flags = MESH_BUILD_OPTIMIZE);
+  /// The GL part of from_file: uploads the loaded meshes and creates their VAOs, textures are left to the caller
+  static std::vector<std::unique_ptr<Mesh>> from_loaded_file(const MeshFile &file, GLint position_location = -1,
+                                                             GLint normal_location = -1,
+                                                             GLint tex_coord_location = -1,
+                                                             uint32_t build_flags = MESH_BUILD_OPTIMIZE);
+  /// Distinct diffuse texture paths of the materials in the order of first use
+  static std::vector<std::string> texture_paths(const std::vector<std::unique_ptr<Mesh>> &meshes);
+  /// Sets the diffuse textures of the materials, 'load_texture' is called once for every distinct image path.
+  /// It returns a reference of the TextureCache (as load_texture_2d does), which the meshes take over: each keeps
+  /// one reference to the textures of its materials until it is destroyed.
+  static void assign_textures(const std::vector<std::unique_ptr<Mesh>> &meshes,
+                              const std::function<GLuint(const std::string &)> &load_texture);
 
   static Mesh cube(GLint position_location = -1, GLint normal_location = -1, GLint tex_coord_location = -1);
   static Mesh sphere(GLint position_location = -1, GLint normal_location = -1, GLint tex_coord_location = -1);
@@ -47,20 +148,59 @@ public:
   ~Mesh();
 
 private:
+  void upload(const MeshView &view, GLenum mode, bool compact_vertices);
+
   GLuint vao_id = 0;
   GLuint texture_id = 0;
+  /// Textures of the materials the mesh holds a TextureCache reference to
+  std::vector<GLuint> texture_references;
 
   size_t vertices_count = 0;
+  /// Interleaved CompactVertex buffer when compact_vertices is set, positions only otherwise
   GLuint vertices_buffer_id = 0;
   GLuint normals_buffer_id = 0;
   GLuint tex_coords_buffer_id = 0;
 
   size_t indices_count = 0;
   GLuint indices_buffer_id = 0;
+  /// GL_UNSIGNED_SHORT when there are less than 65536 vertices, GL_UNSIGNED_INT otherwise
+  GLenum index_type = GL_UNSIGNED_INT;
 
   GLint position_location = -1;
   GLint normal_location = -1;
   GLint tex_coord_location = -1;
 
   GLenum mode = GL_TRIANGLES;
+
+  bool compact_vertices = false;
+  glm::vec3 position_offset = glm::vec3(0.f);
+  glm::vec3 position_scale = glm::vec3(1.f);
+
+  /// Ranges of the index buffer sorted by material
+  std::vector<Submesh> submeshes;
+  std::vector<Material> materials;
+  std::vector<std::string> shape_names;
+  std::vector<ShapeRange> shape_ranges;
+
+  /// Coarser levels after the full one, 'current_lod' 0 is the full detail
+  std::vector<MeshLod> lods;
+  std::vector<float> lod_errors = {0.f};
+  size_t current_lod = 0;
+  glm::vec3 bounds_min = glm::vec3(0.f);
+  glm::vec3 bounds_max = glm::vec3(0.f);
+  std::vector<TexelDensity> texel_densities;
+
+  /// Index ranges of the visible meshlets of one submesh, for glMultiDrawElementsBaseVertex
+  struct MeshletDraws {
+    std::vector<GLsizei> counts;
+    std::vector<const void *> offsets;
+    std::vector<GLint> base_vertices;
+    size_t index_count = 0;
+  };
+
+  std::vector<Meshlet> meshlets;
+  std::shared_ptr<const MeshletCuller> meshlet_culler;
+  bool meshlets_culled = false;
+  std::vector<uint32_t> visible_meshlets;
+  std::vector<MeshletDraws> meshlet_draws;
 };
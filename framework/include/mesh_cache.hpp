@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "mesh_data.hpp"
+
+/// Binary cache of a loaded OBJ file, stored next to it as '<file>.meshcache'.
+///
+/// It holds the final (welded, 16-bit where possible) vertex and index streams of every mesh together with
+/// the mesh names, bounds, submeshes, shape tables, levels of detail, meshlets and materials, so a later load
+/// only maps the file and hands the bytes to glBufferData. The cache is versioned and remembers size,
+/// modification time and content hash of the OBJ and its MTL files; a change of any of them makes it stale.
+class MeshCache {
+public:
+  struct Entry {
+    std::string name;
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    std::vector<Submesh> submeshes;
+    std::vector<Material> materials;
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+    std::vector<std::string> shape_names;
+    std::vector<ShapeRange> shape_ranges;
+    /// Points into the mapped file
+    MeshView view;
+  };
+
+  /// Opens the cache of the given OBJ file. Returns nullptr when there is none, or when it is stale, broken
+  /// or was built with other MeshBuildFlags.
+  static std::unique_ptr<MeshCache> open(const std::string &obj_file_name, uint32_t build_flags = 0);
+
+  /// Writes the cache of the given OBJ file. 'source_files' are the OBJ and all MTL files it was built from.
+  /// Returns false when the file could not be written (e.g. read-only folder).
+  static bool write(const std::string &obj_file_name, const std::vector<std::string> &source_files,
+                    const std::vector<MeshData> &meshes, uint32_t build_flags = 0);
+
+  static std::string path_for(const std::string &obj_file_name) { return obj_file_name + ".meshcache"; }
+
+  const std::vector<Entry> &get_meshes() const { return meshes; }
+
+  /// Increase whenever the layout of the file changes
+  static const uint32_t version = 8;
+
+private:
+  explicit MeshCache(std::unique_ptr<MappedFile> file) : file(std::move(file)) {}
+  bool parse(uint32_t build_flags);
+
+  std::unique_ptr<MappedFile> file;
+  std::vector<Entry> meshes;
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "tiny_obj_loader.h"
+
+/// Optional steps of building meshes from OBJ files, the mesh cache remembers which ones were applied
+enum MeshBuildFlags : uint32_t {
+  /// Vertex cache, overdraw and vertex fetch optimization (see mesh_optimizer.hpp)
+  MESH_BUILD_OPTIMIZE = 1,
+  /// Interleaved 16-byte vertices (see vertex_format.hpp). Applied on upload, so it does not change the cached data
+  MESH_BUILD_COMPACT_VERTICES = 2,
+  /// Simplified levels of detail appended to the index buffer (see mesh_lod.hpp)
+  MESH_BUILD_LODS = 4,
+  /// Meshlets of the full detail triangles for cluster culling (see meshlet.hpp)
+  MESH_BUILD_MESHLETS = 8,
+};
+
+/// Surface properties read from the MTL file. Objects are shaded with the diffuse texture alone, the values are
+/// kept for other renderers and tools.
+struct Material {
+  std::string name;
+
+  glm::vec3 diffuse = glm::vec3(1.f);  // Kd
+  glm::vec3 specular = glm::vec3(0.f); // Ks
+  float shininess = 1.f;               // Ns
+  float dissolve = 1.f;                // d
+
+  /// Path of the diffuse texture (map_Kd) relative to the working directory, empty for none
+  std::string diffuse_texture;
+  /// OpenGL name of the diffuse texture once it has been loaded
+  unsigned int texture_id = 0;
+};
+
+/// Range of the index buffer drawn with one material. Its indices are relative to 'base_vertex',
+/// so 16-bit indices suffice as long as the range references less than 65536 vertices.
+struct Submesh {
+  int material_id = 0;
+  size_t first_index = 0;
+  size_t index_count = 0;
+  size_t base_vertex = 0;
+  size_t vertex_count = 0;
+};
+
+/// Run of triangles of one OBJ shape ('o' or 'g') inside a full detail submesh. A shape has at least one range in
+/// each submesh of its materials, more when optimize_mesh interleaved its triangles with those of other shapes.
+struct ShapeRange {
+  uint32_t shape = 0;
+  uint32_t submesh = 0;
+  size_t first_index = 0;
+  size_t index_count = 0;
+};
+
+/// Coarser version of a mesh that reuses its vertices. It has one range per submesh of the full detail mesh,
+/// in the same order and with the same materials; a range may be empty when its material disappeared.
+struct MeshLod {
+  std::vector<Submesh> submeshes;
+  /// Largest object space distance of the simplified surface from the original one
+  float error = 0.f;
+};
+
+/// Small cluster of neighbouring triangles of one submesh with the data to cull it as a whole. Its triangles
+/// are a continuous range of the index buffer, so visible meshlets are drawn straight from it.
+struct Meshlet {
+  uint32_t submesh = 0;
+  uint32_t first_index = 0;
+  uint32_t triangle_count = 0;
+  /// Distinct vertices referenced by the triangles
+  uint32_t vertex_count = 0;
+
+  /// Bounding sphere
+  glm::vec3 center = glm::vec3(0.f);
+  float radius = 0.f;
+
+  /// Normal cone, every triangle faces away from an eye with
+  /// dot(center - eye, cone_axis) >= cone_cutoff * length(center - eye) + radius. A cutoff of 1 never culls.
+  glm::vec3 cone_axis = glm::vec3(0.f);
+  float cone_cutoff = 1.f;
+};
+
+static_assert(sizeof(Meshlet) == 48, "Meshlet is stored in the mesh cache as is");
+
+/// Geometry of one mesh kept in CPU memory, in the layout the Mesh constructor uploads.
+/// Does not touch OpenGL, so it can be built on any thread.
+struct MeshData {
+  std::string name;
+
+  std::vector<float> vertices;   // 3 floats per vertex
+  std::vector<float> normals;    // 3 floats per vertex, or empty
+  std::vector<float> tex_coords; // 2 floats per vertex, or empty
+  std::vector<uint32_t> indices;
+
+  /// Ranges sorted by material; empty when the whole index buffer is drawn at once
+  std::vector<Submesh> submeshes;
+  std::vector<Material> materials;
+  /// Levels of detail after the full one, from finer to coarser; their indices follow those of the submeshes
+  std::vector<MeshLod> lods;
+  /// Clusters of the full detail triangles, empty without MESH_BUILD_MESHLETS
+  std::vector<Meshlet> meshlets;
+  /// Shapes of the OBJ file the mesh was built from and their triangles, sorted by submesh and first index.
+  /// Empty for meshes without submeshes.
+  std::vector<std::string> shape_names;
+  std::vector<ShapeRange> shape_ranges;
+
+  /// Axis aligned bounding box of the vertices
+  glm::vec3 bounds_min = glm::vec3(0.f);
+  glm::vec3 bounds_max = glm::vec3(0.f);
+
+  size_t vertex_count() const { return vertices.size() / 3; }
+
+  /// Whether the indices fit into GL_UNSIGNED_SHORT
+  bool has_16bit_indices() const;
+
+  /// Bytes of the vertex buffers plus the index buffer once uploaded
+  size_t gpu_bytes() const;
+
+  void compute_bounds();
+};
+
+/// Non-owning view of mesh geometry that is already in its final GPU layout,
+/// e.g. inside a memory mapped cache file. Normals and texture coordinates may be nullptr.
+struct MeshView {
+  const float *vertices = nullptr;
+  const float *normals = nullptr;
+  const float *tex_coords = nullptr;
+  size_t vertex_count = 0;
+
+  const void *indices = nullptr;
+  size_t index_count = 0;
+  /// 2 or 4 bytes per index
+  size_t index_size = sizeof(uint32_t);
+};
+
+/// Returns the view of the data, 16-bit indices are converted into 'short_indices' when they fit.
+MeshView make_mesh_view(const MeshData &data, std::vector<uint16_t> *short_indices);
+
+/// Builds an indexed mesh from a triangulated tinyobj shape. Corners with an identical
+/// (position, normal, texture coordinate) tuple are welded into a single vertex.
+MeshData weld_shape(const tinyobj::attrib_t &attrib, const tinyobj::shape_t &shape);
+
+/// Builds one indexed mesh from all shapes of a file with one submesh per material. Every submesh
+/// is welded separately and owns a continuous block of vertices. Faces without a material get a default one.
+/// The shapes are welded separately as well and the shape table records their triangles.
+/// Texture paths of the materials are resolved relative to 'texture_dir'.
+MeshData build_material_batches(const tinyobj::attrib_t &attrib, const std::vector<tinyobj::shape_t> &shapes,
+                                const std::vector<tinyobj::material_t> &materials, const std::string &texture_dir);
+
+/// Number of vertex shader invocations needed to draw the triangle list with a FIFO post-transform cache
+/// of the given size (i.e. number of cache misses).
+size_t count_vertex_shader_invocations(const std::vector<uint32_t> &indices, size_t cache_size = 32);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.hpp"
+
+/// Appends up to 'level_count' simplified levels to the mesh (see simplify_mesh). Every level aims at half the
+/// triangles of the previous one and is simplified from it, so the errors add up along the chain. The chain
+/// stops early when a level would exceed 'max_error' (relative to the diagonal of the bounds) or would keep more
+/// than 90 % of the previous triangles. The new index ranges are optimized for the vertex cache.
+void build_lods(MeshData *data, size_t level_count = 3, float max_error = 0.05f);
+
+struct LodSettings {
+  /// Largest allowed error of a level projected onto the screen, in pixels. 0 always draws the full detail.
+  float max_pixel_error = 1.f;
+  /// Part of the threshold a coarser level must stay below before it replaces the current one, so a camera
+  /// resting at a switching distance does not flip between two levels every frame
+  float hysteresis = 0.2f;
+};
+
+/// Pixels per object space unit at distance 1, for a perspective projection with the given vertical field of
+/// view (radians) and viewport height
+float lod_projection_scale(float fovy, float viewport_height);
+
+/// Distance from the point to the box, 0 inside of it
+float distance_to_bounds(const glm::vec3 &point, const glm::vec3 &bounds_min, const glm::vec3 &bounds_max);
+
+/// Picks the coarsest level whose error projects to at most 'max_pixel_error' pixels at the given distance.
+/// 'errors' are the object space errors of all levels, the full detail (error 0) included. 'current' is the
+/// level drawn so far, coarser levels than it have to pass the threshold reduced by the hysteresis.
+size_t select_lod(const std::vector<float> &errors, size_t current, float distance, float projection_scale,
+                  const LodSettings &settings);
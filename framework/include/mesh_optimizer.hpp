@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mesh_data.hpp"
+
+/// Post-transform cache efficiency of a triangle list, simulated with a FIFO cache
+struct VertexCacheStats {
+  size_t vertices_transformed = 0;
+  /// Average cache miss ratio, transformed vertices per triangle (0.5 is ideal for regular grids, 3 is worst)
+  float acmr = 0.f;
+  /// Average transformed vertex ratio, transformed vertices per unique vertex (1 is ideal)
+  float atvr = 0.f;
+};
+
+/// Pixel work of a triangle list measured with a CPU rasterizer from the six axis directions
+struct OverdrawStats {
+  size_t pixels_covered = 0;
+  size_t pixels_shaded = 0;
+  /// Shaded fragments per covered pixel (1 is ideal)
+  float overdraw = 0.f;
+};
+
+/// Vertex buffer traffic simulated with a small cache of 64-byte lines, as if the attributes were interleaved
+struct VertexFetchStats {
+  size_t bytes_fetched = 0;
+  /// Fetched bytes per byte of the vertex buffers (1 is ideal)
+  float overfetch = 0.f;
+};
+
+struct MeshStats {
+  VertexCacheStats vertex_cache;
+  OverdrawStats overdraw;
+  VertexFetchStats vertex_fetch;
+};
+
+VertexCacheStats analyze_vertex_cache(const uint32_t *indices, size_t index_count, size_t vertex_count,
+                                      size_t cache_size = 32);
+
+/// Positions are 3 floats per vertex. 'resolution' is the size of the square framebuffer of every view.
+OverdrawStats analyze_overdraw(const uint32_t *indices, size_t index_count, const float *positions,
+                               size_t vertex_count, int resolution = 256);
+
+/// 'vertex_size' is the size of all attributes of one vertex in bytes
+VertexFetchStats analyze_vertex_fetch(const uint32_t *indices, size_t index_count, size_t vertex_count,
+                                      size_t vertex_size);
+
+/// Statistics of all submeshes of the data together
+MeshStats analyze_mesh(const MeshData &data);
+
+/// Reorders triangles so recently transformed vertices are reused (Forsyth, "Linear-Speed Vertex Cache
+/// Optimisation"). Indices are rewritten in place.
+void optimize_vertex_cache(uint32_t *indices, size_t index_count, size_t vertex_count);
+
+/// Reorders the triangles of a cache optimized list so outward facing parts are drawn first (Sander et al.,
+/// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"). The list is split into clusters where
+/// the cache restarts, clusters are then sorted by how much they face away from the mesh center. 'threshold'
+/// is the allowed ACMR loss of the clusters, e.g. 1.05 for 5 %.
+void optimize_overdraw(uint32_t *indices, size_t index_count, const float *positions, size_t vertex_count,
+                       float threshold = 1.05f);
+
+/// Reorders the vertices of every submesh into the order of their first use, so the vertex buffers are read
+/// linearly. Indices are remapped accordingly.
+void optimize_vertex_fetch(MeshData *data);
+
+/// Runs the vertex cache, overdraw and vertex fetch steps on every submesh (or the whole mesh without them). A
+/// submesh keeps its vertex cache order when the overdraw step does not reduce its overdraw. The shape table is
+/// rebuilt for the new triangle order.
+/// When 'steps' is given, it receives the statistics of the input followed by the statistics after each step.
+void optimize_mesh(MeshData *data, std::vector<MeshStats> *steps = nullptr);
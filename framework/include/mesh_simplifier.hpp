@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// Simplifies a triangle list with edge collapses ordered by quadric error (Garland and Heckbert, "Surface
+/// Simplification Using Quadric Error Metrics"). A position only collapses onto one of its neighbours, so the
+/// vertex buffers stay as they are and only new indices are written.
+///
+/// The cost of a collapse is the squared distance to the planes of the original triangles around the removed
+/// position plus the squared change of normals and texture coordinates. Vertices split by a seam move together,
+/// each side onto the vertex of the target on the same side, so seams stay closed. Positions on borders and on
+/// non-manifold edges never move, which keeps the silhouette of open meshes intact.
+///
+/// Positions are 3 floats per vertex, normals and texture coordinates may be nullptr. Writes at most
+/// 'index_count' indices into 'destination' and returns how many were written. Simplification stops at
+/// 'target_index_count' or when the cost of the next collapse would exceed 'target_error' (object space distance,
+/// attribute changes included). 'result_error' receives the largest geometric error of the performed collapses.
+size_t simplify_mesh(uint32_t *destination, const uint32_t *indices, size_t index_count, const float *positions,
+                     const float *normals, const float *tex_coords, size_t vertex_count, size_t target_index_count,
+                     float target_error, float *result_error = nullptr);
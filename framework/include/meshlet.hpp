@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.hpp"
+
+/// Splits the full detail triangles of every submesh into meshlets of at most 'max_vertices' distinct vertices
+/// and 'max_triangles' triangles. Triangles are taken in index buffer order, which is already spatially coherent
+/// after optimize_mesh, so no reordering is needed and the meshlets stay drawable from the index buffer.
+std::vector<Meshlet> build_meshlets(const MeshData &data, size_t max_vertices = 64, size_t max_triangles = 124);
+
+struct MeshletCullSettings {
+  /// Rejects meshlets outside of the view frustum
+  bool frustum = true;
+  /// Rejects meshlets whose normal cone faces away from the eye. Only valid for meshes drawn without back faces,
+  /// i.e. closed opaque surfaces.
+  bool backface = true;
+  /// Tests four meshlets at once with SSE2 where it is available, the scalar path gives the same results
+  bool simd = true;
+};
+
+struct MeshletCullStats {
+  size_t meshlets = 0;
+  size_t triangles = 0;
+  size_t visible_meshlets = 0;
+  size_t visible_triangles = 0;
+};
+
+/// Culls meshlets on the CPU. The bounds are kept as a structure of arrays, so one pass tests four meshlets.
+/// Positions are in the space of the mesh, the view projection matrix has to include the model matrix.
+class MeshletCuller {
+public:
+  explicit MeshletCuller(const std::vector<Meshlet> &meshlets);
+
+  /// Replaces 'visible' with the indices of the meshlets that may be visible, in increasing order
+  MeshletCullStats cull(const glm::mat4 &view_projection, const glm::vec3 &eye, const MeshletCullSettings &settings,
+                        std::vector<uint32_t> *visible) const;
+
+  size_t size() const { return this->count; }
+
+private:
+  size_t count = 0;
+  /// Padded to a multiple of four
+  std::vector<float> center_x, center_y, center_z, radius;
+  std::vector<float> axis_x, axis_y, axis_z, cutoff;
+  std::vector<uint32_t> triangle_counts;
+  size_t total_triangles = 0;
+};
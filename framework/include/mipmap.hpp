@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "texture.hpp"
+#include "thread_pool.hpp"
+
+enum class MipFilter {
+  /// Average of the 2x2 texels below each mip texel, what glGenerateMipmap usually does
+  Box,
+  /// Lanczos windowed sinc with three lobes, keeps distant levels sharper at the cost of slight ringing
+  Lanczos,
+};
+
+struct MipSettings {
+  MipFilter filter = MipFilter::Lanczos;
+  /// The color channels are sRGB encoded and filtered in linear light, so the levels do not darken
+  bool srgb = true;
+  /// Colors are weighted by alpha while filtering, so transparent texels do not bleed into their neighbours
+  bool premultiplied_alpha = true;
+  /// Use the SSE2 kernels where they are available, the scalar ones are the reference
+  bool simd = true;
+};
+
+/// Identifies the settings in caches of generated levels, changes whenever the generated levels would
+uint32_t mip_settings_key(const MipSettings &settings);
+
+/// Halves the image with the filter of the settings. Odd sizes round down and the filter footprint is scaled to
+/// match. Both filter passes spread their rows over the pool.
+Image downsample_image(const Image &image, const MipSettings &settings = MipSettings(),
+                       ThreadPool &pool = ThreadPool::shared());
+
+/// Mip levels 1 to 1x1 of the image, level 0 is the image itself and not part of the result. Every level is
+/// filtered from the one above it at float precision and only rounded to 8 bits for the result.
+std::vector<Image> generate_mipmaps(const Image &image, const MipSettings &settings = MipSettings(),
+                                    ThreadPool &pool = ThreadPool::shared());
+
+struct CubemapMipSettings {
+  MipSettings mip;
+  /// Levels below the first hold the environment convolved with the GGX lobe of roughness
+  /// level / (level count - 1), for glossy reflections that pick the level by roughness. Without it the levels are
+  /// the plain filtered faces, what a mirror needs against aliasing.
+  bool prefilter = false;
+  /// Directions of the GGX lobe sampled per texel of a prefiltered level
+  int prefilter_samples = 64;
+};
+
+/// Identifies the settings in caches of generated cubemap levels, changes whenever the generated levels would
+uint32_t cubemap_mip_settings_key(const CubemapMipSettings &settings);
+
+/// Mip levels 1 to 1x1 of the six faces of a cubemap, square RGBA images of one size in the order of the cube map
+/// targets (+X, -X, +Y, -Y, +Z, -Z). Returns the levels of every face, level 0 is the face itself and not part of
+/// the result.
+/// Every face level is filtered from the one above like generate_mipmaps does, the faces concurrently on the pool.
+/// The filter clamps at the face edges, so the texels along each edge are then averaged with the ones across it on
+/// the neighbouring face (and the corner texels with those of both other faces at the corner): both sides of an
+/// edge match and the cube has no seams at a distance. Prefiltered levels sample these seamless levels with
+/// filtered importance sampling, the rows of all faces spread over the pool.
+std::vector<std::vector<Image>> generate_cubemap_mipmaps(const std::vector<Image> &faces,
+                                                         const CubemapMipSettings &settings = CubemapMipSettings(),
+                                                         ThreadPool &pool = ThreadPool::shared());
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "tiny_obj_loader.h"
+
+/// Drop-in replacement for tinyobj::LoadObj (with triangulation) for big OBJ files.
+///
+/// The file is memory mapped and split at line boundaries into chunks. The 'v', 'vn', 'vt' and 'f' lines of
+/// every chunk are parsed in parallel on the given pool, then the per-chunk results are merged in file order,
+/// which is also where 'o', 'g', 'usemtl' and 'mtllib' are applied. The produced attrib/shape/material data
+/// is the same as tinyobj::LoadObj gives for the same file ('t' subdivision tags are ignored).
+///
+/// 'chunk_count' of 0 picks a count based on the file size and the pool size.
+/// The paths of the .mtl files that were read are appended to 'material_files' when given.
+bool load_obj(tinyobj::attrib_t *attrib, std::vector<tinyobj::shape_t> *shapes,
+              std::vector<tinyobj::material_t> *materials, std::string *err, const std::string &file_name,
+              const std::string &mtl_base_dir = "", ThreadPool &pool = ThreadPool::shared(), size_t chunk_count = 0,
+              std::vector<std::string> *material_files = nullptr);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+
+#include "texture.hpp"
+
+/// What the 4-byte pixels of an image hold
+struct PixelContent {
+  /// Red, green and blue are equal in every pixel
+  bool gray = true;
+  /// Alpha is 255 in every pixel
+  bool opaque = true;
+};
+
+/// Bytes of a pixel of the 8-bit format: GL_RED, GL_RG, GL_RGB, GL_BGR, GL_RGBA or GL_BGRA
+size_t channel_count(GLenum pixel_format);
+/// Sized internal format of textures uploaded from pixels in the format, e.g. GL_RGB8 for GL_RGB and GL_BGR
+GLenum internal_format_for(GLenum pixel_format);
+/// Sets the swizzle of the texture bound to the target, so shaders read every format as RGBA: GL_RED as gray
+/// (r, r, r, 1) and GL_RG as gray with alpha (r, r, r, g). The other formats read as they are.
+void set_texture_swizzle(GLenum target, GLenum pixel_format);
+
+/// Scans RGBA or BGRA pixels
+PixelContent classify_pixels(const uint8_t *pixels, size_t pixel_count, bool simd = true);
+/// Smallest format that holds 4-byte pixels in 'pixel_format' (GL_RGBA or GL_BGRA) with the content exactly:
+/// GL_RED when gray and opaque, GL_RG when gray with alpha (masks), GL_RGB or GL_BGR when opaque, otherwise
+/// 'pixel_format' itself
+GLenum packed_pixel_format(const PixelContent &content, GLenum pixel_format = GL_RGBA);
+
+/// Packs 4-byte pixels into a format of packed_pixel_format: GL_RED keeps the first channel, GL_RG the first
+/// one and alpha, GL_RGB and GL_BGR the first three. 'destination' takes pixel_count * channel_count(format)
+/// bytes.
+void pack_pixels(const uint8_t *pixels, size_t pixel_count, GLenum format, uint8_t *destination,
+                 bool simd = true);
+/// Expands pixels of 1 to 4 channels as image files hold them (gray, gray and alpha, RGB, RGBA) to RGBA,
+/// missing alpha is 255
+void expand_to_rgba(const uint8_t *source, int channels, size_t pixel_count, uint8_t *rgba, bool simd = true);
+/// Swaps red and blue of 4-byte pixels in place, RGBA to BGRA and back
+void swap_red_blue(uint8_t *pixels, size_t pixel_count, bool simd = true);
+/// Multiplies the colors of RGBA or BGRA pixels by their alpha in place, rounded to the nearest byte
+void premultiply_alpha(uint8_t *pixels, size_t pixel_count, bool simd = true);
+
+/// The image with its uncompressed pixels or levels (GL_RGBA or GL_BGRA) in the smallest format that holds all
+/// of them exactly, see classify_pixels and packed_pixel_format. Block compressed images and colored ones with
+/// varying alpha stay as they are. The uploads set the swizzle of the format, so shaders see no difference.
+Image pack_channels(Image image, bool simd = true);
+/// Packs the faces of a cubemap into the one format that holds all of them, as the faces of a cube need the
+/// same internal format
+std::vector<Image> pack_cubemap_channels(std::vector<Image> faces, bool simd = true);
@@ -17,6 +17,8 @@ public:
 
   GLint get_attribute_location(const std::string &attribute_name);
   GLint get_uniform_location(const std::string &uniform_name);
+  /// Makes the uniform block read from the buffer bound to 'binding', returns false when there is no such block
+  bool bind_uniform_block(const std::string &block_name, GLuint binding);
 
   void use();
 
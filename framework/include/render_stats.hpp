@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+
+/// Counters of the GL work issued during one frame
+struct RenderStats {
+  size_t draw_calls = 0;
+  size_t program_changes = 0;
+  size_t vao_changes = 0;
+  size_t texture_changes = 0;
+  size_t uniform_calls = 0;
+  /// glBufferSubData calls of the uniform buffers and the bytes they sent
+  size_t buffer_updates = 0;
+  size_t buffer_update_bytes = 0;
+  size_t triangles = 0;
+  /// Triangles of the meshes with meshlet culling and how many of them the culling rejected
+  size_t meshlet_triangles = 0;
+  size_t meshlet_triangles_culled = 0;
+  /// CPU time of issuing the frame, from the end of the uploads to the last draw
+  double cpu_milliseconds = 0.0;
+
+  /// GL calls of the counters above
+  size_t gl_calls() const {
+    return this->draw_calls + this->program_changes + this->vao_changes + this->texture_changes +
+           this->uniform_calls + this->buffer_updates;
+  }
+
+  void reset() { *this = RenderStats(); }
+};
+
+/// Statistics of the frame being rendered, filled by Mesh, ShaderProgram, UniformBuffer and bind_texture
+RenderStats &render_stats();
+
+std::ostream &operator<<(std::ostream &out, const RenderStats &stats);
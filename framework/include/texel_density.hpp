@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.hpp"
+
+/// How densely the texture coordinates of a submesh cover its surface, and where the surface is
+struct TexelDensity {
+  /// Axis aligned bounding box of the vertices of the submesh
+  glm::vec3 bounds_min = glm::vec3(0.f);
+  glm::vec3 bounds_max = glm::vec3(0.f);
+  /// Texture coordinate units per object space unit, averaged over the area of the triangles. 0 without texture
+  /// coordinates.
+  float uv_per_unit = 0.f;
+};
+
+/// The density of every submesh of the view, or of the whole index buffer when there are no submeshes.
+/// Does not touch OpenGL.
+std::vector<TexelDensity> compute_texel_densities(const MeshView &view, const std::vector<Submesh> &submeshes);
+
+/// Texture coordinate units one pixel covers at the nearest point of the bounds as seen from 'eye', so a texture
+/// of N texels across needs the mip level log2(N * uv_per_pixel). 'projection_scale' comes from
+/// lod_projection_scale. 0 inside the bounds, where the full resolution can be visible.
+float uv_per_pixel(const TexelDensity &density, const glm::vec3 &eye, float projection_scale);
@@ -1,7 +1,20 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// S3TC formats of GL_EXT_texture_compression_s3tc, which the generated GL loader does not include
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
 
 const GLenum cubemap_sides[6] = {
     GL_TEXTURE_CUBE_MAP_POSITIVE_X,
@@ -12,5 +25,129 @@ const GLenum cubemap_sides[6] = {
     GL_TEXTURE_CUBE_MAP_NEGATIVE_Z,
 };
 
+/// Takes the image from a texture container next to it when there is one (see decode_image). Uncompressed images
+/// are uploaded with only the channels they use (see pack_channels).
+/// Textures are shared through TextureCache::shared(): loading a file again returns the same texture, and every
+/// load hands out a reference to release with TextureCache::release once the texture is no longer used.
 GLuint load_texture_2d(const std::string& filename);
+/// Takes the faces from a cubemap container when there is one, otherwise they are decoded concurrently
+/// (see decode_cubemap). Shared like load_texture_2d.
 GLuint load_texture_cubemap(std::string filenames[6]);
+
+/// Mip level stored outside of Image::pixels, e.g. in a mapped texture container
+struct ImageLevel {
+  int width;
+  int height;
+  const unsigned char *data;
+  size_t size;
+};
+
+/// Decoded image in memory, RGBA unless packed (see pack_channels). Decoding does not touch OpenGL, so it can run
+/// on any thread.
+struct Image {
+  int width = 0;
+  int height = 0;
+  /// 8-bit pixels in 'pixel_format'
+  std::vector<unsigned char> pixels;
+
+  /// Complete mip chain, uploaded level by level instead of 'pixels' when not empty. The levels are block
+  /// compressed when 'compressed_format' is set, otherwise 8-bit pixels in 'pixel_format' (GL_RGBA or GL_BGRA,
+  /// or one with fewer channels once packed). They point into 'storage', a mapped DdsFile, the blocks of a fresh
+  /// encode or the packed levels.
+  std::vector<ImageLevel> levels;
+  GLenum compressed_format = 0;
+  GLenum pixel_format = GL_RGBA;
+  std::shared_ptr<const void> storage;
+
+  bool empty() const { return pixels.empty() && levels.empty(); }
+  /// Bytes of the pixels or of all levels
+  size_t byte_size() const;
+  /// Video memory of the uploaded texture: all levels, or the pixels and the levels glGenerateMipmap adds
+  size_t texture_memory() const;
+  /// Bytes of every level, empty without levels
+  std::vector<size_t> level_sizes() const;
+};
+
+/// Decodes the file into 4 channels, the image is empty (and a message printed) when it could not be read.
+/// The common PNG and TGA files go through decode_image_fast, anything else through stb_image.
+///
+/// With 'use_container' the image comes from a DDS file next to it instead when there is one (see
+/// DdsFile::open_for), mapped and with all of its mip levels. Block compressed files are only taken with texture
+/// compression on. A missing or stale file is built from the image and written to '<file>.dds' for the next run:
+/// the mip levels come from generate_mipmaps, and with texture compression on they are encoded to BC1, or to
+/// BC3 when the image has transparent pixels. Without compression they are packed into the channels the image
+/// uses (see pack_channels), so the levels are uploaded straight from the mapping on the next run.
+/// The file is keyed by the content hash of the image and texture_load_parameters().
+Image decode_image(const std::string &filename, bool use_container = false);
+
+/// Reads only the size from the header of the image file, false when it cannot be read
+bool read_image_size(const std::string &filename, int *width, int *height);
+
+/// Turns the block compressed path of decode_image on or off. Turning it on checks that the driver supports the
+/// S3TC formats, so it must run on the thread of the GL context. Returns whether compression is on.
+bool set_texture_compression(bool enabled);
+bool get_texture_compression();
+/// Identifies how files become textures with the current settings (mip generation and compression), part of the
+/// TextureCache keys of the loaders
+uint32_t texture_load_parameters();
+/// Turns the roughness prefilter of the cubemap levels on or off, see CubemapMipSettings::prefilter. The skybox
+/// is drawn from level 0 and keeps its look, reflections that sample lower levels turn glossy.
+void set_cubemap_prefilter(bool enabled);
+bool get_cubemap_prefilter();
+/// texture_load_parameters of cubemaps, which also cover the cubemap settings
+uint32_t cubemap_load_parameters();
+
+/// Cost of decoding one image
+struct ImageDecodeStats {
+  std::string filename;
+  double decode_milliseconds = 0.0;
+  /// Size of the file and of the decoded pixels or levels
+  size_t file_bytes = 0;
+  size_t decoded_bytes = 0;
+};
+
+/// Decodes all files concurrently on the pool, the images are returned in the order of the names.
+/// 'stats' receives one entry per file in the same order when given.
+std::vector<Image> decode_images(const std::vector<std::string> &filenames, ThreadPool &pool = ThreadPool::shared(),
+                                 std::vector<ImageDecodeStats> *stats = nullptr, bool use_container = false);
+
+/// The six faces of a cubemap. They come from the cubemap container of the faces when there is one (see
+/// DdsFile::open_for_cubemap), mapped and with all of their mip levels. Otherwise the face images are decoded
+/// concurrently with decode_images and, when they are squares of one size, the container is built from them as
+/// decode_image builds that of an image, with the seamless levels of generate_cubemap_mipmaps and keyed by
+/// cubemap_load_parameters(). Faces that make no cube are returned as decoded, without levels.
+std::vector<Image> decode_cubemap(const std::vector<std::string> &filenames, ThreadPool &pool = ThreadPool::shared(),
+                                  std::vector<ImageDecodeStats> *stats = nullptr);
+
+/// Batch version of load_texture_2d: decodes the files that are not cached concurrently, then uploads them in
+/// order on the calling thread. Returns the textures in the order of the names, one reference for every name.
+/// Containers are used as in load_texture_2d.
+std::vector<GLuint> load_textures_2d(const std::vector<std::string> &filenames,
+                                     ThreadPool &pool = ThreadPool::shared(),
+                                     std::vector<ImageDecodeStats> *stats = nullptr);
+
+/// Uploads the image with mipmaps into the texture, a new one is created when 'texture_id' is 0. Uploading into
+/// an existing texture replaces its image, so everything referring to it (e.g. a placeholder) shows the new one.
+/// Images with levels upload them straight from their storage, the others get theirs from glGenerateMipmap.
+/// The internal format follows the pixel format of the image (see internal_format_for and set_texture_swizzle).
+/// Cubemap faces are only mipmapped when all of them bring their levels.
+/// Images with levels can leave out the largest ones: only the levels from 'first_level' on are uploaded and it
+/// becomes the base level (GL_TEXTURE_BASE_LEVEL), the levels above take no memory (see TextureResidency).
+/// Binds the texture to the active unit.
+GLuint upload_texture_2d(const Image &image, GLuint texture_id = 0, size_t first_level = 0);
+/// Uploads the levels [first_level, end_level) of the image into a texture uploaded from it before, which keeps
+/// its other levels, and makes 'first_level' the base level. Binds the texture to the active unit.
+void upload_texture_levels_2d(const Image &image, GLuint texture_id, size_t first_level, size_t end_level);
+/// Raises the base level of a texture with levels from 'old_base_level' to 'base_level' and frees the levels
+/// in between. Binds the texture to the active unit.
+void drop_texture_levels_2d(GLuint texture_id, size_t old_base_level, size_t base_level);
+GLuint upload_texture_cubemap(const Image images[6], GLuint texture_id = 0);
+
+/// 1x1 textures of a single color shown until the real image is uploaded into them
+GLuint create_placeholder_texture_2d(const unsigned char color[4]);
+GLuint create_placeholder_texture_cubemap(const unsigned char color[4]);
+
+/// Binds the texture to the given unit unless it is bound there already. The bindings are only tracked, so
+/// call reset_texture_bindings() whenever textures were bound by other means (e.g. at the start of a frame).
+void bind_texture(GLuint unit, GLenum target, GLuint texture_id);
+void reset_texture_bindings();
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "texture.hpp"
+
+/// Place of an image packed into a texture array: a layer and the part of it the image covers
+struct PackedTexture {
+  /// Index of the array in the result of pack_texture_arrays
+  size_t array = 0;
+  int layer = 0;
+  /// Texture coordinates in [0, 1] of the image map to 'offset + coordinate * scale' in the layer
+  glm::vec2 offset = glm::vec2(0.f);
+  glm::vec2 scale = glm::vec2(1.f);
+};
+
+/// All layers of one 2D texture array with their mip levels, built on the CPU
+struct TextureArrayImage {
+  int width = 0;
+  int height = 0;
+  int layers = 0;
+  /// Block compressed format, or 0 for 8-bit RGBA
+  GLenum compressed_format = 0;
+  /// Largest level first, each holds all layers one after another
+  std::vector<std::vector<unsigned char>> levels;
+};
+
+/// Packs the images into as few texture arrays as possible, so draws of different images need no other binding.
+/// There is one array per format and its layers are as large as the largest image of that format. Images of
+/// the layer size fill a layer, smaller ones share layers as an atlas, placed on shelves sorted by height.
+///
+/// Every image keeps its own mip levels (generated when it has none), so atlas neighbours never bleed into each
+/// other through the mips. An array only gets the levels at which all of its images still start on a texel,
+/// or block for compressed formats. 'placements' receives the place of every image in the order of the images,
+/// layer -1 for empty ones.
+/// Does not touch OpenGL, so it can run on any thread.
+std::vector<TextureArrayImage> pack_texture_arrays(const std::vector<Image> &images,
+                                                   std::vector<PackedTexture> *placements);
+
+/// Creates the array texture with the levels of the image from 'first_level' on, which becomes the base level
+/// (GL_TEXTURE_BASE_LEVEL) as in upload_texture_2d. Sampling outside the packed images is clamped, atlas images
+/// have to wrap their coordinates in the shader. Binds the texture to the active unit.
+GLuint upload_texture_array(const TextureArrayImage &image, size_t first_level = 0);
+/// Uploads the levels [first_level, end_level) of the image into an array uploaded from it before, which keeps
+/// its other levels, and makes 'first_level' the base level. Binds the texture to the active unit.
+void upload_texture_array_levels(const TextureArrayImage &image, GLuint texture_id, size_t first_level,
+                                 size_t end_level);
+/// Raises the base level of an array from 'old_base_level' to 'base_level' and frees the levels in between.
+/// Binds the texture to the active unit.
+void drop_texture_array_levels(GLuint texture_id, size_t old_base_level, size_t base_level);
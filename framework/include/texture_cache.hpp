@@ -0,0 +1,94 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Counters of a TextureCache
+struct TextureCacheStats {
+  size_t textures = 0;
+  size_t referenced_textures = 0;
+  /// Video memory of all cached textures and of the referenced ones, in bytes
+  size_t memory = 0;
+  size_t referenced_memory = 0;
+  size_t memory_limit = 0;
+  size_t peak_memory = 0;
+  /// Loads served by a cached texture, loads that created one, and textures deleted for the limit
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t evictions = 0;
+};
+
+std::ostream &operator<<(std::ostream &out, const TextureCacheStats &stats);
+
+/// Reference counted GL textures by the files and parameters they were loaded with, so every image is loaded
+/// once no matter how many meshes, materials or scenes use it.
+///
+/// A load either acquires the cached texture or creates one and inserts it, both hand a reference to the caller,
+/// which releases it once it no longer draws with the texture. Unreferenced textures stay cached for later loads
+/// until the memory limit needs their space, then they are deleted in the order they were released.
+/// Referenced textures are never deleted, so a scene larger than the limit still loads; the stats show it.
+///
+/// The cache creates and deletes GL objects, so it must only be used on the thread of the GL context. Textures
+/// still cached when it is destroyed are left to the context, the shared cache outlives it.
+class TextureCache {
+public:
+  /// Starts with a limit of 'default_memory_limit'. Evicted textures are untracked from TextureResidency::shared()
+  /// and deleted.
+  TextureCache();
+  /// Hands every evicted texture to 'delete_texture' instead, e.g. to keep the bookkeeping away from OpenGL
+  explicit TextureCache(std::function<void(GLuint)> delete_texture);
+  TextureCache(const TextureCache &) = delete;
+  TextureCache &operator=(const TextureCache &) = delete;
+
+  static const size_t default_memory_limit = size_t(512) << 20;
+
+  /// The cache of load_texture_2d, load_texture_cubemap, Mesh::from_file and AssetLoader
+  static TextureCache &shared();
+
+  /// Key of a texture: the target, the load parameters and the canonical paths of its files
+  static std::string key(GLenum target, const std::vector<std::string> &file_names, uint32_t parameters);
+
+  /// Returns the texture of the key with a new reference, or 0 when it is not cached
+  GLuint acquire(const std::string &key);
+  /// Adds a texture created for the key with one reference. 'memory' is its size in bytes of video memory.
+  void insert(const std::string &key, GLuint texture_id, size_t memory);
+  /// Updates the size of a cached texture, e.g. once the image was uploaded into its placeholder
+  void set_memory(GLuint texture_id, size_t memory);
+
+  /// Adds or drops a reference. Textures that are not cached (e.g. created by other means) are ignored.
+  void retain(GLuint texture_id);
+  void release(GLuint texture_id);
+
+  /// Limit of the video memory of all cached textures in bytes, 0 for none
+  void set_memory_limit(size_t bytes);
+  /// Deletes every unreferenced texture
+  void trim();
+
+  TextureCacheStats get_stats() const;
+
+private:
+  struct Entry {
+    std::string key;
+    size_t references = 0;
+    size_t memory = 0;
+    /// When the last reference was dropped, the oldest unreferenced texture is deleted first
+    uint64_t release_order = 0;
+  };
+
+  void enforce_limit();
+  /// Deletes unreferenced textures until the memory fits 'limit'
+  void evict(size_t limit);
+  void erase(GLuint texture_id);
+
+  std::unordered_map<std::string, GLuint> textures_by_key;
+  std::unordered_map<GLuint, Entry> entries;
+  uint64_t releases = 0;
+  TextureCacheStats stats;
+  std::function<void(GLuint)> delete_texture;
+};
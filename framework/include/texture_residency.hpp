@@ -0,0 +1,195 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "texture.hpp"
+#include "texture_array.hpp"
+#include "thread_pool.hpp"
+
+/// Counters of a TextureResidency
+struct TextureResidencyStats {
+  size_t textures = 0;
+  /// Video memory of the tracked textures as they are, and with all of their levels
+  size_t memory = 0;
+  size_t full_memory = 0;
+  /// Part of the memory in textures whose levels are not managed, see TextureResidency::track_fixed
+  size_t fixed_memory = 0;
+  /// Host memory of the packed images kept for the texture arrays, see TextureResidency::track_array
+  size_t array_image_memory = 0;
+  size_t budget = 0;
+  /// Levels left out of the tracked textures right now
+  size_t dropped_levels = 0;
+  /// Times levels were freed and times they were streamed in again
+  size_t drops = 0;
+  size_t reloads = 0;
+  size_t upload_bytes = 0;
+  /// Frames that ended over the budget because every texture above its smallest levels was used in them
+  size_t frames_over_budget = 0;
+};
+
+std::ostream &operator<<(std::ostream &out, const TextureResidencyStats &stats);
+
+/// Resident size of one tracked texture
+struct TextureResidencyEntry {
+  GLuint texture_id = 0;
+  std::string file_name;
+  size_t memory = 0;
+  size_t full_memory = 0;
+  /// Base level of the texture, the levels above it are not resident
+  size_t dropped_levels = 0;
+  /// Base level the texture was last used with
+  size_t needed_levels = 0;
+  /// Base level of the last plan, update() brings 'dropped_levels' there
+  size_t planned_levels = 0;
+  /// Frame the texture was last bound or requested in, 0 when it never was
+  uint64_t last_used_frame = 0;
+  /// Counted with a fixed size, see TextureResidency::track_fixed
+  bool fixed = false;
+};
+
+/// Decides which mip levels of the 2D textures of files are resident, by the screen size they are drawn at and a
+/// budget of video memory.
+///
+/// The loaders track every texture they upload with its levels, bind_texture() marks the textures bound in a
+/// frame and request() tells the level a draw needs. A texture bound without a request needs all of its levels.
+/// At the end of a frame update() plans the base level (GL_TEXTURE_BASE_LEVEL) of every texture:
+///  - the finest level it needed within the last 'keep_frames' frames, so levels are not dropped and streamed
+///    again while the camera moves back and forth;
+///  - then, while the total is over the budget, the largest levels of the least recently used textures, never
+///    below their 'kept_levels' smallest levels and never for a texture used in the frame.
+/// Raising the base level frees the levels above at once. Lowering it loads the image from the texture container
+/// on the pool (see decode_image) and uploads only the missing levels, the texture draws with the levels it has
+/// until then.
+///
+/// With streaming on the loaders upload only the 'kept_levels' smallest levels, so loading finishes sooner, and
+/// the finer ones come with the requests.
+///
+/// Texture arrays take part like the 2D textures (see track_array). Binding an array or requesting a level of it
+/// counts for all of its layers, so its base level is the finest one any of the packed images needs. Its levels
+/// come back from the packed image kept in host memory (counted in 'array_image_memory' of the stats), without
+/// decoding the files again.
+///
+/// The other textures of the frame (cube maps, video planes, the pages of virtual textures) are tracked with
+/// their fixed sizes. They keep all of their levels but count against the budget, which the 2D
+/// textures then share with less memory.
+///
+/// When the textures used in a frame need more than the budget, the others are reduced as far as possible and
+/// the budget is exceeded; the stats count those frames.
+///
+/// Uploads happen on the thread of the GL context, like those of TextureCache, which is told the new sizes.
+class TextureResidency {
+public:
+  TextureResidency() = default;
+  TextureResidency(const TextureResidency &) = delete;
+  TextureResidency &operator=(const TextureResidency &) = delete;
+
+  /// Smallest levels no texture loses, down to 64 texels across
+  static const size_t kept_levels = 7;
+  /// Frames a texture keeps levels finer than it needs
+  static const uint64_t keep_frames = 120;
+
+  /// The manager of the textures of the loaders and bind_texture
+  static TextureResidency &shared();
+
+  /// Turns the upload of only the smallest levels by the loaders on or off
+  void set_streaming(bool enabled) { this->streaming = enabled; }
+  bool get_streaming() const { return this->streaming; }
+  /// First level a loader uploads of an image with the levels, any thread
+  size_t first_streamed_level(size_t level_count) const;
+
+  /// Tracks a texture uploaded from the file with levels of the sizes, from 'dropped_levels' on. Textures without
+  /// levels are ignored.
+  void track(GLuint texture_id, const std::string &file_name, const std::vector<size_t> &level_sizes,
+             size_t dropped_levels = 0);
+  /// Tracks a texture array uploaded from the image from 'dropped_levels' on. The image stays alive with the
+  /// entry, dropped levels are uploaded again from it.
+  void track_array(GLuint texture_id, const std::string &name, std::shared_ptr<const TextureArrayImage> image,
+                   size_t dropped_levels = 0);
+  /// Tracks a texture whose levels are not managed here with its video memory, so the budget and the report
+  /// cover it. Tracking it again changes its size.
+  void track_fixed(GLuint texture_id, const std::string &name, size_t bytes);
+  /// Forgets the texture, e.g. once it is deleted
+  void untrack(GLuint texture_id);
+  /// Marks the texture as bound in this frame
+  void touch(GLuint texture_id);
+  /// Asks for the level a draw of the texture needs in this frame, from the texture coordinate units a pixel
+  /// covers (see Mesh::uv_per_pixel). The finest request of a frame counts. For a texture array the coordinates
+  /// are those of its layers, scaled by the part of the layer a packed image covers.
+  void request(GLuint texture_id, float uv_per_pixel);
+  /// Coarsest level whose texels still cover at most a pixel, for a texture of the levels. Level 0 is taken to
+  /// be 2^(level_count - 1) texels across, as the chains end at 1x1. The 'kept_levels' smallest levels stay.
+  static size_t needed_level(size_t level_count, float uv_per_pixel);
+
+  /// Budget of the video memory of the tracked textures in bytes, 0 for none
+  void set_budget(size_t bytes);
+
+  /// Uploads the levels of at most 'max_uploads' textures whose images are ready, plans the levels of every
+  /// texture for the frame that ends, frees the levels no longer planned and starts loading the missing ones.
+  /// Binds textures to the active unit, so it belongs before the tracked bindings are reset.
+  void update(size_t max_uploads = 2, ThreadPool &pool = ThreadPool::shared());
+  /// Only plans the levels of every texture for the frame that ends and starts the next frame, without touching
+  /// OpenGL. The plan shows in the report and is carried out by the next update().
+  void end_frame();
+
+  /// The tracked textures, largest first
+  std::vector<TextureResidencyEntry> get_report() const;
+  TextureResidencyStats get_stats() const;
+
+private:
+  struct Entry {
+    std::string file_name;
+    std::vector<size_t> level_sizes;
+    /// Base level now, in the plan, and the finest one needed lately with the frame it was last needed in
+    size_t dropped_levels = 0;
+    size_t planned_levels = 0;
+    size_t needed_levels = 0;
+    uint64_t needed_frame = 0;
+    /// Finest level requested in 'requested_frame'
+    size_t requested_levels = 0;
+    uint64_t requested_frame = 0;
+    uint64_t bound_frame = 0;
+    bool loading = false;
+    /// The file could not be loaded, the texture keeps the levels it has
+    bool broken = false;
+    /// Tells a texture from a later one with the same name
+    uint64_t serial = 0;
+    /// Tracked with track_fixed, 'level_sizes' holds its whole size
+    bool fixed = false;
+    /// Tracked with track_array, the levels are uploaded from this image instead of loading the file
+    std::shared_ptr<const TextureArrayImage> array_image;
+  };
+
+  /// Image of the file being loaded to upload its levels from 'dropped_levels' on
+  struct Load {
+    GLuint texture_id;
+    uint64_t serial;
+    size_t dropped_levels;
+    std::future<Image> image;
+  };
+
+  static size_t memory(const Entry &entry, size_t dropped_levels);
+  static size_t max_dropped_levels(const Entry &entry);
+  /// Levels of the full chain of the texture down to 1x1, the packing may leave the smallest ones out of arrays
+  static size_t full_level_count(const Entry &entry);
+  static uint64_t last_used_frame(const Entry &entry);
+  /// Uploads the levels of the finished loads
+  void finish_loads(size_t max_uploads);
+  /// Plans the levels of the textures by their use and the budget
+  void plan();
+
+  std::unordered_map<GLuint, Entry> entries;
+  std::vector<Load> loads;
+  std::atomic<bool> streaming{false};
+  uint64_t frame = 1;
+  uint64_t serials = 0;
+  TextureResidencyStats stats;
+};
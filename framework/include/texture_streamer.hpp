@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "texture.hpp"
+
+/// Counters of a TextureStreamer
+struct TextureStreamStats {
+  size_t images = 0;
+  size_t bytes = 0;
+  /// Images that were too large for a buffer and went the direct way
+  size_t rejected = 0;
+  /// Times a writer had to wait until the GPU was done with a buffer
+  size_t buffer_waits = 0;
+};
+
+/// Streams images to the GPU through a ring of pixel buffer objects, so the thread of the GL context no longer
+/// copies pixels itself.
+///
+/// Worker threads copy an image with all of its levels into a free buffer with write(). The buffers are kept
+/// mapped while they are free, so that needs no GL call. The GL thread then unmaps the buffer and runs the
+/// texture uploads from it with upload(); the driver copies from the buffer asynchronously. A fence after the
+/// uploads tells when the buffer may be mapped again (orphaning its old storage), recycle() checks the fences
+/// without waiting.
+class TextureStreamer {
+public:
+  /// Creates and maps the buffers, must run on the thread of the GL context
+  explicit TextureStreamer(size_t buffer_count = 4, size_t buffer_bytes = size_t(8) << 20);
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+  /// Deletes the buffers, must run on the thread of the GL context
+  ~TextureStreamer();
+
+  /// Copies the levels of the image into a free buffer, waiting for one while all of them are in use. Levels
+  /// before 'first_level' are left out, upload() then makes it the base level (see upload_texture_2d).
+  /// Any thread. Returns the buffer for upload(), or -1 when the image has no levels, does not fit a buffer or
+  /// the streamer was shut down; such images have to be uploaded directly.
+  int write(const Image &image, size_t first_level = 0);
+
+  /// Uploads the image written to the buffer into the texture like upload_texture_2d, then fences the buffer.
+  /// Returns false when the mapping of the buffer was lost, the texture keeps its old image then. GL thread only.
+  bool upload(int buffer, GLuint texture_id);
+
+  /// Maps the buffers the GPU is done with again, so writers can use them. GL thread only.
+  void recycle();
+
+  /// Wakes writers waiting for a buffer, write() fails from then on
+  void shutdown();
+
+  TextureStreamStats get_stats();
+
+private:
+  enum class BufferState { Free, Writing, Written, InFlight };
+
+  struct Buffer {
+    GLuint id = 0;
+    BufferState state = BufferState::Free;
+    unsigned char *mapped = nullptr;
+    GLsync fence = nullptr;
+    /// The written image, its level pointers are offsets into the buffer
+    Image layout;
+    size_t first_level = 0;
+  };
+
+  /// Maps the whole buffer with its old storage orphaned
+  void map(Buffer &buffer);
+
+  const size_t buffer_bytes;
+  std::vector<Buffer> buffers;
+
+  std::mutex mutex;
+  std::condition_variable buffer_freed;
+  bool stopped = false;
+  TextureStreamStats stats;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/// Fixed-size pool of worker threads used by the loaders to spread CPU work (parsing, decoding, ...)
+/// over all cores. Tasks are executed in FIFO order.
+class ThreadPool {
+public:
+  /// Creates a pool with 'thread_count' workers; 0 means one worker per hardware thread.
+  explicit ThreadPool(size_t thread_count = 0);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool();
+
+  /// Queues a task and returns the future with its result.
+  template <typename F> std::future<typename std::result_of<F()>::type> submit(F &&task) {
+    using Result = typename std::result_of<F()>::type;
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    std::future<Result> result = packaged->get_future();
+    enqueue([packaged]() { (*packaged)(); });
+    return result;
+  }
+
+  /// Calls body(i) for every i in [0, count) and returns once all of them have finished.
+  /// The calling thread takes part in the work, so it is safe to call from inside a task of the same pool.
+  void parallel_for(size_t count, const std::function<void(size_t)> &body);
+
+  size_t size() const { return workers.size(); }
+
+  /// Pool shared by the whole framework, created on first use.
+  static ThreadPool &shared();
+
+private:
+  void enqueue(std::function<void()> task);
+  void worker_loop();
+
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool stopping = false;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/// CPU copy of a uniform block that remembers which 16-byte rows changed since they were last uploaded. Writing
+/// the bytes a row already has leaves it clean, so values that are set every frame but rarely change cost no
+/// upload.
+class UniformBlockData {
+public:
+  /// All rows start dirty, the first upload sends the whole block
+  explicit UniformBlockData(size_t size);
+
+  /// Copies 'size' bytes to 'offset', marking the rows whose bytes change
+  void write(size_t offset, const void *data, size_t size);
+  template <typename T> void write(size_t offset, const T &value) { this->write(offset, &value, sizeof(T)); }
+
+  /// Offsets and sizes of the runs of consecutive dirty rows
+  std::vector<std::pair<size_t, size_t>> get_dirty_ranges() const;
+  void clear_dirty();
+
+  const uint8_t *data() const { return this->bytes.data(); }
+  size_t size() const { return this->bytes.size(); }
+
+  static const size_t row_size = 16;
+
+private:
+  std::vector<uint8_t> bytes;
+  std::vector<bool> dirty_rows;
+};
+
+/// Uniform buffer object bound to a binding point of the context. Programs read it through a uniform block
+/// bound to the same point, see ShaderProgram::bind_uniform_block.
+class UniformBuffer {
+public:
+  /// Creates the buffer and binds it, must run on the thread of the GL context
+  UniformBuffer(size_t size, GLuint binding);
+  UniformBuffer(const UniformBuffer &) = delete;
+  UniformBuffer &operator=(const UniformBuffer &) = delete;
+  ~UniformBuffer();
+
+  /// Changes go here and reach the GPU with the next update()
+  UniformBlockData &get_data() { return this->data; }
+
+  /// Uploads the dirty ranges of the data with glBufferSubData, one call per range
+  void update();
+
+  GLuint get_binding() const { return this->binding; }
+
+private:
+  GLuint buffer_id = 0;
+  GLuint binding = 0;
+  UniformBlockData data;
+};
@@ -1,6 +1,28 @@
 #pragma once
 
+#include <cstdint>
 #include <fstream>
 #include <string>
 
-const std::string load_file_to_string(const std::string &file_name);
\ No newline at end of file
+const std::string load_file_to_string(const std::string &file_name);
+
+/// Fast non-cryptographic 64-bit hash, used to detect changed source files of the caches
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed = 0);
+
+/// hash_bytes of the whole file, returns false when it cannot be read
+bool hash_file(const std::string &file_name, uint64_t *hash);
+
+/// Size and modification time (seconds since epoch) of a file, returns false when it does not exist
+bool get_file_info(const std::string &file_name, uint64_t *size, int64_t *modification_time);
+
+/// Absolute path of an existing file with links and '.'/'..' resolved, so different spellings of one file compare
+/// equal. Returns the name unchanged when the file does not exist.
+std::string canonical_path(const std::string &file_name);
+
+/// Name of a temporary file next to the file, unique to this process (by its id) and this call, so concurrent
+/// writers of the same file never share one
+std::string temporary_path_for(const std::string &file_name);
+
+/// Moves a fully written temporary file over the file. The rename replaces it at once on POSIX, Windows needs it
+/// removed first. Removes the temporary file and returns false when the rename fails.
+bool replace_file(const std::string &temporary_path, const std::string &file_name);
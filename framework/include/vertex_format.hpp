@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.hpp"
+
+/// Interleaved vertex of MESH_BUILD_COMPACT_VERTICES, 16 bytes instead of the 32 bytes of three float buffers
+struct CompactVertex {
+  /// Unsigned normalized 16-bit position relative to the bounds of the mesh, w is unused
+  uint16_t position[4];
+  /// Signed normalized 10:10:10:2 normal, GL_INT_2_10_10_10_REV
+  uint32_t normal;
+  /// Half float texture coordinate, texture coordinates often leave [0, 1] so unorm16 does not fit
+  uint16_t tex_coord[2];
+};
+
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex must stay tightly packed");
+
+/// Compact vertices of the view. Positions are decoded as 'offset + position * scale' in the vertex shader.
+std::vector<CompactVertex> compact_vertices(const MeshView &view, glm::vec3 *position_offset,
+                                            glm::vec3 *position_scale);
+
+/// Worst-case differences between the float vertices and their compact encoding
+struct QuantizationError {
+  float position = 0.f;
+  /// Position error relative to the diagonal of the bounds
+  float position_relative = 0.f;
+  /// Angle between the original and the decoded normal in degrees
+  float normal_degrees = 0.f;
+  float tex_coord = 0.f;
+};
+
+QuantizationError measure_quantization_error(const MeshView &view, const std::vector<CompactVertex> &compact,
+                                             glm::vec3 position_offset, glm::vec3 position_scale);
+
+uint16_t float_to_half(float value);
+float half_to_float(uint16_t value);
+
+uint32_t pack_snorm_10_10_10_2(glm::vec3 value);
+/// Decodes with the OpenGL 4.2+ rule (c / 511, clamped to -1), which current drivers apply in every version
+glm::vec3 unpack_snorm_10_10_10_2(uint32_t value);
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+/// One decoded frame in 8-bit YUV 4:2:0 (BT.601, limited range): the Y plane of width x height texels, then the U
+/// and V planes of half the size rounded up
+struct VideoFrame {
+  /// Position in playback, counting on across loops of the video
+  size_t number = 0;
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> planes;
+
+  int chroma_width() const { return (this->width + 1) / 2; }
+  int chroma_height() const { return (this->height + 1) / 2; }
+  size_t luma_bytes() const { return size_t(this->width) * this->height; }
+  size_t chroma_bytes() const { return size_t(this->chroma_width()) * this->chroma_height(); }
+};
+
+/// Counters of a VideoSource and the VideoTexture showing it
+struct VideoStats {
+  size_t decoded_frames = 0;
+  double decode_milliseconds = 0.0;
+  size_t uploaded_frames = 0;
+  size_t uploaded_bytes = 0;
+  double upload_milliseconds = 0.0;
+  /// Frames that were never shown: skipped by the decoder to catch up, or decoded but already stale
+  size_t dropped_frames = 0;
+  /// Frames shown late or repeated because the next one was not decoded in time
+  size_t late_frames = 0;
+  /// Uploads put off because every pixel buffer was still in use by the GPU
+  size_t buffer_stalls = 0;
+};
+
+std::ostream &operator<<(std::ostream &os, const VideoStats &stats);
+
+/// Decodes a video on a background thread into a bounded queue of frames.
+///
+/// The video is a raw Y4M file (4:2:0 chroma only) or an image sequence given as a printf pattern with one
+/// integer, e.g. 'frames/%04d.png', numbered from 0 or 1; its images are converted to YUV 4:2:0 on the decode
+/// thread, so both kinds reach the GPU the same way. The decoder runs ahead until the queue is full and skips
+/// frames whose time has passed when it falls behind. Playback loops.
+class VideoSource {
+public:
+  /// Opens the video and starts decoding. 'fps' is the rate of image sequences, Y4M files carry their own.
+  /// Throws a std::string when the file or the first image of the sequence cannot be read.
+  explicit VideoSource(const std::string &file_name, double fps = 30.0, size_t queue_capacity = 4);
+  VideoSource(const VideoSource &) = delete;
+  VideoSource &operator=(const VideoSource &) = delete;
+  /// Stops the decode thread
+  ~VideoSource();
+
+  int get_width() const { return this->width; }
+  int get_height() const { return this->height; }
+  double get_fps() const { return this->fps; }
+  size_t get_frame_count() const;
+
+  /// Moves the frame to show 'time' seconds into playback into 'frame'. Older queued frames are dropped. Returns
+  /// false when no newer frame than the last taken one is due, or when it is not decoded yet; never waits.
+  bool take_frame(double time, VideoFrame *frame);
+
+  VideoStats get_stats();
+
+private:
+  void decode_loop();
+  /// Decodes the frame of the video at 'index' (not counting loops), false when it cannot be read
+  bool decode_frame(size_t index, VideoFrame *frame);
+
+  int width = 0;
+  int height = 0;
+  double fps = 30.0;
+  const size_t queue_capacity;
+
+  /// Y4M: the mapped file and the offsets of the planes of every frame
+  std::unique_ptr<MappedFile> file;
+  std::vector<size_t> frame_offsets;
+  /// Image sequence: the files of the frames
+  std::vector<std::string> file_names;
+
+  std::mutex mutex;
+  std::condition_variable queue_changed;
+  std::deque<VideoFrame> queue;
+  /// Frame number the player wants next, the decoder skips ahead to it
+  size_t wanted_number = 0;
+  /// Number of the last taken frame plus one, 0 before the first
+  size_t taken_number = 0;
+  /// Last frame number counted as late, so a frame is counted once however often it is asked for
+  size_t late_number = size_t(-1);
+  bool stopped = false;
+  VideoStats stats;
+  std::thread thread;
+};
+
+/// Shows a VideoSource through three single channel textures, one per YUV plane; the shader converts to RGB.
+///
+/// Frames go to the GPU through a ring of pixel buffer objects: update() copies the due frame into a buffer the
+/// GPU is done with and starts the asynchronous texture uploads from it, then fences the buffer. When no buffer
+/// is free the frame waits for the next update, so the GL thread never waits for the decoder or the GPU.
+class VideoTexture {
+public:
+  /// Creates the plane textures and buffers, must run on the thread of the GL context
+  explicit VideoTexture(std::unique_ptr<VideoSource> source, size_t buffer_count = 3);
+  VideoTexture(const VideoTexture &) = delete;
+  VideoTexture &operator=(const VideoTexture &) = delete;
+  /// Deletes the textures and buffers, must run on the thread of the GL context
+  ~VideoTexture();
+
+  /// Uploads the frame due 'time' seconds into playback when there is a new one. Binds the plane textures to
+  /// the active unit, so it belongs before the tracked bindings are reset.
+  void update(double time);
+
+  /// Binds the Y, U and V planes to the units 'first_unit' to 'first_unit + 2'
+  void bind(GLuint first_unit) const;
+
+  /// Whether a frame was uploaded yet, before that the planes are black
+  bool has_frame() const { return this->frames_uploaded > 0; }
+
+  VideoSource &get_source() { return *this->source; }
+  /// Counters of the source with the uploads added
+  VideoStats get_stats();
+
+private:
+  struct Buffer {
+    GLuint id = 0;
+    GLsync fence = nullptr;
+  };
+
+  std::unique_ptr<VideoSource> source;
+  GLuint planes[3] = {0, 0, 0};
+  std::vector<Buffer> buffers;
+  size_t next_buffer = 0;
+  size_t frame_bytes = 0;
+
+  size_t frames_uploaded = 0;
+  size_t bytes_uploaded = 0;
+  double upload_milliseconds = 0.0;
+  size_t buffer_stalls = 0;
+};
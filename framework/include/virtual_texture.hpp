@@ -0,0 +1,230 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+
+/// Mip chain of an image cut into square pages, stored uncompressed in a file next to the image and mapped.
+///
+/// Every page holds 'content' texels of its level plus a border of the neighbouring texels on each side, so
+/// bilinear filtering inside a page never needs another one. Texel t of level l covers the texels [t * 2^l,
+/// (t + 1) * 2^l) of level 0, so the page grids of the levels nest: the page (x, y) of level l lies in the page
+/// (x / 2, y / 2) of level l + 1. The coarsest level fits into a single page. Outside the image the pages
+/// continue mirrored, as the textures of the scene wrap.
+class PageFile {
+public:
+  /// Texels of a page with its border, the border is 'page_border' texels on each side
+  static const int page_size = 128;
+  static const int page_border = 4;
+  static const int page_content = page_size - 2 * page_border;
+  static const size_t page_bytes = size_t(page_size) * page_size * 4;
+
+  /// Maps the page file of the image, building it first when it is missing or older than the image. Building
+  /// decodes the whole image once and spreads the pages over the pool. Throws a std::string when the image
+  /// cannot be read or the file cannot be written.
+  static std::shared_ptr<PageFile> open_for(const std::string &image_file_name,
+                                            ThreadPool &pool = ThreadPool::shared());
+
+  static std::string path_for(const std::string &image_file_name) { return image_file_name + ".pages"; }
+
+  int get_width() const { return this->width; }
+  int get_height() const { return this->height; }
+  int get_level_count() const { return this->level_count; }
+  /// Pages across and down a level
+  int get_pages_x(int level) const;
+  int get_pages_y(int level) const;
+  /// RGBA8 texels of a page, 'page_size' rows of 'page_size' texels
+  const uint8_t *get_page(int level, int x, int y) const;
+  /// Bytes of all pages, what uploading the whole mip chain would take
+  size_t get_total_bytes() const { return this->page_offsets.back() * page_bytes; }
+
+private:
+  explicit PageFile(std::unique_ptr<MappedFile> file) : file(std::move(file)) {}
+  /// Reads the header, false when it is broken or does not match the size and time of the image
+  bool parse(uint64_t source_size, int64_t source_time);
+
+  std::unique_ptr<MappedFile> file;
+  int width = 0;
+  int height = 0;
+  int level_count = 0;
+  /// Index of the first page of every level, plus the page count at the end
+  std::vector<size_t> page_offsets;
+  size_t data_offset = 0;
+};
+
+/// Counters of a PageCache
+struct PageCacheStats {
+  size_t resident_pages = 0;
+  size_t capacity = 0;
+  /// Pages requested by the feedback, summed over the frames
+  size_t requested_pages = 0;
+  /// Requests of pages that were not resident, summed over the frames
+  size_t page_faults = 0;
+  size_t loaded_pages = 0;
+  size_t evicted_pages = 0;
+  /// Loads put off because every page was used in the current frame
+  size_t full_frames = 0;
+};
+
+std::ostream &operator<<(std::ostream &out, const PageCacheStats &stats);
+
+/// Decides which pages of a PageFile are resident in a fixed number of slots. Does not touch OpenGL.
+///
+/// Pages requested in a frame are marked as used together with their coarser ancestors, so the pages that stand
+/// in for a fine page are evicted after it. Missing pages are loaded coarsest first, each into a free slot or the
+/// slot of the least recently used page that was not requested in the frame. The page of the coarsest level is
+/// loaded by the first update and never evicted, so every texel always has a resident page.
+class PageCache {
+public:
+  /// A page to copy into its slot
+  struct Load {
+    int level;
+    int x;
+    int y;
+    size_t slot;
+  };
+
+  PageCache(std::shared_ptr<const PageFile> file, size_t capacity);
+
+  /// Marks the page and its ancestors as used in this frame, missing ones are loaded by the next update()
+  void request(int level, int x, int y);
+
+  /// Assigns slots to at most 'max_pages' missing pages and ends the frame. Returns the pages to copy into their
+  /// slots, the first update also returns the page of the coarsest level.
+  std::vector<Load> update(size_t max_pages);
+
+  /// Builds the indirection levels, level l being 'across[l]' x 'down[l]' RGBA8 texels with one per page: the
+  /// slot (x and y in a square of 'slots_across' slots) and the level of the page to sample. A page that is not
+  /// resident refers to its nearest resident ancestor.
+  void build_indirection(int slots_across, const std::vector<int> &across, const std::vector<int> &down,
+                         std::vector<std::vector<uint8_t>> *levels) const;
+
+  const PageFile &get_file() const { return *this->file; }
+  PageCacheStats get_stats() const;
+
+private:
+  struct Slot {
+    uint32_t key = 0;
+    bool used = false;
+    uint64_t last_used = 0;
+  };
+
+  static uint32_t key(int level, int x, int y) { return uint32_t(level) << 28 | uint32_t(y) << 14 | uint32_t(x); }
+
+  std::shared_ptr<const PageFile> file;
+  std::vector<Slot> slots;
+  std::unordered_map<uint32_t, size_t> resident;
+  /// Pages requested in this frame and those of them that are missing
+  std::unordered_set<uint32_t> requested;
+  std::vector<uint32_t> missing;
+  uint64_t frame = 1;
+  bool coarsest_loaded = false;
+  PageCacheStats stats;
+};
+
+/// Texture too large for video memory, sampled through a fixed size physical texture of resident pages and an
+/// indirection texture that maps every page of every level to its slot there (see PageCache).
+///
+/// The shader picks the level from the texture coordinate derivatives, looks up the page in the indirection
+/// texture with texelFetch and samples the physical texture inside the page it refers to. Which pages to load
+/// comes from a feedback pass (see VirtualTextureFeedback). Video memory stays at the physical texture and the
+/// small indirection texture no matter how large the image is.
+class VirtualTexture {
+public:
+  /// Creates the textures for 'slots_across' x 'slots_across' pages, must run on the thread of the GL context
+  explicit VirtualTexture(std::shared_ptr<const PageFile> file, int slots_across = 16);
+  VirtualTexture(const VirtualTexture &) = delete;
+  VirtualTexture &operator=(const VirtualTexture &) = delete;
+  ~VirtualTexture();
+
+  void request(int level, int x, int y) { this->cache.request(level, x, y); }
+
+  /// Uploads at most 'max_pages' missing pages straight from the mapped file and the changed indirection, then
+  /// starts the next frame. Binds the textures to the active unit, so it belongs before the tracked bindings are
+  /// reset.
+  void update(size_t max_pages);
+
+  /// Binds the physical texture and the indirection texture
+  void bind(GLuint physical_unit, GLuint indirection_unit) const;
+
+  const PageFile &get_file() const { return this->cache.get_file(); }
+  /// Texels across the physical texture
+  int get_physical_size() const { return this->slots_across * PageFile::page_size; }
+  PageCacheStats get_stats() const { return this->cache.get_stats(); }
+  /// Video memory of both textures in bytes
+  size_t get_memory() const;
+
+private:
+  PageCache cache;
+  const int slots_across;
+  GLuint physical = 0;
+  GLuint indirection = 0;
+  /// Texels across each indirection level, powers of two so the GL levels are large enough for the page grids
+  std::vector<int> indirection_across;
+  std::vector<int> indirection_down;
+};
+
+/// Page wanted by a texel of the feedback pass
+struct PageRequest {
+  /// Index of the virtual texture the material uses
+  int texture;
+  int level;
+  int x;
+  int y;
+};
+
+/// Renders which pages the visible texels need into a small framebuffer and reads it back without stalling.
+///
+/// The feedback shader writes one RGBA8 texel per pixel: the low bits of the page x and y in red and green, their
+/// high nibbles in blue, the level in the low nibble of alpha and the texture index plus one in its high nibble,
+/// alpha 0 where no virtual texture is visible. That allows 15 textures of 16 levels with 4096 pages across.
+/// The framebuffer is a fraction of the window, so the shader lowers its level by log2 of 'divisor' to match the
+/// full resolution derivatives. Read-backs go through a ring of pixel buffers and are used a few frames later.
+class VirtualTextureFeedback {
+public:
+  explicit VirtualTextureFeedback(int divisor = 8, size_t buffer_count = 3);
+  VirtualTextureFeedback(const VirtualTextureFeedback &) = delete;
+  VirtualTextureFeedback &operator=(const VirtualTextureFeedback &) = delete;
+  ~VirtualTextureFeedback();
+
+  /// Binds and clears the framebuffer for a window of the size. Blending is off until end().
+  void begin(int window_width, int window_height);
+  /// Starts reading the framebuffer back and restores the window framebuffer and viewport
+  void end();
+
+  /// The distinct requests of the oldest finished read-back, false when none is finished. Never waits.
+  bool read(std::vector<PageRequest> *requests);
+
+  /// Added to the level the shader computes from the derivatives of the smaller framebuffer
+  float get_level_bias() const;
+
+private:
+  struct Buffer {
+    GLuint id = 0;
+    GLsync fence = nullptr;
+    size_t size = 0;
+  };
+
+  void resize(int width, int height);
+
+  const int divisor;
+  GLuint framebuffer = 0;
+  GLuint color = 0;
+  GLuint depth = 0;
+  int width = 0;
+  int height = 0;
+  int window_width = 0;
+  int window_height = 0;
+  GLboolean blend_enabled = GL_FALSE;
+  std::vector<Buffer> buffers;
+  size_t next_buffer = 0;
+};
@@ -0,0 +1,329 @@
+#include "asset_loader.hpp"
+#include "dds.hpp"
+#include "pixel_format.hpp"
+#include "texture.hpp"
+#include "texture_cache.hpp"
+#include "texture_residency.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+const unsigned char placeholder_color[4] = {128, 128, 128, 255};
+const unsigned char placeholder_sky_color[4] = {10, 12, 26, 255};
+
+} // namespace
+
+AssetLoader::~AssetLoader() {
+  // Tasks waiting for a streaming buffer would wait for uploads that never run
+  if (this->streamer) {
+    this->streamer->shutdown();
+  }
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->tasks_finished.wait(lock, [this]() { return this->running_tasks == 0; });
+  this->uploads.clear();
+}
+
+void AssetLoader::run_task(const std::string &name, std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->running_tasks++;
+  }
+
+  this->pool.submit([this, name, task]() {
+    try {
+      task();
+    } catch (const std::string &error) {
+      std::cout << "Could not load " << name << ": " << error << std::endl;
+    } catch (const char *error) {
+      std::cout << "Could not load " << name << ": " << error << std::endl;
+    } catch (const std::exception &error) {
+      std::cout << "Could not load " << name << ": " << error.what() << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->running_tasks--;
+    this->tasks_finished.notify_all();
+  });
+}
+
+void AssetLoader::queue_upload(std::function<void()> upload) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->uploads.push_back(std::move(upload));
+}
+
+void AssetLoader::load_meshes(std::vector<std::unique_ptr<Mesh>> *meshes, const std::string &file_name,
+                              GLint position_location, GLint normal_location, GLint tex_coord_location,
+                              uint32_t build_flags) {
+  this->run_task(file_name, [=]() {
+    auto file = std::make_shared<MeshFile>(Mesh::load_file(file_name, build_flags));
+
+    this->queue_upload([=]() {
+      *meshes = Mesh::from_loaded_file(*file, position_location, normal_location, tex_coord_location, build_flags);
+
+      const std::vector<std::string> paths = Mesh::texture_paths(*meshes);
+      const std::vector<GLuint> texture_ids = this->load_textures_2d(paths);
+      Mesh::assign_textures(*meshes, [&](const std::string &path) {
+        return texture_ids[std::find(paths.begin(), paths.end(), path) - paths.begin()];
+      });
+    });
+  });
+}
+
+GLuint AssetLoader::load_texture_2d(const std::string &file_name) {
+  return this->load_textures_2d({file_name})[0];
+}
+
+std::vector<GLuint> AssetLoader::load_textures_2d(const std::vector<std::string> &file_names) {
+  TextureCache &cache = TextureCache::shared();
+  std::vector<GLuint> texture_ids;
+  // Files that are not cached get a placeholder, which the upload fills
+  std::vector<std::string> missing;
+  std::vector<GLuint> placeholders;
+  for (const std::string &file_name : file_names) {
+    const std::string key = TextureCache::key(GL_TEXTURE_2D, {file_name}, texture_load_parameters());
+    GLuint texture_id = cache.acquire(key);
+    if (texture_id == 0) {
+      texture_id = create_placeholder_texture_2d(placeholder_color);
+      cache.insert(key, texture_id, sizeof(placeholder_color));
+      // The pending upload keeps the texture alive, a failed task releases it too
+      cache.retain(texture_id);
+      missing.push_back(file_name);
+      placeholders.push_back(texture_id);
+    }
+    texture_ids.push_back(texture_id);
+  }
+  if (missing.empty()) {
+    return texture_ids;
+  }
+
+  this->run_task(missing[0], [=]() {
+    // Placeholders whose reference no queued upload releases yet, a failed task releases them itself
+    std::vector<GLuint> pending = placeholders;
+    const auto hand_over = [&](GLuint texture_id) {
+      pending.erase(std::find(pending.begin(), pending.end(), texture_id));
+    };
+    try {
+      // Images left to virtual texturing keep their placeholders, only the reference of the upload goes
+      std::vector<std::string> decoded;
+      std::vector<GLuint> targets;
+      const int virtual_size = this->virtual_texture_size;
+      for (size_t i = 0; i < missing.size(); i++) {
+        int width, height;
+        if (virtual_size > 0 && read_image_size(missing[i], &width, &height) &&
+            std::max(width, height) >= virtual_size) {
+          const GLuint texture_id = placeholders[i];
+          {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->virtual_textures.emplace_back(missing[i], texture_id);
+          }
+          this->queue_upload([=]() { TextureCache::shared().release(texture_id); });
+          hand_over(texture_id);
+        } else {
+          decoded.push_back(missing[i]);
+          targets.push_back(placeholders[i]);
+        }
+      }
+
+      std::vector<ImageDecodeStats> stats;
+      std::vector<Image> images = decode_images(decoded, this->pool, &stats, true);
+      this->add_decode_stats(stats);
+      this->pool.parallel_for(images.size(), [&](size_t i) { images[i] = pack_channels(std::move(images[i])); });
+
+      // One upload per image, so a frame never has to take all of them
+      for (size_t i = 0; i < images.size(); i++) {
+        const GLuint texture_id = targets[i];
+        const std::string file_name = decoded[i];
+        const std::vector<size_t> level_sizes = images[i].level_sizes();
+        // With mip streaming only the smallest levels, the others come when they are needed
+        const size_t first_level = TextureResidency::shared().first_streamed_level(level_sizes.size());
+        size_t memory = images[i].texture_memory();
+        for (size_t level = 0; level < first_level; level++) {
+          memory -= level_sizes[level];
+        }
+        const int buffer = this->streamer ? this->streamer->write(images[i], first_level) : -1;
+        if (buffer >= 0) {
+          // The image is in the buffer, its own memory can go
+          images[i] = Image();
+          this->queue_upload([=]() {
+            if (!this->streamer->upload(buffer, texture_id)) {
+              std::cout << "Texture streaming buffer was lost, " << file_name << " is decoded again" << std::endl;
+              this->reload_texture_2d(texture_id, file_name);
+              return;
+            }
+            TextureCache::shared().set_memory(texture_id, memory);
+            TextureResidency::shared().track(texture_id, file_name, level_sizes, first_level);
+            TextureCache::shared().release(texture_id);
+          });
+          hand_over(texture_id);
+          continue;
+        }
+
+        this->queue_texture_upload_2d(texture_id, file_name, std::make_shared<Image>(std::move(images[i])));
+        hand_over(texture_id);
+      }
+    } catch (...) {
+      for (const GLuint texture_id : pending) {
+        this->queue_upload([=]() { TextureCache::shared().release(texture_id); });
+      }
+      throw;
+    }
+  });
+
+  return texture_ids;
+}
+
+void AssetLoader::queue_texture_upload_2d(GLuint texture_id, const std::string &file_name,
+                                          std::shared_ptr<const Image> image) {
+  const std::vector<size_t> level_sizes = image->level_sizes();
+  const size_t first_level = TextureResidency::shared().first_streamed_level(level_sizes.size());
+  size_t memory = image->texture_memory();
+  for (size_t level = 0; level < first_level; level++) {
+    memory -= level_sizes[level];
+  }
+  this->queue_upload([=]() {
+    upload_texture_2d(*image, texture_id, first_level);
+    TextureCache::shared().set_memory(texture_id, memory);
+    TextureResidency::shared().track(texture_id, file_name, level_sizes, first_level);
+    TextureCache::shared().release(texture_id);
+  });
+}
+
+void AssetLoader::reload_texture_2d(GLuint texture_id, const std::string &file_name) {
+  this->run_task(file_name, [=]() {
+    std::shared_ptr<const Image> image;
+    try {
+      image = std::make_shared<Image>(pack_channels(decode_image(file_name, true)));
+    } catch (...) {
+      this->queue_upload([=]() { TextureCache::shared().release(texture_id); });
+      throw;
+    }
+    this->queue_texture_upload_2d(texture_id, file_name, image);
+  });
+}
+
+GLuint AssetLoader::load_texture_cubemap(const std::string file_names[6]) {
+  const std::vector<std::string> names(file_names, file_names + 6);
+  TextureCache &cache = TextureCache::shared();
+  const std::string key = TextureCache::key(GL_TEXTURE_CUBE_MAP, names, cubemap_load_parameters());
+  GLuint texture_id = cache.acquire(key);
+  if (texture_id != 0) {
+    return texture_id;
+  }
+
+  texture_id = create_placeholder_texture_cubemap(placeholder_sky_color);
+  cache.insert(key, texture_id, 6 * sizeof(placeholder_sky_color));
+  cache.retain(texture_id);
+  this->run_task(names[0], [=]() {
+    std::shared_ptr<std::vector<Image>> images;
+    try {
+      std::vector<ImageDecodeStats> stats;
+      images = std::make_shared<std::vector<Image>>(pack_cubemap_channels(decode_cubemap(names, this->pool, &stats)));
+      this->add_decode_stats(stats);
+    } catch (...) {
+      // No upload will release the reference
+      this->queue_upload([=]() { TextureCache::shared().release(texture_id); });
+      throw;
+    }
+    this->queue_upload([=]() {
+      upload_texture_cubemap(images->data(), texture_id);
+      size_t memory = 0;
+      for (const Image &image : *images) {
+        memory += image.texture_memory();
+      }
+      TextureCache::shared().set_memory(texture_id, memory);
+      TextureCache::shared().release(texture_id);
+      TextureResidency::shared().track_fixed(texture_id, DdsFile::cubemap_path_for(names), memory);
+    });
+  });
+
+  return texture_id;
+}
+
+void AssetLoader::load_texture_arrays(std::vector<GLuint> *arrays, std::vector<PackedTexture> *placements,
+                                      const std::vector<std::string> &file_names) {
+  if (file_names.empty()) {
+    return;
+  }
+
+  this->run_task(file_names[0], [=]() {
+    std::vector<ImageDecodeStats> stats;
+    const std::vector<Image> images = decode_images(file_names, this->pool, &stats, true);
+    this->add_decode_stats(stats);
+
+    auto packed = std::make_shared<std::vector<PackedTexture>>();
+    auto array_images = std::make_shared<std::vector<TextureArrayImage>>(pack_texture_arrays(images, packed.get()));
+    this->queue_upload([=]() {
+      arrays->clear();
+      for (const TextureArrayImage &image : *array_images) {
+        const size_t first_level = TextureResidency::shared().first_streamed_level(image.levels.size());
+        arrays->push_back(upload_texture_array(image, first_level));
+        // Shares the ownership of the packed images, the residency uploads the other levels from them
+        TextureResidency::shared().track_array(arrays->back(), "texture array " + std::to_string(arrays->size() - 1),
+                                               std::shared_ptr<const TextureArrayImage>(array_images, &image),
+                                               first_level);
+      }
+      *placements = *packed;
+    });
+  });
+}
+
+void AssetLoader::enable_texture_streaming(size_t buffer_count, size_t buffer_bytes) {
+  this->streamer = std::make_unique<TextureStreamer>(buffer_count, buffer_bytes);
+}
+
+TextureStreamStats AssetLoader::get_stream_stats() {
+  return this->streamer ? this->streamer->get_stats() : TextureStreamStats();
+}
+
+std::vector<std::pair<std::string, GLuint>> AssetLoader::get_virtual_textures() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->virtual_textures;
+}
+
+void AssetLoader::add_decode_stats(const std::vector<ImageDecodeStats> &stats) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->decode_stats.insert(this->decode_stats.end(), stats.begin(), stats.end());
+}
+
+std::vector<ImageDecodeStats> AssetLoader::get_decode_stats() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->decode_stats;
+}
+
+size_t AssetLoader::process_uploads(double budget_milliseconds) {
+  const auto start = std::chrono::steady_clock::now();
+  size_t processed = 0;
+  if (this->streamer) {
+    this->streamer->recycle();
+  }
+
+  for (;;) {
+    std::function<void()> upload;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (this->uploads.empty()) {
+        break;
+      }
+      upload = std::move(this->uploads.front());
+      this->uploads.pop_front();
+    }
+
+    upload();
+    processed++;
+
+    const double elapsed =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (elapsed >= budget_milliseconds) {
+      break;
+    }
+  }
+
+  return processed;
+}
+
+bool AssetLoader::is_finished() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->running_tasks == 0 && this->uploads.empty();
+}
@@ -0,0 +1,481 @@
+#include "block_compression.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCK_COMPRESSION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/// Least squares passes after the principal axis fit, each one moves the endpoints to the colors the chosen
+/// indices want and searches the indices again. Later passes rarely change anything.
+const int refinement_passes = 2;
+
+uint16_t pack_565(glm::vec3 color) {
+  const glm::vec3 clamped = glm::clamp(color, 0.f, 255.f);
+  const uint16_t r = static_cast<uint16_t>(std::round(clamped.r * 31.f / 255.f));
+  const uint16_t g = static_cast<uint16_t>(std::round(clamped.g * 63.f / 255.f));
+  const uint16_t b = static_cast<uint16_t>(std::round(clamped.b * 31.f / 255.f));
+  return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+/// Expands to 8 bits by replicating the high bits, same as the hardware
+void unpack_565(uint16_t color, int rgb[3]) {
+  const int r = color >> 11;
+  const int g = (color >> 5) & 63;
+  const int b = color & 31;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+/// Palette of the four color mode: both endpoints and the colors at 1/3 and 2/3 between them
+void bc1_palette(uint16_t color0, uint16_t color1, int palette[4][3]) {
+  unpack_565(color0, palette[0]);
+  unpack_565(color1, palette[1]);
+  for (int c = 0; c < 3; c++) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+}
+
+/// Nearest palette entry of every pixel, returns the packed 2-bit indices and adds the squared error to 'error'
+uint32_t select_indices_scalar(const uint8_t rgba[64], const int palette[4][3], uint32_t *error) {
+  uint32_t indices = 0;
+  for (int p = 0; p < 16; p++) {
+    const uint8_t *pixel = rgba + 4 * p;
+    uint32_t best_distance = std::numeric_limits<uint32_t>::max();
+    uint32_t best_index = 0;
+    for (uint32_t i = 0; i < 4; i++) {
+      const int dr = pixel[0] - palette[i][0];
+      const int dg = pixel[1] - palette[i][1];
+      const int db = pixel[2] - palette[i][2];
+      const uint32_t distance = static_cast<uint32_t>(dr * dr + dg * dg + db * db);
+      if (distance < best_distance) {
+        best_distance = distance;
+        best_index = i;
+      }
+    }
+    indices |= best_index << (2 * p);
+    *error += best_distance;
+  }
+  return indices;
+}
+
+#ifdef BLOCK_COMPRESSION_SSE2
+
+/// Squared RGB distances of four pixels to one color. The pixels are widened to 16 bits, so one madd squares
+/// and adds red and green, another lane holds blue (alpha is masked to 0 on both sides).
+inline __m128i distances_sse2(__m128i pixels_low, __m128i pixels_high, __m128i color) {
+  const __m128i difference_low = _mm_sub_epi16(pixels_low, color);
+  const __m128i difference_high = _mm_sub_epi16(pixels_high, color);
+  // [rg0, b0, rg1, b1] and [rg2, b2, rg3, b3], regrouped to [rg0, rg1, rg2, rg3] + [b0, b1, b2, b3]
+  const __m128i squares_low =
+      _mm_shuffle_epi32(_mm_madd_epi16(difference_low, difference_low), _MM_SHUFFLE(3, 1, 2, 0));
+  const __m128i squares_high =
+      _mm_shuffle_epi32(_mm_madd_epi16(difference_high, difference_high), _MM_SHUFFLE(3, 1, 2, 0));
+  return _mm_add_epi32(_mm_unpacklo_epi64(squares_low, squares_high),
+                       _mm_unpackhi_epi64(squares_low, squares_high));
+}
+
+/// Same result as select_indices_scalar, four pixels at a time
+uint32_t select_indices_sse2(const uint8_t rgba[64], const int palette[4][3], uint32_t *error) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i rgb_mask = _mm_set1_epi32(0x00ffffff);
+
+  __m128i colors[4];
+  for (int i = 0; i < 4; i++) {
+    colors[i] = _mm_setr_epi16(static_cast<short>(palette[i][0]), static_cast<short>(palette[i][1]),
+                               static_cast<short>(palette[i][2]), 0, static_cast<short>(palette[i][0]),
+                               static_cast<short>(palette[i][1]), static_cast<short>(palette[i][2]), 0);
+  }
+
+  uint32_t indices = 0;
+  __m128i error_sum = zero;
+  for (int row = 0; row < 4; row++) {
+    const __m128i pixels =
+        _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(rgba + 16 * row)), rgb_mask);
+    const __m128i pixels_low = _mm_unpacklo_epi8(pixels, zero);
+    const __m128i pixels_high = _mm_unpackhi_epi8(pixels, zero);
+
+    // Strictly smaller only, so ties keep the lower index like the scalar search
+    __m128i best_distance = distances_sse2(pixels_low, pixels_high, colors[0]);
+    __m128i best_index = zero;
+    for (int i = 1; i < 4; i++) {
+      const __m128i distance = distances_sse2(pixels_low, pixels_high, colors[i]);
+      const __m128i closer = _mm_cmplt_epi32(distance, best_distance);
+      best_distance = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best_distance));
+      best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(i)), _mm_andnot_si128(closer, best_index));
+    }
+    error_sum = _mm_add_epi32(error_sum, best_distance);
+
+    // Two bits per pixel: shift each lane into place and fold the four lanes together
+    const __m128i shifted = _mm_or_si128(_mm_srli_epi64(best_index, 30), best_index);
+    const uint32_t low = static_cast<uint32_t>(_mm_cvtsi128_si32(shifted));
+    const uint32_t high = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(shifted, 8)));
+    indices |= ((low & 0xf) | ((high & 0xf) << 4)) << (8 * row);
+  }
+
+  uint32_t errors[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(errors), error_sum);
+  *error += errors[0] + errors[1] + errors[2] + errors[3];
+  return indices;
+}
+
+#endif
+
+uint32_t select_indices(const uint8_t rgba[64], const int palette[4][3], uint32_t *error, bool simd) {
+#ifdef BLOCK_COMPRESSION_SSE2
+  if (simd) {
+    return select_indices_sse2(rgba, palette, error);
+  }
+#endif
+  return select_indices_scalar(rgba, palette, error);
+}
+
+/// Endpoints at the extremes of the colors projected onto their principal axis
+void fit_principal_axis(const uint8_t rgba[64], glm::vec3 *high, glm::vec3 *low) {
+  glm::vec3 mean(0.f);
+  for (int p = 0; p < 16; p++) {
+    mean += glm::vec3(rgba[4 * p], rgba[4 * p + 1], rgba[4 * p + 2]);
+  }
+  mean /= 16.f;
+
+  glm::mat3 covariance(0.f);
+  for (int p = 0; p < 16; p++) {
+    const glm::vec3 offset = glm::vec3(rgba[4 * p], rgba[4 * p + 1], rgba[4 * p + 2]) - mean;
+    covariance += glm::outerProduct(offset, offset);
+  }
+
+  // Power iteration, started from the column of the channel with the largest variance
+  int start = 0;
+  for (int c = 1; c < 3; c++) {
+    if (covariance[c][c] > covariance[start][start]) {
+      start = c;
+    }
+  }
+  glm::vec3 axis = covariance[start];
+  for (int i = 0; i < 4; i++) {
+    const float length = glm::length(axis);
+    if (length < 1e-6f) {
+      break;
+    }
+    axis = covariance * (axis / length);
+  }
+
+  const float length = glm::length(axis);
+  if (length < 1e-6f) {
+    *high = *low = mean;
+    return;
+  }
+  axis /= length;
+
+  float min_t = std::numeric_limits<float>::max();
+  float max_t = -std::numeric_limits<float>::max();
+  for (int p = 0; p < 16; p++) {
+    const float t = glm::dot(glm::vec3(rgba[4 * p], rgba[4 * p + 1], rgba[4 * p + 2]) - mean, axis);
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+  *high = mean + axis * max_t;
+  *low = mean + axis * min_t;
+}
+
+/// Endpoints minimizing the squared error for the given indices, false when the indices do not determine them
+bool refine_endpoints(const uint8_t rgba[64], uint32_t indices, glm::vec3 *color0, glm::vec3 *color1) {
+  // Weight of color0 for each index of the four color mode
+  const float weights[4] = {1.f, 0.f, 2.f / 3.f, 1.f / 3.f};
+
+  float aa = 0.f, ab = 0.f, bb = 0.f;
+  glm::vec3 ax(0.f), bx(0.f);
+  for (int p = 0; p < 16; p++) {
+    const float a = weights[(indices >> (2 * p)) & 3];
+    const float b = 1.f - a;
+    const glm::vec3 color(rgba[4 * p], rgba[4 * p + 1], rgba[4 * p + 2]);
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    ax += a * color;
+    bx += b * color;
+  }
+
+  const float determinant = aa * bb - ab * ab;
+  if (std::abs(determinant) < 1e-6f) {
+    return false;
+  }
+  *color0 = (bb * ax - ab * bx) / determinant;
+  *color1 = (aa * bx - ab * ax) / determinant;
+  return true;
+}
+
+void write_u16(uint8_t *destination, uint16_t value) {
+  destination[0] = static_cast<uint8_t>(value);
+  destination[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void write_u32(uint8_t *destination, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    destination[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+uint16_t read_u16(const uint8_t *source) { return static_cast<uint16_t>(source[0] | (source[1] << 8)); }
+
+uint32_t read_u32(const uint8_t *source) {
+  return static_cast<uint32_t>(source[0]) | (static_cast<uint32_t>(source[1]) << 8) |
+         (static_cast<uint32_t>(source[2]) << 16) | (static_cast<uint32_t>(source[3]) << 24);
+}
+
+/// Eight-value alpha block (alpha0 > alpha1): the extremes of the block and six values evenly between them
+void encode_alpha_block(const uint8_t rgba[64], uint8_t destination[8]) {
+  int min_alpha = 255, max_alpha = 0;
+  for (int p = 0; p < 16; p++) {
+    min_alpha = std::min<int>(min_alpha, rgba[4 * p + 3]);
+    max_alpha = std::max<int>(max_alpha, rgba[4 * p + 3]);
+  }
+  destination[0] = static_cast<uint8_t>(max_alpha);
+  destination[1] = static_cast<uint8_t>(min_alpha);
+
+  uint64_t indices = 0;
+  if (max_alpha > min_alpha) {
+    int palette[8] = {max_alpha, min_alpha};
+    for (int i = 1; i < 7; i++) {
+      palette[i + 1] = ((7 - i) * max_alpha + i * min_alpha) / 7;
+    }
+    for (int p = 0; p < 16; p++) {
+      const int alpha = rgba[4 * p + 3];
+      uint64_t best_index = 0;
+      for (int i = 1; i < 8; i++) {
+        if (std::abs(palette[i] - alpha) < std::abs(palette[best_index] - alpha)) {
+          best_index = i;
+        }
+      }
+      indices |= best_index << (3 * p);
+    }
+  }
+  for (int i = 0; i < 6; i++) {
+    destination[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+  }
+}
+
+void decode_alpha_block(const uint8_t block[8], uint8_t rgba[64]) {
+  const int alpha0 = block[0], alpha1 = block[1];
+  int palette[8] = {alpha0, alpha1};
+  if (alpha0 > alpha1) {
+    for (int i = 1; i < 7; i++) {
+      palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+    }
+  } else {
+    for (int i = 1; i < 5; i++) {
+      palette[i + 1] = ((5 - i) * alpha0 + i * alpha1) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+
+  uint64_t indices = 0;
+  for (int i = 0; i < 6; i++) {
+    indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+  }
+  for (int p = 0; p < 16; p++) {
+    rgba[4 * p + 3] = static_cast<uint8_t>(palette[(indices >> (3 * p)) & 7]);
+  }
+}
+
+/// Copies the 4x4 block at the given block position, pixels past the edge repeat the last row or column
+void fetch_block(const uint8_t *rgba, int width, int height, int block_x, int block_y, uint8_t block[64]) {
+  for (int y = 0; y < 4; y++) {
+    const int source_y = std::min(4 * block_y + y, height - 1);
+    for (int x = 0; x < 4; x++) {
+      const int source_x = std::min(4 * block_x + x, width - 1);
+      std::memcpy(block + 16 * y + 4 * x, rgba + 4 * (size_t(source_y) * width + source_x), 4);
+    }
+  }
+}
+
+} // namespace
+
+size_t block_bytes(BlockFormat format) { return format == BlockFormat::BC1 ? 8 : 16; }
+
+size_t compressed_size(BlockFormat format, int width, int height) {
+  return size_t((width + 3) / 4) * ((height + 3) / 4) * block_bytes(format);
+}
+
+void encode_bc1_block(const uint8_t rgba[64], uint8_t destination[8], bool simd) {
+  glm::vec3 color0, color1;
+  fit_principal_axis(rgba, &color0, &color1);
+
+  uint16_t best_endpoints[2] = {0, 0};
+  uint32_t best_indices = 0;
+  uint32_t best_error = std::numeric_limits<uint32_t>::max();
+
+  for (int pass = 0; pass <= refinement_passes; pass++) {
+    uint16_t endpoint0 = pack_565(color0);
+    uint16_t endpoint1 = pack_565(color1);
+    // The four color mode needs endpoint0 > endpoint1, equal endpoints only work with every index at 0
+    if (endpoint0 < endpoint1) {
+      std::swap(endpoint0, endpoint1);
+    }
+
+    int palette[4][3];
+    bc1_palette(endpoint0, endpoint1, palette);
+    uint32_t error = 0;
+    uint32_t indices = 0;
+    if (endpoint0 == endpoint1) {
+      select_indices_scalar(rgba, palette, &error);
+    } else {
+      indices = select_indices(rgba, palette, &error, simd);
+    }
+
+    if (error < best_error) {
+      best_error = error;
+      best_indices = indices;
+      best_endpoints[0] = endpoint0;
+      best_endpoints[1] = endpoint1;
+    }
+    if (error == 0 || endpoint0 == endpoint1 || !refine_endpoints(rgba, indices, &color0, &color1)) {
+      break;
+    }
+  }
+
+  write_u16(destination, best_endpoints[0]);
+  write_u16(destination + 2, best_endpoints[1]);
+  write_u32(destination + 4, best_indices);
+}
+
+void encode_bc3_block(const uint8_t rgba[64], uint8_t destination[16], bool simd) {
+  encode_alpha_block(rgba, destination);
+  encode_bc1_block(rgba, destination + 8, simd);
+}
+
+void decode_bc1_block(const uint8_t block[8], uint8_t rgba[64]) {
+  const uint16_t color0 = read_u16(block);
+  const uint16_t color1 = read_u16(block + 2);
+  const uint32_t indices = read_u32(block + 4);
+
+  int palette[4][4];
+  unpack_565(color0, palette[0]);
+  unpack_565(color1, palette[1]);
+  palette[0][3] = palette[1][3] = palette[2][3] = 255;
+  for (int c = 0; c < 3; c++) {
+    if (color0 > color1) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    } else {
+      // Three color mode, the last entry is transparent black
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+  }
+  palette[3][3] = color0 > color1 ? 255 : 0;
+
+  for (int p = 0; p < 16; p++) {
+    const int *color = palette[(indices >> (2 * p)) & 3];
+    for (int c = 0; c < 4; c++) {
+      rgba[4 * p + c] = static_cast<uint8_t>(color[c]);
+    }
+  }
+}
+
+void decode_bc3_block(const uint8_t block[16], uint8_t rgba[64]) {
+  // The color part of BC3 always uses the four color mode
+  const uint16_t color0 = read_u16(block + 8);
+  const uint16_t color1 = read_u16(block + 10);
+  const uint32_t indices = read_u32(block + 12);
+
+  int palette[4][3];
+  unpack_565(color0, palette[0]);
+  unpack_565(color1, palette[1]);
+  for (int c = 0; c < 3; c++) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+  for (int p = 0; p < 16; p++) {
+    const int *color = palette[(indices >> (2 * p)) & 3];
+    for (int c = 0; c < 3; c++) {
+      rgba[4 * p + c] = static_cast<uint8_t>(color[c]);
+    }
+  }
+
+  decode_alpha_block(block, rgba);
+}
+
+std::vector<uint8_t> compress_image(const uint8_t *rgba, int width, int height, BlockFormat format,
+                                    ThreadPool &pool, bool simd) {
+  const int blocks_x = (width + 3) / 4;
+  const int blocks_y = (height + 3) / 4;
+  const size_t bytes = block_bytes(format);
+  std::vector<uint8_t> blocks(compressed_size(format, width, height));
+
+  pool.parallel_for(blocks_y, [&](size_t block_y) {
+    uint8_t block[64];
+    for (int block_x = 0; block_x < blocks_x; block_x++) {
+      fetch_block(rgba, width, height, block_x, static_cast<int>(block_y), block);
+      uint8_t *destination = blocks.data() + (block_y * blocks_x + block_x) * bytes;
+      if (format == BlockFormat::BC1) {
+        encode_bc1_block(block, destination, simd);
+      } else {
+        encode_bc3_block(block, destination, simd);
+      }
+    }
+  });
+
+  return blocks;
+}
+
+std::vector<uint8_t> decompress_image(const uint8_t *blocks, int width, int height, BlockFormat format) {
+  const int blocks_x = (width + 3) / 4;
+  const int blocks_y = (height + 3) / 4;
+  const size_t bytes = block_bytes(format);
+  std::vector<uint8_t> rgba(size_t(width) * height * 4);
+
+  uint8_t block[64];
+  for (int block_y = 0; block_y < blocks_y; block_y++) {
+    for (int block_x = 0; block_x < blocks_x; block_x++) {
+      const uint8_t *source = blocks + (size_t(block_y) * blocks_x + block_x) * bytes;
+      if (format == BlockFormat::BC1) {
+        decode_bc1_block(source, block);
+      } else {
+        decode_bc3_block(source, block);
+      }
+
+      for (int y = 0; y < 4 && 4 * block_y + y < height; y++) {
+        const int columns = std::min(4, width - 4 * block_x);
+        std::memcpy(rgba.data() + 4 * ((size_t(4 * block_y + y)) * width + 4 * block_x), block + 16 * y,
+                    4 * columns);
+      }
+    }
+  }
+  return rgba;
+}
+
+bool has_transparency(const uint8_t *rgba, size_t pixel_count) {
+  for (size_t p = 0; p < pixel_count; p++) {
+    if (rgba[4 * p + 3] != 255) {
+      return true;
+    }
+  }
+  return false;
+}
+
+double compute_psnr(const uint8_t *reference, const uint8_t *image, size_t pixel_count, int channels) {
+  double squared_error = 0.0;
+  for (size_t p = 0; p < pixel_count; p++) {
+    for (int c = 0; c < channels; c++) {
+      const double difference = double(reference[4 * p + c]) - double(image[4 * p + c]);
+      squared_error += difference * difference;
+    }
+  }
+  if (squared_error == 0.0) {
+    return std::numeric_limits<double>::infinity();
+  }
+  const double mean_squared_error = squared_error / (double(pixel_count) * channels);
+  return 10.0 * std::log10(255.0 * 255.0 / mean_squared_error);
+}
@@ -0,0 +1,379 @@
+#include "dds.hpp"
+#include "block_compression.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+constexpr uint32_t four_cc(char a, char b, char c, char d) {
+  return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) |
+         (static_cast<uint32_t>(d) << 24);
+}
+
+const uint32_t magic = four_cc('D', 'D', 'S', ' ');
+/// Marks the source record in the reserved words of the header, the parameters follow it
+const uint32_t source_tag = four_cc('S', 'R', 'C', '1');
+const size_t source_record_word = 1;
+const size_t parameters_word = 7;
+
+const uint32_t header_caps = 0x1;
+const uint32_t header_height = 0x2;
+const uint32_t header_width = 0x4;
+const uint32_t header_pixel_format = 0x1000;
+const uint32_t header_mip_map_count = 0x20000;
+const uint32_t header_pitch = 0x8;
+const uint32_t header_linear_size = 0x80000;
+const uint32_t pixel_format_alpha_pixels = 0x1;
+const uint32_t pixel_format_four_cc = 0x4;
+const uint32_t pixel_format_rgb = 0x40;
+const uint32_t pixel_format_luminance = 0x20000;
+const uint32_t caps_complex = 0x8;
+const uint32_t caps_texture = 0x1000;
+const uint32_t caps_mip_map = 0x400000;
+const uint32_t caps2_cubemap = 0x200;
+const uint32_t caps2_cubemap_all_faces = 0xfc00;
+const uint32_t caps2_volume = 0x200000;
+
+const uint32_t rgba_masks[4] = {0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000};
+const uint32_t bgra_masks[4] = {0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000};
+const uint32_t rgb_masks[4] = {0x000000ff, 0x0000ff00, 0x00ff0000, 0};
+/// Luminance in the first, alpha in the last mask
+const uint32_t luminance_alpha_masks[4] = {0x000000ff, 0, 0, 0x0000ff00};
+const uint32_t luminance_masks[4] = {0x000000ff, 0, 0, 0};
+
+struct DdsPixelFormat {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t four_cc;
+  uint32_t rgb_bit_count;
+  uint32_t bit_masks[4];
+};
+
+struct DdsHeader {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t height;
+  uint32_t width;
+  uint32_t pitch_or_linear_size;
+  uint32_t depth;
+  uint32_t mip_map_count;
+  uint32_t reserved1[11];
+  DdsPixelFormat pixel_format;
+  uint32_t caps[4];
+  uint32_t reserved2;
+};
+
+static_assert(sizeof(DdsHeader) == 124, "DdsHeader must match the file layout");
+
+size_t level_size(DdsFormat format, int width, int height) {
+  switch (format) {
+  case DdsFormat::BC1:
+    return compressed_size(BlockFormat::BC1, width, height);
+  case DdsFormat::BC3:
+    return compressed_size(BlockFormat::BC3, width, height);
+  default:
+    return size_t(width) * height * pixel_bytes(format);
+  }
+}
+
+/// Flags, bit count and masks of an uncompressed format
+void describe_format(DdsFormat format, DdsPixelFormat *pixel_format) {
+  const uint32_t *masks;
+  switch (format) {
+  case DdsFormat::RGBA8:
+  case DdsFormat::BGRA8:
+    masks = format == DdsFormat::RGBA8 ? rgba_masks : bgra_masks;
+    pixel_format->flags = pixel_format_rgb | pixel_format_alpha_pixels;
+    break;
+  case DdsFormat::RGB8:
+    masks = rgb_masks;
+    pixel_format->flags = pixel_format_rgb;
+    break;
+  case DdsFormat::RG8:
+    masks = luminance_alpha_masks;
+    pixel_format->flags = pixel_format_luminance | pixel_format_alpha_pixels;
+    break;
+  default:
+    masks = luminance_masks;
+    pixel_format->flags = pixel_format_luminance;
+    break;
+  }
+  pixel_format->rgb_bit_count = static_cast<uint32_t>(8 * pixel_bytes(format));
+  std::memcpy(pixel_format->bit_masks, masks, sizeof(pixel_format->bit_masks));
+}
+
+/// Summed size, latest modification time and combined hash of the sources, in the reserved words after the tag
+struct SourceRecord {
+  uint64_t size;
+  int64_t time;
+  uint64_t hash;
+};
+
+/// Cheap checks of size and time first when 'expected' is given, hashing reads the whole source files
+bool read_source_record(const std::vector<std::string> &file_names, SourceRecord *record,
+                        const SourceRecord *expected = nullptr) {
+  *record = SourceRecord{0, 0, 0};
+  for (const std::string &file_name : file_names) {
+    uint64_t size;
+    int64_t time;
+    if (!get_file_info(file_name, &size, &time)) {
+      return false;
+    }
+    record->size += size;
+    record->time = std::max(record->time, time);
+  }
+  if (expected && (record->size != expected->size || record->time != expected->time)) {
+    return false;
+  }
+
+  for (const std::string &file_name : file_names) {
+    uint64_t hash;
+    if (!hash_file(file_name, &hash)) {
+      return false;
+    }
+    record->hash = hash_bytes(&hash, sizeof(hash), record->hash);
+  }
+  return !expected || record->hash == expected->hash;
+}
+
+/// File name with the extension replaced, or with the extension appended when it has none
+std::string replace_extension(const std::string &file_name, const std::string &extension) {
+  const size_t slash = file_name.find_last_of("/\\");
+  const size_t dot = file_name.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    return file_name + extension;
+  }
+  return file_name.substr(0, dot) + extension;
+}
+
+} // namespace
+
+bool is_block_compressed(DdsFormat format) { return format == DdsFormat::BC1 || format == DdsFormat::BC3; }
+
+size_t pixel_bytes(DdsFormat format) {
+  switch (format) {
+  case DdsFormat::RGB8:
+    return 3;
+  case DdsFormat::RG8:
+    return 2;
+  case DdsFormat::R8:
+    return 1;
+  default:
+    return 4;
+  }
+}
+
+std::unique_ptr<DdsFile> DdsFile::open(const std::string &file_name,
+                                       const std::vector<std::string> &source_file_names, uint32_t parameters) {
+  std::unique_ptr<MappedFile> file;
+  try {
+    file = std::make_unique<MappedFile>(file_name);
+  } catch (const std::string &) {
+    return nullptr;
+  }
+
+  std::unique_ptr<DdsFile> dds(new DdsFile(std::move(file)));
+  if (!dds->parse(source_file_names, parameters)) {
+    return nullptr;
+  }
+  return dds;
+}
+
+bool DdsFile::parse(const std::vector<std::string> &source_file_names, uint32_t parameters) {
+  uint32_t file_magic;
+  DdsHeader header;
+  if (file->size() < sizeof(file_magic) + sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&file_magic, file->data(), sizeof(file_magic));
+  std::memcpy(&header, file->data() + sizeof(file_magic), sizeof(header));
+  if (file_magic != magic || header.size != sizeof(header) || header.width == 0 || header.height == 0 ||
+      header.width > 65536 || header.height > 65536 || (header.caps[1] & caps2_volume)) {
+    return false;
+  }
+
+  const DdsPixelFormat &pixel_format = header.pixel_format;
+  if (pixel_format.flags & pixel_format_four_cc) {
+    if (pixel_format.four_cc == four_cc('D', 'X', 'T', '1')) {
+      format = DdsFormat::BC1;
+    } else if (pixel_format.four_cc == four_cc('D', 'X', 'T', '5')) {
+      format = DdsFormat::BC3;
+    } else {
+      return false;
+    }
+  } else {
+    // The uncompressed formats written here, told apart by flags, bit count and masks
+    bool known = false;
+    for (DdsFormat candidate : {DdsFormat::RGBA8, DdsFormat::BGRA8, DdsFormat::RGB8, DdsFormat::RG8, DdsFormat::R8}) {
+      DdsPixelFormat description;
+      describe_format(candidate, &description);
+      const uint32_t flags = pixel_format_rgb | pixel_format_luminance | pixel_format_alpha_pixels;
+      if ((pixel_format.flags & flags) == description.flags &&
+          pixel_format.rgb_bit_count == description.rgb_bit_count &&
+          std::memcmp(pixel_format.bit_masks, description.bit_masks, sizeof(description.bit_masks)) == 0) {
+        format = candidate;
+        known = true;
+        break;
+      }
+    }
+    if (!known) {
+      return false;
+    }
+  }
+
+  size_t face_count = 1;
+  if (header.caps[1] & caps2_cubemap) {
+    // Cubemaps with missing faces have no use here
+    if ((header.caps[1] & caps2_cubemap_all_faces) != caps2_cubemap_all_faces) {
+      return false;
+    }
+    face_count = 6;
+  }
+
+  if (!source_file_names.empty() && header.reserved1[0] == source_tag) {
+    SourceRecord expected, current;
+    std::memcpy(&expected, &header.reserved1[source_record_word], sizeof(expected));
+    if (header.reserved1[parameters_word] != parameters ||
+        !read_source_record(source_file_names, &current, &expected)) {
+      return false;
+    }
+  }
+
+  width = static_cast<int>(header.width);
+  height = static_cast<int>(header.height);
+  const uint32_t level_count =
+      (header.flags & header_mip_map_count) && header.mip_map_count > 0 ? std::min(header.mip_map_count, 17u) : 1;
+
+  size_t offset = sizeof(file_magic) + sizeof(header);
+  faces.resize(face_count);
+  for (std::vector<Level> &levels : faces) {
+    for (uint32_t i = 0; i < level_count; i++) {
+      Level level;
+      level.width = std::max(1, width >> i);
+      level.height = std::max(1, height >> i);
+      level.size = level_size(format, level.width, level.height);
+      if (offset + level.size > file->size()) {
+        return false;
+      }
+      level.data = reinterpret_cast<const uint8_t *>(file->data()) + offset;
+      levels.push_back(level);
+      offset += level.size;
+    }
+  }
+  return true;
+}
+
+std::unique_ptr<DdsFile> DdsFile::open_for(const std::string &image_file_name, uint32_t parameters) {
+  for (const std::string &path : {path_for(image_file_name), replace_extension(image_file_name, ".dds")}) {
+    std::unique_ptr<DdsFile> file = open(path, {image_file_name}, parameters);
+    if (file && !file->is_cubemap()) {
+      return file;
+    }
+  }
+  return nullptr;
+}
+
+std::unique_ptr<DdsFile> DdsFile::open_for_cubemap(const std::vector<std::string> &face_file_names,
+                                                   uint32_t parameters) {
+  std::unique_ptr<DdsFile> file = open(cubemap_path_for(face_file_names), face_file_names, parameters);
+  if (file && file->is_cubemap()) {
+    return file;
+  }
+  return nullptr;
+}
+
+std::string DdsFile::cubemap_path_for(const std::vector<std::string> &face_file_names) {
+  if (face_file_names.empty()) {
+    return "";
+  }
+
+  std::string prefix = face_file_names[0];
+  for (const std::string &name : face_file_names) {
+    size_t length = 0;
+    while (length < prefix.size() && length < name.size() && prefix[length] == name[length]) {
+      length++;
+    }
+    prefix.resize(length);
+  }
+
+  const size_t slash = prefix.find_last_of("/\\");
+  const size_t name_start = slash == std::string::npos ? 0 : slash + 1;
+  while (prefix.size() > name_start && std::strchr("_-. ", prefix.back())) {
+    prefix.pop_back();
+  }
+  if (prefix.size() == name_start) {
+    return face_file_names[0] + ".cube.dds";
+  }
+  return prefix + ".dds";
+}
+
+bool DdsFile::write(const std::string &file_name, DdsFormat format, int width, int height,
+                    const std::vector<std::vector<uint8_t>> &levels,
+                    const std::vector<std::string> &source_file_names, bool cubemap, uint32_t parameters) {
+  const size_t face_count = cubemap ? 6 : 1;
+  if (levels.empty() || levels.size() % face_count != 0) {
+    return false;
+  }
+  const size_t level_count = levels.size() / face_count;
+
+  DdsHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.size = sizeof(header);
+  header.flags = header_caps | header_height | header_width | header_pixel_format;
+  header.height = static_cast<uint32_t>(height);
+  header.width = static_cast<uint32_t>(width);
+  header.pixel_format.size = sizeof(header.pixel_format);
+  if (is_block_compressed(format)) {
+    header.flags |= header_linear_size;
+    header.pitch_or_linear_size = static_cast<uint32_t>(levels[0].size());
+    header.pixel_format.flags = pixel_format_four_cc;
+    header.pixel_format.four_cc =
+        format == DdsFormat::BC1 ? four_cc('D', 'X', 'T', '1') : four_cc('D', 'X', 'T', '5');
+  } else {
+    header.flags |= header_pitch;
+    header.pitch_or_linear_size = static_cast<uint32_t>(width * pixel_bytes(format));
+    describe_format(format, &header.pixel_format);
+  }
+
+  header.caps[0] = caps_texture;
+  if (level_count > 1) {
+    header.flags |= header_mip_map_count;
+    header.mip_map_count = static_cast<uint32_t>(level_count);
+    header.caps[0] |= caps_complex | caps_mip_map;
+  }
+  if (cubemap) {
+    header.caps[0] |= caps_complex;
+    header.caps[1] = caps2_cubemap | caps2_cubemap_all_faces;
+  }
+
+  if (!source_file_names.empty()) {
+    SourceRecord record;
+    if (!read_source_record(source_file_names, &record)) {
+      return false;
+    }
+    header.reserved1[0] = source_tag;
+    std::memcpy(&header.reserved1[source_record_word], &record, sizeof(record));
+    header.reserved1[parameters_word] = parameters;
+  }
+
+  // Write into a temporary file first so a crash never leaves a half written file behind
+  const std::string temporary_path = temporary_path_for(file_name);
+  {
+    std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&magic), sizeof(magic));
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const std::vector<uint8_t> &level : levels) {
+      out.write(reinterpret_cast<const char *>(level.data()), static_cast<std::streamsize>(level.size()));
+    }
+    if (!out) {
+      std::remove(temporary_path.c_str());
+      return false;
+    }
+  }
+
+  return replace_file(temporary_path, file_name);
+}
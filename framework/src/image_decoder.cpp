@@ -0,0 +1,448 @@
+#include "image_decoder.hpp"
+#include "mapped_file.hpp"
+#include "pixel_format.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <stb_image.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_DECODER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const uint8_t png_signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+/// Largest width and height stb_image accepts in PNG files
+const uint32_t png_max_dimension = 1u << 24;
+
+enum PngFilter { PNG_FILTER_NONE = 0, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVERAGE, PNG_FILTER_PAETH };
+
+uint32_t read_u32_be(const uint8_t *bytes) {
+  return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3];
+}
+
+uint32_t read_u16_le(const uint8_t *bytes) { return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8); }
+
+bool is_chunk(const uint8_t *type, const char *name) { return std::memcmp(type, name, 4) == 0; }
+
+bool is_png(const uint8_t *data, size_t size) {
+  return size >= sizeof(png_signature) && std::memcmp(data, png_signature, sizeof(png_signature)) == 0;
+}
+
+/// Predictor of the Paeth filter, ties broken like the PNG specification (and stb_image) does
+int paeth_predictor(int left, int up, int up_left) {
+  const int p = left + up - up_left;
+  const int distance_left = std::abs(p - left);
+  const int distance_up = std::abs(p - up);
+  const int distance_up_left = std::abs(p - up_left);
+  if (distance_left <= distance_up && distance_left <= distance_up_left) {
+    return left;
+  }
+  return distance_up <= distance_up_left ? up : up_left;
+}
+
+/// Reconstructs a row of 4-byte pixels. 'prior' is the reconstructed row above, zeros for the first row.
+void unfilter_scalar(int filter, const uint8_t *filtered, const uint8_t *prior, uint8_t *row, size_t width) {
+  const size_t length = 4 * width;
+  switch (filter) {
+  case PNG_FILTER_NONE:
+    std::memcpy(row, filtered, length);
+    break;
+  case PNG_FILTER_SUB:
+    for (size_t i = 0; i < length; i++) {
+      row[i] = static_cast<uint8_t>(filtered[i] + (i >= 4 ? row[i - 4] : 0));
+    }
+    break;
+  case PNG_FILTER_UP:
+    for (size_t i = 0; i < length; i++) {
+      row[i] = static_cast<uint8_t>(filtered[i] + prior[i]);
+    }
+    break;
+  case PNG_FILTER_AVERAGE:
+    for (size_t i = 0; i < length; i++) {
+      const int left = i >= 4 ? row[i - 4] : 0;
+      row[i] = static_cast<uint8_t>(filtered[i] + ((left + prior[i]) >> 1));
+    }
+    break;
+  case PNG_FILTER_PAETH:
+    for (size_t i = 0; i < length; i++) {
+      const int left = i >= 4 ? row[i - 4] : 0;
+      const int up_left = i >= 4 ? prior[i - 4] : 0;
+      row[i] = static_cast<uint8_t>(filtered[i] + paeth_predictor(left, prior[i], up_left));
+    }
+    break;
+  }
+}
+
+void set_opaque_scalar(uint8_t *pixels, size_t pixel_count) {
+  for (size_t p = 0; p < pixel_count; p++) {
+    pixels[4 * p + 3] = 255;
+  }
+}
+
+void fill_scalar(uint8_t *pixels, const uint8_t *pixel, size_t pixel_count) {
+  for (size_t p = 0; p < pixel_count; p++) {
+    std::memcpy(pixels + 4 * p, pixel, 4);
+  }
+}
+
+#ifdef IMAGE_DECODER_SSE2
+
+__m128i load_pixel(const uint8_t *pixel) {
+  int32_t value;
+  std::memcpy(&value, pixel, 4);
+  return _mm_cvtsi32_si128(value);
+}
+
+void store_pixel(uint8_t *pixel, __m128i value) {
+  const int32_t low = _mm_cvtsi128_si32(value);
+  std::memcpy(pixel, &low, 4);
+}
+
+/// Lanes of 'if_true' where 'mask' is set, the others of 'if_false'
+__m128i select(__m128i mask, __m128i if_true, __m128i if_false) {
+  return _mm_or_si128(_mm_and_si128(mask, if_true), _mm_andnot_si128(mask, if_false));
+}
+
+__m128i abs_epi16(__m128i value) { return _mm_max_epi16(value, _mm_sub_epi16(_mm_setzero_si128(), value)); }
+
+/// Same as unfilter_scalar. Up and Sub work on 4 pixels at once, Sub with a prefix sum over the pixels of a
+/// vector. Average and Paeth depend on the pixel to the left, so they compute the 4 channels of a pixel at once.
+void unfilter_sse2(int filter, const uint8_t *filtered, const uint8_t *prior, uint8_t *row, size_t width) {
+  const __m128i zero = _mm_setzero_si128();
+  size_t p = 0;
+  switch (filter) {
+  case PNG_FILTER_NONE:
+    std::memcpy(row, filtered, 4 * width);
+    break;
+  case PNG_FILTER_SUB: {
+    __m128i left = zero;
+    for (; p + 4 <= width; p += 4) {
+      __m128i sum = _mm_loadu_si128(reinterpret_cast<const __m128i *>(filtered + 4 * p));
+      sum = _mm_add_epi8(sum, _mm_slli_si128(sum, 4));
+      sum = _mm_add_epi8(sum, _mm_slli_si128(sum, 8));
+      sum = _mm_add_epi8(sum, left);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(row + 4 * p), sum);
+      left = _mm_shuffle_epi32(sum, 0xff);
+    }
+    for (; p < width; p++) {
+      left = _mm_add_epi8(load_pixel(filtered + 4 * p), left);
+      store_pixel(row + 4 * p, left);
+    }
+    break;
+  }
+  case PNG_FILTER_UP:
+    for (; p + 4 <= width; p += 4) {
+      const __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prior + 4 * p));
+      const __m128i difference = _mm_loadu_si128(reinterpret_cast<const __m128i *>(filtered + 4 * p));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(row + 4 * p), _mm_add_epi8(difference, up));
+    }
+    for (; p < width; p++) {
+      store_pixel(row + 4 * p, _mm_add_epi8(load_pixel(filtered + 4 * p), load_pixel(prior + 4 * p)));
+    }
+    break;
+  case PNG_FILTER_AVERAGE: {
+    // The rounded up average of _mm_avg_epu8 minus the carry of the lowest bits is (left + up) >> 1
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i left = zero;
+    for (; p < width; p++) {
+      const __m128i up = load_pixel(prior + 4 * p);
+      const __m128i carry = _mm_and_si128(_mm_xor_si128(left, up), one);
+      const __m128i average = _mm_sub_epi8(_mm_avg_epu8(left, up), carry);
+      left = _mm_add_epi8(load_pixel(filtered + 4 * p), average);
+      store_pixel(row + 4 * p, left);
+    }
+    break;
+  }
+  case PNG_FILTER_PAETH: {
+    // In 16-bit lanes: p - left = up - up_left, p - up = left - up_left and p - up_left is their sum
+    const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+    __m128i left = zero, up_left = zero;
+    for (; p < width; p++) {
+      const __m128i up = _mm_unpacklo_epi8(load_pixel(prior + 4 * p), zero);
+      const __m128i difference = _mm_unpacklo_epi8(load_pixel(filtered + 4 * p), zero);
+      const __m128i to_left = _mm_sub_epi16(up, up_left);
+      const __m128i to_up = _mm_sub_epi16(left, up_left);
+      const __m128i distance_up_left = abs_epi16(_mm_add_epi16(to_left, to_up));
+      const __m128i distance_left = abs_epi16(to_left);
+      const __m128i distance_up = abs_epi16(to_up);
+      const __m128i smallest = _mm_min_epi16(distance_up_left, _mm_min_epi16(distance_left, distance_up));
+      const __m128i predictor = select(_mm_cmpeq_epi16(smallest, distance_left), left,
+                                       select(_mm_cmpeq_epi16(smallest, distance_up), up, up_left));
+      left = _mm_and_si128(_mm_add_epi16(predictor, difference), low_bytes);
+      store_pixel(row + 4 * p, _mm_packus_epi16(left, left));
+      up_left = up;
+    }
+    break;
+  }
+  }
+}
+
+/// Sets alpha of the pixels up to the last multiple of 4, returns how many that were
+size_t set_opaque_sse2(uint8_t *pixels, size_t pixel_count) {
+  const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000u));
+  size_t p = 0;
+  for (; p + 4 <= pixel_count; p += 4) {
+    __m128i *vector = reinterpret_cast<__m128i *>(pixels + 4 * p);
+    _mm_storeu_si128(vector, _mm_or_si128(_mm_loadu_si128(vector), alpha));
+  }
+  return p;
+}
+
+/// Fills the pixels up to the last multiple of 4, returns how many that were
+size_t fill_sse2(uint8_t *pixels, const uint8_t *pixel, size_t pixel_count) {
+  int32_t value;
+  std::memcpy(&value, pixel, 4);
+  const __m128i repeated = _mm_set1_epi32(value);
+  size_t p = 0;
+  for (; p + 4 <= pixel_count; p += 4) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + 4 * p), repeated);
+  }
+  return p;
+}
+
+#endif
+
+void unfilter_row(int filter, const uint8_t *filtered, const uint8_t *prior, uint8_t *row, size_t width,
+                  bool simd) {
+#ifdef IMAGE_DECODER_SSE2
+  if (simd) {
+    unfilter_sse2(filter, filtered, prior, row, width);
+    return;
+  }
+#endif
+  unfilter_scalar(filter, filtered, prior, row, width);
+}
+
+void set_opaque(uint8_t *pixels, size_t pixel_count, bool simd) {
+  size_t done = 0;
+#ifdef IMAGE_DECODER_SSE2
+  if (simd) {
+    done = set_opaque_sse2(pixels, pixel_count);
+  }
+#endif
+  set_opaque_scalar(pixels + 4 * done, pixel_count - done);
+}
+
+/// Writes the RGBA 'pixel' into 'pixel_count' pixels
+void fill_pixels(uint8_t *pixels, const uint8_t *pixel, size_t pixel_count, bool simd) {
+  size_t done = 0;
+#ifdef IMAGE_DECODER_SSE2
+  if (simd) {
+    done = fill_sse2(pixels, pixel, pixel_count);
+  }
+#endif
+  fill_scalar(pixels + 4 * done, pixel, pixel_count - done);
+}
+
+/// Converts BGR or BGRA pixels of TGA files to RGBA
+void bgr_to_rgba(const uint8_t *source, size_t bytes_per_pixel, size_t pixel_count, uint8_t *rgba, bool simd) {
+  if (bytes_per_pixel == 3) {
+    expand_to_rgba(source, 3, pixel_count, rgba, simd);
+  } else {
+    std::memcpy(rgba, source, 4 * pixel_count);
+  }
+  swap_red_blue(rgba, pixel_count, simd);
+}
+
+bool ends_with(const std::string &text, const std::string &suffix) {
+  if (text.size() < suffix.size()) {
+    return false;
+  }
+  return std::equal(suffix.begin(), suffix.end(), text.end() - suffix.size(),
+                    [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+}
+
+} // namespace
+
+bool decode_png(const uint8_t *data, size_t size, Image *image, bool simd) {
+  if (!is_png(data, size)) {
+    return false;
+  }
+
+  uint32_t width = 0, height = 0;
+  size_t channels = 0;
+  std::vector<uint8_t> compressed;
+  bool ended = false;
+  for (size_t offset = sizeof(png_signature); !ended && offset + 12 <= size;) {
+    const uint32_t length = read_u32_be(data + offset);
+    const uint8_t *type = data + offset + 4;
+    const uint8_t *chunk = data + offset + 8;
+    if (length > size - offset - 12 || (channels == 0) != is_chunk(type, "IHDR")) {
+      return false;
+    }
+
+    if (is_chunk(type, "IHDR")) {
+      if (length != 13) {
+        return false;
+      }
+      width = read_u32_be(chunk);
+      height = read_u32_be(chunk + 4);
+      const uint8_t bit_depth = chunk[8], color_type = chunk[9];
+      // Compression, filter and interlace method
+      if (bit_depth != 8 || (color_type != 2 && color_type != 6) || chunk[10] != 0 || chunk[11] != 0 ||
+          chunk[12] != 0) {
+        return false;
+      }
+      channels = color_type == 2 ? 3 : 4;
+    } else if (is_chunk(type, "IDAT")) {
+      compressed.insert(compressed.end(), chunk, chunk + length);
+    } else if (is_chunk(type, "IEND")) {
+      ended = true;
+    } else if ((type[0] & 0x20) == 0 || is_chunk(type, "tRNS")) {
+      // Other critical chunks (palettes, the CgBI of iPhone files) and color keys change the pixels
+      return false;
+    }
+    offset += 12 + size_t(length);
+  }
+  if (!ended || width == 0 || height == 0 || width > png_max_dimension || height > png_max_dimension) {
+    return false;
+  }
+
+  // Every row starts with its filter type
+  const size_t stride = 1 + channels * width;
+  const size_t raw_size = stride * height;
+  if (raw_size > size_t(INT_MAX) || compressed.size() > size_t(INT_MAX)) {
+    return false;
+  }
+  std::vector<uint8_t> raw(raw_size);
+  // Longer streams do not fit the buffer, they are left to stb_image, which ignores the extra bytes
+  if (stbi_zlib_decode_buffer(reinterpret_cast<char *>(raw.data()), static_cast<int>(raw_size),
+                              reinterpret_cast<const char *>(compressed.data()),
+                              static_cast<int>(compressed.size())) != static_cast<int>(raw_size)) {
+    return false;
+  }
+
+  // RGB rows are expanded to RGBA before the reconstruction. The filters work on each channel by itself, so alpha
+  // comes out as garbage that is set afterwards without touching the colors.
+  const size_t row_bytes = 4 * size_t(width);
+  std::vector<uint8_t> pixels(row_bytes * height);
+  const std::vector<uint8_t> zero_row(row_bytes, 0);
+  std::vector<uint8_t> expanded(channels == 3 ? row_bytes : 0);
+  for (size_t y = 0; y < height; y++) {
+    const uint8_t *filtered = raw.data() + y * stride;
+    const int filter = *filtered++;
+    if (filter > PNG_FILTER_PAETH) {
+      return false;
+    }
+    if (channels == 3) {
+      expand_to_rgba(filtered, 3, width, expanded.data(), simd);
+      filtered = expanded.data();
+    }
+    uint8_t *row = pixels.data() + y * row_bytes;
+    const uint8_t *prior = y == 0 ? zero_row.data() : row - row_bytes;
+    unfilter_row(filter, filtered, prior, row, width, simd);
+    if (channels == 3) {
+      set_opaque(row, width, simd);
+    }
+  }
+
+  image->width = static_cast<int>(width);
+  image->height = static_cast<int>(height);
+  image->pixels = std::move(pixels);
+  image->pixel_format = GL_RGBA;
+  return true;
+}
+
+bool decode_tga(const uint8_t *data, size_t size, Image *image, bool simd) {
+  const size_t header_size = 18;
+  if (size < header_size) {
+    return false;
+  }
+  const uint8_t id_length = data[0], color_map_type = data[1], image_type = data[2];
+  const size_t width = read_u16_le(data + 12), height = read_u16_le(data + 14);
+  const uint8_t bits_per_pixel = data[16], descriptor = data[17];
+  // True color, uncompressed (2) or RLE (10)
+  if (color_map_type != 0 || (image_type != 2 && image_type != 10) || (bits_per_pixel != 24 && bits_per_pixel != 32) ||
+      width == 0 || height == 0) {
+    return false;
+  }
+
+  const size_t bytes_per_pixel = bits_per_pixel / 8;
+  const size_t row_bytes = 4 * width;
+  // Rows are stored bottom up unless bit 5 of the descriptor is set
+  const bool bottom_up = (descriptor & 0x20) == 0;
+  std::vector<uint8_t> pixels(row_bytes * height);
+  auto row_at = [&](size_t y) { return pixels.data() + (bottom_up ? height - 1 - y : y) * row_bytes; };
+
+  size_t offset = header_size + id_length;
+  if (image_type == 2) {
+    if (offset > size || (size - offset) / bytes_per_pixel / width < height) {
+      return false;
+    }
+    for (size_t y = 0; y < height; y++) {
+      bgr_to_rgba(data + offset + y * width * bytes_per_pixel, bytes_per_pixel, width, row_at(y), simd);
+    }
+  } else {
+    // Packets of one repeated pixel or of literal pixels, up to 128 of them, may run on into the next row
+    size_t x = 0, y = 0;
+    uint8_t *row = row_at(0);
+    while (y < height) {
+      if (offset >= size) {
+        return false;
+      }
+      const uint8_t packet = data[offset++];
+      const bool repeated = (packet & 0x80) != 0;
+      size_t count = (packet & 0x7f) + 1;
+      uint8_t pixel[4];
+      if (repeated) {
+        if (size - offset < bytes_per_pixel) {
+          return false;
+        }
+        bgr_to_rgba(data + offset, bytes_per_pixel, 1, pixel, false);
+        offset += bytes_per_pixel;
+      }
+      while (count > 0 && y < height) {
+        const size_t run = std::min(count, width - x);
+        if (repeated) {
+          fill_pixels(row + 4 * x, pixel, run, simd);
+        } else {
+          if ((size - offset) / bytes_per_pixel < run) {
+            return false;
+          }
+          bgr_to_rgba(data + offset, bytes_per_pixel, run, row + 4 * x, simd);
+          offset += run * bytes_per_pixel;
+        }
+        count -= run;
+        x += run;
+        if (x == width) {
+          x = 0;
+          if (++y < height) {
+            row = row_at(y);
+          }
+        }
+      }
+    }
+  }
+
+  image->width = static_cast<int>(width);
+  image->height = static_cast<int>(height);
+  image->pixels = std::move(pixels);
+  image->pixel_format = GL_RGBA;
+  return true;
+}
+
+bool decode_image_fast(const std::string &filename, Image *image, bool simd) {
+  std::unique_ptr<MappedFile> file;
+  try {
+    file = std::make_unique<MappedFile>(filename);
+  } catch (const std::string &) {
+    return false;
+  }
+
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(file->data());
+  if (is_png(data, file->size())) {
+    return decode_png(data, file->size(), image, simd);
+  }
+  // TGA files have no signature, stb_image tries them after all other formats
+  return ends_with(filename, ".tga") && decode_tga(data, file->size(), image, simd);
+}
@@ -0,0 +1,97 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &file_name) {
+  HANDLE file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw "File " + file_name + " does not exists";
+  }
+  this->file_handle = file;
+
+  LARGE_INTEGER file_size;
+  GetFileSizeEx(file, &file_size);
+  this->length = static_cast<size_t>(file_size.QuadPart);
+
+  // Empty files cannot be mapped, data() stays nullptr
+  if (this->length == 0) {
+    return;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr) {
+    CloseHandle(file);
+    throw "File " + file_name + " could not be mapped";
+  }
+  const void *address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (address == nullptr) {
+    // The destructor does not run for a throwing constructor
+    CloseHandle(mapping);
+    CloseHandle(file);
+    throw "File " + file_name + " could not be mapped";
+  }
+  this->mapping_handle = mapping;
+  this->bytes = static_cast<const char *>(address);
+}
+
+MappedFile::~MappedFile() {
+  if (this->bytes) {
+    UnmapViewOfFile(this->bytes);
+  }
+  if (this->mapping_handle) {
+    CloseHandle(this->mapping_handle);
+  }
+  if (this->file_handle) {
+    CloseHandle(this->file_handle);
+  }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &file_name) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw "File " + file_name + " does not exists";
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw "File " + file_name + " could not be read";
+  }
+  this->length = static_cast<size_t>(info.st_size);
+
+  // Empty files cannot be mapped, data() stays nullptr
+  if (this->length > 0) {
+    void *address = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+      close(fd);
+      throw "File " + file_name + " could not be mapped";
+    }
+    madvise(address, this->length, MADV_SEQUENTIAL);
+    this->bytes = static_cast<const char *>(address);
+  }
+
+  // The mapping keeps its own reference to the file
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (this->bytes) {
+    munmap(const_cast<char *>(this->bytes), this->length);
+  }
+}
+
+#endif
@@ -4,68 +4,146 @@
 #include "sphere.inl"
 #include "teapot.inl"
 #include "texture.hpp"
+#include "obj_loader.hpp"
+#include "mesh_optimizer.hpp"
+#include "render_stats.hpp"
+#include "texture_cache.hpp"
+#include "vertex_format.hpp"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
+#include <cstddef>
+#include <unordered_map>
 
 Mesh::Mesh(std::vector<float> vertices, std::vector<float> normals, std::vector<float> tex_coords,
            std::vector<uint32_t> indices, GLenum mode, GLint position_location, GLint normal_location,
            GLint tex_coord_location) {
-  vertices_count = vertices.size() / 3;
-  this->texture_id = texture_id;
+  MeshView view;
+  view.vertices = vertices.data();
+  view.normals = normals.empty() ? nullptr : normals.data();
+  view.tex_coords = tex_coords.empty() ? nullptr : tex_coords.data();
+  view.vertex_count = vertices.size() / 3;
+  view.index_count = indices.size();
+
+  // Every index fits into 16 bits, halve the size of the buffer
+  std::vector<uint16_t> short_indices;
+  if (view.vertex_count < 65536) {
+    short_indices.assign(indices.begin(), indices.end());
+    view.indices = short_indices.data();
+    view.index_size = sizeof(uint16_t);
+  } else {
+    view.indices = indices.data();
+    view.index_size = sizeof(uint32_t);
+  }
 
-  // Create buffer for vertices
-  glGenBuffers(1, &this->vertices_buffer_id);
-  glBindBuffer(GL_ARRAY_BUFFER, this->vertices_buffer_id);
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  this->upload(view, mode, false);
+  this->create_vao(position_location, normal_location, tex_coord_location);
+}
 
-  // Create buffer for normals
-  if (!normals.empty()) {
-    glGenBuffers(1, &this->normals_buffer_id);
-    glBindBuffer(GL_ARRAY_BUFFER, this->normals_buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), normals.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-  }
+Mesh::Mesh(const MeshData &data, GLenum mode, GLint position_location, GLint normal_location,
+           GLint tex_coord_location, bool compact_vertices) {
+  std::vector<uint16_t> short_indices;
+  this->upload(make_mesh_view(data, &short_indices), mode, compact_vertices);
+  this->create_vao(position_location, normal_location, tex_coord_location);
 
-  // Create buffer for texture coordinates
-  if (!tex_coords.empty()) {
-    glGenBuffers(1, &this->tex_coords_buffer_id);
-    glBindBuffer(GL_ARRAY_BUFFER, this->tex_coords_buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, tex_coords.size() * sizeof(float), tex_coords.data(), GL_STATIC_DRAW);
+  this->submeshes = data.submeshes;
+  this->materials = data.materials;
+  this->set_shapes(data.shape_names, data.shape_ranges);
+  this->set_lods(data.lods);
+  this->set_bounds(data.bounds_min, data.bounds_max);
+  this->set_meshlets(data.meshlets);
+}
+
+Mesh::Mesh(const MeshView &view, GLenum mode, GLint position_location, GLint normal_location,
+           GLint tex_coord_location, bool compact_vertices) {
+  this->upload(view, mode, compact_vertices);
+  this->create_vao(position_location, normal_location, tex_coord_location);
+}
+
+void Mesh::upload(const MeshView &view, GLenum mode, bool compact) {
+  vertices_count = view.vertex_count;
+
+  if (compact) {
+    // One interleaved buffer holds all attributes
+    this->compact_vertices = true;
+    const std::vector<CompactVertex> vertices =
+        ::compact_vertices(view, &this->position_offset, &this->position_scale);
+    glGenBuffers(1, &this->vertices_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, this->vertices_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(CompactVertex), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  } else {
+    // Create buffer for vertices
+    glGenBuffers(1, &this->vertices_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, this->vertices_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, vertices_count * 3 * sizeof(float), view.vertices, GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Create buffer for normals
+    if (view.normals) {
+      glGenBuffers(1, &this->normals_buffer_id);
+      glBindBuffer(GL_ARRAY_BUFFER, this->normals_buffer_id);
+      glBufferData(GL_ARRAY_BUFFER, vertices_count * 3 * sizeof(float), view.normals, GL_STATIC_DRAW);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Create buffer for texture coordinates
+    if (view.tex_coords) {
+      glGenBuffers(1, &this->tex_coords_buffer_id);
+      glBindBuffer(GL_ARRAY_BUFFER, this->tex_coords_buffer_id);
+      glBufferData(GL_ARRAY_BUFFER, vertices_count * 2 * sizeof(float), view.tex_coords, GL_STATIC_DRAW);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
   }
 
-  if (!indices.empty()) {
+  if (view.index_count > 0) {
     // If indices buffer is not empty => create buffer for indices
     glGenBuffers(1, &this->indices_buffer_id);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->indices_buffer_id);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, view.index_count * view.index_size, view.indices, GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    this->indices_count = indices.size();
+    this->index_type = view.index_size == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    this->indices_count = view.index_count;
   }
 
   this->mode = mode;
-
-  this->create_vao(position_location, normal_location, tex_coord_location);
 }
 
 Mesh::Mesh(const Mesh &other) {
   this->vertices_count = other.vertices_count;
   this->indices_count = other.indices_count;
+  this->index_type = other.index_type;
   this->texture_id = other.texture_id;
   this->mode = other.mode;
+  this->submeshes = other.submeshes;
+  this->materials = other.materials;
+  this->shape_names = other.shape_names;
+  this->shape_ranges = other.shape_ranges;
+  this->compact_vertices = other.compact_vertices;
+  this->position_offset = other.position_offset;
+  this->position_scale = other.position_scale;
+  this->lods = other.lods;
+  this->lod_errors = other.lod_errors;
+  this->current_lod = other.current_lod;
+  this->bounds_min = other.bounds_min;
+  this->bounds_max = other.bounds_max;
+  this->meshlets = other.meshlets;
+  this->meshlet_culler = other.meshlet_culler;
+  this->texel_densities = other.texel_densities;
+  this->texture_references = other.texture_references;
+  for (GLuint texture : this->texture_references) {
+    TextureCache::shared().retain(texture);
+  }
 
   // Copy vertices
   if (other.vertices_buffer_id != 0) {
+    const size_t vertex_size = this->compact_vertices ? sizeof(CompactVertex) : sizeof(float) * 3;
     glGenBuffers(1, &this->vertices_buffer_id);
     glBindBuffer(GL_ARRAY_BUFFER, this->vertices_buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, vertices_count * sizeof(float) * 3, nullptr, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertices_count * vertex_size, nullptr, GL_STATIC_DRAW);
 
     glBindBuffer(GL_COPY_READ_BUFFER, other.vertices_buffer_id);
     glBindBuffer(GL_COPY_WRITE_BUFFER, this->vertices_buffer_id);
-    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, vertices_count * sizeof(float) * 3);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, vertices_count * vertex_size);
   }
 
   // Copy normals
@@ -92,13 +170,14 @@ Mesh::Mesh(const Mesh &other) {
 
   // Copy indices buffer
   if (other.indices_buffer_id != 0) {
+    const size_t index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
     glGenBuffers(1, &this->indices_buffer_id);
     glBindBuffer(GL_ARRAY_BUFFER, this->indices_buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, indices_count * sizeof(uint32_t), nullptr, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, indices_count * index_size, nullptr, GL_STATIC_DRAW);
 
     glBindBuffer(GL_COPY_READ_BUFFER, other.indices_buffer_id);
     glBindBuffer(GL_COPY_WRITE_BUFFER, this->indices_buffer_id);
-    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, indices_count * sizeof(uint32_t));
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, indices_count * index_size);
   }
 
   // Set up VAO if the other object has one too
@@ -121,19 +200,43 @@ void Mesh::create_vao(GLint position_location, GLint normal_location, GLint tex_
   // Set the parameters of the geometry
   glBindVertexArray(this->vao_id);
 
-  if (position_location >= 0) {
+  if (this->compact_vertices) {
+    // Layout of CompactVertex, normalization turns the integers back into [0, 1] and [-1, 1]
+    const GLsizei stride = sizeof(CompactVertex);
+    glBindBuffer(GL_ARRAY_BUFFER, this->vertices_buffer_id);
+    if (position_location >= 0) {
+      this->position_location = position_location;
+      glEnableVertexAttribArray(position_location);
+      glVertexAttribPointer(position_location, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+                            reinterpret_cast<const void *>(offsetof(CompactVertex, position)));
+    }
+    if (normal_location >= 0) {
+      this->normal_location = normal_location;
+      glEnableVertexAttribArray(normal_location);
+      glVertexAttribPointer(normal_location, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+                            reinterpret_cast<const void *>(offsetof(CompactVertex, normal)));
+    }
+    if (tex_coord_location >= 0) {
+      this->tex_coord_location = tex_coord_location;
+      glEnableVertexAttribArray(tex_coord_location);
+      glVertexAttribPointer(tex_coord_location, 2, GL_HALF_FLOAT, GL_FALSE, stride,
+                            reinterpret_cast<const void *>(offsetof(CompactVertex, tex_coord)));
+    }
+  }
+
+  if (!this->compact_vertices && position_location >= 0) {
     this->position_location = position_location;
     glBindBuffer(GL_ARRAY_BUFFER, this->vertices_buffer_id);
     glEnableVertexAttribArray(position_location);
     glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, 0);
   }
-  if (normal_location >= 0) {
+  if (!this->compact_vertices && normal_location >= 0) {
     this->normal_location = normal_location;
     glBindBuffer(GL_ARRAY_BUFFER, this->normals_buffer_id);
     glEnableVertexAttribArray(normal_location);
     glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, 0);
   }
-  if (tex_coord_location >= 0) {
+  if (!this->compact_vertices && tex_coord_location >= 0) {
     this->tex_coord_location = tex_coord_location;
     glBindBuffer(GL_ARRAY_BUFFER, this->tex_coords_buffer_id);
     glEnableVertexAttribArray(tex_coord_location);
@@ -149,13 +252,127 @@ void Mesh::create_vao(GLint position_location, GLint normal_location, GLint tex_
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
+void Mesh::bind_vao() {
+  glBindVertexArray(this->vao_id);
+  render_stats().vao_changes++;
+}
+
+void Mesh::set_lods(const std::vector<MeshLod> &lods) {
+  this->lods = lods;
+  this->lod_errors = {0.f};
+  for (const MeshLod &lod : lods) {
+    this->lod_errors.push_back(lod.error);
+  }
+  this->current_lod = 0;
+}
+
+size_t Mesh::select_lod(const glm::vec3 &eye, float projection_scale, const LodSettings &settings) {
+  const float distance = distance_to_bounds(eye, this->bounds_min, this->bounds_max);
+  this->current_lod = ::select_lod(this->lod_errors, this->current_lod, distance, projection_scale, settings);
+  return this->current_lod;
+}
+
+float Mesh::uv_per_pixel(size_t submesh, const glm::vec3 &eye, float projection_scale) const {
+  if (submesh >= this->texel_densities.size()) {
+    return 0.f;
+  }
+  return ::uv_per_pixel(this->texel_densities[submesh], eye, projection_scale);
+}
+
+void Mesh::set_meshlets(const std::vector<Meshlet> &meshlets) {
+  this->meshlets = meshlets;
+  this->meshlet_culler = meshlets.empty() ? nullptr : std::make_shared<const MeshletCuller>(meshlets);
+  this->meshlets_culled = false;
+}
+
+MeshletCullStats Mesh::cull_meshlets(const glm::mat4 &view_projection, const glm::vec3 &eye,
+                                     const MeshletCullSettings &settings) {
+  if (!this->meshlet_culler || this->submeshes.empty() || this->current_lod > 0) {
+    this->meshlets_culled = false;
+    return MeshletCullStats();
+  }
+
+  const MeshletCullStats stats = this->meshlet_culler->cull(view_projection, eye, settings, &this->visible_meshlets);
+  render_stats().meshlet_triangles += stats.triangles;
+  render_stats().meshlet_triangles_culled += stats.triangles - stats.visible_triangles;
+
+  this->meshlet_draws.resize(this->submeshes.size());
+  for (MeshletDraws &draws : this->meshlet_draws) {
+    draws.counts.clear();
+    draws.offsets.clear();
+    draws.base_vertices.clear();
+    draws.index_count = 0;
+  }
+
+  // Neighbouring visible meshlets are continuous in the index buffer and merge into one range
+  const size_t index_size = this->index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+  size_t range_end = 0;
+  for (uint32_t m : this->visible_meshlets) {
+    const Meshlet &meshlet = this->meshlets[m];
+    MeshletDraws &draws = this->meshlet_draws[meshlet.submesh];
+    const GLsizei count = static_cast<GLsizei>(meshlet.triangle_count * 3);
+    if (!draws.counts.empty() && range_end == meshlet.first_index) {
+      draws.counts.back() += count;
+    } else {
+      draws.counts.push_back(count);
+      draws.offsets.push_back(reinterpret_cast<const void *>(meshlet.first_index * index_size));
+      draws.base_vertices.push_back(static_cast<GLint>(this->submeshes[meshlet.submesh].base_vertex));
+    }
+    draws.index_count += count;
+    range_end = meshlet.first_index + count;
+  }
+
+  this->meshlets_culled = true;
+  return stats;
+}
+
 void Mesh::draw() {
   this->bind_vao();
 
-  if (this->indices_buffer_id > 0) {
-    glDrawElements(this->mode, static_cast<GLsizei>(this->indices_count), GL_UNSIGNED_INT, nullptr);
+  if (!this->submeshes.empty()) {
+    for (size_t s = 0; s < this->submeshes.size(); s++) {
+      this->draw_submesh(s);
+    }
+  } else if (this->indices_buffer_id > 0) {
+    glDrawElements(this->mode, static_cast<GLsizei>(this->indices_count), this->index_type, nullptr);
+    render_stats().draw_calls++;
+    if (this->mode == GL_TRIANGLES) {
+      render_stats().triangles += this->indices_count / 3;
+    }
   } else {
     glDrawArrays(this->mode, 0, static_cast<GLsizei>(this->vertices_count));
+    render_stats().draw_calls++;
+  }
+}
+
+void Mesh::draw_submesh(size_t submesh) {
+  if (this->meshlets_culled && this->current_lod == 0) {
+    const MeshletDraws &draws = this->meshlet_draws[submesh];
+    if (draws.counts.empty()) {
+      return;
+    }
+    glMultiDrawElementsBaseVertex(this->mode, draws.counts.data(), this->index_type, draws.offsets.data(),
+                                  static_cast<GLsizei>(draws.counts.size()),
+                                  draws.base_vertices.data());
+    render_stats().draw_calls++;
+    render_stats().triangles += draws.index_count / 3;
+    return;
+  }
+
+  const Submesh &range = this->get_submeshes()[submesh];
+  if (range.index_count == 0) {
+    // The material has no triangles left in this level
+    return;
+  }
+  const size_t index_size = this->index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+
+  // Indices of a submesh are relative to its first vertex, which keeps them 16-bit
+  glDrawElementsBaseVertex(this->mode, static_cast<GLsizei>(range.index_count), this->index_type,
+                           reinterpret_cast<const void *>(range.first_index * index_size),
+                           static_cast<GLint>(range.base_vertex));
+  render_stats().draw_calls++;
+  if (this->mode == GL_TRIANGLES) {
+    render_stats().triangles += range.index_count / 3;
   }
 }
 
@@ -207,73 +424,163 @@ static std::string GetBaseDir(const std::string& filepath) {
 }
 
 std::vector<std::unique_ptr<Mesh>> Mesh::from_file(const std::string &file_name, GLint position_location, GLint normal_location,
-                                  GLint tex_coord_location) {
+                                  GLint tex_coord_location, uint32_t build_flags) {
+  std::vector<std::unique_ptr<Mesh>> meshes =
+      Mesh::from_loaded_file(Mesh::load_file(file_name, build_flags), position_location, normal_location,
+                             tex_coord_location, build_flags);
+
+  // All images of the file are decoded at once
+  const std::vector<std::string> paths = Mesh::texture_paths(meshes);
+  const std::vector<GLuint> texture_ids = load_textures_2d(paths);
+  std::unordered_map<std::string, GLuint> textures;
+  for (size_t i = 0; i < paths.size(); i++) {
+    textures.emplace(paths[i], texture_ids[i]);
+  }
+  Mesh::assign_textures(meshes, [&](const std::string &path) { return textures.at(path); });
+  return meshes;
+}
+
+MeshFile Mesh::load_file(const std::string &file_name, uint32_t build_flags) {
+  MeshFile file;
+
+  const std::string base_dir = GetBaseDir(file_name);
+
+  // Compact vertices are encoded on upload, the cached data is the same either way
+  const uint32_t cache_flags = build_flags & ~MESH_BUILD_COMPACT_VERTICES;
+
+  // Up to date binary cache, the buffers are uploaded straight from the mapped file
+  file.cache = MeshCache::open(file_name, cache_flags);
+  if (file.cache) {
+    for (const auto &entry : file.cache->get_meshes()) {
+      file.texel_densities.push_back(compute_texel_densities(entry.view, entry.submeshes));
+    }
+    return file;
+  }
+
   tinyobj::attrib_t attrib;
   std::vector<tinyobj::shape_t> shapes;
   std::vector<tinyobj::material_t> materials;
+  std::vector<std::string> material_files;
 
   std::string err;
 
-  const std::string base_dir = GetBaseDir(file_name);
-  bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, file_name.c_str(), base_dir.c_str());
+  // tinyobj appends the MTL name to the directory as is, so it needs the trailing separator
+  const std::string mtl_base_dir = base_dir.empty() ? "" : base_dir + "/";
+  bool ret = load_obj(&attrib, &shapes, &materials, &err, file_name, mtl_base_dir, ThreadPool::shared(), 0,
+                      &material_files);
 
   if (!ret) {
     throw "Could not load object file.";
   }
 
-  std::vector<std::unique_ptr<Mesh>> meshes;
+  // All shapes share one buffer, faces are grouped by material and welded per group
+  file.meshes.push_back(build_material_batches(attrib, shapes, materials, base_dir));
+  MeshData &data = file.meshes.back();
+  if (build_flags & MESH_BUILD_OPTIMIZE) {
+    optimize_mesh(&data);
+  }
+  if (build_flags & MESH_BUILD_LODS) {
+    build_lods(&data);
+  }
+  if (build_flags & MESH_BUILD_MESHLETS) {
+    data.meshlets = build_meshlets(data);
+  }
 
-  // Load diffuse texture
-  GLuint texture_id = 0;
+  std::vector<std::string> source_files = {file_name};
+  source_files.insert(source_files.end(), material_files.begin(), material_files.end());
+  MeshCache::write(file_name, source_files, file.meshes, cache_flags);
 
-  // default material
-  materials.push_back(tinyobj::material_t());
+  for (const MeshData &mesh : file.meshes) {
+    std::vector<uint16_t> short_indices;
+    file.texel_densities.push_back(compute_texel_densities(make_mesh_view(mesh, &short_indices), mesh.submeshes));
+  }
 
-  if (materials[0].diffuse_texname.length() > 0) {
-      auto const pos = materials[0].diffuse_texname.find_last_of("/\\");
-      if (pos != std::string::npos) {
-          const std::string leaf = base_dir + materials[0].diffuse_texname.substr(pos);
-          texture_id = load_texture_2d(leaf);
-          glBindTexture(GL_TEXTURE_2D, 0);
-      }
+  return file;
+}
+
+std::vector<std::unique_ptr<Mesh>> Mesh::from_loaded_file(const MeshFile &file, GLint position_location,
+                                                          GLint normal_location, GLint tex_coord_location,
+                                                          uint32_t build_flags) {
+  std::vector<std::unique_ptr<Mesh>> meshes;
+  const bool compact = (build_flags & MESH_BUILD_COMPACT_VERTICES) != 0;
+
+  if (file.cache) {
+    for (const auto &entry : file.cache->get_meshes()) {
+      meshes.push_back(std::make_unique<Mesh>(entry.view, GL_TRIANGLES, -1, -1, -1, compact));
+      meshes.back()->set_submeshes(entry.submeshes);
+      meshes.back()->set_materials(entry.materials);
+      meshes.back()->set_shapes(entry.shape_names, entry.shape_ranges);
+      meshes.back()->set_lods(entry.lods);
+      meshes.back()->set_bounds(entry.bounds_min, entry.bounds_max);
+      meshes.back()->set_meshlets(entry.meshlets);
+    }
+  } else {
+    for (const auto &data : file.meshes) {
+      meshes.push_back(std::make_unique<Mesh>(data, GL_TRIANGLES, -1, -1, -1, compact));
+    }
   }
 
+  for (size_t i = 0; i < meshes.size(); i++) {
+    meshes[i]->create_vao(position_location, normal_location, tex_coord_location);
+    if (i < file.texel_densities.size()) {
+      meshes[i]->set_texel_densities(file.texel_densities[i]);
+    }
+  }
 
-  // Loop over shapes
-  for (size_t s = 0; s < shapes.size(); s++) {
-    std::vector<float> vertices;
-    std::vector<float> normals;
-    std::vector<float> tex_coords;
+  return meshes;
+}
 
-    for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-      // Loop over vertices in the face/polygon
-      // (because of triangulate true in LoadObj number of vertices
-      // per face/polygon is always 3
-      for (size_t v = 0; v < 3; v++) {
-        // access to vertex
-        tinyobj::index_t idx = shapes[s].mesh.indices[f * 3 + v];
+std::vector<std::string> Mesh::texture_paths(const std::vector<std::unique_ptr<Mesh>> &meshes) {
+  std::vector<std::string> paths;
+  for (const auto &mesh : meshes) {
+    for (const auto &material : mesh->materials) {
+      if (!material.diffuse_texture.empty() &&
+          std::find(paths.begin(), paths.end(), material.diffuse_texture) == paths.end()) {
+        paths.push_back(material.diffuse_texture);
+      }
+    }
+  }
+  return paths;
+}
 
-        for (int i = 0; i < 3; i++) {
-          vertices.push_back(attrib.vertices[3 * idx.vertex_index + i]);
+void Mesh::assign_textures(const std::vector<std::unique_ptr<Mesh>> &meshes,
+                           const std::function<GLuint(const std::string &)> &load_texture) {
+  TextureCache &cache = TextureCache::shared();
+  // Materials sharing an image share the texture too
+  std::unordered_map<std::string, GLuint> textures;
+  for (const auto &mesh : meshes) {
+    for (GLuint texture : mesh->texture_references) {
+      cache.release(texture);
+    }
+    mesh->texture_references.clear();
 
-          if (!attrib.normals.empty()) {
-            normals.push_back(attrib.normals[3 * idx.normal_index + i]);
-          }
-        }
+    for (auto &material : mesh->materials) {
+      if (material.diffuse_texture.empty()) {
+        continue;
+      }
+      auto found = textures.find(material.diffuse_texture);
+      if (found == textures.end()) {
+        found = textures.emplace(material.diffuse_texture, load_texture(material.diffuse_texture)).first;
+      }
+      material.texture_id = found->second;
 
-        if (!attrib.texcoords.empty()) {
-          tex_coords.push_back(attrib.texcoords[2 * idx.texcoord_index + 0]);
-          tex_coords.push_back(attrib.texcoords[2 * idx.texcoord_index + 1]);
-        }
+      if (std::find(mesh->texture_references.begin(), mesh->texture_references.end(), material.texture_id) ==
+          mesh->texture_references.end()) {
+        mesh->texture_references.push_back(material.texture_id);
+        cache.retain(material.texture_id);
       }
     }
 
-    meshes.push_back(std::make_unique<Mesh>(vertices, normals, tex_coords, std::vector<uint32_t>()));
-    meshes[meshes.size() - 1]->create_vao(position_location, normal_location, tex_coord_location);
-    meshes[meshes.size() - 1]->set_texture_id(texture_id);
+    // Texture of the first material, for the callers that draw the mesh as a whole
+    if (!mesh->materials.empty()) {
+      mesh->set_texture_id(mesh->materials[0].texture_id);
+    }
   }
-
-  return meshes;
+  // The meshes hold their own references now
+  for (const auto &texture : textures) {
+    cache.release(texture.second);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 Mesh::~Mesh() {
@@ -286,4 +593,8 @@ Mesh::~Mesh() {
   glDeleteBuffers(1, &this->normals_buffer_id);
   glDeleteBuffers(1, &this->tex_coords_buffer_id);
   glDeleteBuffers(1, &this->indices_buffer_id);
+
+  for (GLuint texture : this->texture_references) {
+    TextureCache::shared().release(texture);
+  }
 }
@@ -0,0 +1,438 @@
+#include "mesh_cache.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+const char magic[8] = {'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H'};
+const size_t blob_alignment = 16;
+
+const uint32_t has_normals = 1;
+const uint32_t has_tex_coords = 2;
+
+/// Appends plain values to a byte buffer
+class CacheWriter {
+public:
+  template <typename T> void write(const T &value) {
+    const char *bytes = reinterpret_cast<const char *>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+  }
+
+  void write_string(const std::string &value) {
+    write(static_cast<uint32_t>(value.size()));
+    buffer.insert(buffer.end(), value.begin(), value.end());
+  }
+
+  /// Appends the bytes aligned and returns their offset
+  size_t write_blob(const void *data, size_t size) {
+    buffer.resize((buffer.size() + blob_alignment - 1) / blob_alignment * blob_alignment);
+    const size_t offset = buffer.size();
+    const char *bytes = static_cast<const char *>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+    return offset;
+  }
+
+  std::vector<char> buffer;
+};
+
+/// Reads plain values from the mapped file, every read is bounds checked
+class CacheReader {
+public:
+  CacheReader(const char *data, size_t size) : data(data), size(size) {}
+
+  template <typename T> bool read(T *value) {
+    if (offset + sizeof(T) > size) {
+      return false;
+    }
+    std::memcpy(value, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+  }
+
+  bool read_string(std::string *value) {
+    uint32_t length;
+    if (!read(&length) || length > size - offset) {
+      return false;
+    }
+    value->assign(data + offset, length);
+    offset += length;
+    return true;
+  }
+
+  /// Returns the blob at the given offset of the data section or nullptr when it does not fit into the file.
+  /// The values come from the file, every term is checked against what remains so no sum can wrap.
+  const char *blob(uint64_t data_offset, uint64_t blob_offset, uint64_t blob_size) const {
+    if (data_offset > size || blob_offset > size - data_offset || blob_size > size - data_offset - blob_offset) {
+      return nullptr;
+    }
+    return data + data_offset + blob_offset;
+  }
+
+private:
+  const char *data;
+  size_t size;
+  size_t offset = 0;
+};
+
+/// Whether [first, first + count) lies within [0, total), without overflowing on values read from the file
+bool fits(uint64_t first, uint64_t count, uint64_t total) { return first <= total && count <= total - first; }
+
+/// Whether the indices of [first, first + count) are all below 'limit'; the range is known to be in the blob
+bool indices_below(const void *indices, uint32_t index_size, uint64_t first, uint64_t count, uint64_t limit) {
+  uint32_t largest = 0;
+  if (index_size == sizeof(uint16_t)) {
+    const uint16_t *values = static_cast<const uint16_t *>(indices) + first;
+    for (uint64_t i = 0; i < count; i++) {
+      largest = std::max<uint32_t>(largest, values[i]);
+    }
+  } else {
+    const uint32_t *values = static_cast<const uint32_t *>(indices) + first;
+    for (uint64_t i = 0; i < count; i++) {
+      largest = std::max(largest, values[i]);
+    }
+  }
+  return count == 0 || largest < limit;
+}
+
+} // namespace
+
+const uint32_t MeshCache::version;
+
+std::unique_ptr<MeshCache> MeshCache::open(const std::string &obj_file_name, uint32_t build_flags) {
+  std::unique_ptr<MappedFile> file;
+  try {
+    file = std::make_unique<MappedFile>(path_for(obj_file_name));
+  } catch (const std::string &) {
+    return nullptr;
+  }
+
+  std::unique_ptr<MeshCache> cache(new MeshCache(std::move(file)));
+  if (!cache->parse(build_flags)) {
+    return nullptr;
+  }
+  return cache;
+}
+
+bool MeshCache::parse(uint32_t build_flags) {
+  CacheReader reader(file->data(), file->size());
+
+  char file_magic[sizeof(magic)];
+  uint32_t file_version, file_build_flags, source_count, mesh_count;
+  uint64_t data_offset;
+  if (!reader.read(&file_magic) || std::memcmp(file_magic, magic, sizeof(magic)) != 0 ||
+      !reader.read(&file_version) || file_version != version || !reader.read(&file_build_flags) ||
+      file_build_flags != build_flags || !reader.read(&data_offset) ||
+      !reader.read(&source_count) || !reader.read(&mesh_count)) {
+    return false;
+  }
+
+  // Cheap checks of size and time first, hashing reads the whole source file
+  for (uint32_t s = 0; s < source_count; s++) {
+    std::string path;
+    uint64_t size, hash, current_size, current_hash;
+    int64_t time, current_time;
+    if (!reader.read_string(&path) || !reader.read(&size) || !reader.read(&time) || !reader.read(&hash)) {
+      return false;
+    }
+    if (!get_file_info(path, &current_size, &current_time) || current_size != size || current_time != time ||
+        !hash_file(path, &current_hash) || current_hash != hash) {
+      return false;
+    }
+  }
+
+  if (mesh_count > file->size()) {
+    return false;
+  }
+  meshes.resize(mesh_count);
+  for (auto &mesh : meshes) {
+    float bounds[6];
+    uint64_t vertex_count, index_count, offsets[4];
+    uint32_t index_size, flags, material_count, submesh_count, lod_count;
+    if (!reader.read_string(&mesh.name) || !reader.read(&bounds) || !reader.read(&vertex_count) ||
+        !reader.read(&index_count) || !reader.read(&index_size) || !reader.read(&flags) || !reader.read(&offsets) ||
+        !reader.read(&material_count) || !reader.read(&submesh_count) || !reader.read(&lod_count)) {
+      return false;
+    }
+
+    if (vertex_count > file->size() || index_count > file->size() || material_count > file->size() ||
+        submesh_count > file->size() || lod_count > file->size()) {
+      return false;
+    }
+
+    mesh.materials.resize(material_count);
+    for (Material &material : mesh.materials) {
+      float values[8];
+      if (!reader.read_string(&material.name) || !reader.read(&values) ||
+          !reader.read_string(&material.diffuse_texture)) {
+        return false;
+      }
+      material.diffuse = glm::vec3(values[0], values[1], values[2]);
+      material.specular = glm::vec3(values[3], values[4], values[5]);
+      material.shininess = values[6];
+      material.dissolve = values[7];
+    }
+
+    mesh.submeshes.resize(submesh_count);
+    for (Submesh &submesh : mesh.submeshes) {
+      int32_t material_id;
+      uint64_t ranges[4];
+      if (!reader.read(&material_id) || !reader.read(&ranges)) {
+        return false;
+      }
+      submesh.material_id = material_id;
+      submesh.first_index = ranges[0];
+      submesh.index_count = ranges[1];
+      submesh.base_vertex = ranges[2];
+      submesh.vertex_count = ranges[3];
+
+      if (material_id < 0 || static_cast<uint32_t>(material_id) >= material_count ||
+          !fits(ranges[0], ranges[1], index_count) || !fits(ranges[2], ranges[3], vertex_count)) {
+        return false;
+      }
+    }
+
+    // Levels of detail share the vertices and materials of the submeshes, only the index ranges differ
+    mesh.lods.resize(lod_count);
+    for (MeshLod &lod : mesh.lods) {
+      if (!reader.read(&lod.error)) {
+        return false;
+      }
+      lod.submeshes = mesh.submeshes;
+      for (Submesh &submesh : lod.submeshes) {
+        uint64_t ranges[2];
+        if (!reader.read(&ranges) || !fits(ranges[0], ranges[1], index_count)) {
+          return false;
+        }
+        submesh.first_index = ranges[0];
+        submesh.index_count = ranges[1];
+      }
+    }
+
+    uint32_t meshlet_count;
+    uint64_t meshlet_offset;
+    if (!reader.read(&meshlet_count) || !reader.read(&meshlet_offset) || meshlet_count > file->size()) {
+      return false;
+    }
+    const char *meshlets = reader.blob(data_offset, meshlet_offset, meshlet_count * sizeof(Meshlet));
+    if (!meshlets) {
+      return false;
+    }
+    mesh.meshlets.resize(meshlet_count);
+    std::memcpy(mesh.meshlets.data(), meshlets, meshlet_count * sizeof(Meshlet));
+    for (const Meshlet &meshlet : mesh.meshlets) {
+      // Without submeshes the whole index buffer is a single range
+      Submesh range;
+      range.index_count = index_count;
+      if (submesh_count > 0) {
+        if (meshlet.submesh >= submesh_count) {
+          return false;
+        }
+        range = mesh.submeshes[meshlet.submesh];
+      }
+      if (meshlet.first_index < range.first_index ||
+          meshlet.first_index + 3 * uint64_t(meshlet.triangle_count) > range.first_index + range.index_count) {
+        return false;
+      }
+    }
+
+    uint32_t shape_count, shape_range_count;
+    if (!reader.read(&shape_count) || shape_count > file->size()) {
+      return false;
+    }
+    mesh.shape_names.resize(shape_count);
+    for (std::string &name : mesh.shape_names) {
+      if (!reader.read_string(&name)) {
+        return false;
+      }
+    }
+    if (!reader.read(&shape_range_count) || shape_range_count > file->size()) {
+      return false;
+    }
+    mesh.shape_ranges.resize(shape_range_count);
+    for (ShapeRange &range : mesh.shape_ranges) {
+      uint32_t ids[2];
+      uint64_t ranges[2];
+      if (!reader.read(&ids) || !reader.read(&ranges) || ids[0] >= shape_count || ids[1] >= submesh_count) {
+        return false;
+      }
+      const Submesh &submesh = mesh.submeshes[ids[1]];
+      if (ranges[0] < submesh.first_index ||
+          !fits(ranges[0] - submesh.first_index, ranges[1], submesh.index_count)) {
+        return false;
+      }
+      range.shape = ids[0];
+      range.submesh = ids[1];
+      range.first_index = ranges[0];
+      range.index_count = ranges[1];
+    }
+
+    mesh.bounds_min = glm::vec3(bounds[0], bounds[1], bounds[2]);
+    mesh.bounds_max = glm::vec3(bounds[3], bounds[4], bounds[5]);
+
+    // Checked before it scales the size of the index blob
+    if (index_size != 2 && index_size != 4) {
+      return false;
+    }
+
+    MeshView &view = mesh.view;
+    view.vertex_count = vertex_count;
+    view.index_count = index_count;
+    view.index_size = index_size;
+    view.vertices = reinterpret_cast<const float *>(reader.blob(data_offset, offsets[0], vertex_count * 12));
+    if (flags & has_normals) {
+      view.normals = reinterpret_cast<const float *>(reader.blob(data_offset, offsets[1], vertex_count * 12));
+    }
+    if (flags & has_tex_coords) {
+      view.tex_coords = reinterpret_cast<const float *>(reader.blob(data_offset, offsets[2], vertex_count * 8));
+    }
+    view.indices = reader.blob(data_offset, offsets[3], index_count * index_size);
+
+    if (!view.vertices || !view.indices ||
+        ((flags & has_normals) && !view.normals) || ((flags & has_tex_coords) && !view.tex_coords)) {
+      return false;
+    }
+
+    // The indices of a submesh count from its base vertex and must stay within its vertices, otherwise the
+    // draws and the texel densities read past the vertex data
+    if (submesh_count == 0 && !indices_below(view.indices, index_size, 0, index_count, vertex_count)) {
+      return false;
+    }
+    auto ranges_valid = [&](const std::vector<Submesh> &submeshes) {
+      for (const Submesh &submesh : submeshes) {
+        if (!indices_below(view.indices, index_size, submesh.first_index, submesh.index_count,
+                           submesh.vertex_count)) {
+          return false;
+        }
+      }
+      return true;
+    };
+    if (!ranges_valid(mesh.submeshes)) {
+      return false;
+    }
+    for (const MeshLod &lod : mesh.lods) {
+      if (!ranges_valid(lod.submeshes)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool MeshCache::write(const std::string &obj_file_name, const std::vector<std::string> &source_files,
+                      const std::vector<MeshData> &meshes, uint32_t build_flags) {
+  CacheWriter header;
+  CacheWriter data;
+
+  header.write(magic);
+  header.write(version);
+  header.write(build_flags);
+  // data offset is patched below
+  header.write(uint64_t(0));
+  header.write(static_cast<uint32_t>(source_files.size()));
+  header.write(static_cast<uint32_t>(meshes.size()));
+
+  for (const std::string &path : source_files) {
+    uint64_t size, hash;
+    int64_t time;
+    if (!get_file_info(path, &size, &time) || !hash_file(path, &hash)) {
+      return false;
+    }
+    header.write_string(path);
+    header.write(size);
+    header.write(time);
+    header.write(hash);
+  }
+
+  for (const MeshData &mesh : meshes) {
+    const float bounds[6] = {mesh.bounds_min.x, mesh.bounds_min.y, mesh.bounds_min.z,
+                             mesh.bounds_max.x, mesh.bounds_max.y, mesh.bounds_max.z};
+    const uint32_t index_size = mesh.has_16bit_indices() ? sizeof(uint16_t) : sizeof(uint32_t);
+    const uint32_t flags = (mesh.normals.empty() ? 0 : has_normals) | (mesh.tex_coords.empty() ? 0 : has_tex_coords);
+
+    uint64_t offsets[4];
+    offsets[0] = data.write_blob(mesh.vertices.data(), mesh.vertices.size() * sizeof(float));
+    offsets[1] = data.write_blob(mesh.normals.data(), mesh.normals.size() * sizeof(float));
+    offsets[2] = data.write_blob(mesh.tex_coords.data(), mesh.tex_coords.size() * sizeof(float));
+    if (index_size == sizeof(uint16_t)) {
+      std::vector<uint16_t> short_indices(mesh.indices.begin(), mesh.indices.end());
+      offsets[3] = data.write_blob(short_indices.data(), short_indices.size() * sizeof(uint16_t));
+    } else {
+      offsets[3] = data.write_blob(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+    }
+
+    header.write_string(mesh.name);
+    header.write(bounds);
+    header.write(static_cast<uint64_t>(mesh.vertex_count()));
+    header.write(static_cast<uint64_t>(mesh.indices.size()));
+    header.write(index_size);
+    header.write(flags);
+    header.write(offsets);
+    header.write(static_cast<uint32_t>(mesh.materials.size()));
+    header.write(static_cast<uint32_t>(mesh.submeshes.size()));
+    header.write(static_cast<uint32_t>(mesh.lods.size()));
+
+    for (const Material &material : mesh.materials) {
+      const float values[8] = {material.diffuse.x,  material.diffuse.y,  material.diffuse.z, material.specular.x,
+                               material.specular.y, material.specular.z, material.shininess, material.dissolve};
+      header.write_string(material.name);
+      header.write(values);
+      header.write_string(material.diffuse_texture);
+    }
+
+    for (const Submesh &submesh : mesh.submeshes) {
+      const uint64_t ranges[4] = {submesh.first_index, submesh.index_count, submesh.base_vertex,
+                                  submesh.vertex_count};
+      header.write(static_cast<int32_t>(submesh.material_id));
+      header.write(ranges);
+    }
+
+    for (const MeshLod &lod : mesh.lods) {
+      header.write(lod.error);
+      for (const Submesh &submesh : lod.submeshes) {
+        const uint64_t ranges[2] = {submesh.first_index, submesh.index_count};
+        header.write(ranges);
+      }
+    }
+
+    header.write(static_cast<uint32_t>(mesh.meshlets.size()));
+    header.write(static_cast<uint64_t>(data.write_blob(mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet))));
+
+    header.write(static_cast<uint32_t>(mesh.shape_names.size()));
+    for (const std::string &name : mesh.shape_names) {
+      header.write_string(name);
+    }
+    header.write(static_cast<uint32_t>(mesh.shape_ranges.size()));
+    for (const ShapeRange &range : mesh.shape_ranges) {
+      const uint32_t ids[2] = {range.shape, range.submesh};
+      const uint64_t ranges[2] = {range.first_index, range.index_count};
+      header.write(ids);
+      header.write(ranges);
+    }
+  }
+
+  // Data section starts aligned, so the blobs stay aligned inside the mapping
+  header.buffer.resize((header.buffer.size() + blob_alignment - 1) / blob_alignment * blob_alignment);
+  const uint64_t data_offset = header.buffer.size();
+  const size_t data_offset_position = sizeof(magic) + sizeof(version) + sizeof(build_flags);
+  std::memcpy(header.buffer.data() + data_offset_position, &data_offset, sizeof(data_offset));
+
+  // Write into a temporary file first so a crash never leaves a half written cache behind
+  const std::string path = path_for(obj_file_name);
+  const std::string temporary_path = temporary_path_for(path);
+  {
+    std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+    out.write(header.buffer.data(), static_cast<std::streamsize>(header.buffer.size()));
+    out.write(data.buffer.data(), static_cast<std::streamsize>(data.buffer.size()));
+    if (!out) {
+      std::remove(temporary_path.c_str());
+      return false;
+    }
+  }
+
+  return replace_file(temporary_path, path);
+}
@@ -0,0 +1,259 @@
+#include "mesh_data.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+/// All attributes of one face corner, compared bit by bit
+struct WeldKey {
+  float values[8];
+
+  bool operator==(const WeldKey &other) const { return std::memcmp(values, other.values, sizeof(values)) == 0; }
+};
+
+struct WeldKeyHash {
+  size_t operator()(const WeldKey &key) const {
+    // FNV-1a over the 32-bit words
+    uint32_t words[8];
+    std::memcpy(words, key.values, sizeof(words));
+
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t word : words) {
+      hash ^= word;
+      hash *= 1099511628211ull;
+    }
+    return static_cast<size_t>(hash ^ (hash >> 32));
+  }
+};
+
+/// Welds the given face corners into 'data', appending to the vertices already there without sharing them
+void weld_corners(const tinyobj::attrib_t &attrib, const tinyobj::index_t *corners, size_t corner_count,
+                  MeshData *data) {
+  const bool has_normals = !attrib.normals.empty();
+  const bool has_tex_coords = !attrib.texcoords.empty();
+  const uint32_t first_vertex = static_cast<uint32_t>(data->vertex_count());
+
+  std::unordered_map<WeldKey, uint32_t, WeldKeyHash> unique_vertices;
+  unique_vertices.reserve(corner_count);
+  data->indices.reserve(data->indices.size() + corner_count);
+
+  for (size_t c = 0; c < corner_count; c++) {
+    const tinyobj::index_t &idx = corners[c];
+    WeldKey key = {};
+    for (int i = 0; i < 3; i++) {
+      key.values[i] = attrib.vertices[3 * idx.vertex_index + i];
+      if (has_normals && idx.normal_index >= 0) {
+        key.values[3 + i] = attrib.normals[3 * idx.normal_index + i];
+      }
+    }
+    if (has_tex_coords && idx.texcoord_index >= 0) {
+      key.values[6] = attrib.texcoords[2 * idx.texcoord_index + 0];
+      key.values[7] = attrib.texcoords[2 * idx.texcoord_index + 1];
+    }
+
+    auto inserted = unique_vertices.emplace(key, first_vertex + static_cast<uint32_t>(unique_vertices.size()));
+    if (inserted.second) {
+      data->vertices.insert(data->vertices.end(), key.values, key.values + 3);
+      if (has_normals) {
+        data->normals.insert(data->normals.end(), key.values + 3, key.values + 6);
+      }
+      if (has_tex_coords) {
+        data->tex_coords.insert(data->tex_coords.end(), key.values + 6, key.values + 8);
+      }
+    }
+    data->indices.push_back(inserted.first->second);
+  }
+}
+
+/// Leaf of a path written on either Windows or Unix
+std::string file_leaf(const std::string &path) {
+  const size_t pos = path.find_last_of("/\\");
+  return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+Material convert_material(const tinyobj::material_t &source, const std::string &texture_dir) {
+  Material material;
+  material.name = source.name;
+  material.diffuse = glm::vec3(source.diffuse[0], source.diffuse[1], source.diffuse[2]);
+  material.specular = glm::vec3(source.specular[0], source.specular[1], source.specular[2]);
+  material.shininess = source.shininess;
+  material.dissolve = source.dissolve;
+
+  // Exporters write absolute paths of the authoring machine, textures are expected next to the OBJ
+  if (!source.diffuse_texname.empty()) {
+    const std::string leaf = file_leaf(source.diffuse_texname);
+    material.diffuse_texture = texture_dir.empty() ? leaf : texture_dir + "/" + leaf;
+  }
+  return material;
+}
+
+} // namespace
+
+bool MeshData::has_16bit_indices() const {
+  if (submeshes.empty()) {
+    return vertex_count() < 65536;
+  }
+  for (const Submesh &submesh : submeshes) {
+    if (submesh.vertex_count >= 65536) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t MeshData::gpu_bytes() const {
+  const size_t index_size = has_16bit_indices() ? sizeof(uint16_t) : sizeof(uint32_t);
+  return (vertices.size() + normals.size() + tex_coords.size()) * sizeof(float) + indices.size() * index_size;
+}
+
+void MeshData::compute_bounds() {
+  if (vertices.empty()) {
+    bounds_min = bounds_max = glm::vec3(0.f);
+    return;
+  }
+
+  bounds_min = bounds_max = glm::vec3(vertices[0], vertices[1], vertices[2]);
+  for (size_t v = 0; v < vertices.size(); v += 3) {
+    const glm::vec3 position(vertices[v], vertices[v + 1], vertices[v + 2]);
+    bounds_min = glm::min(bounds_min, position);
+    bounds_max = glm::max(bounds_max, position);
+  }
+}
+
+MeshView make_mesh_view(const MeshData &data, std::vector<uint16_t> *short_indices) {
+  MeshView view;
+  view.vertices = data.vertices.data();
+  view.normals = data.normals.empty() ? nullptr : data.normals.data();
+  view.tex_coords = data.tex_coords.empty() ? nullptr : data.tex_coords.data();
+  view.vertex_count = data.vertex_count();
+  view.index_count = data.indices.size();
+
+  if (data.has_16bit_indices()) {
+    short_indices->assign(data.indices.begin(), data.indices.end());
+    view.indices = short_indices->data();
+    view.index_size = sizeof(uint16_t);
+  } else {
+    view.indices = data.indices.data();
+    view.index_size = sizeof(uint32_t);
+  }
+  return view;
+}
+
+MeshData weld_shape(const tinyobj::attrib_t &attrib, const tinyobj::shape_t &shape) {
+  MeshData data;
+  data.name = shape.name;
+  weld_corners(attrib, shape.mesh.indices.data(), shape.mesh.indices.size(), &data);
+  data.compute_bounds();
+  return data;
+}
+
+MeshData build_material_batches(const tinyobj::attrib_t &attrib, const std::vector<tinyobj::shape_t> &shapes,
+                                const std::vector<tinyobj::material_t> &materials, const std::string &texture_dir) {
+  // Faces without a (valid) material go to the default one stored after the others
+  const size_t default_material = materials.size();
+  std::vector<std::vector<tinyobj::index_t>> corners(materials.size() + 1);
+  // Shapes are appended one after another, so each has one run of corners per material
+  std::vector<std::vector<ShapeRange>> shape_runs(corners.size());
+
+  for (size_t s = 0; s < shapes.size(); s++) {
+    const auto &mesh = shapes[s].mesh;
+    size_t offset = 0;
+    for (size_t f = 0; f < mesh.num_face_vertices.size(); f++) {
+      const int id = f < mesh.material_ids.size() ? mesh.material_ids[f] : -1;
+      const size_t material = id >= 0 && static_cast<size_t>(id) < materials.size() ? id : default_material;
+      const size_t face_vertices = mesh.num_face_vertices[f];
+      std::vector<ShapeRange> &runs = shape_runs[material];
+      if (runs.empty() || runs.back().shape != s) {
+        ShapeRange run;
+        run.shape = static_cast<uint32_t>(s);
+        run.first_index = corners[material].size();
+        runs.push_back(run);
+      }
+      runs.back().index_count += face_vertices;
+      corners[material].insert(corners[material].end(), mesh.indices.begin() + offset,
+                               mesh.indices.begin() + offset + face_vertices);
+      offset += face_vertices;
+    }
+  }
+
+  // Every material is welded on its own, so the blocks of vertices do not overlap. Inside a block every shape is
+  // welded on its own too, no vertex belongs to two shapes.
+  std::vector<MeshData> batches(corners.size());
+  ThreadPool::shared().parallel_for(corners.size(), [&](size_t m) {
+    for (const ShapeRange &run : shape_runs[m]) {
+      weld_corners(attrib, corners[m].data() + run.first_index, run.index_count, &batches[m]);
+    }
+  });
+
+  MeshData data;
+  if (!shapes.empty()) {
+    data.name = shapes[0].name;
+  }
+  for (const auto &shape : shapes) {
+    data.shape_names.push_back(shape.name);
+  }
+  for (const auto &material : materials) {
+    data.materials.push_back(convert_material(material, texture_dir));
+  }
+  if (!corners[default_material].empty()) {
+    Material material;
+    material.name = "default";
+    data.materials.push_back(material);
+  }
+
+  // Submeshes follow the material order, so consecutive draws share as much state as possible
+  for (size_t m = 0; m < batches.size(); m++) {
+    const MeshData &batch = batches[m];
+    if (batch.indices.empty()) {
+      continue;
+    }
+
+    Submesh submesh;
+    submesh.material_id = static_cast<int>(m);
+    submesh.first_index = data.indices.size();
+    submesh.index_count = batch.indices.size();
+    submesh.base_vertex = data.vertex_count();
+    submesh.vertex_count = batch.vertex_count();
+    // Welding keeps one index per corner, so the runs carry over with the offset of the submesh
+    for (ShapeRange run : shape_runs[m]) {
+      run.submesh = static_cast<uint32_t>(data.submeshes.size());
+      run.first_index += submesh.first_index;
+      data.shape_ranges.push_back(run);
+    }
+    data.submeshes.push_back(submesh);
+
+    data.vertices.insert(data.vertices.end(), batch.vertices.begin(), batch.vertices.end());
+    data.normals.insert(data.normals.end(), batch.normals.begin(), batch.normals.end());
+    data.tex_coords.insert(data.tex_coords.end(), batch.tex_coords.begin(), batch.tex_coords.end());
+    data.indices.insert(data.indices.end(), batch.indices.begin(), batch.indices.end());
+  }
+
+  data.compute_bounds();
+  return data;
+}
+
+size_t count_vertex_shader_invocations(const std::vector<uint32_t> &indices, size_t cache_size) {
+  std::vector<uint32_t> cache;
+  cache.reserve(cache_size);
+  size_t oldest = 0;
+  size_t misses = 0;
+
+  for (uint32_t index : indices) {
+    if (std::find(cache.begin(), cache.end(), index) != cache.end()) {
+      continue;
+    }
+
+    misses++;
+    if (cache.size() < cache_size) {
+      cache.push_back(index);
+    } else {
+      cache[oldest] = index;
+      oldest = (oldest + 1) % cache_size;
+    }
+  }
+
+  return misses;
+}
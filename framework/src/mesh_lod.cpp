@@ -0,0 +1,104 @@
+#include "mesh_lod.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void build_lods(MeshData *data, size_t level_count, float max_error) {
+  data->lods.clear();
+  if (data->submeshes.empty()) {
+    // The whole buffer as one range, so the levels have something to refer to
+    Submesh whole;
+    whole.index_count = data->indices.size();
+    whole.vertex_count = data->vertex_count();
+    data->submeshes.push_back(whole);
+  }
+
+  const float diagonal = glm::length(data->bounds_max - data->bounds_min);
+  const float target_error = max_error * diagonal;
+
+  const std::vector<Submesh> *previous = &data->submeshes;
+  float previous_error = 0.f;
+  size_t previous_index_count = data->indices.size();
+
+  for (size_t level = 0; level < level_count; level++) {
+    const std::vector<Submesh> &source = *previous;
+    std::vector<std::vector<uint32_t>> simplified(source.size());
+    std::vector<float> errors(source.size(), 0.f);
+
+    // The submeshes own separate vertices, so they are simplified independently
+    ThreadPool::shared().parallel_for(source.size(), [&](size_t s) {
+      const Submesh &range = source[s];
+      const uint32_t *indices = data->indices.data() + range.first_index;
+      const float *normals = data->normals.empty() ? nullptr : data->normals.data() + 3 * range.base_vertex;
+      const float *tex_coords = data->tex_coords.empty() ? nullptr : data->tex_coords.data() + 2 * range.base_vertex;
+
+      simplified[s].resize(range.index_count);
+      const size_t target_index_count = range.index_count / 6 * 3;
+      const size_t count = simplify_mesh(simplified[s].data(), indices, range.index_count,
+                                         data->vertices.data() + 3 * range.base_vertex, normals, tex_coords,
+                                         range.vertex_count, target_index_count, target_error, &errors[s]);
+      simplified[s].resize(count);
+      optimize_vertex_cache(simplified[s].data(), count, range.vertex_count);
+    });
+
+    size_t index_count = 0;
+    for (const auto &indices : simplified) {
+      index_count += indices.size();
+    }
+    if (index_count == 0 || index_count * 10 > previous_index_count * 9) {
+      // Not worth another level
+      break;
+    }
+
+    MeshLod lod;
+    lod.error = previous_error + *std::max_element(errors.begin(), errors.end());
+    for (size_t s = 0; s < source.size(); s++) {
+      Submesh range = source[s];
+      range.first_index = data->indices.size();
+      range.index_count = simplified[s].size();
+      data->indices.insert(data->indices.end(), simplified[s].begin(), simplified[s].end());
+      lod.submeshes.push_back(range);
+    }
+    data->lods.push_back(lod);
+
+    previous = &data->lods.back().submeshes;
+    previous_error = lod.error;
+    previous_index_count = index_count;
+  }
+}
+
+float lod_projection_scale(float fovy, float viewport_height) {
+  return viewport_height / (2.f * std::tan(fovy / 2.f));
+}
+
+float distance_to_bounds(const glm::vec3 &point, const glm::vec3 &bounds_min, const glm::vec3 &bounds_max) {
+  const glm::vec3 outside = glm::max(glm::max(bounds_min - point, point - bounds_max), glm::vec3(0.f));
+  return glm::length(outside);
+}
+
+size_t select_lod(const std::vector<float> &errors, size_t current, float distance, float projection_scale,
+                  const LodSettings &settings) {
+  if (errors.empty() || settings.max_pixel_error <= 0.f) {
+    return 0;
+  }
+  if (distance <= 0.f) {
+    // Inside the bounds every error is visible
+    return 0;
+  }
+
+  size_t selected = 0;
+  for (size_t level = 1; level < errors.size(); level++) {
+    float threshold = settings.max_pixel_error;
+    if (level > current) {
+      threshold *= 1.f - settings.hysteresis;
+    }
+    if (errors[level] * projection_scale / distance > threshold) {
+      break;
+    }
+    selected = level;
+  }
+  return selected;
+}
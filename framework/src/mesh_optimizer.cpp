@@ -0,0 +1,554 @@
+#include "mesh_optimizer.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Tuning of Forsyth's scoring function, the values from the article
+const size_t forsyth_cache_size = 32;
+const float cache_decay_power = 1.5f;
+const float last_triangle_score = 0.75f;
+const float valence_boost_scale = 2.f;
+const float valence_boost_power = 0.5f;
+
+const size_t cluster_cache_size = 16;
+
+const size_t fetch_line_size = 64;
+const size_t fetch_cache_lines = 64;
+
+float forsyth_vertex_score(int cache_position, uint32_t remaining_triangles) {
+  if (remaining_triangles == 0) {
+    // No triangle needs the vertex anymore
+    return -1.f;
+  }
+
+  float score = 0.f;
+  if (cache_position >= 0) {
+    if (cache_position < 3) {
+      // Used by the last triangle, fixed score so it is not favoured too much
+      score = last_triangle_score;
+    } else {
+      const float scaler = 1.f / (forsyth_cache_size - 3);
+      score = std::pow(1.f - (cache_position - 3) * scaler, cache_decay_power);
+    }
+  }
+
+  // Vertices with few remaining triangles are finished first, so they do not stay around
+  score += valence_boost_scale * std::pow(static_cast<float>(remaining_triangles), -valence_boost_power);
+  return score;
+}
+
+glm::vec3 position_of(const float *positions, uint32_t vertex) {
+  return glm::vec3(positions[3 * vertex], positions[3 * vertex + 1], positions[3 * vertex + 2]);
+}
+
+/// Submeshes of the data, or one range covering the whole mesh when it has none
+std::vector<Submesh> ranges_of(const MeshData &data) {
+  if (!data.submeshes.empty()) {
+    return data.submeshes;
+  }
+  Submesh whole;
+  whole.index_count = data.indices.size();
+  whole.vertex_count = data.vertex_count();
+  return {whole};
+}
+
+/// Shape of every vertex of the submeshes, from the shape table. Shapes are welded separately, so a vertex
+/// belongs to one shape.
+std::vector<uint32_t> vertex_shapes_of(const MeshData &data) {
+  std::vector<uint32_t> shapes(data.vertex_count(), 0);
+  for (const ShapeRange &range : data.shape_ranges) {
+    const size_t base_vertex = data.submeshes[range.submesh].base_vertex;
+    for (size_t i = range.first_index; i < range.first_index + range.index_count; i++) {
+      shapes[base_vertex + data.indices[i]] = range.shape;
+    }
+  }
+  return shapes;
+}
+
+/// Shape table of the reordered triangles, one range per run of triangles of the same shape
+std::vector<ShapeRange> shape_ranges_of(const MeshData &data, const std::vector<uint32_t> &vertex_shapes) {
+  std::vector<ShapeRange> ranges;
+  for (size_t s = 0; s < data.submeshes.size(); s++) {
+    const Submesh &submesh = data.submeshes[s];
+    for (size_t i = submesh.first_index; i + 3 <= submesh.first_index + submesh.index_count; i += 3) {
+      const uint32_t shape = vertex_shapes[submesh.base_vertex + data.indices[i]];
+      if (ranges.empty() || ranges.back().submesh != s || ranges.back().shape != shape) {
+        ShapeRange range;
+        range.shape = shape;
+        range.submesh = static_cast<uint32_t>(s);
+        range.first_index = i;
+        ranges.push_back(range);
+      }
+      ranges.back().index_count += 3;
+    }
+  }
+  return ranges;
+}
+
+/// Rasterizes the triangle into the depth buffer with the depth test GL_LESS, returns the shaded pixels
+size_t rasterize(const glm::vec3 &a, glm::vec3 b, glm::vec3 c, int resolution, std::vector<float> *depth,
+                 std::vector<char> *covered) {
+  float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+  if (area == 0.f) {
+    return 0;
+  }
+  // Culling is off in the application, so both windings are drawn
+  if (area < 0.f) {
+    std::swap(b, c);
+    area = -area;
+  }
+
+  const int min_x = std::max(0, static_cast<int>(std::floor(std::min({a.x, b.x, c.x}))));
+  const int min_y = std::max(0, static_cast<int>(std::floor(std::min({a.y, b.y, c.y}))));
+  const int max_x = std::min(resolution - 1, static_cast<int>(std::ceil(std::max({a.x, b.x, c.x}))));
+  const int max_y = std::min(resolution - 1, static_cast<int>(std::ceil(std::max({a.y, b.y, c.y}))));
+
+  size_t shaded = 0;
+  for (int y = min_y; y <= max_y; y++) {
+    for (int x = min_x; x <= max_x; x++) {
+      const float px = x + 0.5f;
+      const float py = y + 0.5f;
+      const float w0 = (c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x);
+      const float w1 = (a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x);
+      const float w2 = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+      if (w0 < 0.f || w1 < 0.f || w2 < 0.f) {
+        continue;
+      }
+
+      const float z = (w0 * a.z + w1 * b.z + w2 * c.z) / area;
+      float &stored = (*depth)[y * resolution + x];
+      if (z < stored) {
+        stored = z;
+        (*covered)[y * resolution + x] = 1;
+        shaded++;
+      }
+    }
+  }
+  return shaded;
+}
+
+/// Splits the triangles where the cache starts over (all three vertices miss), then splits those clusters
+/// further wherever the cache efficiency of the part stays within 'threshold' of the whole cluster
+std::vector<size_t> find_clusters(const uint32_t *indices, size_t triangle_count, size_t vertex_count,
+                                  float threshold) {
+  // A vertex is cached when less than cluster_cache_size misses happened since it was transformed
+  std::vector<size_t> timestamps(vertex_count, 0);
+  size_t timestamp = cluster_cache_size + 1;
+  auto misses_of = [&](size_t triangle) {
+    size_t misses = 0;
+    for (size_t k = 0; k < 3; k++) {
+      const uint32_t vertex = indices[3 * triangle + k];
+      if (timestamp - timestamps[vertex] > cluster_cache_size) {
+        timestamps[vertex] = timestamp++;
+        misses++;
+      }
+    }
+    return misses;
+  };
+  auto flush = [&]() { timestamp += cluster_cache_size + 1; };
+
+  std::vector<size_t> hard;
+  for (size_t t = 0; t < triangle_count; t++) {
+    if (misses_of(t) == 3) {
+      hard.push_back(t);
+    }
+  }
+  if (hard.empty() || hard[0] != 0) {
+    hard.insert(hard.begin(), 0);
+  }
+  hard.push_back(triangle_count);
+
+  std::vector<size_t> clusters;
+  for (size_t h = 0; h + 1 < hard.size(); h++) {
+    const size_t start = hard[h];
+    const size_t end = hard[h + 1];
+
+    flush();
+    size_t cluster_misses = 0;
+    for (size_t t = start; t < end; t++) {
+      cluster_misses += misses_of(t);
+    }
+    const float cluster_acmr = static_cast<float>(cluster_misses) / (end - start);
+
+    flush();
+    size_t part_start = start;
+    size_t part_misses = 0;
+    clusters.push_back(start);
+    for (size_t t = start; t < end; t++) {
+      part_misses += misses_of(t);
+      const float part_acmr = static_cast<float>(part_misses) / (t + 1 - part_start);
+      if (t + 1 < end && part_acmr <= threshold * cluster_acmr) {
+        part_start = t + 1;
+        part_misses = 0;
+        clusters.push_back(part_start);
+        flush();
+      }
+    }
+  }
+  clusters.push_back(triangle_count);
+  return clusters;
+}
+
+} // namespace
+
+VertexCacheStats analyze_vertex_cache(const uint32_t *indices, size_t index_count, size_t vertex_count,
+                                      size_t cache_size) {
+  VertexCacheStats stats;
+  stats.vertices_transformed =
+      count_vertex_shader_invocations(std::vector<uint32_t>(indices, indices + index_count), cache_size);
+  if (index_count > 0) {
+    stats.acmr = static_cast<float>(stats.vertices_transformed) / (index_count / 3);
+  }
+  if (vertex_count > 0) {
+    stats.atvr = static_cast<float>(stats.vertices_transformed) / vertex_count;
+  }
+  return stats;
+}
+
+OverdrawStats analyze_overdraw(const uint32_t *indices, size_t index_count, const float *positions,
+                               size_t vertex_count, int resolution) {
+  OverdrawStats stats;
+  if (index_count == 0 || vertex_count == 0) {
+    return stats;
+  }
+
+  glm::vec3 bounds_min = position_of(positions, indices[0]);
+  glm::vec3 bounds_max = bounds_min;
+  for (size_t i = 0; i < index_count; i++) {
+    bounds_min = glm::min(bounds_min, position_of(positions, indices[i]));
+    bounds_max = glm::max(bounds_max, position_of(positions, indices[i]));
+  }
+  const glm::vec3 extent = bounds_max - bounds_min;
+
+  std::vector<float> depth(resolution * resolution);
+  std::vector<char> covered(resolution * resolution);
+
+  // Orthographic views along +-X, +-Y and +-Z, the mesh fills the framebuffer
+  for (int axis = 0; axis < 3; axis++) {
+    const int u = (axis + 1) % 3;
+    const int v = (axis + 2) % 3;
+    const float size = std::max(extent[u], extent[v]);
+    if (size <= 0.f) {
+      continue;
+    }
+    const float scale = (resolution - 1) / size;
+
+    for (float direction : {1.f, -1.f}) {
+      std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+      std::fill(covered.begin(), covered.end(), 0);
+
+      for (size_t i = 0; i + 2 < index_count; i += 3) {
+        glm::vec3 corners[3];
+        for (int k = 0; k < 3; k++) {
+          const glm::vec3 p = position_of(positions, indices[i + k]);
+          corners[k] = glm::vec3((p[u] - bounds_min[u]) * scale, (p[v] - bounds_min[v]) * scale, direction * p[axis]);
+        }
+        stats.pixels_shaded += rasterize(corners[0], corners[1], corners[2], resolution, &depth, &covered);
+      }
+
+      stats.pixels_covered += std::count(covered.begin(), covered.end(), 1);
+    }
+  }
+
+  if (stats.pixels_covered > 0) {
+    stats.overdraw = static_cast<float>(stats.pixels_shaded) / stats.pixels_covered;
+  }
+  return stats;
+}
+
+VertexFetchStats analyze_vertex_fetch(const uint32_t *indices, size_t index_count, size_t vertex_count,
+                                      size_t vertex_size) {
+  VertexFetchStats stats;
+  if (vertex_count == 0 || vertex_size == 0) {
+    return stats;
+  }
+
+  // A line is cached when less than fetch_cache_lines lines were fetched since it was loaded
+  std::vector<size_t> timestamps((vertex_count * vertex_size + fetch_line_size - 1) / fetch_line_size, 0);
+  size_t timestamp = fetch_cache_lines + 1;
+
+  for (size_t i = 0; i < index_count; i++) {
+    const size_t begin = indices[i] * vertex_size;
+    const size_t end = begin + vertex_size;
+    for (size_t line = begin / fetch_line_size; line <= (end - 1) / fetch_line_size; line++) {
+      if (timestamp - timestamps[line] > fetch_cache_lines) {
+        timestamps[line] = timestamp++;
+        stats.bytes_fetched += fetch_line_size;
+      }
+    }
+  }
+
+  stats.overfetch = static_cast<float>(stats.bytes_fetched) / (vertex_count * vertex_size);
+  return stats;
+}
+
+MeshStats analyze_mesh(const MeshData &data) {
+  // Indices of the submeshes are relative to their base vertex
+  std::vector<uint32_t> indices;
+  indices.reserve(data.indices.size());
+  for (const Submesh &range : ranges_of(data)) {
+    for (size_t i = range.first_index; i < range.first_index + range.index_count; i++) {
+      indices.push_back(static_cast<uint32_t>(data.indices[i] + range.base_vertex));
+    }
+  }
+
+  const size_t vertex_size =
+      (3 + (data.normals.empty() ? 0 : 3) + (data.tex_coords.empty() ? 0 : 2)) * sizeof(float);
+
+  MeshStats stats;
+  stats.vertex_cache = analyze_vertex_cache(indices.data(), indices.size(), data.vertex_count());
+  stats.overdraw = analyze_overdraw(indices.data(), indices.size(), data.vertices.data(), data.vertex_count());
+  stats.vertex_fetch = analyze_vertex_fetch(indices.data(), indices.size(), data.vertex_count(), vertex_size);
+  return stats;
+}
+
+void optimize_vertex_cache(uint32_t *indices, size_t index_count, size_t vertex_count) {
+  const size_t triangle_count = index_count / 3;
+  if (triangle_count == 0) {
+    return;
+  }
+
+  // Triangles using each vertex, only the first 'remaining[v]' of them are not emitted yet
+  std::vector<uint32_t> remaining(vertex_count, 0);
+  for (size_t i = 0; i < triangle_count * 3; i++) {
+    remaining[indices[i]]++;
+  }
+  std::vector<size_t> offsets(vertex_count + 1, 0);
+  for (size_t v = 0; v < vertex_count; v++) {
+    offsets[v + 1] = offsets[v] + remaining[v];
+  }
+  std::vector<uint32_t> adjacency(triangle_count * 3);
+  {
+    std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangle_count; t++) {
+      for (size_t k = 0; k < 3; k++) {
+        adjacency[fill[indices[3 * t + k]]++] = static_cast<uint32_t>(t);
+      }
+    }
+  }
+
+  std::vector<float> vertex_scores(vertex_count);
+  for (size_t v = 0; v < vertex_count; v++) {
+    vertex_scores[v] = forsyth_vertex_score(-1, remaining[v]);
+  }
+  std::vector<float> triangle_scores(triangle_count);
+  for (size_t t = 0; t < triangle_count; t++) {
+    triangle_scores[t] = vertex_scores[indices[3 * t]] + vertex_scores[indices[3 * t + 1]] +
+                         vertex_scores[indices[3 * t + 2]];
+  }
+
+  std::vector<char> emitted(triangle_count, 0);
+  std::vector<uint32_t> result(triangle_count * 3);
+  std::vector<uint32_t> cache, new_cache;
+  cache.reserve(forsyth_cache_size + 3);
+  new_cache.reserve(forsyth_cache_size + 3);
+
+  size_t next_unemitted = 0;
+  int64_t best = -1;
+  for (size_t out = 0; out < triangle_count; out++) {
+    if (best < 0) {
+      // Dead end, nothing in the cache has triangles left, continue in the input order
+      while (emitted[next_unemitted]) {
+        next_unemitted++;
+      }
+      best = static_cast<int64_t>(next_unemitted);
+    }
+
+    const uint32_t *triangle = indices + 3 * best;
+    std::copy(triangle, triangle + 3, result.begin() + 3 * out);
+    emitted[best] = 1;
+
+    for (size_t k = 0; k < 3; k++) {
+      const uint32_t vertex = triangle[k];
+      uint32_t *begin = adjacency.data() + offsets[vertex];
+      uint32_t *end = begin + remaining[vertex];
+      std::iter_swap(std::find(begin, end, static_cast<uint32_t>(best)), end - 1);
+      remaining[vertex]--;
+    }
+
+    // The triangle moves its vertices to the front of the cache (LRU)
+    new_cache.assign(triangle, triangle + 3);
+    for (uint32_t vertex : cache) {
+      if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+        new_cache.push_back(vertex);
+      }
+    }
+
+    for (size_t i = 0; i < new_cache.size(); i++) {
+      const uint32_t vertex = new_cache[i];
+      const int position = i < forsyth_cache_size ? static_cast<int>(i) : -1;
+
+      const float score = forsyth_vertex_score(position, remaining[vertex]);
+      const float delta = score - vertex_scores[vertex];
+      vertex_scores[vertex] = score;
+      for (size_t a = offsets[vertex]; a < offsets[vertex] + remaining[vertex]; a++) {
+        triangle_scores[adjacency[a]] += delta;
+      }
+    }
+
+    if (new_cache.size() > forsyth_cache_size) {
+      new_cache.resize(forsyth_cache_size);
+    }
+    std::swap(cache, new_cache);
+
+    // Next triangle is the best one touching the cache
+    best = -1;
+    float best_score = -std::numeric_limits<float>::max();
+    for (uint32_t vertex : cache) {
+      for (size_t a = offsets[vertex]; a < offsets[vertex] + remaining[vertex]; a++) {
+        if (triangle_scores[adjacency[a]] > best_score) {
+          best_score = triangle_scores[adjacency[a]];
+          best = adjacency[a];
+        }
+      }
+    }
+  }
+
+  std::copy(result.begin(), result.end(), indices);
+}
+
+void optimize_overdraw(uint32_t *indices, size_t index_count, const float *positions, size_t vertex_count,
+                       float threshold) {
+  const size_t triangle_count = index_count / 3;
+  if (triangle_count == 0) {
+    return;
+  }
+
+  const std::vector<size_t> clusters = find_clusters(indices, triangle_count, vertex_count, threshold);
+  const size_t cluster_count = clusters.size() - 1;
+
+  // Area weighted centroids and normals of the clusters and of the whole mesh
+  std::vector<glm::vec3> centroids(cluster_count, glm::vec3(0.f));
+  std::vector<glm::vec3> normals(cluster_count, glm::vec3(0.f));
+  std::vector<float> areas(cluster_count, 0.f);
+  glm::vec3 mesh_centroid(0.f);
+  float mesh_area = 0.f;
+
+  for (size_t c = 0; c < cluster_count; c++) {
+    for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+      const glm::vec3 a = position_of(positions, indices[3 * t]);
+      const glm::vec3 b = position_of(positions, indices[3 * t + 1]);
+      const glm::vec3 d = position_of(positions, indices[3 * t + 2]);
+      const glm::vec3 normal = glm::cross(b - a, d - a);
+      const float area = glm::length(normal);
+
+      centroids[c] += (a + b + d) / 3.f * area;
+      normals[c] += normal;
+      areas[c] += area;
+    }
+    mesh_centroid += centroids[c];
+    mesh_area += areas[c];
+  }
+  if (mesh_area > 0.f) {
+    mesh_centroid /= mesh_area;
+  }
+
+  // Clusters facing away from the center are likely in front of the rest, so they go first
+  std::vector<float> sort_keys(cluster_count, 0.f);
+  for (size_t c = 0; c < cluster_count; c++) {
+    const float normal_length = glm::length(normals[c]);
+    if (areas[c] > 0.f && normal_length > 0.f) {
+      sort_keys[c] = glm::dot(centroids[c] / areas[c] - mesh_centroid, normals[c] / normal_length);
+    }
+  }
+
+  std::vector<size_t> order(cluster_count);
+  for (size_t c = 0; c < cluster_count; c++) {
+    order[c] = c;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sort_keys[a] > sort_keys[b]; });
+
+  std::vector<uint32_t> result;
+  result.reserve(triangle_count * 3);
+  for (size_t c : order) {
+    result.insert(result.end(), indices + 3 * clusters[c], indices + 3 * clusters[c + 1]);
+  }
+  std::copy(result.begin(), result.end(), indices);
+}
+
+void optimize_vertex_fetch(MeshData *data) {
+  const bool has_normals = !data->normals.empty();
+  const bool has_tex_coords = !data->tex_coords.empty();
+
+  for (const Submesh &range : ranges_of(*data)) {
+    const uint32_t unused = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> remap(range.vertex_count, unused);
+    uint32_t next = 0;
+
+    uint32_t *indices = data->indices.data() + range.first_index;
+    for (size_t i = 0; i < range.index_count; i++) {
+      if (remap[indices[i]] == unused) {
+        remap[indices[i]] = next++;
+      }
+      indices[i] = remap[indices[i]];
+    }
+    // Unreferenced vertices keep their place behind the used ones
+    for (uint32_t &target : remap) {
+      if (target == unused) {
+        target = next++;
+      }
+    }
+
+    auto permute = [&](std::vector<float> *attribute, size_t components) {
+      float *block = attribute->data() + range.base_vertex * components;
+      const std::vector<float> original(block, block + range.vertex_count * components);
+      for (size_t v = 0; v < range.vertex_count; v++) {
+        std::copy(original.begin() + v * components, original.begin() + (v + 1) * components,
+                  block + remap[v] * components);
+      }
+    };
+    permute(&data->vertices, 3);
+    if (has_normals) {
+      permute(&data->normals, 3);
+    }
+    if (has_tex_coords) {
+      permute(&data->tex_coords, 2);
+    }
+  }
+}
+
+void optimize_mesh(MeshData *data, std::vector<MeshStats> *steps) {
+  const std::vector<Submesh> ranges = ranges_of(*data);
+  const std::vector<uint32_t> vertex_shapes = vertex_shapes_of(*data);
+  if (steps) {
+    steps->push_back(analyze_mesh(*data));
+  }
+
+  ThreadPool::shared().parallel_for(ranges.size(), [&](size_t r) {
+    optimize_vertex_cache(data->indices.data() + ranges[r].first_index, ranges[r].index_count,
+                          ranges[r].vertex_count);
+  });
+  if (steps) {
+    steps->push_back(analyze_mesh(*data));
+  }
+
+  // The reorder costs vertex cache efficiency, a submesh keeps it unless the overdraw estimate goes down
+  ThreadPool::shared().parallel_for(ranges.size(), [&](size_t r) {
+    uint32_t *indices = data->indices.data() + ranges[r].first_index;
+    const float *positions = data->vertices.data() + 3 * ranges[r].base_vertex;
+    const std::vector<uint32_t> cache_order(indices, indices + ranges[r].index_count);
+    optimize_overdraw(indices, ranges[r].index_count, positions, ranges[r].vertex_count);
+    const OverdrawStats before =
+        analyze_overdraw(cache_order.data(), cache_order.size(), positions, ranges[r].vertex_count);
+    const OverdrawStats after = analyze_overdraw(indices, ranges[r].index_count, positions, ranges[r].vertex_count);
+    if (after.pixels_shaded >= before.pixels_shaded) {
+      std::copy(cache_order.begin(), cache_order.end(), indices);
+    }
+  });
+  if (steps) {
+    steps->push_back(analyze_mesh(*data));
+  }
+
+  // Before the vertex fetch step renumbers the vertices
+  if (!data->shape_ranges.empty()) {
+    data->shape_ranges = shape_ranges_of(*data, vertex_shapes);
+  }
+  optimize_vertex_fetch(data);
+  if (steps) {
+    steps->push_back(analyze_mesh(*data));
+  }
+}
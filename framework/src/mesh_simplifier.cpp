@@ -0,0 +1,362 @@
+#include "mesh_simplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace {
+
+/// A texture coordinate or normal difference of 1 costs as much as moving by this part of the mesh diagonal
+const float attribute_weight = 0.01f;
+
+/// Sum of squared distances to a set of planes, Q(p) = p^T A p + 2 b^T p + c
+struct Quadric {
+  double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+  double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+  double c = 0.0;
+
+  void add_plane(const glm::dvec3 &normal, double distance) {
+    a00 += normal.x * normal.x;
+    a11 += normal.y * normal.y;
+    a22 += normal.z * normal.z;
+    a01 += normal.x * normal.y;
+    a02 += normal.x * normal.z;
+    a12 += normal.y * normal.z;
+    b0 += normal.x * distance;
+    b1 += normal.y * distance;
+    b2 += normal.z * distance;
+    c += distance * distance;
+  }
+
+  void add(const Quadric &other) {
+    a00 += other.a00;
+    a11 += other.a11;
+    a22 += other.a22;
+    a01 += other.a01;
+    a02 += other.a02;
+    a12 += other.a12;
+    b0 += other.b0;
+    b1 += other.b1;
+    b2 += other.b2;
+    c += other.c;
+  }
+
+  double evaluate(const glm::dvec3 &p) const {
+    const double result = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+                          2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z) +
+                          2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+    // Rounding may make it slightly negative
+    return std::max(result, 0.0);
+  }
+};
+
+struct PositionKey {
+  float values[3];
+
+  bool operator==(const PositionKey &other) const { return std::memcmp(values, other.values, sizeof(values)) == 0; }
+};
+
+struct PositionKeyHash {
+  size_t operator()(const PositionKey &key) const {
+    uint32_t words[3];
+    std::memcpy(words, key.values, sizeof(words));
+    return (words[0] * 73856093u) ^ (words[1] * 19349663u) ^ (words[2] * 83492791u);
+  }
+};
+
+/// Moves every vertex of position 'from' onto position 'to' (both are the first vertex of their position)
+struct Collapse {
+  uint32_t from;
+  uint32_t to;
+  float cost;
+};
+
+glm::vec3 read_vec3(const float *values, uint32_t vertex) {
+  return glm::vec3(values[3 * vertex], values[3 * vertex + 1], values[3 * vertex + 2]);
+}
+
+} // namespace
+
+size_t simplify_mesh(uint32_t *destination, const uint32_t *indices, size_t index_count, const float *positions,
+                     const float *normals, const float *tex_coords, size_t vertex_count, size_t target_index_count,
+                     float target_error, float *result_error) {
+  std::vector<uint32_t> result(indices, indices + index_count - index_count % 3);
+  float max_error = 0.f;
+
+  // Vertices sharing a position (split by normals or texture coordinates) map to the first one of them
+  std::vector<uint32_t> remap(vertex_count);
+  {
+    std::unordered_map<PositionKey, uint32_t, PositionKeyHash> first_vertex;
+    first_vertex.reserve(vertex_count);
+    for (uint32_t v = 0; v < vertex_count; v++) {
+      PositionKey key;
+      std::memcpy(key.values, positions + 3 * v, sizeof(key.values));
+      remap[v] = first_vertex.emplace(key, v).first->second;
+    }
+  }
+
+  // Positions that must not move: borders and non-manifold edges
+  std::vector<char> locked_position(vertex_count, 0);
+  {
+    std::unordered_map<uint64_t, uint32_t> edges;
+    edges.reserve(result.size());
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (size_t k = 0; k < 3; k++) {
+        const uint64_t a = remap[result[i + k]];
+        const uint64_t b = remap[result[i + (k + 1) % 3]];
+        edges[(a << 32) | b]++;
+      }
+    }
+    for (const auto &edge : edges) {
+      const uint64_t a = edge.first >> 32;
+      const uint64_t b = edge.first & 0xffffffffu;
+      if (edge.second > 1 || edges.find((b << 32) | a) == edges.end()) {
+        locked_position[a] = locked_position[b] = 1;
+      }
+    }
+  }
+
+  // Vertices of each position (wedges), a position on a seam has more than one
+  std::vector<size_t> wedge_offsets(vertex_count + 1, 0);
+  std::vector<uint32_t> wedges;
+  {
+    std::vector<char> used(vertex_count, 0);
+    for (uint32_t v : result) {
+      used[v] = 1;
+    }
+    for (uint32_t v = 0; v < vertex_count; v++) {
+      wedge_offsets[remap[v] + 1] += used[v];
+    }
+    for (size_t v = 0; v < vertex_count; v++) {
+      wedge_offsets[v + 1] += wedge_offsets[v];
+    }
+    wedges.resize(wedge_offsets[vertex_count]);
+    std::vector<size_t> fill(wedge_offsets.begin(), wedge_offsets.end() - 1);
+    for (uint32_t v = 0; v < vertex_count; v++) {
+      if (used[v]) {
+        wedges[fill[remap[v]]++] = v;
+      }
+    }
+  }
+
+  glm::vec3 bounds_min(0.f), bounds_max(0.f);
+  if (vertex_count > 0) {
+    bounds_min = bounds_max = read_vec3(positions, 0);
+  }
+  for (uint32_t v = 1; v < vertex_count; v++) {
+    bounds_min = glm::min(bounds_min, read_vec3(positions, v));
+    bounds_max = glm::max(bounds_max, read_vec3(positions, v));
+  }
+  const float attribute_scale = attribute_weight * glm::length(bounds_max - bounds_min);
+
+  // Planes of the original triangles, gathered per position
+  std::vector<Quadric> quadrics(vertex_count);
+  for (size_t i = 0; i < result.size(); i += 3) {
+    const glm::dvec3 p0 = read_vec3(positions, result[i]);
+    const glm::dvec3 p1 = read_vec3(positions, result[i + 1]);
+    const glm::dvec3 p2 = read_vec3(positions, result[i + 2]);
+    const glm::dvec3 cross = glm::cross(p1 - p0, p2 - p0);
+    const double length = glm::length(cross);
+    if (length == 0.0) {
+      continue;
+    }
+    const glm::dvec3 normal = cross / length;
+    for (size_t k = 0; k < 3; k++) {
+      quadrics[remap[result[i + k]]].add_plane(normal, -glm::dot(normal, p0));
+    }
+  }
+
+  std::vector<size_t> offsets(vertex_count + 1);
+  std::vector<uint32_t> adjacency;
+  std::vector<Collapse> collapses;
+  std::vector<char> locked(vertex_count);
+  std::vector<uint32_t> collapse_to(vertex_count);
+
+  auto attribute_distance = [&](uint32_t a, uint32_t b) {
+    double distance = 0.0;
+    if (normals) {
+      const glm::vec3 difference = read_vec3(normals, a) - read_vec3(normals, b);
+      distance += glm::dot(difference, difference);
+    }
+    if (tex_coords) {
+      const glm::vec2 difference(tex_coords[2 * a] - tex_coords[2 * b], tex_coords[2 * a + 1] - tex_coords[2 * b + 1]);
+      distance += glm::dot(difference, difference);
+    }
+    return distance;
+  };
+
+  // Vertex of the target position that takes over the corners of 'wedge'. On a seam every side of it collapses
+  // along its own edge; a wedge without such an edge takes the target vertex with the closest attributes.
+  auto target_wedge = [&](uint32_t wedge, uint32_t to_position) {
+    for (size_t a = offsets[wedge]; a < offsets[wedge + 1]; a++) {
+      const uint32_t *triangle = result.data() + 3 * adjacency[a];
+      for (int k = 0; k < 3; k++) {
+        if (remap[triangle[k]] == to_position) {
+          return triangle[k];
+        }
+      }
+    }
+
+    uint32_t best = to_position;
+    double best_distance = -1.0;
+    for (size_t w = wedge_offsets[to_position]; w < wedge_offsets[to_position + 1]; w++) {
+      const uint32_t candidate = wedges[w];
+      if (offsets[candidate] == offsets[candidate + 1]) {
+        // Not referenced anymore
+        continue;
+      }
+      const double distance = attribute_distance(wedge, candidate);
+      if (best_distance < 0.0 || distance < best_distance) {
+        best = candidate;
+        best_distance = distance;
+      }
+    }
+    return best;
+  };
+
+  // Distance to the original planes around the removed position plus the attribute change of all its vertices
+  auto collapse_cost = [&](uint32_t from_position, uint32_t to_position) {
+    double cost = quadrics[from_position].evaluate(read_vec3(positions, to_position));
+    for (size_t w = wedge_offsets[from_position]; w < wedge_offsets[from_position + 1]; w++) {
+      const uint32_t wedge = wedges[w];
+      if (offsets[wedge] != offsets[wedge + 1]) {
+        cost += attribute_distance(wedge, target_wedge(wedge, to_position)) * attribute_scale * attribute_scale;
+      }
+    }
+    return static_cast<float>(cost);
+  };
+
+  // Moving the position onto the target must not turn any of its other triangles around
+  auto flips = [&](uint32_t from_position, uint32_t to_position) {
+    const glm::vec3 target = read_vec3(positions, to_position);
+    for (size_t w = wedge_offsets[from_position]; w < wedge_offsets[from_position + 1]; w++) {
+      const uint32_t wedge = wedges[w];
+      for (size_t a = offsets[wedge]; a < offsets[wedge + 1]; a++) {
+        const uint32_t *triangle = result.data() + 3 * adjacency[a];
+        if (remap[triangle[0]] == to_position || remap[triangle[1]] == to_position ||
+            remap[triangle[2]] == to_position) {
+          // Removed by the collapse
+          continue;
+        }
+
+        glm::vec3 before[3], after[3];
+        for (int k = 0; k < 3; k++) {
+          before[k] = read_vec3(positions, triangle[k]);
+          after[k] = remap[triangle[k]] == from_position ? target : before[k];
+        }
+        const glm::vec3 normal_before = glm::cross(before[1] - before[0], before[2] - before[0]);
+        const glm::vec3 normal_after = glm::cross(after[1] - after[0], after[2] - after[0]);
+        if (glm::dot(normal_before, normal_after) <=
+            0.25f * glm::length(normal_before) * glm::length(normal_after)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+
+  // Passes of independent collapses, cheapest first
+  while (result.size() > target_index_count) {
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (uint32_t v : result) {
+      offsets[v + 1]++;
+    }
+    for (size_t v = 0; v < vertex_count; v++) {
+      offsets[v + 1] += offsets[v];
+    }
+    adjacency.resize(result.size());
+    {
+      std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+      for (size_t i = 0; i < result.size(); i++) {
+        adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+      }
+    }
+
+    // Candidates are the edges between positions, in both directions
+    collapses.clear();
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (size_t k = 0; k < 3; k++) {
+        const uint32_t a = remap[result[i + k]];
+        const uint32_t b = remap[result[i + (k + 1) % 3]];
+        if (!locked_position[a]) {
+          collapses.push_back({a, b, collapse_cost(a, b)});
+        }
+        if (!locked_position[b]) {
+          collapses.push_back({b, a, collapse_cost(b, a)});
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+    // Every collapse removes about two triangles
+    const size_t goal = std::max<size_t>(1, (result.size() - target_index_count) / 6);
+    std::fill(locked.begin(), locked.end(), 0);
+    for (uint32_t v = 0; v < vertex_count; v++) {
+      collapse_to[v] = v;
+    }
+
+    size_t performed = 0;
+    for (const Collapse &collapse : collapses) {
+      if (collapse.cost > target_error * target_error) {
+        break;
+      }
+      if (locked[collapse.from] || locked[collapse.to] || flips(collapse.from, collapse.to)) {
+        continue;
+      }
+
+      for (size_t w = wedge_offsets[collapse.from]; w < wedge_offsets[collapse.from + 1]; w++) {
+        const uint32_t wedge = wedges[w];
+        if (offsets[wedge] != offsets[wedge + 1]) {
+          collapse_to[wedge] = target_wedge(wedge, collapse.to);
+        }
+      }
+      const double distance = quadrics[collapse.from].evaluate(read_vec3(positions, collapse.to));
+      max_error = std::max(max_error, static_cast<float>(std::sqrt(distance)));
+      quadrics[collapse.to].add(quadrics[collapse.from]);
+
+      // The triangles around the removed position change, nothing else may touch them in this pass
+      for (size_t w = wedge_offsets[collapse.from]; w < wedge_offsets[collapse.from + 1]; w++) {
+        const uint32_t wedge = wedges[w];
+        for (size_t a = offsets[wedge]; a < offsets[wedge + 1]; a++) {
+          const uint32_t *triangle = result.data() + 3 * adjacency[a];
+          for (int k = 0; k < 3; k++) {
+            locked[remap[triangle[k]]] = 1;
+          }
+        }
+      }
+
+      if (++performed >= goal) {
+        break;
+      }
+    }
+
+    if (performed == 0) {
+      break;
+    }
+
+    size_t write = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      const uint32_t a = collapse_to[result[i]];
+      const uint32_t b = collapse_to[result[i + 1]];
+      const uint32_t c = collapse_to[result[i + 2]];
+      if (remap[a] == remap[b] || remap[b] == remap[c] || remap[a] == remap[c]) {
+        continue;
+      }
+      result[write++] = a;
+      result[write++] = b;
+      result[write++] = c;
+    }
+    result.resize(write);
+  }
+
+  if (result_error) {
+    *result_error = max_error;
+  }
+  std::copy(result.begin(), result.end(), destination);
+  return result.size();
+}
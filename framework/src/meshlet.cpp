@@ -0,0 +1,248 @@
+#include "meshlet.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESHLET_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/// Below this minimum cosine between the cone axis and the triangle normals the cone is too wide to ever cull
+const float min_cone_cosine = 0.1f;
+
+glm::vec3 read_vec3(const float *values, size_t vertex) {
+  return glm::vec3(values[3 * vertex], values[3 * vertex + 1], values[3 * vertex + 2]);
+}
+
+void compute_bounds(const MeshData &data, const Submesh &submesh, Meshlet *meshlet) {
+  const uint32_t *indices = data.indices.data() + meshlet->first_index;
+  const float *positions = data.vertices.data() + 3 * submesh.base_vertex;
+  const size_t index_count = meshlet->triangle_count * 3;
+
+  glm::vec3 bounds_min = read_vec3(positions, indices[0]);
+  glm::vec3 bounds_max = bounds_min;
+  for (size_t i = 1; i < index_count; i++) {
+    bounds_min = glm::min(bounds_min, read_vec3(positions, indices[i]));
+    bounds_max = glm::max(bounds_max, read_vec3(positions, indices[i]));
+  }
+  meshlet->center = (bounds_min + bounds_max) * 0.5f;
+  meshlet->radius = 0.f;
+  for (size_t i = 0; i < index_count; i++) {
+    meshlet->radius = std::max(meshlet->radius, glm::length(read_vec3(positions, indices[i]) - meshlet->center));
+  }
+
+  glm::vec3 normals_sum(0.f);
+  std::vector<glm::vec3> normals;
+  normals.reserve(meshlet->triangle_count);
+  for (size_t i = 0; i < index_count; i += 3) {
+    const glm::vec3 p0 = read_vec3(positions, indices[i]);
+    const glm::vec3 cross =
+        glm::cross(read_vec3(positions, indices[i + 1]) - p0, read_vec3(positions, indices[i + 2]) - p0);
+    const float length = glm::length(cross);
+    if (length > 0.f) {
+      normals.push_back(cross / length);
+      normals_sum += normals.back();
+    }
+  }
+
+  meshlet->cone_axis = glm::vec3(0.f);
+  meshlet->cone_cutoff = 1.f;
+  const float sum_length = glm::length(normals_sum);
+  if (normals.empty() || sum_length == 0.f) {
+    return;
+  }
+  meshlet->cone_axis = normals_sum / sum_length;
+
+  float min_cosine = 1.f;
+  for (const glm::vec3 &normal : normals) {
+    min_cosine = std::min(min_cosine, glm::dot(normal, meshlet->cone_axis));
+  }
+  if (min_cosine > min_cone_cosine) {
+    // The sine of the cone angle: a view direction within 90 degrees minus that angle of the axis sees only backs
+    meshlet->cone_cutoff = std::sqrt(1.f - min_cosine * min_cosine);
+  }
+}
+
+/// Planes of the clip space frustum in the space of the matrix, normalized so they give distances
+void extract_frustum_planes(const glm::mat4 &matrix, glm::vec4 planes[6]) {
+  const glm::vec4 row0(matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0]);
+  const glm::vec4 row1(matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1]);
+  const glm::vec4 row2(matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]);
+  const glm::vec4 row3(matrix[0][3], matrix[1][3], matrix[2][3], matrix[3][3]);
+  planes[0] = row3 + row0;
+  planes[1] = row3 - row0;
+  planes[2] = row3 + row1;
+  planes[3] = row3 - row1;
+  planes[4] = row3 + row2;
+  planes[5] = row3 - row2;
+  for (int p = 0; p < 6; p++) {
+    const float length = glm::length(glm::vec3(planes[p]));
+    if (length > 0.f) {
+      planes[p] /= length;
+    }
+  }
+}
+
+} // namespace
+
+std::vector<Meshlet> build_meshlets(const MeshData &data, size_t max_vertices, size_t max_triangles) {
+  std::vector<Meshlet> meshlets;
+
+  std::vector<Submesh> ranges = data.submeshes;
+  if (ranges.empty()) {
+    Submesh whole;
+    whole.index_count = data.indices.size();
+    whole.vertex_count = data.vertex_count();
+    ranges.push_back(whole);
+  }
+
+  // Which meshlet last referenced each vertex, so counting distinct vertices needs no clearing
+  std::vector<uint32_t> last_meshlet;
+
+  for (size_t s = 0; s < ranges.size(); s++) {
+    const Submesh &range = ranges[s];
+    last_meshlet.assign(range.vertex_count, ~uint32_t(0));
+
+    Meshlet meshlet;
+    meshlet.submesh = static_cast<uint32_t>(s);
+    meshlet.first_index = static_cast<uint32_t>(range.first_index);
+    uint32_t id = static_cast<uint32_t>(meshlets.size());
+
+    for (size_t i = range.first_index; i + 3 <= range.first_index + range.index_count; i += 3) {
+      const uint32_t *triangle = data.indices.data() + i;
+      uint32_t new_vertices = 0;
+      for (int k = 0; k < 3; k++) {
+        new_vertices += last_meshlet[triangle[k]] != id;
+      }
+      if (meshlet.vertex_count + new_vertices > max_vertices || meshlet.triangle_count + 1 > max_triangles) {
+        compute_bounds(data, range, &meshlet);
+        meshlets.push_back(meshlet);
+
+        meshlet = Meshlet();
+        meshlet.submesh = static_cast<uint32_t>(s);
+        meshlet.first_index = static_cast<uint32_t>(i);
+        id = static_cast<uint32_t>(meshlets.size());
+      }
+
+      for (int k = 0; k < 3; k++) {
+        if (last_meshlet[triangle[k]] != id) {
+          last_meshlet[triangle[k]] = id;
+          meshlet.vertex_count++;
+        }
+      }
+      meshlet.triangle_count++;
+    }
+
+    if (meshlet.triangle_count > 0) {
+      compute_bounds(data, range, &meshlet);
+      meshlets.push_back(meshlet);
+    }
+  }
+
+  return meshlets;
+}
+
+MeshletCuller::MeshletCuller(const std::vector<Meshlet> &meshlets) : count(meshlets.size()) {
+  const size_t padded = (this->count + 3) / 4 * 4;
+  for (auto *values : {&center_x, &center_y, &center_z, &radius, &axis_x, &axis_y, &axis_z, &cutoff}) {
+    values->assign(padded, 0.f);
+  }
+  this->triangle_counts.resize(this->count);
+
+  for (size_t m = 0; m < this->count; m++) {
+    const Meshlet &meshlet = meshlets[m];
+    this->center_x[m] = meshlet.center.x;
+    this->center_y[m] = meshlet.center.y;
+    this->center_z[m] = meshlet.center.z;
+    this->radius[m] = meshlet.radius;
+    this->axis_x[m] = meshlet.cone_axis.x;
+    this->axis_y[m] = meshlet.cone_axis.y;
+    this->axis_z[m] = meshlet.cone_axis.z;
+    this->cutoff[m] = meshlet.cone_cutoff;
+    this->triangle_counts[m] = meshlet.triangle_count;
+    this->total_triangles += meshlet.triangle_count;
+  }
+}
+
+MeshletCullStats MeshletCuller::cull(const glm::mat4 &view_projection, const glm::vec3 &eye,
+                                     const MeshletCullSettings &settings, std::vector<uint32_t> *visible) const {
+  glm::vec4 planes[6];
+  extract_frustum_planes(view_projection, planes);
+  visible->clear();
+
+  size_t m = 0;
+#ifdef MESHLET_SSE2
+  if (settings.simd) {
+    for (; m + 4 <= this->count; m += 4) {
+      const __m128 x = _mm_loadu_ps(&this->center_x[m]);
+      const __m128 y = _mm_loadu_ps(&this->center_y[m]);
+      const __m128 z = _mm_loadu_ps(&this->center_z[m]);
+      const __m128 r = _mm_loadu_ps(&this->radius[m]);
+      __m128 culled = _mm_setzero_ps();
+
+      if (settings.frustum) {
+        const __m128 minus_r = _mm_sub_ps(_mm_setzero_ps(), r);
+        for (int p = 0; p < 6; p++) {
+          __m128 distance = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes[p].x)), _mm_set1_ps(planes[p].w));
+          distance = _mm_add_ps(distance, _mm_mul_ps(y, _mm_set1_ps(planes[p].y)));
+          distance = _mm_add_ps(distance, _mm_mul_ps(z, _mm_set1_ps(planes[p].z)));
+          culled = _mm_or_ps(culled, _mm_cmplt_ps(distance, minus_r));
+        }
+      }
+
+      if (settings.backface) {
+        const __m128 dx = _mm_sub_ps(x, _mm_set1_ps(eye.x));
+        const __m128 dy = _mm_sub_ps(y, _mm_set1_ps(eye.y));
+        const __m128 dz = _mm_sub_ps(z, _mm_set1_ps(eye.z));
+        const __m128 length =
+            _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        const __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&this->axis_x[m])),
+                                                   _mm_mul_ps(dy, _mm_loadu_ps(&this->axis_y[m]))),
+                                        _mm_mul_ps(dz, _mm_loadu_ps(&this->axis_z[m])));
+        const __m128 limit = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&this->cutoff[m]), length), r);
+        culled = _mm_or_ps(culled, _mm_cmpge_ps(along, limit));
+      }
+
+      const int mask = _mm_movemask_ps(culled);
+      for (int lane = 0; lane < 4; lane++) {
+        if (!(mask & (1 << lane))) {
+          visible->push_back(static_cast<uint32_t>(m + lane));
+        }
+      }
+    }
+  }
+#endif
+
+  for (; m < this->count; m++) {
+    const glm::vec3 center(this->center_x[m], this->center_y[m], this->center_z[m]);
+    bool culled = false;
+
+    if (settings.frustum) {
+      for (int p = 0; p < 6 && !culled; p++) {
+        culled = glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -this->radius[m];
+      }
+    }
+
+    if (settings.backface && !culled) {
+      const glm::vec3 direction = center - eye;
+      const glm::vec3 axis(this->axis_x[m], this->axis_y[m], this->axis_z[m]);
+      culled = glm::dot(direction, axis) >= this->cutoff[m] * glm::length(direction) + this->radius[m];
+    }
+
+    if (!culled) {
+      visible->push_back(static_cast<uint32_t>(m));
+    }
+  }
+
+  MeshletCullStats stats;
+  stats.meshlets = this->count;
+  stats.visible_meshlets = visible->size();
+  stats.triangles = this->total_triangles;
+  for (uint32_t v : *visible) {
+    stats.visible_triangles += this->triangle_counts[v];
+  }
+  return stats;
+}
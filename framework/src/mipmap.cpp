@@ -0,0 +1,625 @@
+#include "mipmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPMAP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/// Increase whenever the generated levels change for the same settings
+const uint32_t generator_version = 1;
+/// Same for the cubemap levels, on top of the version of the face filter
+const uint32_t cubemap_generator_version = 1;
+
+const float pi = 3.14159265358979f;
+const float lanczos_lobes = 3.f;
+
+/// Resolution of the linear to sRGB table, fine enough that dark values round to the right byte
+const int linear_table_size = 16384;
+
+/// Level in float RGBA, linear and premultiplied when the settings ask for it
+struct FloatImage {
+  int width = 0;
+  int height = 0;
+  std::vector<float> pixels;
+};
+
+struct ConversionTables {
+  float to_linear[256];
+  uint8_t from_linear[linear_table_size + 1];
+};
+
+float srgb_to_linear(float value) {
+  return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float linear_to_srgb(float value) {
+  return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+}
+
+ConversionTables build_conversion_tables(bool srgb) {
+  ConversionTables tables;
+  for (int i = 0; i < 256; i++) {
+    tables.to_linear[i] = srgb ? srgb_to_linear(i / 255.f) : i / 255.f;
+  }
+  for (int i = 0; i <= linear_table_size; i++) {
+    const float value = float(i) / linear_table_size;
+    tables.from_linear[i] = static_cast<uint8_t>(std::lround((srgb ? linear_to_srgb(value) : value) * 255.f));
+  }
+  return tables;
+}
+
+const ConversionTables &conversion_tables(bool srgb) {
+  static const ConversionTables plain = build_conversion_tables(false);
+  static const ConversionTables encoded = build_conversion_tables(true);
+  return srgb ? encoded : plain;
+}
+
+float filter_weight(MipFilter filter, float t) {
+  t = std::abs(t);
+  if (filter == MipFilter::Box) {
+    return t < 0.5f ? 1.f : (t == 0.5f ? 0.5f : 0.f);
+  }
+  if (t < 1e-6f) {
+    return 1.f;
+  }
+  if (t >= lanczos_lobes) {
+    return 0.f;
+  }
+  const float x = pi * t;
+  return lanczos_lobes * std::sin(x) * std::sin(x / lanczos_lobes) / (x * x);
+}
+
+/// Source texels and normalized weights of every destination texel along one axis, 'taps' per texel.
+/// Texels past the edge are clamped to it.
+struct Contributions {
+  int taps = 0;
+  std::vector<int> indices;
+  std::vector<float> weights;
+};
+
+Contributions compute_contributions(int source_size, int destination_size, MipFilter filter) {
+  const float scale = float(source_size) / destination_size;
+  const float support = (filter == MipFilter::Box ? 0.5f : lanczos_lobes) * scale;
+
+  Contributions contributions;
+  contributions.taps = static_cast<int>(std::ceil(2.f * support)) + 1;
+  contributions.indices.resize(size_t(destination_size) * contributions.taps);
+  contributions.weights.resize(size_t(destination_size) * contributions.taps);
+
+  for (int d = 0; d < destination_size; d++) {
+    // Texel centers are at +0.5
+    const float center = (d + 0.5f) * scale;
+    const int first = static_cast<int>(std::floor(center - support));
+    float sum = 0.f;
+    for (int k = 0; k < contributions.taps; k++) {
+      const int source = first + k;
+      const float weight = filter_weight(filter, (source + 0.5f - center) / scale);
+      contributions.indices[size_t(d) * contributions.taps + k] = std::min(std::max(source, 0), source_size - 1);
+      contributions.weights[size_t(d) * contributions.taps + k] = weight;
+      sum += weight;
+    }
+    for (int k = 0; k < contributions.taps; k++) {
+      contributions.weights[size_t(d) * contributions.taps + k] /= sum;
+    }
+  }
+  return contributions;
+}
+
+/// Weighted sum of 'taps' RGBA texels of one row
+void filter_row_scalar(const float *row, const int *indices, const float *weights, int taps, float *destination) {
+  float sum[4] = {0.f, 0.f, 0.f, 0.f};
+  for (int k = 0; k < taps; k++) {
+    const float *texel = row + 4 * indices[k];
+    for (int c = 0; c < 4; c++) {
+      sum[c] += weights[k] * texel[c];
+    }
+  }
+  std::memcpy(destination, sum, sizeof(sum));
+}
+
+/// Weighted sum of whole rows, 'count' floats each
+void filter_rows_scalar(const float *const *rows, const float *weights, int taps, size_t count, float *destination) {
+  for (size_t i = 0; i < count; i++) {
+    float sum = 0.f;
+    for (int k = 0; k < taps; k++) {
+      sum += weights[k] * rows[k][i];
+    }
+    destination[i] = sum;
+  }
+}
+
+#ifdef MIPMAP_SSE2
+
+/// One RGBA texel is one register, so every tap is a single multiply-add
+void filter_row_sse2(const float *row, const int *indices, const float *weights, int taps, float *destination) {
+  __m128 sum = _mm_setzero_ps();
+  for (int k = 0; k < taps; k++) {
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(row + 4 * indices[k])));
+  }
+  _mm_storeu_ps(destination, sum);
+}
+
+/// Same order of operations as the scalar version, so both give the same result
+void filter_rows_sse2(const float *const *rows, const float *weights, int taps, size_t count, float *destination) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 sum = _mm_setzero_ps();
+    for (int k = 0; k < taps; k++) {
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+    }
+    _mm_storeu_ps(destination + i, sum);
+  }
+  for (; i < count; i++) {
+    float sum = 0.f;
+    for (int k = 0; k < taps; k++) {
+      sum += weights[k] * rows[k][i];
+    }
+    destination[i] = sum;
+  }
+}
+
+#endif
+
+/// Returns row 'y' of the source as float RGBA, either in place or converted into 'buffer'
+using RowLoader = std::function<const float *(int y, std::vector<float> &buffer)>;
+
+/// Separable filter: first every source row horizontally, then the columns of that result vertically
+FloatImage downsample(int width, int height, const RowLoader &load_row, const MipSettings &settings,
+                      ThreadPool &pool) {
+  FloatImage result;
+  result.width = std::max(1, width / 2);
+  result.height = std::max(1, height / 2);
+
+  auto filter_row = filter_row_scalar;
+  auto filter_rows = filter_rows_scalar;
+#ifdef MIPMAP_SSE2
+  if (settings.simd) {
+    filter_row = filter_row_sse2;
+    filter_rows = filter_rows_sse2;
+  }
+#endif
+
+  const Contributions horizontal = compute_contributions(width, result.width, settings.filter);
+  const Contributions vertical = compute_contributions(height, result.height, settings.filter);
+
+  std::vector<float> intermediate(size_t(result.width) * height * 4);
+  pool.parallel_for(height, [&](size_t y) {
+    thread_local std::vector<float> buffer;
+    const float *row = load_row(static_cast<int>(y), buffer);
+    float *destination = intermediate.data() + y * result.width * 4;
+    for (int x = 0; x < result.width; x++) {
+      const size_t first = size_t(x) * horizontal.taps;
+      filter_row(row, &horizontal.indices[first], &horizontal.weights[first], horizontal.taps, destination + 4 * x);
+    }
+  });
+
+  result.pixels.resize(size_t(result.width) * result.height * 4);
+  pool.parallel_for(result.height, [&](size_t y) {
+    std::vector<const float *> rows(vertical.taps);
+    for (int k = 0; k < vertical.taps; k++) {
+      rows[k] = intermediate.data() + size_t(vertical.indices[y * vertical.taps + k]) * result.width * 4;
+    }
+    filter_rows(rows.data(), &vertical.weights[y * vertical.taps], vertical.taps, size_t(result.width) * 4,
+                result.pixels.data() + y * result.width * 4);
+  });
+
+  return result;
+}
+
+/// Row loader of an 8-bit image, converting to linear and premultiplying as the settings ask
+RowLoader byte_rows(const Image &image, const MipSettings &settings) {
+  const ConversionTables &tables = conversion_tables(settings.srgb);
+  const bool premultiply = settings.premultiplied_alpha;
+  return [&image, &tables, premultiply](int y, std::vector<float> &buffer) -> const float * {
+    buffer.resize(size_t(image.width) * 4);
+    const unsigned char *source = &image.pixels[size_t(y) * image.width * 4];
+    for (int x = 0; x < image.width; x++) {
+      const float alpha = source[4 * x + 3] / 255.f;
+      const float weight = premultiply ? alpha : 1.f;
+      for (int c = 0; c < 3; c++) {
+        buffer[4 * x + c] = tables.to_linear[source[4 * x + c]] * weight;
+      }
+      buffer[4 * x + 3] = alpha;
+    }
+    return buffer.data();
+  };
+}
+
+RowLoader float_rows(const FloatImage &image) {
+  return [&image](int y, std::vector<float> &) { return &image.pixels[size_t(y) * image.width * 4]; };
+}
+
+Image quantize(const FloatImage &level, const MipSettings &settings, ThreadPool &pool) {
+  const ConversionTables &tables = conversion_tables(settings.srgb);
+
+  Image image;
+  image.width = level.width;
+  image.height = level.height;
+  image.pixels.resize(size_t(level.width) * level.height * 4);
+  pool.parallel_for(level.height, [&](size_t y) {
+    const float *source = &level.pixels[y * level.width * 4];
+    unsigned char *destination = &image.pixels[y * level.width * 4];
+    for (int x = 0; x < level.width; x++) {
+      // Lanczos overshoots a little next to hard edges
+      const float alpha = std::min(std::max(source[4 * x + 3], 0.f), 1.f);
+      const float weight = settings.premultiplied_alpha ? (alpha > 0.f ? 1.f / alpha : 0.f) : 1.f;
+      for (int c = 0; c < 3; c++) {
+        const float value = std::min(std::max(source[4 * x + c] * weight, 0.f), 1.f);
+        destination[4 * x + c] = tables.from_linear[static_cast<int>(value * linear_table_size + 0.5f)];
+      }
+      destination[4 * x + 3] = static_cast<unsigned char>(alpha * 255.f + 0.5f);
+    }
+  });
+  return image;
+}
+
+/// Level 0 of an 8-bit image as float RGBA, converted as byte_rows does
+FloatImage to_float_image(const Image &image, const MipSettings &settings, ThreadPool &pool) {
+  FloatImage result;
+  result.width = image.width;
+  result.height = image.height;
+  result.pixels.resize(size_t(image.width) * image.height * 4);
+  const RowLoader rows = byte_rows(image, settings);
+  pool.parallel_for(image.height, [&](size_t y) {
+    thread_local std::vector<float> buffer;
+    const float *row = rows(static_cast<int>(y), buffer);
+    std::copy(row, row + size_t(image.width) * 4, &result.pixels[y * image.width * 4]);
+  });
+  return result;
+}
+
+/// Direction through the point (u, v) in [-1, 1] of a cube face, laid out like the cube map targets
+glm::vec3 face_direction(int face, float u, float v) {
+  switch (face) {
+  case 0:
+    return glm::vec3(1.f, -v, -u);
+  case 1:
+    return glm::vec3(-1.f, -v, u);
+  case 2:
+    return glm::vec3(u, 1.f, v);
+  case 3:
+    return glm::vec3(u, -1.f, -v);
+  case 4:
+    return glm::vec3(u, -v, 1.f);
+  default:
+    return glm::vec3(-u, -v, -1.f);
+  }
+}
+
+/// Point (u, v) of the face the direction goes through, the inverse of face_direction
+void face_coordinates(int face, const glm::vec3 &direction, float *u, float *v) {
+  const glm::vec3 d = direction / std::abs(direction[face / 2]);
+  switch (face) {
+  case 0:
+    *u = -d.z;
+    *v = -d.y;
+    break;
+  case 1:
+    *u = d.z;
+    *v = -d.y;
+    break;
+  case 2:
+    *u = d.x;
+    *v = d.z;
+    break;
+  case 3:
+    *u = d.x;
+    *v = -d.z;
+    break;
+  case 4:
+    *u = d.x;
+    *v = -d.y;
+    break;
+  default:
+    *u = -d.x;
+    *v = -d.y;
+    break;
+  }
+}
+
+/// Face the direction points into, that of its largest component
+int direction_face(const glm::vec3 &direction) {
+  const glm::vec3 magnitude = glm::abs(direction);
+  if (magnitude.x >= magnitude.y && magnitude.x >= magnitude.z) {
+    return direction.x >= 0.f ? 0 : 1;
+  }
+  if (magnitude.y >= magnitude.z) {
+    return direction.y >= 0.f ? 2 : 3;
+  }
+  return direction.z >= 0.f ? 4 : 5;
+}
+
+/// Texel of a face 'size' texels across that holds the coordinate in [-1, 1]
+int texel_index(float coordinate, int size) {
+  return std::min(std::max(static_cast<int>((coordinate + 1.f) * 0.5f * size), 0), size - 1);
+}
+
+/// Texels of the faces of a cube that show the same point, both texels along an edge or the three at a corner
+struct SeamGroup {
+  int count = 0;
+  int faces[3];
+  size_t texels[3];
+};
+
+/// Every group of a cube with faces 'size' texels across, at least 2
+std::vector<SeamGroup> seam_groups(int size) {
+  std::vector<SeamGroup> groups;
+  for (int face = 0; face < 6; face++) {
+    for (int y = 0; y < size; y++) {
+      // Only the first and last row are on the border all the way through
+      const int step = y == 0 || y == size - 1 ? 1 : size - 1;
+      for (int x = 0; x < size; x += step) {
+        // The point of the edge (or corner) next to the texel center, exactly on the neighbouring faces too
+        float u = (x + 0.5f) * 2.f / size - 1.f;
+        float v = (y + 0.5f) * 2.f / size - 1.f;
+        u = x == 0 ? -1.f : (x == size - 1 ? 1.f : u);
+        v = y == 0 ? -1.f : (y == size - 1 ? 1.f : v);
+        const glm::vec3 point = face_direction(face, u, v);
+
+        SeamGroup group;
+        for (int other = 0; other < 6; other++) {
+          if (point[other / 2] != (other % 2 == 0 ? 1.f : -1.f)) {
+            continue;
+          }
+          float other_u, other_v;
+          face_coordinates(other, point, &other_u, &other_v);
+          group.faces[group.count] = other;
+          group.texels[group.count] = size_t(texel_index(other_v, size)) * size + texel_index(other_u, size);
+          group.count++;
+        }
+        // Each group once, from the first of its faces
+        if (group.faces[0] == face) {
+          groups.push_back(group);
+        }
+      }
+    }
+  }
+  return groups;
+}
+
+/// Averages the texels of every seam group of the six faces of one level
+void fix_seams(std::vector<FloatImage> *faces) {
+  if ((*faces)[0].width < 2) {
+    return;
+  }
+  for (const SeamGroup &group : seam_groups((*faces)[0].width)) {
+    float sum[4] = {0.f, 0.f, 0.f, 0.f};
+    for (int m = 0; m < group.count; m++) {
+      const float *texel = &(*faces)[group.faces[m]].pixels[4 * group.texels[m]];
+      for (int c = 0; c < 4; c++) {
+        sum[c] += texel[c];
+      }
+    }
+    for (int m = 0; m < group.count; m++) {
+      float *texel = &(*faces)[group.faces[m]].pixels[4 * group.texels[m]];
+      for (int c = 0; c < 4; c++) {
+        texel[c] = sum[c] / group.count;
+      }
+    }
+  }
+}
+
+/// Direction of the GGX lobe around the normal (+Z) with its weight and the level it is sampled from
+struct LobeSample {
+  glm::vec3 direction;
+  float weight;
+  size_t level;
+};
+
+/// Van der Corput sequence in base 2, the second coordinate of the Hammersley points
+float radical_inverse(uint32_t bits) {
+  bits = (bits << 16u) | (bits >> 16u);
+  bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+  bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+  bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+  bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+  return float(bits) * 2.3283064365386963e-10f;
+}
+
+/// Importance samples of the GGX lobe with the view along the normal, as prefiltered environment maps assume.
+/// Each sample reads the level whose texels cover about the solid angle the sample stands for, so a few dozen
+/// samples do not alias (filtered importance sampling, GPU Gems 3 chapter 20).
+std::vector<LobeSample> ggx_lobe_samples(float roughness, int sample_count, int base_size, size_t level_count) {
+  const float alpha = roughness * roughness;
+  const float alpha_squared = alpha * alpha;
+  const float texel_solid_angle = 4.f * pi / (6.f * base_size * base_size);
+  std::vector<LobeSample> samples;
+  for (int i = 0; i < sample_count; i++) {
+    const float phi = 2.f * pi * i / sample_count;
+    const float xi = radical_inverse(static_cast<uint32_t>(i));
+    const float cos_theta = std::sqrt((1.f - xi) / (1.f + (alpha_squared - 1.f) * xi));
+    const float sin_theta = std::sqrt(1.f - cos_theta * cos_theta);
+    // The normal reflected about the half vector
+    const glm::vec3 direction(2.f * cos_theta * sin_theta * std::cos(phi), 2.f * cos_theta * sin_theta * std::sin(phi),
+                              2.f * cos_theta * cos_theta - 1.f);
+    if (direction.z <= 0.f) {
+      continue;
+    }
+    // With the view along the normal the density of the direction is D / 4
+    const float denominator = cos_theta * cos_theta * (alpha_squared - 1.f) + 1.f;
+    const float density = alpha_squared / (4.f * pi * denominator * denominator);
+    const float sample_solid_angle = 1.f / (sample_count * density);
+    const float level = std::max(0.5f * std::log2(sample_solid_angle / texel_solid_angle) + 1.f, 0.f);
+    samples.push_back({direction, direction.z, std::min(static_cast<size_t>(level + 0.5f), level_count - 1)});
+  }
+  return samples;
+}
+
+/// Bilinear sample of a seamless level in the direction, within the face it points into, added to 'sum'
+void add_cube_sample_scalar(const std::vector<FloatImage> &faces, const glm::vec3 &direction, float weight,
+                            float *sum) {
+  const int face = direction_face(direction);
+  float u, v;
+  face_coordinates(face, direction, &u, &v);
+  const FloatImage &image = faces[face];
+  const float x = (u + 1.f) * 0.5f * image.width - 0.5f;
+  const float y = (v + 1.f) * 0.5f * image.height - 0.5f;
+  const int x0 = static_cast<int>(std::floor(x)), y0 = static_cast<int>(std::floor(y));
+  const float fx = x - x0, fy = y - y0;
+  const int left = std::min(std::max(x0, 0), image.width - 1), right = std::min(x0 + 1, image.width - 1);
+  const int top = std::min(std::max(y0, 0), image.height - 1), bottom = std::min(y0 + 1, image.height - 1);
+  const float *texels[4] = {&image.pixels[(size_t(top) * image.width + left) * 4],
+                            &image.pixels[(size_t(top) * image.width + right) * 4],
+                            &image.pixels[(size_t(bottom) * image.width + left) * 4],
+                            &image.pixels[(size_t(bottom) * image.width + right) * 4]};
+  const float weights[4] = {(1.f - fx) * (1.f - fy) * weight, fx * (1.f - fy) * weight, (1.f - fx) * fy * weight,
+                            fx * fy * weight};
+  for (int c = 0; c < 4; c++) {
+    sum[c] += weights[0] * texels[0][c] + weights[1] * texels[1][c] + weights[2] * texels[2][c] +
+              weights[3] * texels[3][c];
+  }
+}
+
+#ifdef MIPMAP_SSE2
+
+/// Same as the scalar version with one RGBA texel per register, in the same order of operations
+void add_cube_sample_sse2(const std::vector<FloatImage> &faces, const glm::vec3 &direction, float weight,
+                          float *sum) {
+  const int face = direction_face(direction);
+  float u, v;
+  face_coordinates(face, direction, &u, &v);
+  const FloatImage &image = faces[face];
+  const float x = (u + 1.f) * 0.5f * image.width - 0.5f;
+  const float y = (v + 1.f) * 0.5f * image.height - 0.5f;
+  const int x0 = static_cast<int>(std::floor(x)), y0 = static_cast<int>(std::floor(y));
+  const float fx = x - x0, fy = y - y0;
+  const int left = std::min(std::max(x0, 0), image.width - 1), right = std::min(x0 + 1, image.width - 1);
+  const int top = std::min(std::max(y0, 0), image.height - 1), bottom = std::min(y0 + 1, image.height - 1);
+  const float *top_row = &image.pixels[size_t(top) * image.width * 4];
+  const float *bottom_row = &image.pixels[size_t(bottom) * image.width * 4];
+  __m128 value = _mm_mul_ps(_mm_set1_ps((1.f - fx) * (1.f - fy) * weight), _mm_loadu_ps(top_row + 4 * left));
+  value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(fx * (1.f - fy) * weight), _mm_loadu_ps(top_row + 4 * right)));
+  value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps((1.f - fx) * fy * weight), _mm_loadu_ps(bottom_row + 4 * left)));
+  value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(fx * fy * weight), _mm_loadu_ps(bottom_row + 4 * right)));
+  _mm_storeu_ps(sum, _mm_add_ps(_mm_loadu_ps(sum), value));
+}
+
+#endif
+
+/// Level 'level' of the chain convolved with the GGX lobe of its roughness, all rows of the six faces on the pool
+std::vector<FloatImage> prefilter_level(const std::vector<std::vector<FloatImage>> &chain, size_t level,
+                                        const CubemapMipSettings &settings, ThreadPool &pool) {
+  auto add_sample = add_cube_sample_scalar;
+#ifdef MIPMAP_SSE2
+  if (settings.mip.simd) {
+    add_sample = add_cube_sample_sse2;
+  }
+#endif
+  const float roughness = float(level) / (chain.size() - 1);
+  const std::vector<LobeSample> samples =
+      ggx_lobe_samples(roughness, settings.prefilter_samples, chain[0][0].width, chain.size());
+  const int size = chain[level][0].width;
+
+  std::vector<FloatImage> faces(6);
+  for (FloatImage &face : faces) {
+    face.width = face.height = size;
+    face.pixels.resize(size_t(size) * size * 4);
+  }
+  pool.parallel_for(6 * size_t(size), [&](size_t i) {
+    const int face = static_cast<int>(i / size), y = static_cast<int>(i % size);
+    for (int x = 0; x < size; x++) {
+      const glm::vec3 normal =
+          glm::normalize(face_direction(face, (x + 0.5f) * 2.f / size - 1.f, (y + 0.5f) * 2.f / size - 1.f));
+      const glm::vec3 up = std::abs(normal.z) < 0.999f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(1.f, 0.f, 0.f);
+      const glm::vec3 tangent = glm::normalize(glm::cross(up, normal));
+      const glm::vec3 bitangent = glm::cross(normal, tangent);
+      float sum[4] = {0.f, 0.f, 0.f, 0.f};
+      float total_weight = 0.f;
+      for (const LobeSample &sample : samples) {
+        const glm::vec3 direction =
+            tangent * sample.direction.x + bitangent * sample.direction.y + normal * sample.direction.z;
+        add_sample(chain[sample.level], direction, sample.weight, sum);
+        total_weight += sample.weight;
+      }
+      float *destination = &faces[face].pixels[(size_t(y) * size + x) * 4];
+      for (int c = 0; c < 4; c++) {
+        destination[c] = sum[c] / total_weight;
+      }
+    }
+  });
+  return faces;
+}
+
+} // namespace
+
+uint32_t mip_settings_key(const MipSettings &settings) {
+  // The SIMD and scalar kernels give the same levels, so 'simd' is not part of the key
+  return generator_version | (static_cast<uint32_t>(settings.filter) << 8) | (settings.srgb ? 1u << 12 : 0u) |
+         (settings.premultiplied_alpha ? 1u << 13 : 0u);
+}
+
+Image downsample_image(const Image &image, const MipSettings &settings, ThreadPool &pool) {
+  return quantize(downsample(image.width, image.height, byte_rows(image, settings), settings, pool), settings,
+                  pool);
+}
+
+std::vector<Image> generate_mipmaps(const Image &image, const MipSettings &settings, ThreadPool &pool) {
+  std::vector<Image> levels;
+  if (image.width <= 1 && image.height <= 1) {
+    return levels;
+  }
+
+  FloatImage level = downsample(image.width, image.height, byte_rows(image, settings), settings, pool);
+  for (;;) {
+    levels.push_back(quantize(level, settings, pool));
+    if (level.width <= 1 && level.height <= 1) {
+      return levels;
+    }
+    level = downsample(level.width, level.height, float_rows(level), settings, pool);
+  }
+}
+
+uint32_t cubemap_mip_settings_key(const CubemapMipSettings &settings) {
+  // The bits of the face filter stay as they are
+  const uint32_t samples = static_cast<uint32_t>(std::min(std::max(settings.prefilter_samples, 0), 1023));
+  return mip_settings_key(settings.mip) | (cubemap_generator_version << 16) |
+         (settings.prefilter ? (1u << 14) | (samples << 18) : 0u);
+}
+
+std::vector<std::vector<Image>> generate_cubemap_mipmaps(const std::vector<Image> &faces,
+                                                         const CubemapMipSettings &settings, ThreadPool &pool) {
+  std::vector<std::vector<Image>> levels(faces.size());
+  if (faces.size() != 6 || faces[0].width <= 1) {
+    return levels;
+  }
+  const MipSettings &mip = settings.mip;
+
+  // The seamless levels in float, by level and face. Level 0 is only needed as a source of the prefilter.
+  std::vector<std::vector<FloatImage>> chain(1, std::vector<FloatImage>(6));
+  if (settings.prefilter) {
+    for (size_t face = 0; face < 6; face++) {
+      chain[0][face] = to_float_image(faces[face], mip, pool);
+    }
+  }
+  for (int size = faces[0].width; size > 1; size = std::max(1, size / 2)) {
+    std::vector<FloatImage> next(6);
+    pool.parallel_for(6, [&](size_t face) {
+      const RowLoader rows = chain.size() == 1 ? byte_rows(faces[face], mip) : float_rows(chain.back()[face]);
+      next[face] = downsample(size, size, rows, mip, pool);
+    });
+    fix_seams(&next);
+    chain.push_back(std::move(next));
+  }
+
+  for (size_t level = 1; level < chain.size(); level++) {
+    std::vector<FloatImage> prefiltered;
+    if (settings.prefilter) {
+      prefiltered = prefilter_level(chain, level, settings, pool);
+      fix_seams(&prefiltered);
+    }
+    const std::vector<FloatImage> &source = settings.prefilter ? prefiltered : chain[level];
+    for (size_t face = 0; face < 6; face++) {
+      levels[face].push_back(quantize(source[face], mip, pool));
+    }
+  }
+  return levels;
+}
@@ -0,0 +1,460 @@
+#include "obj_loader.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+// The implementation lives in this translation unit so the parser below can reuse
+// tinyobj's own number parsing and get bit-identical results.
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+using namespace tinyobj;
+
+namespace {
+
+enum class ObjCommandType { Faces, UseMtl, MtlLib, Group, Object };
+
+/// Everything except vertex data is recorded as an ordered list of commands,
+/// which are replayed on one thread once all chunks have been parsed.
+struct ObjCommand {
+  ObjCommandType type;
+  std::string argument;
+
+  // Faces: range of triangles in the chunk and the number of polygons they came from
+  size_t first_triangle = 0;
+  size_t triangle_count = 0;
+  size_t polygon_count = 0;
+};
+
+/// Relative ('-1') indices can only be resolved once the number of elements
+/// in the previous chunks is known, these flags mark them.
+const unsigned char relative_vertex = 1;
+const unsigned char relative_normal = 2;
+const unsigned char relative_texcoord = 4;
+
+struct ObjChunk {
+  const char *begin = nullptr;
+  const char *end = nullptr;
+
+  std::vector<real_t> v;
+  std::vector<real_t> vn;
+  std::vector<real_t> vt;
+
+  // Triangulated faces, three corners per triangle
+  std::vector<index_t> corners;
+  std::vector<unsigned char> relative;
+
+  std::vector<ObjCommand> commands;
+
+  // Offsets of this chunk's elements in the merged arrays
+  size_t v_base = 0;
+  size_t vn_base = 0;
+  size_t vt_base = 0;
+};
+
+inline int fix_chunk_index(int idx, int n, unsigned char flag, unsigned char *relative) {
+  if (idx > 0) return idx - 1;
+  if (idx == 0) return 0;
+  *relative |= flag;
+  return n + idx;
+}
+
+// Same as tinyobj's parseTriple, but relative indices are made relative to the start of the chunk
+index_t parse_chunk_triple(const char **token, const ObjChunk &chunk, unsigned char *relative) {
+  index_t vi;
+  vi.vertex_index = -1;
+  vi.normal_index = -1;
+  vi.texcoord_index = -1;
+  *relative = 0;
+
+  vi.vertex_index = fix_chunk_index(atoi((*token)), static_cast<int>(chunk.v.size() / 3), relative_vertex, relative);
+  (*token) += strcspn((*token), "/ \t\r");
+  if ((*token)[0] != '/') {
+    return vi;
+  }
+  (*token)++;
+
+  // i//k
+  if ((*token)[0] == '/') {
+    (*token)++;
+    vi.normal_index =
+        fix_chunk_index(atoi((*token)), static_cast<int>(chunk.vn.size() / 3), relative_normal, relative);
+    (*token) += strcspn((*token), "/ \t\r");
+    return vi;
+  }
+
+  // i/j/k or i/j
+  vi.texcoord_index =
+      fix_chunk_index(atoi((*token)), static_cast<int>(chunk.vt.size() / 2), relative_texcoord, relative);
+  (*token) += strcspn((*token), "/ \t\r");
+  if ((*token)[0] != '/') {
+    return vi;
+  }
+
+  // i/j/k
+  (*token)++;
+  vi.normal_index = fix_chunk_index(atoi((*token)), static_cast<int>(chunk.vn.size() / 3), relative_normal, relative);
+  (*token) += strcspn((*token), "/ \t\r");
+  return vi;
+}
+
+std::string scan_name(const char *token) {
+  char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+  namebuf[0] = '\0';
+#ifdef _MSC_VER
+  sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+  std::sscanf(token, "%s", namebuf);
+#endif
+  return namebuf;
+}
+
+ObjCommand &faces_command(ObjChunk &chunk) {
+  if (chunk.commands.empty() || chunk.commands.back().type != ObjCommandType::Faces) {
+    ObjCommand command;
+    command.type = ObjCommandType::Faces;
+    command.first_triangle = chunk.corners.size() / 3;
+    chunk.commands.push_back(command);
+  }
+  return chunk.commands.back();
+}
+
+void parse_chunk(ObjChunk &chunk) {
+  std::string linebuf;
+  std::vector<index_t> polygon;
+  std::vector<unsigned char> polygon_relative;
+
+  const char *line_begin = chunk.begin;
+  while (line_begin < chunk.end) {
+    const char *line_end =
+        static_cast<const char *>(memchr(line_begin, '\n', static_cast<size_t>(chunk.end - line_begin)));
+    if (!line_end) {
+      line_end = chunk.end;
+    }
+
+    // Parsing functions of tinyobj expect a null terminated line
+    const char *next_line = line_end + 1;
+    if (line_end > line_begin && line_end[-1] == '\r') {
+      line_end--;
+    }
+    linebuf.assign(line_begin, line_end);
+    line_begin = next_line;
+
+    const char *token = linebuf.c_str();
+    token += strspn(token, " \t");
+
+    if (token[0] == '\0') continue; // empty line
+    if (token[0] == '#') continue;  // comment line
+
+    // vertex
+    if (token[0] == 'v' && IS_SPACE((token[1]))) {
+      token += 2;
+      real_t x, y, z;
+      parseReal3(&x, &y, &z, &token);
+      chunk.v.push_back(x);
+      chunk.v.push_back(y);
+      chunk.v.push_back(z);
+      continue;
+    }
+
+    // normal
+    if (token[0] == 'v' && token[1] == 'n' && IS_SPACE((token[2]))) {
+      token += 3;
+      real_t x, y, z;
+      parseReal3(&x, &y, &z, &token);
+      chunk.vn.push_back(x);
+      chunk.vn.push_back(y);
+      chunk.vn.push_back(z);
+      continue;
+    }
+
+    // texcoord
+    if (token[0] == 'v' && token[1] == 't' && IS_SPACE((token[2]))) {
+      token += 3;
+      real_t x, y;
+      parseReal2(&x, &y, &token);
+      chunk.vt.push_back(x);
+      chunk.vt.push_back(y);
+      continue;
+    }
+
+    // face
+    if (token[0] == 'f' && IS_SPACE((token[1]))) {
+      token += 2;
+      token += strspn(token, " \t");
+
+      polygon.clear();
+      polygon_relative.clear();
+      while (!IS_NEW_LINE(token[0])) {
+        unsigned char relative;
+        polygon.push_back(parse_chunk_triple(&token, chunk, &relative));
+        polygon_relative.push_back(relative);
+        token += strspn(token, " \t\r");
+      }
+
+      ObjCommand &command = faces_command(chunk);
+      command.polygon_count++;
+
+      // Polygon -> triangle fan conversion
+      for (size_t k = 2; k < polygon.size(); k++) {
+        const size_t fan[3] = {0, k - 1, k};
+        for (size_t corner : fan) {
+          chunk.corners.push_back(polygon[corner]);
+          chunk.relative.push_back(polygon_relative[corner]);
+        }
+        command.triangle_count++;
+      }
+      continue;
+    }
+
+    ObjCommand command;
+
+    // use mtl
+    if ((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6]))) {
+      command.type = ObjCommandType::UseMtl;
+      command.argument = scan_name(token + 7);
+      chunk.commands.push_back(command);
+      continue;
+    }
+
+    // load mtl
+    if ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6]))) {
+      command.type = ObjCommandType::MtlLib;
+      command.argument = token + 7;
+      chunk.commands.push_back(command);
+      continue;
+    }
+
+    // group name
+    if (token[0] == 'g' && IS_SPACE((token[1]))) {
+      std::vector<std::string> names;
+      while (!IS_NEW_LINE(token[0])) {
+        names.push_back(parseString(&token));
+        token += strspn(token, " \t\r");
+      }
+
+      // names[0] is 'g'
+      command.type = ObjCommandType::Group;
+      command.argument = names.size() > 1 ? names[1] : "";
+      chunk.commands.push_back(command);
+      continue;
+    }
+
+    // object name
+    if (token[0] == 'o' && IS_SPACE((token[1]))) {
+      command.type = ObjCommandType::Object;
+      command.argument = scan_name(token + 2);
+      chunk.commands.push_back(command);
+      continue;
+    }
+
+    // Ignore unknown command.
+  }
+}
+
+/// Mirrors the state machine of tinyobj::LoadObj, working on whole runs of triangles instead of single faces
+class ShapeBuilder {
+public:
+  ShapeBuilder(std::vector<shape_t> *shapes, std::vector<material_t> *materials, std::string *err,
+               const std::string &mtl_base_dir, std::vector<std::string> *material_files)
+      : shapes(shapes), materials(materials), err(err), material_reader(mtl_base_dir), mtl_base_dir(mtl_base_dir),
+        material_files(material_files) {}
+
+  void replay(const ObjChunk &chunk) {
+    for (const ObjCommand &command : chunk.commands) {
+      switch (command.type) {
+      case ObjCommandType::Faces:
+        face_group.emplace_back(&chunk, &command);
+        break;
+      case ObjCommandType::UseMtl: {
+        int new_material = -1;
+        auto found = material_map.find(command.argument);
+        if (found != material_map.end()) {
+          new_material = found->second;
+        }
+        if (new_material != material) {
+          export_face_group();
+          material = new_material;
+        }
+        break;
+      }
+      case ObjCommandType::MtlLib:
+        load_materials(command.argument);
+        break;
+      case ObjCommandType::Group:
+      case ObjCommandType::Object:
+        // flush previous face group.
+        if (export_face_group()) {
+          shapes->push_back(shape);
+        }
+        shape = shape_t();
+        name = command.argument;
+        break;
+      }
+    }
+  }
+
+  void finish() {
+    // Also keep faces exported by a trailing 'usemtl'
+    if (export_face_group() || shape.mesh.indices.size()) {
+      shapes->push_back(shape);
+    }
+  }
+
+private:
+  bool export_face_group() {
+    size_t polygons = 0;
+    for (const auto &group : face_group) {
+      polygons += group.second->polygon_count;
+    }
+    if (polygons == 0) {
+      face_group.clear();
+      return false;
+    }
+
+    for (const auto &group : face_group) {
+      const ObjChunk &chunk = *group.first;
+      const ObjCommand &command = *group.second;
+
+      auto first = chunk.corners.begin() + static_cast<std::ptrdiff_t>(command.first_triangle * 3);
+      shape.mesh.indices.insert(shape.mesh.indices.end(), first,
+                                first + static_cast<std::ptrdiff_t>(command.triangle_count * 3));
+      shape.mesh.num_face_vertices.insert(shape.mesh.num_face_vertices.end(), command.triangle_count, 3);
+      shape.mesh.material_ids.insert(shape.mesh.material_ids.end(), command.triangle_count, material);
+    }
+
+    shape.name = name;
+    face_group.clear();
+    return true;
+  }
+
+  void load_materials(const std::string &file_names) {
+    std::vector<std::string> names;
+    SplitString(file_names, ' ', names);
+
+    if (names.empty()) {
+      (*err) += "WARN: Looks like empty filename for mtllib. Use default material. \n";
+      return;
+    }
+
+    for (const std::string &material_file : names) {
+      std::string err_mtl;
+      bool ok = material_reader(material_file.c_str(), materials, &material_map, &err_mtl);
+      (*err) += err_mtl;
+      if (ok) {
+        if (material_files) {
+          material_files->push_back(mtl_base_dir + material_file);
+        }
+        return;
+      }
+    }
+    (*err) += "WARN: Failed to load material file(s). Use default material.\n";
+  }
+
+  std::vector<shape_t> *shapes;
+  std::vector<material_t> *materials;
+  std::string *err;
+  MaterialFileReader material_reader;
+  std::string mtl_base_dir;
+  std::vector<std::string> *material_files;
+
+  std::map<std::string, int> material_map;
+  int material = -1;
+  std::string name;
+  shape_t shape;
+  std::vector<std::pair<const ObjChunk *, const ObjCommand *>> face_group;
+};
+
+} // namespace
+
+bool load_obj(attrib_t *attrib, std::vector<shape_t> *shapes, std::vector<material_t> *materials, std::string *err,
+              const std::string &file_name, const std::string &mtl_base_dir, ThreadPool &pool, size_t chunk_count,
+              std::vector<std::string> *material_files) {
+  attrib->vertices.clear();
+  attrib->normals.clear();
+  attrib->texcoords.clear();
+  shapes->clear();
+
+  std::string warnings;
+  std::unique_ptr<MappedFile> file;
+  try {
+    file = std::make_unique<MappedFile>(file_name);
+  } catch (const std::string &) {
+    if (err) {
+      (*err) = "Cannot open file [" + file_name + "]\n";
+    }
+    return false;
+  }
+
+  // Split into chunks of whole lines
+  if (chunk_count == 0) {
+    const size_t min_chunk_size = 256 * 1024;
+    chunk_count = std::max<size_t>(1, std::min(file->size() / min_chunk_size, pool.size() * 4));
+  }
+
+  std::vector<ObjChunk> chunks(chunk_count);
+  const char *file_begin = file->data();
+  const char *file_end = file->data() + file->size();
+  const char *chunk_begin = file_begin;
+  for (size_t c = 0; c < chunk_count; c++) {
+    const char *chunk_end = file_end;
+    if (c + 1 < chunk_count) {
+      chunk_end = std::max(chunk_begin, file_begin + file->size() * (c + 1) / chunk_count);
+      const void *new_line = memchr(chunk_end, '\n', static_cast<size_t>(file_end - chunk_end));
+      chunk_end = new_line ? static_cast<const char *>(new_line) + 1 : file_end;
+    }
+    chunks[c].begin = chunk_begin;
+    chunks[c].end = chunk_end;
+    chunk_begin = chunk_end;
+  }
+
+  pool.parallel_for(chunk_count, [&](size_t c) { parse_chunk(chunks[c]); });
+
+  // Place every chunk's elements after the ones of the previous chunks
+  size_t v_size = 0, vn_size = 0, vt_size = 0;
+  for (auto &chunk : chunks) {
+    chunk.v_base = v_size;
+    chunk.vn_base = vn_size;
+    chunk.vt_base = vt_size;
+    v_size += chunk.v.size();
+    vn_size += chunk.vn.size();
+    vt_size += chunk.vt.size();
+  }
+  attrib->vertices.resize(v_size);
+  attrib->normals.resize(vn_size);
+  attrib->texcoords.resize(vt_size);
+
+  pool.parallel_for(chunk_count, [&](size_t c) {
+    ObjChunk &chunk = chunks[c];
+    std::copy(chunk.v.begin(), chunk.v.end(), attrib->vertices.begin() + static_cast<std::ptrdiff_t>(chunk.v_base));
+    std::copy(chunk.vn.begin(), chunk.vn.end(), attrib->normals.begin() + static_cast<std::ptrdiff_t>(chunk.vn_base));
+    std::copy(chunk.vt.begin(), chunk.vt.end(),
+              attrib->texcoords.begin() + static_cast<std::ptrdiff_t>(chunk.vt_base));
+
+    const int v_offset = static_cast<int>(chunk.v_base / 3);
+    const int vn_offset = static_cast<int>(chunk.vn_base / 3);
+    const int vt_offset = static_cast<int>(chunk.vt_base / 2);
+    for (size_t i = 0; i < chunk.corners.size(); i++) {
+      const unsigned char relative = chunk.relative[i];
+      if (relative == 0) continue;
+      if (relative & relative_vertex) chunk.corners[i].vertex_index += v_offset;
+      if (relative & relative_normal) chunk.corners[i].normal_index += vn_offset;
+      if (relative & relative_texcoord) chunk.corners[i].texcoord_index += vt_offset;
+    }
+  });
+
+  // Commands have to be applied in file order
+  ShapeBuilder builder(shapes, materials, &warnings, mtl_base_dir, material_files);
+  for (const auto &chunk : chunks) {
+    builder.replay(chunk);
+  }
+  builder.finish();
+
+  if (err) {
+    (*err) += warnings;
+  }
+
+  return true;
+}
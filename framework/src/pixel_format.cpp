@@ -0,0 +1,416 @@
+#include "pixel_format.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXEL_FORMAT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/// Pixels classified between checks whether the content is decided already
+const size_t classify_chunk = 4096;
+
+void classify_scalar(const uint8_t *pixels, size_t pixel_count, PixelContent *content) {
+  for (size_t p = 0; p < pixel_count; p++) {
+    const uint8_t *pixel = pixels + 4 * p;
+    content->gray = content->gray && pixel[0] == pixel[1] && pixel[1] == pixel[2];
+    content->opaque = content->opaque && pixel[3] == 255;
+  }
+}
+
+void pack_scalar(const uint8_t *pixels, size_t pixel_count, GLenum format, uint8_t *destination) {
+  for (size_t p = 0; p < pixel_count; p++) {
+    const uint8_t *pixel = pixels + 4 * p;
+    switch (format) {
+    case GL_RED:
+      destination[p] = pixel[0];
+      break;
+    case GL_RG:
+      destination[2 * p] = pixel[0];
+      destination[2 * p + 1] = pixel[3];
+      break;
+    default:
+      std::memcpy(destination + 3 * p, pixel, 3);
+      break;
+    }
+  }
+}
+
+void expand_scalar(const uint8_t *source, int channels, size_t pixel_count, uint8_t *rgba) {
+  for (size_t p = 0; p < pixel_count; p++) {
+    const uint8_t *pixel = source + channels * p;
+    uint8_t *destination = rgba + 4 * p;
+    if (channels < 3) {
+      destination[0] = destination[1] = destination[2] = pixel[0];
+      destination[3] = channels == 2 ? pixel[1] : 255;
+    } else {
+      std::memcpy(destination, pixel, 3);
+      destination[3] = channels == 4 ? pixel[3] : 255;
+    }
+  }
+}
+
+void swap_red_blue_scalar(uint8_t *pixels, size_t pixel_count) {
+  for (size_t p = 0; p < pixel_count; p++) {
+    std::swap(pixels[4 * p], pixels[4 * p + 2]);
+  }
+}
+
+/// c * a / 255 rounded to the nearest integer, exact for all bytes
+uint8_t multiply_bytes(unsigned c, unsigned a) {
+  const unsigned t = c * a + 128;
+  return static_cast<uint8_t>((t + (t >> 8)) >> 8);
+}
+
+void premultiply_scalar(uint8_t *pixels, size_t pixel_count) {
+  for (size_t p = 0; p < pixel_count; p++) {
+    uint8_t *pixel = pixels + 4 * p;
+    for (int c = 0; c < 3; c++) {
+      pixel[c] = multiply_bytes(pixel[c], pixel[3]);
+    }
+  }
+}
+
+#ifdef PIXEL_FORMAT_SSE2
+
+/// Classifies the pixels up to the last multiple of 4, returns how many that were
+size_t classify_sse2(const uint8_t *pixels, size_t pixel_count, PixelContent *content) {
+  const __m128i low_two = _mm_set1_epi32(0x0000ffff);
+  __m128i alpha = _mm_set1_epi32(-1);
+  __m128i differences = _mm_setzero_si128();
+  size_t p = 0;
+  for (; p + 4 <= pixel_count; p += 4) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 4 * p));
+    alpha = _mm_and_si128(alpha, v);
+    // Red against green and green against blue
+    differences = _mm_or_si128(differences, _mm_and_si128(_mm_xor_si128(v, _mm_srli_epi32(v, 8)), low_two));
+  }
+  uint32_t alpha_lanes[4], difference_lanes[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(alpha_lanes), alpha);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(difference_lanes), differences);
+  for (int lane = 0; lane < 4; lane++) {
+    content->gray = content->gray && difference_lanes[lane] == 0;
+    content->opaque = content->opaque && (alpha_lanes[lane] >> 24) == 255;
+  }
+  return p;
+}
+
+size_t pack_sse2(const uint8_t *pixels, size_t pixel_count, GLenum format, uint8_t *destination) {
+  const __m128i *source = reinterpret_cast<const __m128i *>(pixels);
+  size_t p = 0;
+  if (format == GL_RED) {
+    const __m128i low_byte = _mm_set1_epi32(0xff);
+    for (; p + 16 <= pixel_count; p += 16, source += 4) {
+      // Values below 256 survive the signed saturation of the first pack
+      const __m128i a = _mm_and_si128(_mm_loadu_si128(source), low_byte);
+      const __m128i b = _mm_and_si128(_mm_loadu_si128(source + 1), low_byte);
+      const __m128i c = _mm_and_si128(_mm_loadu_si128(source + 2), low_byte);
+      const __m128i d = _mm_and_si128(_mm_loadu_si128(source + 3), low_byte);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + p),
+                       _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+    }
+  } else if (format == GL_RG) {
+    const __m128i low_byte = _mm_set1_epi32(0xff);
+    const __m128i second_byte = _mm_set1_epi32(0xff00);
+    for (; p + 8 <= pixel_count; p += 8, source += 2) {
+      const __m128i a = _mm_loadu_si128(source), b = _mm_loadu_si128(source + 1);
+      // First channel and alpha side by side, sign extended so the pack keeps their bits
+      __m128i ga = _mm_or_si128(_mm_and_si128(a, low_byte), _mm_and_si128(_mm_srli_epi32(a, 16), second_byte));
+      __m128i gb = _mm_or_si128(_mm_and_si128(b, low_byte), _mm_and_si128(_mm_srli_epi32(b, 16), second_byte));
+      ga = _mm_srai_epi32(_mm_slli_epi32(ga, 16), 16);
+      gb = _mm_srai_epi32(_mm_slli_epi32(gb, 16), 16);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + 2 * p), _mm_packs_epi32(ga, gb));
+    }
+  } else {
+    const __m128i color = _mm_set1_epi32(0x00ffffff);
+    const __m128i low_pixel = _mm_set_epi32(0, -1, 0, -1);
+    const __m128i low_half = _mm_set_epi32(0, 0, -1, -1);
+    // The 16 byte store writes 4 bytes past the 12 of the pixels, they stay within the destination
+    for (; p + 6 <= pixel_count; p += 4, source++) {
+      const __m128i v = _mm_and_si128(_mm_loadu_si128(source), color);
+      // Six bytes at the start of each half, then the halves next to each other
+      const __m128i halves =
+          _mm_or_si128(_mm_and_si128(v, low_pixel), _mm_srli_epi64(_mm_andnot_si128(low_pixel, v), 8));
+      const __m128i packed = _mm_or_si128(_mm_and_si128(halves, low_half),
+                                          _mm_srli_si128(_mm_andnot_si128(low_half, halves), 2));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + 3 * p), packed);
+    }
+  }
+  return p;
+}
+
+size_t expand_sse2(const uint8_t *source, int channels, size_t pixel_count, uint8_t *rgba) {
+  __m128i *destination = reinterpret_cast<__m128i *>(rgba);
+  const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xff000000));
+  size_t p = 0;
+  if (channels == 1) {
+    const __m128i ones = _mm_set1_epi8(-1);
+    for (; p + 16 <= pixel_count; p += 16, destination += 4) {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + p));
+      // Gray twice, then gray and 255, interleaved as words
+      const __m128i gray_low = _mm_unpacklo_epi8(v, v), gray_high = _mm_unpackhi_epi8(v, v);
+      const __m128i alpha_low = _mm_unpacklo_epi8(v, ones), alpha_high = _mm_unpackhi_epi8(v, ones);
+      _mm_storeu_si128(destination, _mm_unpacklo_epi16(gray_low, alpha_low));
+      _mm_storeu_si128(destination + 1, _mm_unpackhi_epi16(gray_low, alpha_low));
+      _mm_storeu_si128(destination + 2, _mm_unpacklo_epi16(gray_high, alpha_high));
+      _mm_storeu_si128(destination + 3, _mm_unpackhi_epi16(gray_high, alpha_high));
+    }
+  } else if (channels == 2) {
+    const __m128i low_byte = _mm_set1_epi16(0xff);
+    for (; p + 8 <= pixel_count; p += 8, destination += 2) {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + 2 * p));
+      // Words of gray twice next to the words of gray and alpha
+      const __m128i gray = _mm_and_si128(v, low_byte);
+      const __m128i gray_gray = _mm_or_si128(gray, _mm_slli_epi16(gray, 8));
+      _mm_storeu_si128(destination, _mm_unpacklo_epi16(gray_gray, v));
+      _mm_storeu_si128(destination + 1, _mm_unpackhi_epi16(gray_gray, v));
+    }
+  } else if (channels == 3) {
+    const __m128i lane_0 = _mm_set_epi32(0, 0, 0, -1), lane_1 = _mm_set_epi32(0, 0, -1, 0);
+    const __m128i lane_2 = _mm_set_epi32(0, -1, 0, 0), lane_3 = _mm_set_epi32(-1, 0, 0, 0);
+    const __m128i color = _mm_set1_epi32(0x00ffffff);
+    // The 16 byte load reads 4 bytes past the 12 of the pixels, they stay within the source
+    for (; p + 6 <= pixel_count; p += 4, destination++) {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + 3 * p));
+      // Pixel k starts at byte 3k, which is byte k of lane k, or byte 4 - k of lane k - 1
+      const __m128i previous = _mm_slli_si128(v, 4);
+      const __m128i second = _mm_or_si128(_mm_slli_epi32(v, 8), _mm_srli_epi32(previous, 24));
+      const __m128i third = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(previous, 16));
+      const __m128i fourth = _mm_srli_epi32(previous, 8);
+      __m128i pixels = _mm_or_si128(_mm_and_si128(v, lane_0), _mm_and_si128(second, lane_1));
+      pixels = _mm_or_si128(pixels, _mm_or_si128(_mm_and_si128(third, lane_2), _mm_and_si128(fourth, lane_3)));
+      _mm_storeu_si128(destination, _mm_or_si128(_mm_and_si128(pixels, color), opaque));
+    }
+  }
+  return p;
+}
+
+size_t swap_red_blue_sse2(uint8_t *pixels, size_t pixel_count) {
+  const __m128i red_blue = _mm_set1_epi32(0x00ff00ff);
+  size_t p = 0;
+  for (; p + 4 <= pixel_count; p += 4) {
+    __m128i *location = reinterpret_cast<__m128i *>(pixels + 4 * p);
+    const __m128i v = _mm_loadu_si128(location);
+    // Red and blue are the low bytes of the two words of a pixel
+    __m128i swapped = _mm_and_si128(v, red_blue);
+    swapped = _mm_shufflehi_epi16(_mm_shufflelo_epi16(swapped, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+    _mm_storeu_si128(location, _mm_or_si128(swapped, _mm_andnot_si128(red_blue, v)));
+  }
+  return p;
+}
+
+/// Premultiplies two pixels widened to words, as multiply_bytes does
+__m128i premultiply_words(__m128i pixels) {
+  const __m128i color_words = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+  const __m128i alpha_word = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+  const __m128i half = _mm_set1_epi16(128);
+  // Alpha of each pixel in its color words, 255 in its alpha word so alpha stays
+  __m128i factors =
+      _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+  factors = _mm_or_si128(_mm_and_si128(factors, color_words), alpha_word);
+  const __m128i t = _mm_add_epi16(_mm_mullo_epi16(pixels, factors), half);
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+size_t premultiply_sse2(uint8_t *pixels, size_t pixel_count) {
+  const __m128i zero = _mm_setzero_si128();
+  size_t p = 0;
+  for (; p + 4 <= pixel_count; p += 4) {
+    __m128i *location = reinterpret_cast<__m128i *>(pixels + 4 * p);
+    const __m128i v = _mm_loadu_si128(location);
+    const __m128i low = premultiply_words(_mm_unpacklo_epi8(v, zero));
+    const __m128i high = premultiply_words(_mm_unpackhi_epi8(v, zero));
+    _mm_storeu_si128(location, _mm_packus_epi16(low, high));
+  }
+  return p;
+}
+
+#endif
+
+PixelContent classify_image(const Image &image, bool simd) {
+  PixelContent content;
+  if (!image.pixels.empty()) {
+    content = classify_pixels(image.pixels.data(), image.pixels.size() / 4, simd);
+  }
+  for (const ImageLevel &level : image.levels) {
+    if (!content.gray && !content.opaque) {
+      break;
+    }
+    const PixelContent pixels = classify_pixels(level.data, level.size / 4, simd);
+    content.gray = content.gray && pixels.gray;
+    content.opaque = content.opaque && pixels.opaque;
+  }
+  return content;
+}
+
+bool is_packable(const Image &image) {
+  return !image.compressed_format && (image.pixel_format == GL_RGBA || image.pixel_format == GL_BGRA);
+}
+
+/// The pixels and levels of a packable image packed into the format
+Image convert_image(Image image, GLenum format, bool simd) {
+  if (format == image.pixel_format) {
+    return image;
+  }
+
+  const size_t channels = channel_count(format);
+  if (!image.pixels.empty()) {
+    std::vector<unsigned char> packed(image.pixels.size() / 4 * channels);
+    pack_pixels(image.pixels.data(), image.pixels.size() / 4, format, packed.data(), simd);
+    image.pixels = std::move(packed);
+  }
+  if (!image.levels.empty()) {
+    auto levels = std::make_shared<std::vector<std::vector<uint8_t>>>();
+    for (ImageLevel &level : image.levels) {
+      levels->emplace_back(level.size / 4 * channels);
+      pack_pixels(level.data, level.size / 4, format, levels->back().data(), simd);
+      level.data = levels->back().data();
+      level.size = levels->back().size();
+    }
+    // The old storage, e.g. a mapped container, is no longer referred to
+    image.storage = levels;
+  }
+  image.pixel_format = format;
+  return image;
+}
+
+} // namespace
+
+size_t channel_count(GLenum pixel_format) {
+  switch (pixel_format) {
+  case GL_RED:
+    return 1;
+  case GL_RG:
+    return 2;
+  case GL_RGB:
+  case GL_BGR:
+    return 3;
+  default:
+    return 4;
+  }
+}
+
+GLenum internal_format_for(GLenum pixel_format) {
+  switch (pixel_format) {
+  case GL_RED:
+    return GL_R8;
+  case GL_RG:
+    return GL_RG8;
+  case GL_RGB:
+  case GL_BGR:
+    return GL_RGB8;
+  default:
+    return GL_RGBA8;
+  }
+}
+
+void set_texture_swizzle(GLenum target, GLenum pixel_format) {
+  GLint swizzle[4] = {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+  if (pixel_format == GL_RED || pixel_format == GL_RG) {
+    swizzle[1] = swizzle[2] = GL_RED;
+    swizzle[3] = pixel_format == GL_RED ? GL_ONE : GL_GREEN;
+  }
+  glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+PixelContent classify_pixels(const uint8_t *pixels, size_t pixel_count, bool simd) {
+  PixelContent content;
+  for (size_t first = 0; first < pixel_count && (content.gray || content.opaque); first += classify_chunk) {
+    const uint8_t *chunk = pixels + 4 * first;
+    const size_t count = std::min(classify_chunk, pixel_count - first);
+    size_t done = 0;
+#ifdef PIXEL_FORMAT_SSE2
+    if (simd) {
+      done = classify_sse2(chunk, count, &content);
+    }
+#endif
+    classify_scalar(chunk + 4 * done, count - done, &content);
+  }
+  return content;
+}
+
+GLenum packed_pixel_format(const PixelContent &content, GLenum pixel_format) {
+  if (content.gray) {
+    return content.opaque ? GL_RED : GL_RG;
+  }
+  if (content.opaque) {
+    return pixel_format == GL_BGRA ? GL_BGR : GL_RGB;
+  }
+  return pixel_format;
+}
+
+void pack_pixels(const uint8_t *pixels, size_t pixel_count, GLenum format, uint8_t *destination, bool simd) {
+  if (channel_count(format) == 4) {
+    std::memcpy(destination, pixels, 4 * pixel_count);
+    return;
+  }
+  size_t done = 0;
+#ifdef PIXEL_FORMAT_SSE2
+  if (simd) {
+    done = pack_sse2(pixels, pixel_count, format, destination);
+  }
+#endif
+  pack_scalar(pixels + 4 * done, pixel_count - done, format, destination + channel_count(format) * done);
+}
+
+void expand_to_rgba(const uint8_t *source, int channels, size_t pixel_count, uint8_t *rgba, bool simd) {
+  if (channels == 4) {
+    std::memcpy(rgba, source, 4 * pixel_count);
+    return;
+  }
+  size_t done = 0;
+#ifdef PIXEL_FORMAT_SSE2
+  if (simd) {
+    done = expand_sse2(source, channels, pixel_count, rgba);
+  }
+#endif
+  expand_scalar(source + channels * done, channels, pixel_count - done, rgba + 4 * done);
+}
+
+void swap_red_blue(uint8_t *pixels, size_t pixel_count, bool simd) {
+  size_t done = 0;
+#ifdef PIXEL_FORMAT_SSE2
+  if (simd) {
+    done = swap_red_blue_sse2(pixels, pixel_count);
+  }
+#endif
+  swap_red_blue_scalar(pixels + 4 * done, pixel_count - done);
+}
+
+void premultiply_alpha(uint8_t *pixels, size_t pixel_count, bool simd) {
+  size_t done = 0;
+#ifdef PIXEL_FORMAT_SSE2
+  if (simd) {
+    done = premultiply_sse2(pixels, pixel_count);
+  }
+#endif
+  premultiply_scalar(pixels + 4 * done, pixel_count - done);
+}
+
+Image pack_channels(Image image, bool simd) {
+  if (!is_packable(image) || image.empty()) {
+    return image;
+  }
+  const GLenum format = packed_pixel_format(classify_image(image, simd), image.pixel_format);
+  return convert_image(std::move(image), format, simd);
+}
+
+std::vector<Image> pack_cubemap_channels(std::vector<Image> faces, bool simd) {
+  PixelContent content;
+  for (const Image &face : faces) {
+    if (!is_packable(face)) {
+      return faces;
+    }
+    const PixelContent face_content = classify_image(face, simd);
+    content.gray = content.gray && face_content.gray;
+    content.opaque = content.opaque && face_content.opaque;
+  }
+  for (Image &face : faces) {
+    face = convert_image(std::move(face), packed_pixel_format(content, face.pixel_format), simd);
+  }
+  return faces;
+}
@@ -1,4 +1,5 @@
 #include "program.hpp"
+#include "render_stats.hpp"
 
 #include <vector>
 
@@ -77,6 +78,18 @@ GLint ShaderProgram::get_uniform_location(const std::string &uniform_name) {
   return glGetUniformLocation(this->program_id, uniform_name.c_str());
 }
 
-void ShaderProgram::use() { glUseProgram(this->program_id); }
+bool ShaderProgram::bind_uniform_block(const std::string &block_name, GLuint binding) {
+  const GLuint index = glGetUniformBlockIndex(this->program_id, block_name.c_str());
+  if (index == GL_INVALID_INDEX) {
+    return false;
+  }
+  glUniformBlockBinding(this->program_id, index, binding);
+  return true;
+}
+
+void ShaderProgram::use() {
+  glUseProgram(this->program_id);
+  render_stats().program_changes++;
+}
 
 ShaderProgram::~ShaderProgram() { glDeleteProgram(program_id); }
@@ -0,0 +1,19 @@
+#include "render_stats.hpp"
+
+RenderStats &render_stats() {
+  static RenderStats stats;
+  return stats;
+}
+
+std::ostream &operator<<(std::ostream &out, const RenderStats &stats) {
+  out << "GL calls: " << stats.gl_calls() << ", draw calls: " << stats.draw_calls
+      << ", program changes: " << stats.program_changes << ", VAO changes: " << stats.vao_changes
+      << ", texture changes: " << stats.texture_changes << ", uniform calls: " << stats.uniform_calls
+      << ", uniform buffer updates: " << stats.buffer_updates << " (" << stats.buffer_update_bytes << " bytes)"
+      << ", triangles: " << stats.triangles;
+  if (stats.meshlet_triangles > 0) {
+    out << ", meshlet culled triangles: " << 100.0 * stats.meshlet_triangles_culled / stats.meshlet_triangles << " %";
+  }
+  out << ", CPU time: " << stats.cpu_milliseconds << " ms";
+  return out;
+}
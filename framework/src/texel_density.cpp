@@ -0,0 +1,75 @@
+#include "texel_density.hpp"
+#include "mesh_lod.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+uint32_t index_at(const MeshView &view, size_t i) {
+  return view.index_size == sizeof(uint16_t) ? static_cast<const uint16_t *>(view.indices)[i]
+                                             : static_cast<const uint32_t *>(view.indices)[i];
+}
+
+TexelDensity compute_density(const MeshView &view, const Submesh &range) {
+  TexelDensity density;
+  if (range.vertex_count == 0) {
+    return density;
+  }
+
+  const float *positions = view.vertices + 3 * range.base_vertex;
+  density.bounds_min = density.bounds_max = glm::vec3(positions[0], positions[1], positions[2]);
+  for (size_t v = 1; v < range.vertex_count; v++) {
+    const glm::vec3 position(positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]);
+    density.bounds_min = glm::min(density.bounds_min, position);
+    density.bounds_max = glm::max(density.bounds_max, position);
+  }
+  if (!view.tex_coords) {
+    return density;
+  }
+
+  const float *tex_coords = view.tex_coords + 2 * range.base_vertex;
+  double surface_area = 0.0, uv_area = 0.0;
+  for (size_t i = range.first_index; i + 2 < range.first_index + range.index_count; i += 3) {
+    const uint32_t a = index_at(view, i), b = index_at(view, i + 1), c = index_at(view, i + 2);
+    const glm::vec3 pa(positions[3 * a], positions[3 * a + 1], positions[3 * a + 2]);
+    const glm::vec3 pb(positions[3 * b], positions[3 * b + 1], positions[3 * b + 2]);
+    const glm::vec3 pc(positions[3 * c], positions[3 * c + 1], positions[3 * c + 2]);
+    surface_area += 0.5 * glm::length(glm::cross(pb - pa, pc - pa));
+
+    const glm::vec2 ta(tex_coords[2 * a], tex_coords[2 * a + 1]);
+    const glm::vec2 tb(tex_coords[2 * b], tex_coords[2 * b + 1]);
+    const glm::vec2 tc(tex_coords[2 * c], tex_coords[2 * c + 1]);
+    const glm::vec2 u = tb - ta, v = tc - ta;
+    uv_area += 0.5 * std::abs(u.x * v.y - u.y * v.x);
+  }
+  if (surface_area > 0.0) {
+    density.uv_per_unit = static_cast<float>(std::sqrt(uv_area / surface_area));
+  }
+  return density;
+}
+
+} // namespace
+
+std::vector<TexelDensity> compute_texel_densities(const MeshView &view, const std::vector<Submesh> &submeshes) {
+  std::vector<TexelDensity> densities;
+  if (!view.vertices || view.vertex_count == 0) {
+    return densities;
+  }
+  if (submeshes.empty()) {
+    Submesh whole;
+    whole.index_count = view.index_count;
+    whole.vertex_count = view.vertex_count;
+    densities.push_back(compute_density(view, whole));
+    return densities;
+  }
+  for (const Submesh &range : submeshes) {
+    densities.push_back(compute_density(view, range));
+  }
+  return densities;
+}
+
+float uv_per_pixel(const TexelDensity &density, const glm::vec3 &eye, float projection_scale) {
+  // One pixel covers distance / projection_scale object space units
+  return density.uv_per_unit * distance_to_bounds(eye, density.bounds_min, density.bounds_max) / projection_scale;
+}
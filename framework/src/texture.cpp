@@ -1,66 +1,570 @@
 #include "texture.hpp"
+#include "block_compression.hpp"
+#include "dds.hpp"
+#include "image_decoder.hpp"
+#include "mipmap.hpp"
+#include "pixel_format.hpp"
+#include "render_stats.hpp"
+#include "texture_cache.hpp"
+#include "texture_residency.hpp"
+#include "utility.hpp"
 #include "iostream"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+namespace {
+
+std::atomic<bool> texture_compression(false);
+std::atomic<bool> cubemap_prefilter(false);
+
+/// Image of one face of the container, the levels point into the mapping
+Image image_from_container(const std::shared_ptr<DdsFile> &dds, size_t face) {
+    Image image;
+    image.width = dds->get_width();
+    image.height = dds->get_height();
+    switch (dds->get_format()) {
+    case DdsFormat::BC1:
+        image.compressed_format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        break;
+    case DdsFormat::BC3:
+        image.compressed_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        break;
+    case DdsFormat::RGBA8:
+        image.pixel_format = GL_RGBA;
+        break;
+    case DdsFormat::BGRA8:
+        image.pixel_format = GL_BGRA;
+        break;
+    case DdsFormat::RGB8:
+        image.pixel_format = GL_RGB;
+        break;
+    case DdsFormat::RG8:
+        image.pixel_format = GL_RG;
+        break;
+    case DdsFormat::R8:
+        image.pixel_format = GL_RED;
+        break;
+    }
+    for (const DdsFile::Level &level : dds->get_levels(face)) {
+        image.levels.push_back({level.width, level.height, level.data, level.size});
+    }
+    image.storage = dds;
+    return image;
+}
+
+bool supports_compressed_format(GLenum format) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+    std::vector<GLint> formats(count);
+    if (count > 0) {
+        glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+    }
+    if (std::find(formats.begin(), formats.end(), static_cast<GLint>(format)) != formats.end()) {
+        return true;
+    }
+
+    // Some core profile drivers support S3TC without listing the formats
+    GLint extension_count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+    for (GLint i = 0; i < extension_count; i++) {
+        const char *name = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+        if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Filter of the mip levels the loader generates
+const MipSettings texture_mip_settings;
+
+/// Identifies what the loader writes into a container, so switching compression or mip settings rebuilds it.
+/// Uncompressed containers hold only the channels the image uses, older ones with all four are rebuilt.
+uint32_t container_parameters(bool compressed) {
+    return mip_settings_key(texture_mip_settings) | (compressed ? 0x80000000u : 0x40000000u);
+}
+
+/// Filter of the seamless (and maybe prefiltered) mip levels of cubemaps
+CubemapMipSettings cubemap_mip_settings() {
+    CubemapMipSettings settings;
+    settings.mip = texture_mip_settings;
+    settings.prefilter = cubemap_prefilter;
+    return settings;
+}
+
+/// container_parameters of cubemap containers
+uint32_t cubemap_container_parameters(bool compressed) {
+    return cubemap_mip_settings_key(cubemap_mip_settings()) | (compressed ? 0x80000000u : 0x40000000u);
+}
+
+DdsFormat container_format(GLenum pixel_format) {
+    switch (pixel_format) {
+    case GL_RED:
+        return DdsFormat::R8;
+    case GL_RG:
+        return DdsFormat::RG8;
+    case GL_RGB:
+        return DdsFormat::RGB8;
+    default:
+        return DdsFormat::RGBA8;
+    }
+}
+
+/// Generates the mip levels of the decoded RGBA faces (one for a 2D image, six for a cubemap, whose levels come
+/// from generate_cubemap_mipmaps) and writes them to the container at 'path' for the next run. With 'compressed'
+/// the levels are encoded to BC1, or to BC3 when any pixel is transparent, otherwise they are packed into the
+/// channels the faces use (see pack_channels). Returns the faces with their levels as they were written.
+std::vector<Image> build_container_images(const std::string &path, std::vector<Image> faces,
+                                          const std::vector<std::string> &source_file_names, bool compressed,
+                                          ThreadPool &pool) {
+    const bool cube = faces.size() == 6;
+    std::vector<std::vector<Image>> chains =
+        cube ? generate_cubemap_mipmaps(faces, cubemap_mip_settings(), pool) : std::vector<std::vector<Image>>();
+    bool transparent = false;
+    PixelContent content;
+    for (size_t i = 0; i < faces.size(); i++) {
+        if (!cube) {
+            chains.push_back(generate_mipmaps(faces[i], texture_mip_settings, pool));
+        }
+        std::vector<Image> &chain = chains[i];
+        chain.insert(chain.begin(), std::move(faces[i]));
+        if (compressed) {
+            transparent = transparent || has_transparency(chain[0].pixels.data(), chain[0].pixels.size() / 4);
+        } else {
+            // The format has to hold every level exactly
+            for (const Image &level : chain) {
+                const PixelContent level_content = classify_pixels(level.pixels.data(), level.pixels.size() / 4);
+                content.gray = content.gray && level_content.gray;
+                content.opaque = content.opaque && level_content.opaque;
+            }
+        }
+    }
+
+    const GLenum pixel_format = packed_pixel_format(content);
+    DdsFormat format = container_format(pixel_format);
+    if (compressed) {
+        format = transparent ? DdsFormat::BC3 : DdsFormat::BC1;
+    }
+    const BlockFormat block_format = format == DdsFormat::BC3 ? BlockFormat::BC3 : BlockFormat::BC1;
+
+    // Face after face, each with all of its levels
+    auto levels = std::make_shared<std::vector<std::vector<uint8_t>>>();
+    for (std::vector<Image> &chain : chains) {
+        for (Image &level : chain) {
+            const size_t pixel_count = size_t(level.width) * level.height;
+            if (compressed) {
+                levels->push_back(compress_image(level.pixels.data(), level.width, level.height, block_format, pool));
+            } else if (channel_count(pixel_format) == 4) {
+                levels->push_back(std::move(level.pixels));
+            } else {
+                levels->emplace_back(pixel_count * channel_count(pixel_format));
+                pack_pixels(level.pixels.data(), pixel_count, pixel_format, levels->back().data());
+            }
+        }
+    }
+    // Without the file (e.g. read-only folder) the next run simply builds it again
+    DdsFile::write(path, format, chains[0][0].width, chains[0][0].height, *levels, source_file_names,
+                   cube, cube ? cubemap_container_parameters(compressed) : container_parameters(compressed));
+
+    std::vector<Image> images(chains.size());
+    size_t index = 0;
+    for (size_t face = 0; face < chains.size(); face++) {
+        Image &image = images[face];
+        image.width = chains[face][0].width;
+        image.height = chains[face][0].height;
+        if (compressed) {
+            image.compressed_format =
+                format == DdsFormat::BC1 ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        } else {
+            image.pixel_format = pixel_format;
+        }
+        for (const Image &level : chains[face]) {
+            image.levels.push_back({level.width, level.height, (*levels)[index].data(), (*levels)[index].size()});
+            index++;
+        }
+        image.storage = levels;
+    }
+    return images;
+}
+
+/// Decodes the image and builds its container '<file>.dds', see build_container_images
+Image build_container_image(const std::string &filename, bool compressed) {
+    Image decoded = decode_image(filename);
+    if (decoded.empty()) {
+        return decoded;
+    }
+    std::vector<Image> faces;
+    faces.push_back(std::move(decoded));
+    return build_container_images(DdsFile::path_for(filename), std::move(faces), {filename}, compressed,
+                                  ThreadPool::shared())[0];
+}
+
+/// Six decoded square faces of one size, the only ones a cubemap container can hold
+bool is_cube(const std::vector<Image> &faces) {
+    if (faces.size() != 6) {
+        return false;
+    }
+    for (const Image &face : faces) {
+        if (face.pixels.empty() || face.width != face.height || face.width != faces[0].width) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Rows of pixels packed into fewer than 4 channels are not padded to 4 bytes
+void set_unpack_alignment(GLenum pixel_format) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, channel_count(pixel_format) == 4 ? 4 : 1);
+}
+
+/// Uploads the levels [first_level, end_level) of the image into the target, straight from where the levels are
+/// stored
+void upload_levels(GLenum target, const Image &image, size_t first_level = 0, size_t end_level = SIZE_MAX) {
+    end_level = std::min(end_level, image.levels.size());
+    set_unpack_alignment(image.pixel_format);
+    for (size_t i = first_level; i < end_level; i++) {
+        const ImageLevel &level = image.levels[i];
+        if (image.compressed_format) {
+            glCompressedTexImage2D(target, static_cast<GLint>(i), image.compressed_format, level.width,
+                                   level.height, 0, static_cast<GLsizei>(level.size), level.data);
+        } else {
+            glTexImage2D(target, static_cast<GLint>(i), internal_format_for(image.pixel_format), level.width,
+                         level.height, 0, image.pixel_format, GL_UNSIGNED_BYTE, level.data);
+        }
+    }
+    set_unpack_alignment(GL_RGBA);
+}
+
+/// Redefines the levels [first_level, end_level) of the bound texture as empty, which frees their memory. Outside
+/// of the base and maximum level they do not count for completeness.
+void free_levels(GLenum target, size_t first_level, size_t end_level) {
+    for (size_t i = first_level; i < end_level; i++) {
+        glTexImage2D(target, static_cast<GLint>(i), GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+}
+
+void record_decode_stats(std::vector<ImageDecodeStats> *stats, const std::string &filename, size_t decoded_bytes,
+                         std::chrono::steady_clock::time_point start) {
+    ImageDecodeStats entry;
+    entry.filename = filename;
+    entry.decode_milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    entry.decoded_bytes = decoded_bytes;
+    uint64_t size = 0;
+    int64_t time = 0;
+    if (get_file_info(filename, &size, &time)) {
+        entry.file_bytes = size;
+    }
+    stats->push_back(entry);
+}
+
+} // namespace
+
 GLuint load_texture_2d(const std::string& filename) {
-    GLuint texture_id;
-    glGenTextures(1, &texture_id);
+    return load_textures_2d({filename})[0];
+}
 
-    int width, height, channels;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+GLuint load_texture_cubemap(std::string filenames[6]) {
+    const std::vector<std::string> names(filenames, filenames + 6);
+    TextureCache &cache = TextureCache::shared();
+    const std::string key = TextureCache::key(GL_TEXTURE_CUBE_MAP, names, cubemap_load_parameters());
+    GLuint texture_id = cache.acquire(key);
+    if (texture_id == 0) {
+        const std::vector<Image> images = pack_cubemap_channels(decode_cubemap(names));
+        texture_id = upload_texture_cubemap(images.data());
+        size_t memory = 0;
+        for (const Image &image : images) {
+            memory += image.texture_memory();
+        }
+        cache.insert(key, texture_id, memory);
+        TextureResidency::shared().track_fixed(texture_id, DdsFile::cubemap_path_for(names), memory);
+    }
+    return texture_id;
+}
+
+std::vector<Image> decode_images(const std::vector<std::string> &filenames, ThreadPool &pool,
+                                 std::vector<ImageDecodeStats> *stats, bool use_container) {
+    std::vector<Image> images(filenames.size());
+    std::vector<std::vector<ImageDecodeStats>> image_stats(filenames.size());
+
+    pool.parallel_for(filenames.size(), [&](size_t i) {
+        const auto start = std::chrono::steady_clock::now();
+        images[i] = decode_image(filenames[i], use_container);
+        record_decode_stats(&image_stats[i], filenames[i], images[i].byte_size(), start);
+    });
+
+    if (stats) {
+        for (const std::vector<ImageDecodeStats> &entries : image_stats) {
+            stats->insert(stats->end(), entries.begin(), entries.end());
+        }
+    }
+    return images;
+}
+
+std::vector<Image> decode_cubemap(const std::vector<std::string> &filenames, ThreadPool &pool,
+                                  std::vector<ImageDecodeStats> *stats) {
+    const auto start = std::chrono::steady_clock::now();
+    const bool compressed = texture_compression;
+    std::shared_ptr<DdsFile> dds = DdsFile::open_for_cubemap(filenames, cubemap_container_parameters(compressed));
+    if (!dds) {
+        // Built from the faces for the next run, faces that make no cube are used as they are
+        std::vector<Image> faces = decode_images(filenames, pool, stats);
+        if (!is_cube(faces)) {
+            return faces;
+        }
+        return build_container_images(DdsFile::cubemap_path_for(filenames), std::move(faces), filenames, compressed,
+                                      pool);
+    }
+    // Block compressed files of other tools need texture compression, without it the faces are decoded
+    if (is_block_compressed(dds->get_format()) && !compressed) {
+        return decode_images(filenames, pool, stats);
+    }
+
+    std::vector<Image> images;
+    size_t bytes = 0;
+    for (size_t face = 0; face < 6; face++) {
+        images.push_back(image_from_container(dds, face));
+        bytes += images.back().byte_size();
+    }
+    if (stats) {
+        record_decode_stats(stats, DdsFile::cubemap_path_for(filenames), bytes, start);
+    }
+    return images;
+}
+
+std::vector<GLuint> load_textures_2d(const std::vector<std::string> &filenames, ThreadPool &pool,
+                                     std::vector<ImageDecodeStats> *stats) {
+    TextureCache &cache = TextureCache::shared();
+    std::vector<GLuint> textures(filenames.size());
+    std::vector<std::string> keys(filenames.size());
+    // Files that are not cached, each key once even when it comes up under several names
+    std::vector<std::string> missing;
+    std::vector<size_t> missing_indices;
+    for (size_t i = 0; i < filenames.size(); i++) {
+        keys[i] = TextureCache::key(GL_TEXTURE_2D, {filenames[i]}, texture_load_parameters());
+        if (std::find(keys.begin(), keys.begin() + i, keys[i]) == keys.begin() + i) {
+            textures[i] = cache.acquire(keys[i]);
+            if (textures[i] == 0) {
+                missing.push_back(filenames[i]);
+                missing_indices.push_back(i);
+            }
+        }
+    }
+
+    std::vector<Image> images = decode_images(missing, pool, stats, true);
+    pool.parallel_for(images.size(), [&](size_t j) { images[j] = pack_channels(std::move(images[j])); });
+    for (size_t j = 0; j < images.size(); j++) {
+        const size_t i = missing_indices[j];
+        const std::vector<size_t> level_sizes = images[j].level_sizes();
+        const size_t first_level = TextureResidency::shared().first_streamed_level(level_sizes.size());
+        size_t memory = images[j].texture_memory();
+        for (size_t level = 0; level < first_level; level++) {
+            memory -= level_sizes[level];
+        }
+        textures[i] = upload_texture_2d(images[j], 0, first_level);
+        cache.insert(keys[i], textures[i], memory);
+        TextureResidency::shared().track(textures[i], missing[j], level_sizes, first_level);
+    }
+
+    for (size_t i = 0; i < filenames.size(); i++) {
+        if (textures[i] == 0) {
+            textures[i] = cache.acquire(keys[i]);
+        }
+    }
+    return textures;
+}
+
+size_t Image::byte_size() const {
+    size_t size = pixels.size();
+    for (const ImageLevel &level : levels) {
+        size += level.size;
+    }
+    return size;
+}
+
+size_t Image::texture_memory() const {
+    // The levels glGenerateMipmap adds are a third of the image
+    return levels.empty() ? pixels.size() + pixels.size() / 3 : byte_size();
+}
+
+std::vector<size_t> Image::level_sizes() const {
+    std::vector<size_t> sizes;
+    for (const ImageLevel &level : levels) {
+        sizes.push_back(level.size);
+    }
+    return sizes;
+}
+
+bool set_texture_compression(bool enabled) {
+    if (enabled) {
+        enabled = supports_compressed_format(GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) &&
+                  supports_compressed_format(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+    }
+    texture_compression = enabled;
+    return enabled;
+}
+
+bool get_texture_compression() {
+    return texture_compression;
+}
+
+uint32_t texture_load_parameters() {
+    return container_parameters(texture_compression);
+}
+
+void set_cubemap_prefilter(bool enabled) {
+    cubemap_prefilter = enabled;
+}
+
+bool get_cubemap_prefilter() {
+    return cubemap_prefilter;
+}
+
+uint32_t cubemap_load_parameters() {
+    return cubemap_container_parameters(texture_compression);
+}
+
+bool read_image_size(const std::string &filename, int *width, int *height) {
+    int channels;
+    return stbi_info(filename.c_str(), width, height, &channels) != 0;
+}
+
+Image decode_image(const std::string &filename, bool use_container) {
+    if (use_container) {
+        const bool compressed = texture_compression;
+        std::shared_ptr<DdsFile> dds = DdsFile::open_for(filename, container_parameters(compressed));
+        if (!dds) {
+            return build_container_image(filename, compressed);
+        }
+        // Block compressed files of other tools need texture compression, without it the image is decoded
+        if (!is_block_compressed(dds->get_format()) || compressed) {
+            return image_from_container(dds, 0);
+        }
+    }
+
+    Image image;
+    if (decode_image_fast(filename, &image)) {
+        return image;
+    }
+    int channels;
+    // Other files are decoded with the channels of the file and expanded by the SIMD kernel, stb_image converts
+    // pixel by pixel
+    unsigned char *data = stbi_load(filename.c_str(), &image.width, &image.height, &channels, 0);
     if (data) {
+        const size_t pixel_count = size_t(image.width) * image.height;
+        image.pixels.resize(pixel_count * 4);
+        expand_to_rgba(data, channels, pixel_count, image.pixels.data());
+    } else {
+        std::cout << "Texture failed to load at path: " << filename << std::endl;
+        image.width = image.height = 0;
+    }
+
+    stbi_image_free(data);
+    return image;
+}
+
+GLuint upload_texture_2d(const Image &image, GLuint texture_id, size_t first_level) {
+    if (texture_id == 0) {
+        glGenTextures(1, &texture_id);
+    }
+
+    if (!image.levels.empty()) {
+        first_level = std::min(first_level, image.levels.size() - 1);
         glBindTexture(GL_TEXTURE_2D, texture_id);
+        // A placeholder or an earlier upload may have left larger levels
+        free_levels(GL_TEXTURE_2D, 0, first_level);
+        upload_levels(GL_TEXTURE_2D, image, first_level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(first_level));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size() - 1));
+    } else if (!image.empty()) {
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        const GLenum internal_format = internal_format_for(image.pixel_format);
+        set_unpack_alignment(image.pixel_format);
         glTexImage2D(GL_TEXTURE_2D,
                      0,                    // we are setting mipmap level 0
-                     GL_RGBA,              // base internal format (inside GPU's memory)
-                     width,
-                     height,
+                     internal_format,      // sized internal format (inside GPU's memory)
+                     image.width,
+                     image.height,
                      0,                    // border - deprecated, always 0
-                     GL_RGBA,              // format of the pixel data copied to GPU
+                     image.pixel_format,   // format of the pixel data copied to GPU
                      GL_UNSIGNED_BYTE,     // type of the pixel data
-                     data);                // pointer to data
+                     image.pixels.data()); // pointer to data
+        set_unpack_alignment(GL_RGBA);
         glGenerateMipmap(GL_TEXTURE_2D);
+    }
 
+    if (!image.empty()) {
+        // The texture may have held an image of another format before, e.g. a placeholder
+        set_texture_swizzle(GL_TEXTURE_2D, image.pixel_format);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    } else {
-        std::cout << "Texture failed to load at path: " << filename << std::endl;
     }
 
-    stbi_image_free(data);
     return texture_id;
 }
 
-GLuint load_texture_cubemap(std::string filenames[6]) {
-    GLuint texture_id;
-    glGenTextures(1, &texture_id);
+void upload_texture_levels_2d(const Image &image, GLuint texture_id, size_t first_level, size_t end_level) {
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    upload_levels(GL_TEXTURE_2D, image, first_level, end_level);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(first_level));
+}
+
+void drop_texture_levels_2d(GLuint texture_id, size_t old_base_level, size_t base_level) {
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    // The new base goes first, so the texture never refers to a freed level
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(base_level));
+    free_levels(GL_TEXTURE_2D, old_base_level, base_level);
+}
+
+GLuint upload_texture_cubemap(const Image images[6], GLuint texture_id) {
+    if (texture_id == 0) {
+        glGenTextures(1, &texture_id);
+    }
     glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id);
 
+    // A cube is only complete when every face has the same levels
+    size_t level_count = images[0].levels.size();
+    for (uint8_t index = 1; index < 6; index++) {
+        if (images[index].levels.size() != level_count) {
+            level_count = 0;
+        }
+    }
+
     for(uint8_t index = 0; index < 6; index++) {
-        const std::string filename = filenames[index];
+        const Image &image = images[index];
         const GLenum side = cubemap_sides[index];
 
-        int width, height, channels;
-        unsigned char *data = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb_alpha);
-
+        if (level_count > 0) {
+            upload_levels(side, image);
+            continue;
+        }
+        const GLenum internal_format = internal_format_for(image.pixel_format);
+        set_unpack_alignment(image.pixel_format);
         glTexImage2D(side,
                      0,                    // we are setting mipmap level 0
-                     GL_RGBA,              // base internal format (inside GPU's memory)
-                     width,
-                     height,
+                     internal_format,      // sized internal format (inside GPU's memory)
+                     image.width,
+                     image.height,
                      0,                    // border - deprecated, always 0
-                     GL_RGBA,              // format of the pixel data copied to GPU
+                     image.pixel_format,   // format of the pixel data copied to GPU
                      GL_UNSIGNED_BYTE,     // type of the pixel data
-                     data);                // pointer to data
-
-        stbi_image_free(data);
+                     image.empty() ? nullptr : image.pixels.data()); // pointer to data
+        set_unpack_alignment(GL_RGBA);
     }
+    // The faces share their format, see pack_cubemap_channels
+    set_texture_swizzle(GL_TEXTURE_CUBE_MAP, images[0].pixel_format);
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, level_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, level_count > 1 ? GLint(level_count - 1) : 0);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -68,3 +572,63 @@ GLuint load_texture_cubemap(std::string filenames[6]) {
 
     return texture_id;
 }
+
+GLuint create_placeholder_texture_2d(const unsigned char color[4]) {
+    Image image;
+    image.width = image.height = 1;
+    image.pixels.assign(color, color + 4);
+    return upload_texture_2d(image);
+}
+
+GLuint create_placeholder_texture_cubemap(const unsigned char color[4]) {
+    Image images[6];
+    for (Image &image : images) {
+        image.width = image.height = 1;
+        image.pixels.assign(color, color + 4);
+    }
+    return upload_texture_cubemap(images);
+}
+
+namespace {
+
+const GLuint tracked_units = 16;
+
+struct TextureBinding {
+    GLenum target = 0;
+    GLuint texture_id = 0;
+};
+
+TextureBinding texture_bindings[tracked_units];
+GLuint active_unit = tracked_units;
+
+} // namespace
+
+void bind_texture(GLuint unit, GLenum target, GLuint texture_id) {
+    if (unit < tracked_units && texture_bindings[unit].target == target &&
+        texture_bindings[unit].texture_id == texture_id) {
+        return;
+    }
+
+    if (unit != active_unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        active_unit = unit;
+    }
+    glBindTexture(target, texture_id);
+    render_stats().texture_changes++;
+    if (target == GL_TEXTURE_2D || target == GL_TEXTURE_2D_ARRAY) {
+        TextureResidency::shared().touch(texture_id);
+    }
+
+    if (unit < tracked_units) {
+        texture_bindings[unit].target = target;
+        texture_bindings[unit].texture_id = texture_id;
+    }
+}
+
+void reset_texture_bindings() {
+    for (auto &binding : texture_bindings) {
+        binding = TextureBinding();
+    }
+    // Unknown, so the next bind always selects its unit
+    active_unit = tracked_units;
+}
@@ -0,0 +1,222 @@
+#include "texture_array.hpp"
+#include "block_compression.hpp"
+#include "mipmap.hpp"
+#include "pixel_format.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+/// Level of an image as a rectangle of units: texels, or 4x4 blocks of a compressed format
+struct SourceLevel {
+  int width;
+  int height;
+  const unsigned char *data;
+  /// GL_BGRA levels are swapped to RGBA while copying
+  bool bgra;
+};
+
+/// Storage unit of a format
+struct Units {
+  int size;
+  size_t bytes;
+};
+
+Units units_of(GLenum compressed_format) {
+  switch (compressed_format) {
+  case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    return {4, block_bytes(BlockFormat::BC1)};
+  case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    return {4, block_bytes(BlockFormat::BC3)};
+  default:
+    return {1, 4};
+  }
+}
+
+int units_across(int texels, const Units &units) { return (texels + units.size - 1) / units.size; }
+
+/// Levels of the image largest first, 'generated' keeps the ones made here alive
+std::vector<SourceLevel> source_levels(const Image &image, std::vector<Image> *generated) {
+  std::vector<SourceLevel> levels;
+  if (!image.levels.empty()) {
+    for (const ImageLevel &level : image.levels) {
+      levels.push_back({level.width, level.height, level.data, image.pixel_format == GL_BGRA});
+    }
+    return levels;
+  }
+
+  levels.push_back({image.width, image.height, image.pixels.data(), false});
+  *generated = generate_mipmaps(image);
+  for (const Image &level : *generated) {
+    levels.push_back({level.width, level.height, level.pixels.data(), false});
+  }
+  return levels;
+}
+
+/// Copies a level into the layer at the texel offset 'x', 'y' of the level
+void copy_level(const SourceLevel &level, const Units &units, int x, int y, int layer_width,
+                unsigned char *layer) {
+  const size_t row_bytes = units_across(level.width, units) * units.bytes;
+  const size_t layer_row_bytes = units_across(layer_width, units) * units.bytes;
+  const size_t offset = (y / units.size) * layer_row_bytes + (x / units.size) * units.bytes;
+
+  for (int row = 0; row < units_across(level.height, units); row++) {
+    unsigned char *destination = layer + offset + row * layer_row_bytes;
+    std::memcpy(destination, level.data + row * row_bytes, row_bytes);
+    if (level.bgra) {
+      swap_red_blue(destination, row_bytes / 4);
+    }
+  }
+}
+
+/// Uploads the levels [first_level, end_level) of the image into the bound array
+void upload_array_levels(const TextureArrayImage &image, size_t first_level, size_t end_level) {
+  for (size_t k = first_level; k < std::min(end_level, image.levels.size()); k++) {
+    const GLint level = static_cast<GLint>(k);
+    const int width = std::max(1, image.width >> k);
+    const int height = std::max(1, image.height >> k);
+    if (image.compressed_format) {
+      glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, image.compressed_format, width, height, image.layers, 0,
+                             static_cast<GLsizei>(image.levels[k].size()), image.levels[k].data());
+    } else {
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, width, height, image.layers, 0, GL_RGBA,
+                   GL_UNSIGNED_BYTE, image.levels[k].data());
+    }
+  }
+}
+
+} // namespace
+
+std::vector<TextureArrayImage> pack_texture_arrays(const std::vector<Image> &images,
+                                                   std::vector<PackedTexture> *placements) {
+  PackedTexture missing;
+  missing.layer = -1;
+  placements->assign(images.size(), missing);
+  std::vector<TextureArrayImage> arrays;
+
+  std::vector<GLenum> formats;
+  for (const Image &image : images) {
+    if (!image.empty() && std::find(formats.begin(), formats.end(), image.compressed_format) == formats.end()) {
+      formats.push_back(image.compressed_format);
+    }
+  }
+
+  for (GLenum format : formats) {
+    const Units units = units_of(format);
+    std::vector<size_t> members;
+    TextureArrayImage array;
+    array.compressed_format = format;
+    for (size_t i = 0; i < images.size(); i++) {
+      if (!images[i].empty() && images[i].compressed_format == format) {
+        members.push_back(i);
+        array.width = std::max(array.width, images[i].width);
+        array.height = std::max(array.height, images[i].height);
+      }
+    }
+
+    array.width = units_across(array.width, units) * units.size;
+    array.height = units_across(array.height, units) * units.size;
+
+    // Shelves of images sorted by height, a new layer when the next shelf does not fit
+    std::sort(members.begin(), members.end(), [&](size_t a, size_t b) {
+      return images[a].height != images[b].height ? images[a].height > images[b].height
+                                                   : images[a].width > images[b].width;
+    });
+    std::vector<glm::ivec2> origins(images.size());
+    int x = 0, y = 0, shelf_height = 0;
+    array.layers = 1;
+    for (size_t i : members) {
+      // Images start on whole blocks of compressed formats
+      const int width = units_across(images[i].width, units) * units.size;
+      const int height = units_across(images[i].height, units) * units.size;
+      if (x + width > array.width) {
+        x = 0;
+        y += shelf_height;
+        shelf_height = 0;
+      }
+      if (y + height > array.height) {
+        x = y = 0;
+        array.layers++;
+      }
+      origins[i] = glm::ivec2(x, y);
+      shelf_height = std::max(shelf_height, height);
+      x += width;
+
+      PackedTexture &placement = (*placements)[i];
+      placement.array = arrays.size();
+      placement.layer = array.layers - 1;
+      placement.offset = glm::vec2(float(origins[i].x) / array.width, float(origins[i].y) / array.height);
+      placement.scale = glm::vec2(float(images[i].width) / array.width, float(images[i].height) / array.height);
+    }
+
+    std::vector<std::vector<Image>> generated(images.size());
+    std::vector<std::vector<SourceLevel>> levels(images.size());
+    size_t level_count = 32;
+    for (size_t i : members) {
+      levels[i] = source_levels(images[i], &generated[i]);
+      // Levels where the image still starts on a unit and has the size the array level implies
+      size_t usable = 0;
+      while (usable < levels[i].size()) {
+        const int step = 1 << usable;
+        const SourceLevel &level = levels[i][usable];
+        if (origins[i].x % step != 0 || origins[i].y % step != 0 || (origins[i].x / step) % units.size != 0 ||
+            (origins[i].y / step) % units.size != 0 || level.width != std::max(1, images[i].width / step) ||
+            level.height != std::max(1, images[i].height / step)) {
+          break;
+        }
+        usable++;
+      }
+      level_count = std::min(level_count, std::max<size_t>(usable, 1));
+    }
+
+    for (size_t k = 0; k < level_count; k++) {
+      const int width = std::max(1, array.width >> k);
+      const int height = std::max(1, array.height >> k);
+      const size_t layer_bytes = size_t(units_across(width, units)) * units_across(height, units) * units.bytes;
+      std::vector<unsigned char> data(layer_bytes * array.layers, 0);
+      for (size_t i : members) {
+        copy_level(levels[i][k], units, origins[i].x >> k, origins[i].y >> k, width,
+                   data.data() + (*placements)[i].layer * layer_bytes);
+      }
+      array.levels.push_back(std::move(data));
+    }
+    arrays.push_back(std::move(array));
+  }
+  return arrays;
+}
+
+GLuint upload_texture_array(const TextureArrayImage &image, size_t first_level) {
+  GLuint texture_id = 0;
+  glGenTextures(1, &texture_id);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture_id);
+
+  first_level = std::min(first_level, image.levels.empty() ? 0 : image.levels.size() - 1);
+  upload_array_levels(image, first_level, image.levels.size());
+
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(first_level));
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size()) - 1);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  image.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  return texture_id;
+}
+
+void upload_texture_array_levels(const TextureArrayImage &image, GLuint texture_id, size_t first_level,
+                                 size_t end_level) {
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture_id);
+  upload_array_levels(image, first_level, end_level);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(first_level));
+}
+
+void drop_texture_array_levels(GLuint texture_id, size_t old_base_level, size_t base_level) {
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture_id);
+  // The new base goes first, so the array never refers to a freed level
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(base_level));
+  for (size_t k = old_base_level; k < base_level; k++) {
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(k), GL_RGBA8, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 nullptr);
+  }
+}
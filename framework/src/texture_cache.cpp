@@ -0,0 +1,152 @@
+#include "texture_cache.hpp"
+#include "texture_residency.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <utility>
+
+TextureCache::TextureCache()
+    : TextureCache([](GLuint texture_id) {
+        TextureResidency::shared().untrack(texture_id);
+        glDeleteTextures(1, &texture_id);
+      }) {}
+
+TextureCache::TextureCache(std::function<void(GLuint)> delete_texture) : delete_texture(std::move(delete_texture)) {
+  this->stats.memory_limit = default_memory_limit;
+}
+
+TextureCache &TextureCache::shared() {
+  static TextureCache cache;
+  return cache;
+}
+
+std::string TextureCache::key(GLenum target, const std::vector<std::string> &file_names, uint32_t parameters) {
+  std::string key = std::to_string(target) + ":" + std::to_string(parameters);
+  for (const std::string &file_name : file_names) {
+    key += ":" + canonical_path(file_name);
+  }
+  return key;
+}
+
+GLuint TextureCache::acquire(const std::string &key) {
+  auto found = this->textures_by_key.find(key);
+  if (found == this->textures_by_key.end()) {
+    this->stats.misses++;
+    return 0;
+  }
+
+  this->stats.hits++;
+  this->retain(found->second);
+  return found->second;
+}
+
+void TextureCache::insert(const std::string &key, GLuint texture_id, size_t memory) {
+  if (this->textures_by_key.count(key) > 0 || this->entries.count(texture_id) > 0) {
+    throw std::string("Texture ") + key + " is cached already";
+  }
+
+  Entry &entry = this->entries[texture_id];
+  entry.key = key;
+  entry.references = 1;
+  this->textures_by_key[key] = texture_id;
+  this->stats.textures++;
+  this->stats.referenced_textures++;
+  this->set_memory(texture_id, memory);
+}
+
+void TextureCache::set_memory(GLuint texture_id, size_t memory) {
+  auto found = this->entries.find(texture_id);
+  if (found == this->entries.end()) {
+    return;
+  }
+
+  Entry &entry = found->second;
+  this->stats.memory = this->stats.memory - entry.memory + memory;
+  if (entry.references > 0) {
+    this->stats.referenced_memory = this->stats.referenced_memory - entry.memory + memory;
+  }
+  entry.memory = memory;
+  this->stats.peak_memory = std::max(this->stats.peak_memory, this->stats.memory);
+  this->enforce_limit();
+}
+
+void TextureCache::retain(GLuint texture_id) {
+  auto found = this->entries.find(texture_id);
+  if (found == this->entries.end()) {
+    return;
+  }
+
+  Entry &entry = found->second;
+  if (entry.references++ == 0) {
+    this->stats.referenced_textures++;
+    this->stats.referenced_memory += entry.memory;
+  }
+}
+
+void TextureCache::release(GLuint texture_id) {
+  auto found = this->entries.find(texture_id);
+  if (found == this->entries.end() || found->second.references == 0) {
+    return;
+  }
+
+  Entry &entry = found->second;
+  if (--entry.references == 0) {
+    entry.release_order = this->releases++;
+    this->stats.referenced_textures--;
+    this->stats.referenced_memory -= entry.memory;
+    this->enforce_limit();
+  }
+}
+
+void TextureCache::set_memory_limit(size_t bytes) {
+  this->stats.memory_limit = bytes;
+  this->enforce_limit();
+}
+
+void TextureCache::trim() {
+  this->evict(0);
+}
+
+TextureCacheStats TextureCache::get_stats() const {
+  return this->stats;
+}
+
+void TextureCache::enforce_limit() {
+  if (this->stats.memory_limit > 0) {
+    this->evict(this->stats.memory_limit);
+  }
+}
+
+void TextureCache::evict(size_t limit) {
+  while (this->stats.memory > limit && this->stats.textures > this->stats.referenced_textures) {
+    auto oldest = this->entries.end();
+    for (auto it = this->entries.begin(); it != this->entries.end(); ++it) {
+      if (it->second.references == 0 &&
+          (oldest == this->entries.end() || it->second.release_order < oldest->second.release_order)) {
+        oldest = it;
+      }
+    }
+    this->erase(oldest->first);
+    this->stats.evictions++;
+  }
+}
+
+void TextureCache::erase(GLuint texture_id) {
+  auto found = this->entries.find(texture_id);
+  this->stats.memory -= found->second.memory;
+  this->stats.textures--;
+  this->textures_by_key.erase(found->second.key);
+  this->entries.erase(found);
+  this->delete_texture(texture_id);
+}
+
+std::ostream &operator<<(std::ostream &out, const TextureCacheStats &stats) {
+  out << "textures: " << stats.textures << " (" << stats.referenced_textures << " in use), memory: "
+      << stats.memory / 1024 << " KiB (" << stats.referenced_memory / 1024 << " KiB in use, peak "
+      << stats.peak_memory / 1024 << " KiB";
+  if (stats.memory_limit > 0) {
+    out << ", limit " << stats.memory_limit / 1024 << " KiB";
+  }
+  out << "), hits: " << stats.hits << ", misses: " << stats.misses << ", evictions: " << stats.evictions;
+  return out;
+}
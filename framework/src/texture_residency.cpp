@@ -0,0 +1,315 @@
+#include "texture_residency.hpp"
+#include "pixel_format.hpp"
+#include "texture_cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+TextureResidency &TextureResidency::shared() {
+  static TextureResidency residency;
+  return residency;
+}
+
+size_t TextureResidency::first_streamed_level(size_t level_count) const {
+  return this->streaming && level_count > kept_levels ? level_count - kept_levels : 0;
+}
+
+void TextureResidency::track(GLuint texture_id, const std::string &file_name, const std::vector<size_t> &level_sizes,
+                             size_t dropped_levels) {
+  if (level_sizes.empty()) {
+    return;
+  }
+
+  Entry &entry = this->entries[texture_id];
+  entry = Entry();
+  entry.file_name = file_name;
+  entry.level_sizes = level_sizes;
+  entry.dropped_levels = entry.planned_levels = entry.needed_levels = dropped_levels;
+  entry.serial = ++this->serials;
+}
+
+void TextureResidency::track_array(GLuint texture_id, const std::string &name,
+                                   std::shared_ptr<const TextureArrayImage> image, size_t dropped_levels) {
+  std::vector<size_t> level_sizes;
+  for (const std::vector<unsigned char> &level : image->levels) {
+    level_sizes.push_back(level.size());
+  }
+  this->track(texture_id, name, level_sizes, dropped_levels);
+  auto found = this->entries.find(texture_id);
+  if (found != this->entries.end()) {
+    found->second.array_image = std::move(image);
+  }
+}
+
+void TextureResidency::track_fixed(GLuint texture_id, const std::string &name, size_t bytes) {
+  Entry &entry = this->entries[texture_id];
+  entry = Entry();
+  entry.file_name = name;
+  entry.level_sizes = {bytes};
+  entry.fixed = true;
+  entry.serial = ++this->serials;
+}
+
+void TextureResidency::untrack(GLuint texture_id) {
+  // Loads still running find no entry of their serial and are dropped
+  this->entries.erase(texture_id);
+}
+
+void TextureResidency::touch(GLuint texture_id) {
+  auto found = this->entries.find(texture_id);
+  if (found != this->entries.end()) {
+    found->second.bound_frame = this->frame;
+  }
+}
+
+void TextureResidency::request(GLuint texture_id, float uv_per_pixel) {
+  auto found = this->entries.find(texture_id);
+  if (found == this->entries.end() || found->second.fixed) {
+    return;
+  }
+
+  Entry &entry = found->second;
+  const size_t level = std::min(needed_level(full_level_count(entry), uv_per_pixel), max_dropped_levels(entry));
+  if (entry.requested_frame != this->frame || level < entry.requested_levels) {
+    entry.requested_levels = level;
+  }
+  entry.requested_frame = this->frame;
+}
+
+size_t TextureResidency::needed_level(size_t level_count, float uv_per_pixel) {
+  if (uv_per_pixel <= 0.f || level_count <= kept_levels) {
+    return 0;
+  }
+  const float texels_per_pixel_log2 = std::log2(uv_per_pixel) + float(level_count - 1);
+  const size_t level = texels_per_pixel_log2 > 0.f ? size_t(texels_per_pixel_log2) : 0;
+  return std::min(level, level_count - kept_levels);
+}
+
+void TextureResidency::set_budget(size_t bytes) {
+  this->stats.budget = bytes;
+}
+
+void TextureResidency::update(size_t max_uploads, ThreadPool &pool) {
+  this->finish_loads(max_uploads);
+  this->end_frame();
+
+  // The cache may delete textures, which untracks them, so it hears of the new sizes after the loop
+  std::vector<std::pair<GLuint, size_t>> changed;
+  for (auto &item : this->entries) {
+    Entry &entry = item.second;
+    if (entry.loading || entry.planned_levels == entry.dropped_levels) {
+      continue;
+    }
+    if (entry.planned_levels > entry.dropped_levels) {
+      if (entry.array_image) {
+        drop_texture_array_levels(item.first, entry.dropped_levels, entry.planned_levels);
+      } else {
+        drop_texture_levels_2d(item.first, entry.dropped_levels, entry.planned_levels);
+      }
+      entry.dropped_levels = entry.planned_levels;
+      this->stats.drops++;
+      changed.emplace_back(item.first, memory(entry, entry.dropped_levels));
+    } else if (entry.array_image) {
+      // Already in memory, so there is nothing to wait for
+      upload_texture_array_levels(*entry.array_image, item.first, entry.planned_levels, entry.dropped_levels);
+      this->stats.upload_bytes += memory(entry, entry.planned_levels) - memory(entry, entry.dropped_levels);
+      entry.dropped_levels = entry.planned_levels;
+      this->stats.reloads++;
+    } else if (!entry.broken) {
+      entry.loading = true;
+      const std::string file_name = entry.file_name;
+      this->loads.push_back({item.first, entry.serial, entry.planned_levels,
+                             pool.submit([file_name]() { return pack_channels(decode_image(file_name, true)); })});
+    }
+  }
+  for (const auto &texture : changed) {
+    TextureCache::shared().set_memory(texture.first, texture.second);
+  }
+}
+
+void TextureResidency::end_frame() {
+  this->plan();
+  this->frame++;
+}
+
+std::vector<TextureResidencyEntry> TextureResidency::get_report() const {
+  std::vector<TextureResidencyEntry> report;
+  for (const auto &item : this->entries) {
+    TextureResidencyEntry line;
+    line.texture_id = item.first;
+    line.file_name = item.second.file_name;
+    line.memory = memory(item.second, item.second.dropped_levels);
+    line.full_memory = memory(item.second, 0);
+    line.dropped_levels = item.second.dropped_levels;
+    line.needed_levels = item.second.needed_levels;
+    line.planned_levels = item.second.planned_levels;
+    line.last_used_frame = last_used_frame(item.second);
+    line.fixed = item.second.fixed;
+    report.push_back(line);
+  }
+  std::sort(report.begin(), report.end(), [](const TextureResidencyEntry &a, const TextureResidencyEntry &b) {
+    return a.memory > b.memory || (a.memory == b.memory && a.texture_id < b.texture_id);
+  });
+  return report;
+}
+
+TextureResidencyStats TextureResidency::get_stats() const {
+  TextureResidencyStats stats = this->stats;
+  for (const auto &item : this->entries) {
+    stats.textures++;
+    stats.memory += memory(item.second, item.second.dropped_levels);
+    stats.full_memory += memory(item.second, 0);
+    stats.dropped_levels += item.second.dropped_levels;
+    if (item.second.fixed) {
+      stats.fixed_memory += memory(item.second, 0);
+    }
+    if (item.second.array_image) {
+      stats.array_image_memory += memory(item.second, 0);
+    }
+  }
+  return stats;
+}
+
+size_t TextureResidency::memory(const Entry &entry, size_t dropped_levels) {
+  size_t bytes = 0;
+  for (size_t i = dropped_levels; i < entry.level_sizes.size(); i++) {
+    bytes += entry.level_sizes[i];
+  }
+  return bytes;
+}
+
+size_t TextureResidency::max_dropped_levels(const Entry &entry) {
+  return !entry.fixed && entry.level_sizes.size() > kept_levels ? entry.level_sizes.size() - kept_levels : 0;
+}
+
+size_t TextureResidency::full_level_count(const Entry &entry) {
+  if (!entry.array_image) {
+    return entry.level_sizes.size();
+  }
+  size_t count = 1;
+  while ((std::max(entry.array_image->width, entry.array_image->height) >> count) > 0) {
+    count++;
+  }
+  return count;
+}
+
+uint64_t TextureResidency::last_used_frame(const Entry &entry) {
+  return std::max(entry.bound_frame, entry.requested_frame);
+}
+
+void TextureResidency::finish_loads(size_t max_uploads) {
+  size_t uploads = 0;
+  for (size_t i = 0; i < this->loads.size() && uploads < max_uploads;) {
+    if (this->loads[i].image.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      i++;
+      continue;
+    }
+    const GLuint texture_id = this->loads[i].texture_id;
+    const uint64_t serial = this->loads[i].serial;
+    const size_t loaded_levels = this->loads[i].dropped_levels;
+    const Image image = this->loads[i].image.get();
+    this->loads.erase(this->loads.begin() + i);
+
+    auto found = this->entries.find(texture_id);
+    if (found == this->entries.end() || found->second.serial != serial) {
+      continue;
+    }
+    Entry &entry = found->second;
+    entry.loading = false;
+    if (image.levels.empty()) {
+      std::cout << "Could not stream the levels of " << entry.file_name << std::endl;
+      entry.broken = true;
+      continue;
+    }
+
+    // The plan may have moved on while loading, levels it no longer wants are not uploaded
+    const size_t old_levels = entry.dropped_levels;
+    size_t new_levels = std::max(loaded_levels, std::min(entry.planned_levels, old_levels));
+    const std::vector<size_t> level_sizes = image.level_sizes();
+    if (level_sizes != entry.level_sizes) {
+      // The container changed with the texture compression, none of the old levels fit
+      entry.level_sizes = level_sizes;
+      new_levels = std::min(new_levels, max_dropped_levels(entry));
+      upload_texture_2d(image, texture_id, new_levels);
+      this->stats.upload_bytes += memory(entry, new_levels);
+    } else if (new_levels < old_levels) {
+      upload_texture_levels_2d(image, texture_id, new_levels, old_levels);
+      this->stats.upload_bytes += memory(entry, new_levels) - memory(entry, old_levels);
+    } else {
+      continue;
+    }
+    entry.dropped_levels = new_levels;
+    this->stats.reloads++;
+    uploads++;
+    // The cache may delete textures, which untracks them
+    TextureCache::shared().set_memory(texture_id, memory(entry, new_levels));
+  }
+}
+
+void TextureResidency::plan() {
+  size_t planned_memory = 0;
+  std::vector<std::pair<GLuint, Entry *>> candidates;
+  for (auto &item : this->entries) {
+    Entry &entry = item.second;
+    if (entry.fixed) {
+      // Counts against the budget, the 2D textures share the rest
+      planned_memory += memory(entry, 0);
+      continue;
+    }
+    const bool requested = entry.requested_frame == this->frame;
+    if (requested || entry.bound_frame == this->frame) {
+      // Bound without a request means every level may be sampled
+      const size_t needed = requested ? entry.requested_levels : 0;
+      if (needed <= entry.needed_levels || this->frame - entry.needed_frame > keep_frames) {
+        entry.needed_levels = needed;
+        entry.needed_frame = this->frame;
+      }
+    } else {
+      candidates.emplace_back(item.first, &entry);
+    }
+    entry.planned_levels = entry.needed_levels;
+    planned_memory += memory(entry, entry.planned_levels);
+  }
+  const size_t budget = this->stats.budget;
+  if (budget == 0 || planned_memory <= budget) {
+    return;
+  }
+
+  // Least recently used first, the larger one of those used in the same frame
+  std::sort(candidates.begin(), candidates.end(),
+            [](const std::pair<GLuint, Entry *> &a, const std::pair<GLuint, Entry *> &b) {
+              const uint64_t a_frame = last_used_frame(*a.second), b_frame = last_used_frame(*b.second);
+              if (a_frame != b_frame) {
+                return a_frame < b_frame;
+              }
+              const size_t a_memory = memory(*a.second, a.second->planned_levels);
+              const size_t b_memory = memory(*b.second, b.second->planned_levels);
+              return a_memory > b_memory || (a_memory == b_memory && a.first < b.first);
+            });
+  for (const auto &candidate : candidates) {
+    Entry &entry = *candidate.second;
+    const size_t max_levels = max_dropped_levels(entry);
+    while (planned_memory > budget && entry.planned_levels < max_levels) {
+      planned_memory -= entry.level_sizes[entry.planned_levels];
+      entry.planned_levels++;
+    }
+    if (planned_memory <= budget) {
+      return;
+    }
+  }
+  this->stats.frames_over_budget++;
+}
+
+std::ostream &operator<<(std::ostream &out, const TextureResidencyStats &stats) {
+  out << "textures: " << stats.textures << ", memory: " << stats.memory / 1024 << " KiB of "
+      << stats.full_memory / 1024 << " KiB (" << stats.fixed_memory / 1024 << " KiB fixed)";
+  if (stats.budget > 0) {
+    out << " (budget " << stats.budget / 1024 << " KiB, " << stats.frames_over_budget << " frames over)";
+  }
+  out << ", array images in host memory: " << stats.array_image_memory / 1024 << " KiB";
+  out << ", dropped levels: " << stats.dropped_levels << ", drops: " << stats.drops << ", reloads: "
+      << stats.reloads << ", uploaded: " << stats.upload_bytes / 1024 << " KiB";
+  return out;
+}
@@ -0,0 +1,172 @@
+#include "texture_streamer.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+/// Offsets of the levels in a buffer are aligned for fast copies, the unpack alignment of 4 is then met too
+const size_t level_alignment = 64;
+
+size_t align(size_t offset) { return (offset + level_alignment - 1) / level_alignment * level_alignment; }
+
+} // namespace
+
+TextureStreamer::TextureStreamer(size_t buffer_count, size_t buffer_bytes)
+    : buffer_bytes(buffer_bytes), buffers(buffer_count) {
+  for (Buffer &buffer : this->buffers) {
+    glGenBuffers(1, &buffer.id);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(buffer_bytes), nullptr, GL_STREAM_DRAW);
+    this->map(buffer);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+TextureStreamer::~TextureStreamer() {
+  this->shutdown();
+  for (Buffer &buffer : this->buffers) {
+    if (buffer.fence) {
+      glDeleteSync(buffer.fence);
+    }
+    // Deleting a mapped buffer unmaps it
+    glDeleteBuffers(1, &buffer.id);
+  }
+}
+
+int TextureStreamer::write(const Image &image, size_t first_level) {
+  size_t size = 0;
+  for (size_t i = first_level; i < image.levels.size(); i++) {
+    size = align(size) + image.levels[i].size;
+  }
+
+  std::unique_lock<std::mutex> lock(this->mutex);
+  if (image.levels.empty() || size > this->buffer_bytes) {
+    this->stats.rejected++;
+    return -1;
+  }
+
+  auto find_free = [this]() {
+    for (size_t i = 0; i < this->buffers.size(); i++) {
+      // Buffers that could not be mapped stay unused
+      if (this->buffers[i].state == BufferState::Free && this->buffers[i].mapped) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  };
+  int index = find_free();
+  if (index < 0 && !this->stopped) {
+    this->stats.buffer_waits++;
+    this->buffer_freed.wait(lock, [&]() { return this->stopped || (index = find_free()) >= 0; });
+  }
+  if (this->stopped) {
+    return -1;
+  }
+
+  Buffer &buffer = this->buffers[index];
+  buffer.state = BufferState::Writing;
+  unsigned char *mapped = buffer.mapped;
+  lock.unlock();
+
+  // Copied without the lock, the buffer belongs to this writer until it is marked as written
+  Image layout;
+  layout.width = image.width;
+  layout.height = image.height;
+  layout.compressed_format = image.compressed_format;
+  layout.pixel_format = image.pixel_format;
+  size_t offset = 0;
+  for (size_t i = 0; i < image.levels.size(); i++) {
+    const ImageLevel &level = image.levels[i];
+    if (i < first_level) {
+      // Not uploaded, only keeps the numbers of the levels
+      layout.levels.push_back({level.width, level.height, nullptr, level.size});
+      continue;
+    }
+    offset = align(offset);
+    std::memcpy(mapped + offset, level.data, level.size);
+    // With the buffer bound as GL_PIXEL_UNPACK_BUFFER the pointers are offsets into it
+    layout.levels.push_back(
+        {level.width, level.height, reinterpret_cast<const unsigned char *>(static_cast<uintptr_t>(offset)),
+         level.size});
+    offset += level.size;
+  }
+
+  lock.lock();
+  buffer.layout = std::move(layout);
+  buffer.first_level = first_level;
+  buffer.state = BufferState::Written;
+  this->stats.images++;
+  this->stats.bytes += size;
+  return index;
+}
+
+bool TextureStreamer::upload(int index, GLuint texture_id) {
+  Image layout;
+  size_t first_level;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    layout = std::move(this->buffers[index].layout);
+    first_level = this->buffers[index].first_level;
+  }
+  Buffer &buffer = this->buffers[index];
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+  // The mapping may be lost (e.g. a mode switch), the texture keeps its old image then
+  const bool uploaded = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) != GL_FALSE;
+  if (uploaded) {
+    upload_texture_2d(layout, texture_id, first_level);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    buffer.mapped = nullptr;
+    buffer.state = BufferState::InFlight;
+  }
+  this->recycle();
+  return uploaded;
+}
+
+void TextureStreamer::recycle() {
+  for (Buffer &buffer : this->buffers) {
+    if (!buffer.fence) {
+      continue;
+    }
+    const GLenum status = glClientWaitSync(buffer.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      continue;
+    }
+    glDeleteSync(buffer.fence);
+    buffer.fence = nullptr;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+    this->map(buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      buffer.state = BufferState::Free;
+    }
+    this->buffer_freed.notify_one();
+  }
+}
+
+void TextureStreamer::shutdown() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->stopped = true;
+  this->buffer_freed.notify_all();
+}
+
+TextureStreamStats TextureStreamer::get_stats() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->stats;
+}
+
+void TextureStreamer::map(Buffer &buffer) {
+  // The GPU is done with the old contents, invalidating lets the driver hand out fresh storage at once
+  void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(this->buffer_bytes),
+                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+  std::lock_guard<std::mutex> lock(this->mutex);
+  buffer.mapped = static_cast<unsigned char *>(mapped);
+}
@@ -0,0 +1,65 @@
+#include "uniform_buffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "render_stats.hpp"
+
+UniformBlockData::UniformBlockData(size_t size)
+    : bytes(size, 0), dirty_rows((size + row_size - 1) / row_size, true) {}
+
+void UniformBlockData::write(size_t offset, const void *data, size_t size) {
+  size = std::min(size, this->bytes.size() - std::min(offset, this->bytes.size()));
+  const uint8_t *source = static_cast<const uint8_t *>(data);
+  // Row by row, so an unchanged row is neither copied nor marked
+  for (size_t done = 0; done < size;) {
+    const size_t position = offset + done;
+    const size_t count = std::min(size - done, row_size - position % row_size);
+    if (std::memcmp(&this->bytes[position], source + done, count) != 0) {
+      std::memcpy(&this->bytes[position], source + done, count);
+      this->dirty_rows[position / row_size] = true;
+    }
+    done += count;
+  }
+}
+
+std::vector<std::pair<size_t, size_t>> UniformBlockData::get_dirty_ranges() const {
+  std::vector<std::pair<size_t, size_t>> ranges;
+  for (size_t row = 0; row < this->dirty_rows.size(); row++) {
+    if (!this->dirty_rows[row]) {
+      continue;
+    }
+    const size_t first = row;
+    while (row + 1 < this->dirty_rows.size() && this->dirty_rows[row + 1]) {
+      row++;
+    }
+    const size_t offset = first * row_size;
+    ranges.emplace_back(offset, std::min((row + 1) * row_size, this->bytes.size()) - offset);
+  }
+  return ranges;
+}
+
+void UniformBlockData::clear_dirty() { std::fill(this->dirty_rows.begin(), this->dirty_rows.end(), false); }
+
+UniformBuffer::UniformBuffer(size_t size, GLuint binding) : binding(binding), data(size) {
+  glGenBuffers(1, &this->buffer_id);
+  glBindBuffer(GL_UNIFORM_BUFFER, this->buffer_id);
+  glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, binding, this->buffer_id);
+}
+
+UniformBuffer::~UniformBuffer() { glDeleteBuffers(1, &this->buffer_id); }
+
+void UniformBuffer::update() {
+  const std::vector<std::pair<size_t, size_t>> ranges = this->data.get_dirty_ranges();
+  if (ranges.empty()) {
+    return;
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, this->buffer_id);
+  for (const auto &range : ranges) {
+    glBufferSubData(GL_UNIFORM_BUFFER, range.first, range.second, this->data.data() + range.first);
+    render_stats().buffer_updates++;
+    render_stats().buffer_update_bytes += range.second;
+  }
+  this->data.clear_dirty();
+}
@@ -1,4 +1,18 @@
 #include "utility.hpp"
+#include "mapped_file.hpp"
+
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 
 const std::string load_file_to_string(const std::string &file_name) {
   std::ifstream infile{file_name};
@@ -9,3 +23,97 @@ const std::string load_file_to_string(const std::string &file_name) {
 
   return {std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>()};
 }
+
+static inline uint64_t rotate_left(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed) {
+  // Same round and avalanche as xxHash64, but with a single lane
+  const uint64_t prime1 = 11400714785074694791ull;
+  const uint64_t prime2 = 14029467366897019727ull;
+  const uint64_t prime3 = 1609587929392839161ull;
+
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  uint64_t hash = seed + prime3 + size;
+
+  size_t offset = 0;
+  for (; offset + 8 <= size; offset += 8) {
+    uint64_t word;
+    std::memcpy(&word, bytes + offset, sizeof(word));
+    hash = rotate_left(hash ^ rotate_left(word * prime2, 31) * prime1, 27) * prime1 + prime3;
+  }
+  for (; offset < size; offset++) {
+    hash = rotate_left(hash ^ (bytes[offset] * prime3), 11) * prime1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= prime2;
+  hash ^= hash >> 29;
+  hash *= prime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+bool hash_file(const std::string &file_name, uint64_t *hash) {
+  try {
+    MappedFile file(file_name);
+    *hash = hash_bytes(file.data(), file.size());
+    return true;
+  } catch (const std::string &) {
+    return false;
+  }
+}
+
+bool get_file_info(const std::string &file_name, uint64_t *size, int64_t *modification_time) {
+  struct stat info;
+  if (stat(file_name.c_str(), &info) != 0) {
+    return false;
+  }
+
+  *size = static_cast<uint64_t>(info.st_size);
+  *modification_time = static_cast<int64_t>(info.st_mtime);
+  return true;
+}
+
+std::string canonical_path(const std::string &file_name) {
+#ifdef _WIN32
+  char resolved[_MAX_PATH];
+  if (!_fullpath(resolved, file_name.c_str(), _MAX_PATH)) {
+    return file_name;
+  }
+  // Windows paths are case insensitive and accept both separators
+  std::string path = resolved;
+  for (char &c : path) {
+    c = c == '/' ? '\\' : static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return path;
+#else
+  char *resolved = realpath(file_name.c_str(), nullptr);
+  if (!resolved) {
+    return file_name;
+  }
+  std::string path = resolved;
+  std::free(resolved);
+  return path;
+#endif
+}
+
+std::string temporary_path_for(const std::string &file_name) {
+  static std::atomic<uint64_t> counter{0};
+#ifdef _WIN32
+  const long long process = _getpid();
+#else
+  const long long process = getpid();
+#endif
+  return file_name + "." + std::to_string(process) + "." + std::to_string(counter++) + ".tmp";
+}
+
+bool replace_file(const std::string &temporary_path, const std::string &file_name) {
+#ifdef _WIN32
+  std::remove(file_name.c_str());
+#endif
+  if (std::rename(temporary_path.c_str(), file_name.c_str()) != 0) {
+    std::remove(temporary_path.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,167 @@
+#include "vertex_format.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+glm::vec3 read_vec3(const float *values, size_t vertex) {
+  return glm::vec3(values[3 * vertex], values[3 * vertex + 1], values[3 * vertex + 2]);
+}
+
+glm::vec3 decode_position(const CompactVertex &vertex, glm::vec3 offset, glm::vec3 scale) {
+  const glm::vec3 normalized(vertex.position[0], vertex.position[1], vertex.position[2]);
+  return offset + normalized / 65535.f * scale;
+}
+
+} // namespace
+
+uint16_t float_to_half(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+
+  const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+  const uint32_t magnitude = bits & 0x7fffffff;
+
+  if (magnitude >= 0x7f800000) {
+    // Infinity stays infinity, NaN stays NaN
+    return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+  }
+  if (magnitude >= 0x477ff000) {
+    // Rounds above 65504, the largest half
+    return sign | 0x7c00;
+  }
+  if (magnitude >= 0x38800000) {
+    // Normal half, rebias the exponent and round the mantissa to nearest even
+    const uint32_t rounded = magnitude + 0xfff + ((magnitude >> 13) & 1);
+    return sign | static_cast<uint16_t>((rounded - 0x38000000) >> 13);
+  }
+  if (magnitude < 0x33000000) {
+    // Less than half of the smallest subnormal
+    return sign;
+  }
+
+  // Subnormal half
+  const uint32_t exponent = magnitude >> 23;
+  const uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+  const uint32_t shift = 126 - exponent;
+  uint32_t result = mantissa >> shift;
+  const uint32_t remainder = mantissa & ((1u << shift) - 1);
+  const uint32_t halfway = 1u << (shift - 1);
+  if (remainder > halfway || (remainder == halfway && (result & 1))) {
+    result++;
+  }
+  return sign | static_cast<uint16_t>(result);
+}
+
+float half_to_float(uint16_t value) {
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1f;
+  const uint32_t mantissa = value & 0x3ff;
+
+  if (exponent == 0) {
+    const float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -magnitude : magnitude;
+  }
+
+  uint32_t bits;
+  if (exponent == 31) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+uint32_t pack_snorm_10_10_10_2(glm::vec3 value) {
+  auto pack = [](float component) {
+    const int quantized = static_cast<int>(std::round(glm::clamp(component, -1.f, 1.f) * 511.f));
+    return static_cast<uint32_t>(quantized) & 0x3ff;
+  };
+  return pack(value.x) | (pack(value.y) << 10) | (pack(value.z) << 20);
+}
+
+glm::vec3 unpack_snorm_10_10_10_2(uint32_t value) {
+  auto unpack = [](uint32_t bits) {
+    // Sign extend the 10-bit two's complement value
+    const int quantized = static_cast<int32_t>(bits << 22) >> 22;
+    return std::max(quantized / 511.f, -1.f);
+  };
+  return glm::vec3(unpack(value & 0x3ff), unpack((value >> 10) & 0x3ff), unpack((value >> 20) & 0x3ff));
+}
+
+std::vector<CompactVertex> compact_vertices(const MeshView &view, glm::vec3 *position_offset,
+                                            glm::vec3 *position_scale) {
+  glm::vec3 bounds_min(0.f), bounds_max(0.f);
+  if (view.vertex_count > 0) {
+    bounds_min = bounds_max = read_vec3(view.vertices, 0);
+  }
+  for (size_t v = 1; v < view.vertex_count; v++) {
+    bounds_min = glm::min(bounds_min, read_vec3(view.vertices, v));
+    bounds_max = glm::max(bounds_max, read_vec3(view.vertices, v));
+  }
+  *position_offset = bounds_min;
+  *position_scale = bounds_max - bounds_min;
+
+  std::vector<CompactVertex> compact(view.vertex_count);
+  for (size_t v = 0; v < view.vertex_count; v++) {
+    CompactVertex &vertex = compact[v];
+
+    const glm::vec3 position = read_vec3(view.vertices, v);
+    for (int i = 0; i < 3; i++) {
+      const float extent = (*position_scale)[i];
+      const float normalized = extent > 0.f ? (position[i] - bounds_min[i]) / extent : 0.f;
+      vertex.position[i] = static_cast<uint16_t>(std::round(glm::clamp(normalized, 0.f, 1.f) * 65535.f));
+    }
+    vertex.position[3] = 0;
+
+    vertex.normal = 0;
+    if (view.normals) {
+      const glm::vec3 normal = read_vec3(view.normals, v);
+      const float length = glm::length(normal);
+      vertex.normal = pack_snorm_10_10_10_2(length > 0.f ? normal / length : normal);
+    }
+
+    vertex.tex_coord[0] = vertex.tex_coord[1] = 0;
+    if (view.tex_coords) {
+      vertex.tex_coord[0] = float_to_half(view.tex_coords[2 * v]);
+      vertex.tex_coord[1] = float_to_half(view.tex_coords[2 * v + 1]);
+    }
+  }
+  return compact;
+}
+
+QuantizationError measure_quantization_error(const MeshView &view, const std::vector<CompactVertex> &compact,
+                                             glm::vec3 position_offset, glm::vec3 position_scale) {
+  QuantizationError error;
+  for (size_t v = 0; v < view.vertex_count && v < compact.size(); v++) {
+    const glm::vec3 position = read_vec3(view.vertices, v);
+    error.position =
+        std::max(error.position, glm::length(decode_position(compact[v], position_offset, position_scale) - position));
+
+    if (view.normals) {
+      const glm::vec3 normal = read_vec3(view.normals, v);
+      const glm::vec3 decoded = unpack_snorm_10_10_10_2(compact[v].normal);
+      if (glm::length(normal) > 0.f && glm::length(decoded) > 0.f) {
+        const float cosine = glm::clamp(glm::dot(glm::normalize(normal), glm::normalize(decoded)), -1.f, 1.f);
+        error.normal_degrees = std::max(error.normal_degrees, glm::degrees(std::acos(cosine)));
+      }
+    }
+
+    if (view.tex_coords) {
+      for (int i = 0; i < 2; i++) {
+        const float decoded = half_to_float(compact[v].tex_coord[i]);
+        error.tex_coord = std::max(error.tex_coord, std::abs(decoded - view.tex_coords[2 * v + i]));
+      }
+    }
+  }
+
+  const float diagonal = glm::length(position_scale);
+  if (diagonal > 0.f) {
+    error.position_relative = error.position / diagonal;
+  }
+  return error;
+}
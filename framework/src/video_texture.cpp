@@ -0,0 +1,382 @@
+#include "video_texture.hpp"
+#include "texture.hpp"
+#include "texture_residency.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include <stb_image.h>
+
+namespace {
+
+double milliseconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string sequence_file(const std::string &pattern, size_t number) {
+  std::vector<char> name(pattern.size() + 32);
+  std::snprintf(name.data(), name.size(), pattern.c_str(), static_cast<int>(number));
+  return name.data();
+}
+
+bool file_exists(const std::string &file_name) {
+  uint64_t size;
+  int64_t modification_time;
+  return get_file_info(file_name, &size, &modification_time);
+}
+
+/// Black in limited range YUV
+void clear_frame(VideoFrame *frame) {
+  frame->planes.assign(frame->luma_bytes() + 2 * frame->chroma_bytes(), 128);
+  std::fill(frame->planes.begin(), frame->planes.begin() + frame->luma_bytes(), 16);
+}
+
+/// BT.601 limited range with the common 8-bit integer coefficients, every chroma sample is the average of its 2x2
+/// luma texels. The offsets keep the sums positive, so the shifts round down.
+void rgba_to_yuv420(const unsigned char *rgba, VideoFrame *frame) {
+  const int width = frame->width, height = frame->height;
+  const int chroma_width = frame->chroma_width();
+  uint8_t *y_plane = frame->planes.data();
+  uint8_t *u_plane = y_plane + frame->luma_bytes();
+  uint8_t *v_plane = u_plane + frame->chroma_bytes();
+
+  for (int y = 0; y < height; y += 2) {
+    for (int x = 0; x < width; x += 2) {
+      int r = 0, g = 0, b = 0, count = 0;
+      for (int dy = 0; dy < 2 && y + dy < height; dy++) {
+        for (int dx = 0; dx < 2 && x + dx < width; dx++) {
+          const unsigned char *texel = rgba + (size_t(y + dy) * width + x + dx) * 4;
+          y_plane[size_t(y + dy) * width + x + dx] =
+              static_cast<uint8_t>(((66 * texel[0] + 129 * texel[1] + 25 * texel[2] + 128) >> 8) + 16);
+          r += texel[0];
+          g += texel[1];
+          b += texel[2];
+          count++;
+        }
+      }
+      r /= count;
+      g /= count;
+      b /= count;
+      const size_t chroma = size_t(y / 2) * chroma_width + x / 2;
+      u_plane[chroma] = static_cast<uint8_t>((-38 * r - 74 * g + 112 * b + 32896) >> 8);
+      v_plane[chroma] = static_cast<uint8_t>((112 * r - 94 * g - 18 * b + 32896) >> 8);
+    }
+  }
+}
+
+/// Reads the stream header of a Y4M file and the offsets of the planes of its frames
+void parse_y4m(const MappedFile &file, int *width, int *height, double *fps, std::vector<size_t> *offsets) {
+  const char *data = file.data();
+  const size_t size = file.size();
+  const std::string signature = "YUV4MPEG2";
+  const char *header_end = static_cast<const char *>(std::memchr(data, '\n', size));
+  if (size < signature.size() || std::memcmp(data, signature.data(), signature.size()) != 0 || !header_end) {
+    throw std::string("Not a Y4M file");
+  }
+
+  std::istringstream header(std::string(data + signature.size(), header_end));
+  std::string token;
+  while (header >> token) {
+    switch (token[0]) {
+    case 'W':
+      *width = std::atoi(token.c_str() + 1);
+      break;
+    case 'H':
+      *height = std::atoi(token.c_str() + 1);
+      break;
+    case 'F': {
+      int numerator = 0, denominator = 0;
+      if (std::sscanf(token.c_str() + 1, "%d:%d", &numerator, &denominator) == 2 && numerator > 0 &&
+          denominator > 0) {
+        *fps = double(numerator) / denominator;
+      }
+      break;
+    }
+    case 'C': {
+      // 8-bit 4:2:0 with any chroma siting, the high bit depth variants (e.g. 420p10) have 16-bit samples
+      const std::string colour_space = token.substr(1);
+      if (colour_space != "420" && colour_space != "420jpeg" && colour_space != "420paldv" &&
+          colour_space != "420mpeg2") {
+        throw std::string("Only 8-bit 4:2:0 chroma of Y4M files is supported, not " + colour_space);
+      }
+      break;
+    }
+    }
+  }
+  if (*width <= 0 || *height <= 0) {
+    throw std::string("Y4M file without a frame size");
+  }
+
+  const size_t frame_bytes =
+      size_t(*width) * *height + 2 * size_t((*width + 1) / 2) * ((*height + 1) / 2);
+  size_t offset = header_end - data + 1;
+  while (offset + 5 < size && std::memcmp(data + offset, "FRAME", 5) == 0) {
+    // Frame parameters are ignored
+    const char *line_end = static_cast<const char *>(std::memchr(data + offset, '\n', size - offset));
+    if (!line_end || size_t(line_end - data) + 1 + frame_bytes > size) {
+      break;
+    }
+    offsets->push_back(line_end - data + 1);
+    offset = offsets->back() + frame_bytes;
+  }
+  if (offsets->empty()) {
+    throw std::string("Y4M file without frames");
+  }
+}
+
+} // namespace
+
+std::ostream &operator<<(std::ostream &os, const VideoStats &stats) {
+  os << stats.decoded_frames << " frames decoded";
+  if (stats.decoded_frames > 0) {
+    os << " (" << stats.decode_milliseconds / stats.decoded_frames << " ms each)";
+  }
+  os << ", " << stats.uploaded_frames << " uploaded (" << stats.uploaded_bytes / 1024 << " KiB";
+  if (stats.uploaded_frames > 0) {
+    os << ", " << stats.upload_milliseconds / stats.uploaded_frames << " ms each";
+  }
+  return os << "), " << stats.dropped_frames << " dropped, " << stats.late_frames << " late, " << stats.buffer_stalls
+            << " buffer stalls";
+}
+
+VideoSource::VideoSource(const std::string &file_name, double fps, size_t queue_capacity)
+    : fps(fps), queue_capacity(std::max<size_t>(queue_capacity, 1)) {
+  if (file_name.find('%') == std::string::npos) {
+    this->file = std::unique_ptr<MappedFile>(new MappedFile(file_name));
+    try {
+      parse_y4m(*this->file, &this->width, &this->height, &this->fps, &this->frame_offsets);
+    } catch (const std::string &error) {
+      throw error + ": " + file_name;
+    }
+  } else {
+    const size_t first = file_exists(sequence_file(file_name, 0)) ? 0 : 1;
+    for (size_t number = first; file_exists(sequence_file(file_name, number)); number++) {
+      this->file_names.push_back(sequence_file(file_name, number));
+    }
+    int channels;
+    if (this->file_names.empty() ||
+        !stbi_info(this->file_names[0].c_str(), &this->width, &this->height, &channels)) {
+      throw std::string("Image sequence cannot be read: " + file_name);
+    }
+  }
+
+  this->thread = std::thread(&VideoSource::decode_loop, this);
+}
+
+VideoSource::~VideoSource() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopped = true;
+  }
+  this->queue_changed.notify_all();
+  this->thread.join();
+}
+
+size_t VideoSource::get_frame_count() const {
+  return this->frame_offsets.empty() ? this->file_names.size() : this->frame_offsets.size();
+}
+
+bool VideoSource::take_frame(double time, VideoFrame *frame) {
+  const size_t due = static_cast<size_t>(std::max(time, 0.0) * this->fps);
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->wanted_number = std::max(this->wanted_number, due);
+  if (this->taken_number > due) {
+    // The frame on screen is still the current one
+    return false;
+  }
+
+  // Only the newest frame that is due gets shown
+  while (this->queue.size() > 1 && this->queue[1].number <= due) {
+    this->queue.pop_front();
+    this->stats.dropped_frames++;
+  }
+  if (this->queue.empty() || this->queue.front().number > due) {
+    if (this->late_number != due) {
+      this->late_number = due;
+      this->stats.late_frames++;
+    }
+    return false;
+  }
+
+  *frame = std::move(this->queue.front());
+  this->queue.pop_front();
+  this->taken_number = frame->number + 1;
+  this->wanted_number = std::max(this->wanted_number, this->taken_number);
+  this->queue_changed.notify_one();
+  return true;
+}
+
+VideoStats VideoSource::get_stats() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->stats;
+}
+
+void VideoSource::decode_loop() {
+  size_t number = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->queue_changed.wait(lock, [this]() { return this->stopped || this->queue.size() < this->queue_capacity; });
+      if (this->stopped) {
+        return;
+      }
+      // Behind the player, the frames in between would only be dropped
+      if (number < this->wanted_number) {
+        this->stats.dropped_frames += this->wanted_number - number;
+        number = this->wanted_number;
+      }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    VideoFrame frame;
+    frame.number = number;
+    frame.width = this->width;
+    frame.height = this->height;
+    if (!this->decode_frame(number % this->get_frame_count(), &frame)) {
+      clear_frame(&frame);
+    }
+    const double milliseconds = milliseconds_since(start);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stats.decoded_frames++;
+    this->stats.decode_milliseconds += milliseconds;
+    this->queue.push_back(std::move(frame));
+    number++;
+  }
+}
+
+bool VideoSource::decode_frame(size_t index, VideoFrame *frame) {
+  if (this->file) {
+    const char *planes = this->file->data() + this->frame_offsets[index];
+    frame->planes.assign(planes, planes + frame->luma_bytes() + 2 * frame->chroma_bytes());
+    return true;
+  }
+
+  const Image image = decode_image(this->file_names[index]);
+  if (image.width != this->width || image.height != this->height) {
+    return false;
+  }
+  frame->planes.resize(frame->luma_bytes() + 2 * frame->chroma_bytes());
+  rgba_to_yuv420(image.pixels.data(), frame);
+  return true;
+}
+
+VideoTexture::VideoTexture(std::unique_ptr<VideoSource> source, size_t buffer_count)
+    : source(std::move(source)), buffers(std::max<size_t>(buffer_count, 1)) {
+  VideoFrame layout;
+  layout.width = this->source->get_width();
+  layout.height = this->source->get_height();
+  this->frame_bytes = layout.luma_bytes() + 2 * layout.chroma_bytes();
+
+  // Black until the first frame arrives
+  clear_frame(&layout);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glGenTextures(3, this->planes);
+  const uint8_t *plane = layout.planes.data();
+  for (int i = 0; i < 3; i++) {
+    const int width = i == 0 ? layout.width : layout.chroma_width();
+    const int height = i == 0 ? layout.height : layout.chroma_height();
+    glBindTexture(GL_TEXTURE_2D, this->planes[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, plane);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+    TextureResidency::shared().track_fixed(this->planes[i], i == 0 ? "video luma" : "video chroma",
+                                           i == 0 ? layout.luma_bytes() : layout.chroma_bytes());
+    plane += i == 0 ? layout.luma_bytes() : layout.chroma_bytes();
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  for (Buffer &buffer : this->buffers) {
+    glGenBuffers(1, &buffer.id);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(this->frame_bytes), nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+VideoTexture::~VideoTexture() {
+  for (Buffer &buffer : this->buffers) {
+    if (buffer.fence) {
+      glDeleteSync(buffer.fence);
+    }
+    glDeleteBuffers(1, &buffer.id);
+  }
+  for (GLuint plane : this->planes) {
+    TextureResidency::shared().untrack(plane);
+  }
+  glDeleteTextures(3, this->planes);
+}
+
+void VideoTexture::update(double time) {
+  Buffer &buffer = this->buffers[this->next_buffer];
+  if (buffer.fence) {
+    const GLenum status = glClientWaitSync(buffer.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      // The frame stays queued and may still make it in the next frame
+      this->buffer_stalls++;
+      return;
+    }
+    glDeleteSync(buffer.fence);
+    buffer.fence = nullptr;
+  }
+
+  VideoFrame frame;
+  if (!this->source->take_frame(time, &frame)) {
+    return;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+  // The GPU is done with the buffer, so mapping it needs no synchronization
+  void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(this->frame_bytes),
+                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+  if (!mapped) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return;
+  }
+  std::memcpy(mapped, frame.planes.data(), this->frame_bytes);
+
+  if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE) {
+    // With the buffer bound the pointers are offsets into it
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    size_t offset = 0;
+    for (int i = 0; i < 3; i++) {
+      const int width = i == 0 ? frame.width : frame.chroma_width();
+      const int height = i == 0 ? frame.height : frame.chroma_height();
+      glBindTexture(GL_TEXTURE_2D, this->planes[i]);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE,
+                      reinterpret_cast<const void *>(static_cast<uintptr_t>(offset)));
+      offset += i == 0 ? frame.luma_bytes() : frame.chroma_bytes();
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    this->frames_uploaded++;
+    this->bytes_uploaded += this->frame_bytes;
+    this->next_buffer = (this->next_buffer + 1) % this->buffers.size();
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  this->upload_milliseconds += milliseconds_since(start);
+}
+
+void VideoTexture::bind(GLuint first_unit) const {
+  for (GLuint i = 0; i < 3; i++) {
+    bind_texture(first_unit + i, GL_TEXTURE_2D, this->planes[i]);
+  }
+}
+
+VideoStats VideoTexture::get_stats() {
+  VideoStats stats = this->source->get_stats();
+  stats.uploaded_frames = this->frames_uploaded;
+  stats.uploaded_bytes = this->bytes_uploaded;
+  stats.upload_milliseconds = this->upload_milliseconds;
+  stats.buffer_stalls = this->buffer_stalls;
+  return stats;
+}
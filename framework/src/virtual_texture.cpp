@@ -0,0 +1,534 @@
+#include "virtual_texture.hpp"
+#include "mipmap.hpp"
+#include "texture.hpp"
+#include "texture_residency.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+constexpr uint32_t four_cc(char a, char b, char c, char d) {
+  return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) |
+         (static_cast<uint32_t>(d) << 24);
+}
+
+const uint32_t page_file_magic = four_cc('P', 'G', 'S', '1');
+/// The pages start on a boundary of memory pages, so every page of the file is mapped in as few of them as possible
+const size_t page_data_alignment = 4096;
+
+struct PageFileHeader {
+  uint32_t magic;
+  uint32_t page_size;
+  uint32_t page_border;
+  uint32_t mip_settings;
+  uint64_t source_size;
+  int64_t source_time;
+  int32_t width;
+  int32_t height;
+  int32_t level_count;
+  int32_t reserved;
+};
+
+static_assert(sizeof(PageFileHeader) == 48, "PageFileHeader must match the file layout");
+
+int pages_across(int size, int level) {
+  const int64_t span = int64_t(PageFile::page_content) << level;
+  return static_cast<int>((size + span - 1) / span);
+}
+
+int count_levels(int width, int height) {
+  int level = 0;
+  while (pages_across(width, level) > 1 || pages_across(height, level) > 1) {
+    level++;
+  }
+  return level + 1;
+}
+
+/// Texel of a mirrored repeat of 'size' texels
+int mirror(int x, int size) {
+  const int period = 2 * size;
+  int wrapped = x % period;
+  if (wrapped < 0) {
+    wrapped += period;
+  }
+  return wrapped < size ? wrapped : period - 1 - wrapped;
+}
+
+/// Copies the page with its border out of the level
+void fill_page(const Image &level, int page_x, int page_y, uint8_t *page) {
+  for (int j = 0; j < PageFile::page_size; j++) {
+    const int y = mirror(page_y * PageFile::page_content + j - PageFile::page_border, level.height);
+    const uint8_t *row = level.pixels.data() + size_t(y) * level.width * 4;
+    uint8_t *destination = page + size_t(j) * PageFile::page_size * 4;
+    for (int i = 0; i < PageFile::page_size; i++) {
+      const int x = mirror(page_x * PageFile::page_content + i - PageFile::page_border, level.width);
+      std::memcpy(destination + i * 4, row + x * 4, 4);
+    }
+  }
+}
+
+void build_page_file(const std::string &image_file_name, const std::string &file_name, uint64_t source_size,
+                     int64_t source_time, ThreadPool &pool) {
+  const Image image = decode_image(image_file_name);
+  if (image.empty()) {
+    throw std::string("Image cannot be read");
+  }
+  const MipSettings settings;
+  const std::vector<Image> mips = generate_mipmaps(image, settings, pool);
+
+  PageFileHeader header = {};
+  header.magic = page_file_magic;
+  header.page_size = PageFile::page_size;
+  header.page_border = PageFile::page_border;
+  header.mip_settings = mip_settings_key(settings);
+  header.source_size = source_size;
+  header.source_time = source_time;
+  header.width = image.width;
+  header.height = image.height;
+  header.level_count = count_levels(image.width, image.height);
+
+  // Write into a temporary file first so a crash never leaves a half written file behind
+  const std::string temporary_path = temporary_path_for(file_name);
+  {
+    std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+    std::vector<char> start(page_data_alignment, 0);
+    std::memcpy(start.data(), &header, sizeof(header));
+    out.write(start.data(), static_cast<std::streamsize>(start.size()));
+
+    // One row of pages at a time, its pages are filled concurrently
+    for (int level = 0; level < header.level_count; level++) {
+      const Image &source = level == 0 ? image : mips[level - 1];
+      const int pages_x = pages_across(image.width, level);
+      std::vector<uint8_t> row(pages_x * PageFile::page_bytes);
+      for (int y = 0; y < pages_across(image.height, level); y++) {
+        pool.parallel_for(pages_x, [&](size_t x) {
+          fill_page(source, static_cast<int>(x), y, row.data() + x * PageFile::page_bytes);
+        });
+        out.write(reinterpret_cast<const char *>(row.data()), static_cast<std::streamsize>(row.size()));
+      }
+    }
+    if (!out) {
+      std::remove(temporary_path.c_str());
+      throw std::string("Page file cannot be written: " + file_name);
+    }
+  }
+
+  if (!replace_file(temporary_path, file_name)) {
+    throw std::string("Page file cannot be written: " + file_name);
+  }
+}
+
+} // namespace
+
+std::shared_ptr<PageFile> PageFile::open_for(const std::string &image_file_name, ThreadPool &pool) {
+  uint64_t source_size;
+  int64_t source_time;
+  if (!get_file_info(image_file_name, &source_size, &source_time)) {
+    throw std::string("Image not found: " + image_file_name);
+  }
+
+  const std::string file_name = path_for(image_file_name);
+  uint64_t size;
+  int64_t time;
+  if (get_file_info(file_name, &size, &time)) {
+    std::shared_ptr<PageFile> file(new PageFile(std::unique_ptr<MappedFile>(new MappedFile(file_name))));
+    if (file->parse(source_size, source_time)) {
+      return file;
+    }
+  }
+
+  build_page_file(image_file_name, file_name, source_size, source_time, pool);
+  std::shared_ptr<PageFile> file(new PageFile(std::unique_ptr<MappedFile>(new MappedFile(file_name))));
+  if (!file->parse(source_size, source_time)) {
+    throw std::string("Page file is broken: " + file_name);
+  }
+  return file;
+}
+
+bool PageFile::parse(uint64_t source_size, int64_t source_time) {
+  PageFileHeader header;
+  if (this->file->size() < page_data_alignment) {
+    return false;
+  }
+  std::memcpy(&header, this->file->data(), sizeof(header));
+  if (header.magic != page_file_magic || header.page_size != uint32_t(page_size) ||
+      header.page_border != uint32_t(page_border) || header.mip_settings != mip_settings_key(MipSettings()) ||
+      header.source_size != source_size || header.source_time != source_time || header.width <= 0 ||
+      header.height <= 0 || header.level_count != count_levels(header.width, header.height)) {
+    return false;
+  }
+
+  this->width = header.width;
+  this->height = header.height;
+  this->level_count = header.level_count;
+  this->page_offsets.assign(1, 0);
+  for (int level = 0; level < this->level_count; level++) {
+    this->page_offsets.push_back(this->page_offsets.back() +
+                                 size_t(this->get_pages_x(level)) * this->get_pages_y(level));
+  }
+  this->data_offset = page_data_alignment;
+  return this->file->size() >= this->data_offset + this->get_total_bytes();
+}
+
+int PageFile::get_pages_x(int level) const { return pages_across(this->width, level); }
+
+int PageFile::get_pages_y(int level) const { return pages_across(this->height, level); }
+
+const uint8_t *PageFile::get_page(int level, int x, int y) const {
+  const size_t index = this->page_offsets[level] + size_t(y) * this->get_pages_x(level) + x;
+  return reinterpret_cast<const uint8_t *>(this->file->data()) + this->data_offset + index * page_bytes;
+}
+
+std::ostream &operator<<(std::ostream &out, const PageCacheStats &stats) {
+  out << "pages: " << stats.resident_pages << " of " << stats.capacity << " resident, requests: "
+      << stats.requested_pages << ", page faults: " << stats.page_faults << ", loads: " << stats.loaded_pages
+      << ", evictions: " << stats.evicted_pages << ", full frames: " << stats.full_frames;
+  return out;
+}
+
+PageCache::PageCache(std::shared_ptr<const PageFile> file, size_t capacity)
+    : file(std::move(file)), slots(std::max<size_t>(capacity, 1)) {
+  // The coarsest page takes the first slot for good
+  const uint32_t coarsest = key(this->file->get_level_count() - 1, 0, 0);
+  this->slots[0].key = coarsest;
+  this->slots[0].used = true;
+  this->resident[coarsest] = 0;
+}
+
+void PageCache::request(int level, int x, int y) {
+  if (level < 0 || level >= this->file->get_level_count()) {
+    return;
+  }
+  x = std::min(std::max(x, 0), this->file->get_pages_x(level) - 1);
+  y = std::min(std::max(y, 0), this->file->get_pages_y(level) - 1);
+
+  for (int l = level; l < this->file->get_level_count(); l++, x /= 2, y /= 2) {
+    const uint32_t page = key(l, x, y);
+    if (!this->requested.insert(page).second) {
+      // Its ancestors are marked already
+      break;
+    }
+    if (l == level) {
+      this->stats.requested_pages++;
+    }
+    const auto found = this->resident.find(page);
+    if (found != this->resident.end()) {
+      this->slots[found->second].last_used = this->frame;
+    } else {
+      this->missing.push_back(page);
+      this->stats.page_faults++;
+    }
+  }
+}
+
+std::vector<PageCache::Load> PageCache::update(size_t max_pages) {
+  std::vector<Load> loads;
+  if (!this->coarsest_loaded) {
+    loads.push_back({this->file->get_level_count() - 1, 0, 0, 0});
+    this->stats.loaded_pages++;
+    this->coarsest_loaded = true;
+  }
+
+  // Coarse pages first, they stand in for the most texels
+  std::sort(this->missing.begin(), this->missing.end(), [](uint32_t a, uint32_t b) {
+    return (a >> 28) != (b >> 28) ? (a >> 28) > (b >> 28) : a < b;
+  });
+  size_t loaded = 0;
+  for (uint32_t page : this->missing) {
+    if (loaded == max_pages) {
+      break;
+    }
+
+    size_t slot = this->slots.size();
+    for (size_t i = 1; i < this->slots.size(); i++) {
+      if (!this->slots[i].used) {
+        slot = i;
+        break;
+      }
+      if (this->slots[i].last_used < this->frame &&
+          (slot == this->slots.size() || this->slots[i].last_used < this->slots[slot].last_used)) {
+        slot = i;
+      }
+    }
+    if (slot == this->slots.size()) {
+      this->stats.full_frames++;
+      break;
+    }
+
+    Slot &target = this->slots[slot];
+    if (target.used) {
+      this->resident.erase(target.key);
+      this->stats.evicted_pages++;
+    }
+    target.key = page;
+    target.used = true;
+    target.last_used = this->frame;
+    this->resident[page] = slot;
+    loads.push_back({int(page >> 28), int(page & 0x3fff), int((page >> 14) & 0x3fff), slot});
+    this->stats.loaded_pages++;
+    loaded++;
+  }
+
+  this->missing.clear();
+  this->requested.clear();
+  this->frame++;
+  return loads;
+}
+
+void PageCache::build_indirection(int slots_across, const std::vector<int> &across, const std::vector<int> &down,
+                                  std::vector<std::vector<uint8_t>> *levels) const {
+  const int level_count = this->file->get_level_count();
+  levels->resize(level_count);
+  for (int level = level_count - 1; level >= 0; level--) {
+    std::vector<uint8_t> &texels = (*levels)[level];
+    texels.assign(size_t(across[level]) * down[level] * 4, 0);
+    for (int y = 0; y < this->file->get_pages_y(level); y++) {
+      for (int x = 0; x < this->file->get_pages_x(level); x++) {
+        uint8_t *texel = texels.data() + (size_t(y) * across[level] + x) * 4;
+        const auto found = this->resident.find(key(level, x, y));
+        if (found != this->resident.end()) {
+          texel[0] = static_cast<uint8_t>(found->second % slots_across);
+          texel[1] = static_cast<uint8_t>(found->second / slots_across);
+          texel[2] = static_cast<uint8_t>(level);
+          texel[3] = 255;
+        } else {
+          const std::vector<uint8_t> &parent = (*levels)[level + 1];
+          std::memcpy(texel, parent.data() + (size_t(y / 2) * across[level + 1] + x / 2) * 4, 4);
+        }
+      }
+    }
+  }
+}
+
+PageCacheStats PageCache::get_stats() const {
+  PageCacheStats stats = this->stats;
+  stats.resident_pages = this->resident.size();
+  stats.capacity = this->slots.size();
+  return stats;
+}
+
+VirtualTexture::VirtualTexture(std::shared_ptr<const PageFile> file, int slots_across)
+    : cache(file, size_t(slots_across) * slots_across), slots_across(slots_across) {
+  glGenTextures(1, &this->physical);
+  glBindTexture(GL_TEXTURE_2D, this->physical);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, this->get_physical_size(), this->get_physical_size(), 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  int across = 1, down = 1;
+  while (across < file->get_pages_x(0)) {
+    across *= 2;
+  }
+  while (down < file->get_pages_y(0)) {
+    down *= 2;
+  }
+  glGenTextures(1, &this->indirection);
+  glBindTexture(GL_TEXTURE_2D, this->indirection);
+  for (int level = 0; level < file->get_level_count(); level++) {
+    this->indirection_across.push_back(std::max(1, across >> level));
+    this->indirection_down.push_back(std::max(1, down >> level));
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, this->indirection_across.back(), this->indirection_down.back(), 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, file->get_level_count() - 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  const size_t physical_memory = size_t(this->get_physical_size()) * this->get_physical_size() * 4;
+  TextureResidency::shared().track_fixed(this->physical, "virtual texture pages", physical_memory);
+  TextureResidency::shared().track_fixed(this->indirection, "virtual texture indirection",
+                                         this->get_memory() - physical_memory);
+
+  // Loads the coarsest page
+  this->update(0);
+}
+
+VirtualTexture::~VirtualTexture() {
+  TextureResidency::shared().untrack(this->physical);
+  TextureResidency::shared().untrack(this->indirection);
+  glDeleteTextures(1, &this->physical);
+  glDeleteTextures(1, &this->indirection);
+}
+
+void VirtualTexture::update(size_t max_pages) {
+  const std::vector<PageCache::Load> loads = this->cache.update(max_pages);
+  if (loads.empty()) {
+    return;
+  }
+
+  glBindTexture(GL_TEXTURE_2D, this->physical);
+  for (const PageCache::Load &load : loads) {
+    const int x = static_cast<int>(load.slot % this->slots_across) * PageFile::page_size;
+    const int y = static_cast<int>(load.slot / this->slots_across) * PageFile::page_size;
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, PageFile::page_size, PageFile::page_size, GL_RGBA, GL_UNSIGNED_BYTE,
+                    this->get_file().get_page(load.level, load.x, load.y));
+  }
+
+  std::vector<std::vector<uint8_t>> levels;
+  this->cache.build_indirection(this->slots_across, this->indirection_across, this->indirection_down, &levels);
+  glBindTexture(GL_TEXTURE_2D, this->indirection);
+  for (size_t level = 0; level < levels.size(); level++) {
+    glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), 0, 0, this->indirection_across[level],
+                    this->indirection_down[level], GL_RGBA, GL_UNSIGNED_BYTE, levels[level].data());
+  }
+}
+
+void VirtualTexture::bind(GLuint physical_unit, GLuint indirection_unit) const {
+  bind_texture(physical_unit, GL_TEXTURE_2D, this->physical);
+  bind_texture(indirection_unit, GL_TEXTURE_2D, this->indirection);
+}
+
+size_t VirtualTexture::get_memory() const {
+  size_t memory = size_t(this->get_physical_size()) * this->get_physical_size() * 4;
+  for (size_t level = 0; level < this->indirection_across.size(); level++) {
+    memory += size_t(this->indirection_across[level]) * this->indirection_down[level] * 4;
+  }
+  return memory;
+}
+
+VirtualTextureFeedback::VirtualTextureFeedback(int divisor, size_t buffer_count)
+    : divisor(std::max(divisor, 1)), buffers(std::max<size_t>(buffer_count, 1)) {
+  glGenFramebuffers(1, &this->framebuffer);
+  glGenRenderbuffers(1, &this->color);
+  glGenRenderbuffers(1, &this->depth);
+  for (Buffer &buffer : this->buffers) {
+    glGenBuffers(1, &buffer.id);
+  }
+}
+
+VirtualTextureFeedback::~VirtualTextureFeedback() {
+  for (Buffer &buffer : this->buffers) {
+    if (buffer.fence) {
+      glDeleteSync(buffer.fence);
+    }
+    glDeleteBuffers(1, &buffer.id);
+  }
+  glDeleteRenderbuffers(1, &this->color);
+  glDeleteRenderbuffers(1, &this->depth);
+  glDeleteFramebuffers(1, &this->framebuffer);
+}
+
+void VirtualTextureFeedback::resize(int width, int height) {
+  this->width = width;
+  this->height = height;
+
+  glBindRenderbuffer(GL_RENDERBUFFER, this->color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, this->depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depth);
+
+  // Read-backs of the old size are dropped
+  for (Buffer &buffer : this->buffers) {
+    if (buffer.fence) {
+      glDeleteSync(buffer.fence);
+      buffer.fence = nullptr;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.id);
+    glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(width) * height * 4, nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void VirtualTextureFeedback::begin(int window_width, int window_height) {
+  this->window_width = window_width;
+  this->window_height = window_height;
+  glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+  const int width = std::max(1, window_width / this->divisor);
+  const int height = std::max(1, window_height / this->divisor);
+  if (width != this->width || height != this->height) {
+    this->resize(width, height);
+  }
+
+  glViewport(0, 0, this->width, this->height);
+  this->blend_enabled = glIsEnabled(GL_BLEND);
+  glDisable(GL_BLEND);
+  GLfloat clear_color[4];
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+  glClearColor(0.f, 0.f, 0.f, 0.f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+}
+
+void VirtualTextureFeedback::end() {
+  // An unread result in the buffer is too old by now
+  Buffer &buffer = this->buffers[this->next_buffer];
+  if (buffer.fence) {
+    glDeleteSync(buffer.fence);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.id);
+  glReadPixels(0, 0, this->width, this->height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  buffer.size = size_t(this->width) * this->height * 4;
+  this->next_buffer = (this->next_buffer + 1) % this->buffers.size();
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(0, 0, this->window_width, this->window_height);
+  if (this->blend_enabled) {
+    glEnable(GL_BLEND);
+  }
+}
+
+bool VirtualTextureFeedback::read(std::vector<PageRequest> *requests) {
+  // The oldest read-back follows the one written last
+  Buffer *oldest = nullptr;
+  for (size_t i = 0; i < this->buffers.size() && !oldest; i++) {
+    Buffer &buffer = this->buffers[(this->next_buffer + i) % this->buffers.size()];
+    if (buffer.fence) {
+      oldest = &buffer;
+    }
+  }
+  if (!oldest) {
+    return false;
+  }
+  const GLenum status = glClientWaitSync(oldest->fence, 0, 0);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+    return false;
+  }
+  glDeleteSync(oldest->fence);
+  oldest->fence = nullptr;
+
+  std::unordered_set<uint32_t> texels;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, oldest->id);
+  const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(oldest->size),
+                                        GL_MAP_READ_BIT);
+  if (mapped) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(mapped);
+    for (size_t i = 0; i < oldest->size; i += 4) {
+      if (bytes[i + 3] != 0) {
+        uint32_t texel;
+        std::memcpy(&texel, bytes + i, 4);
+        texels.insert(texel);
+      }
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  requests->clear();
+  for (uint32_t texel : texels) {
+    uint8_t bytes[4];
+    std::memcpy(bytes, &texel, 4);
+    PageRequest request;
+    request.texture = (bytes[3] >> 4) - 1;
+    request.level = bytes[3] & 15;
+    request.x = bytes[0] | (bytes[2] & 15) << 8;
+    request.y = bytes[1] | (bytes[2] >> 4) << 8;
+    requests->push_back(request);
+  }
+  return true;
+}
+
+float VirtualTextureFeedback::get_level_bias() const { return -std::log2(float(this->divisor)); }
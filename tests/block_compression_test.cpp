@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "block_compression.hpp"
+
+// Checks the BC1 and BC3 encoders on generated blocks and images:
+//  - the SSE2 and the scalar index search give the same bytes for every block, including random blocks, solid
+//    colors, gradients and blocks whose pixels lie halfway between two palette entries,
+//  - compress_image gives the same bytes with both paths, with one and with many threads, at odd image sizes,
+//  - decoded blocks stay close to the input: solid colors within the RGB565 rounding, BC1 is opaque, BC3 keeps
+//    two alpha values exactly, and gradients keep a minimum PSNR.
+// Exits with 1 after printing the failures.
+// Usage: block_compression_test
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+/// Small linear congruential generator, so the blocks are the same on every platform
+uint32_t next_random(uint32_t *state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+using Block = std::vector<uint8_t>;
+
+std::vector<std::pair<std::string, Block>> make_blocks() {
+  std::vector<std::pair<std::string, Block>> blocks;
+  uint32_t state = 1;
+  for (int b = 0; b < 200; b++) {
+    Block block(64);
+    for (uint8_t &value : block) {
+      value = static_cast<uint8_t>(next_random(&state));
+    }
+    blocks.emplace_back("random block " + std::to_string(b), block);
+  }
+
+  for (int c = 0; c < 16; c++) {
+    Block block(64);
+    for (int p = 0; p < 16; p++) {
+      const uint8_t rgba[4] = {uint8_t(17 * c), uint8_t(255 - 13 * c), uint8_t(40 + 7 * c), 255};
+      std::memcpy(block.data() + 4 * p, rgba, 4);
+    }
+    blocks.emplace_back("solid block " + std::to_string(c), block);
+  }
+
+  // Gradients along x, y and the diagonal, with alpha ramps for BC3
+  for (int direction = 0; direction < 3; direction++) {
+    Block block(64);
+    for (int p = 0; p < 16; p++) {
+      const int x = p % 4, y = p / 4;
+      const int t = direction == 0 ? x : direction == 1 ? y : (x + y) / 2;
+      const uint8_t rgba[4] = {uint8_t(40 + 50 * t), uint8_t(200 - 30 * t), uint8_t(60 + 20 * t), uint8_t(85 * t)};
+      std::memcpy(block.data() + 4 * p, rgba, 4);
+    }
+    blocks.emplace_back("gradient block " + std::to_string(direction), block);
+  }
+
+  // Two colors and the colors halfway between them, where the search has to break ties the same way
+  for (int b = 0; b < 8; b++) {
+    Block block(64);
+    const int low = 8 * b, high = 255 - 8 * b;
+    for (int p = 0; p < 16; p++) {
+      const int value = p % 3 == 0 ? low : p % 3 == 1 ? high : (low + high) / 2;
+      const uint8_t rgba[4] = {uint8_t(value), uint8_t(value), uint8_t(255 - value), uint8_t(p < 8 ? 0 : 255)};
+      std::memcpy(block.data() + 4 * p, rgba, 4);
+    }
+    blocks.emplace_back("tie block " + std::to_string(b), block);
+  }
+  return blocks;
+}
+
+/// Smooth color and alpha ramps with some noise, as in a photographed texture. The slopes do not depend on the
+/// size, so small images are as smooth as large ones.
+std::vector<uint8_t> make_image(int width, int height, uint32_t seed) {
+  std::vector<uint8_t> rgba(size_t(width) * height * 4);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint8_t *pixel = rgba.data() + 4 * (size_t(y) * width + x);
+      const int noise = static_cast<int>(next_random(&seed) % 9) - 4;
+      pixel[0] = static_cast<uint8_t>(std::min(255, std::max(0, 40 + 3 * x + noise)));
+      pixel[1] = static_cast<uint8_t>(std::min(255, std::max(0, 200 - 2 * y - noise)));
+      pixel[2] = static_cast<uint8_t>(std::min(255, std::max(0, 128 + (x - y) + noise)));
+      pixel[3] = static_cast<uint8_t>(std::min(255, 2 * (x + y)));
+    }
+  }
+  return rgba;
+}
+
+void check_block(const std::string &name, const Block &block) {
+  uint8_t bc1_scalar[8], bc1_simd[8], bc3_scalar[16], bc3_simd[16];
+  encode_bc1_block(block.data(), bc1_scalar, false);
+  encode_bc1_block(block.data(), bc1_simd, true);
+  encode_bc3_block(block.data(), bc3_scalar, false);
+  encode_bc3_block(block.data(), bc3_simd, true);
+  check(std::memcmp(bc1_scalar, bc1_simd, sizeof(bc1_scalar)) == 0, name, "BC1 differs between SSE2 and scalar");
+  check(std::memcmp(bc3_scalar, bc3_simd, sizeof(bc3_scalar)) == 0, name, "BC3 differs between SSE2 and scalar");
+  // The color part of BC3 is a BC1 block
+  check(std::memcmp(bc3_scalar + 8, bc1_scalar, sizeof(bc1_scalar)) == 0, name, "BC3 colors differ from BC1");
+
+  uint8_t decoded[64];
+  decode_bc1_block(bc1_scalar, decoded);
+  bool opaque = true;
+  for (int p = 0; p < 16; p++) {
+    opaque = opaque && decoded[4 * p + 3] == 255;
+  }
+  check(opaque, name, "BC1 decodes with transparency");
+}
+
+} // namespace
+
+int main() {
+  size_t checked = 0;
+  for (const auto &named : make_blocks()) {
+    const std::string &name = named.first;
+    const Block &block = named.second;
+    check_block(name, block);
+    checked++;
+
+    if (name.compare(0, 5, "solid") == 0) {
+      // A solid color stays within the rounding of RGB565: 4 steps of 255 in 5 bits and 2 steps in 6 bits
+      uint8_t encoded[8], decoded[64];
+      encode_bc1_block(block.data(), encoded);
+      decode_bc1_block(encoded, decoded);
+      bool close = true;
+      for (int p = 0; p < 16; p++) {
+        close = close && std::abs(decoded[4 * p] - block[4 * p]) <= 4 &&
+                std::abs(decoded[4 * p + 1] - block[4 * p + 1]) <= 2 &&
+                std::abs(decoded[4 * p + 2] - block[4 * p + 2]) <= 4;
+      }
+      check(close, name, "decodes to another color");
+    } else if (name.compare(0, 3, "tie") == 0) {
+      // Two alpha values are the endpoints of the alpha block, so they come back exactly
+      uint8_t encoded[16], decoded[64];
+      encode_bc3_block(block.data(), encoded);
+      decode_bc3_block(encoded, decoded);
+      bool same_alpha = true;
+      for (int p = 0; p < 16; p++) {
+        same_alpha = same_alpha && decoded[4 * p + 3] == block[4 * p + 3];
+      }
+      check(same_alpha, name, "alpha changed");
+    }
+  }
+
+  ThreadPool single_thread(1);
+  const int sizes[][2] = {{1, 1}, {3, 5}, {4, 4}, {37, 19}, {64, 33}};
+  for (const auto &size : sizes) {
+    const int width = size[0], height = size[1];
+    const std::vector<uint8_t> rgba = make_image(width, height, uint32_t(width * 31 + height));
+    for (BlockFormat format : {BlockFormat::BC1, BlockFormat::BC3}) {
+      const std::string name = std::string(format == BlockFormat::BC1 ? "BC1 " : "BC3 ") + std::to_string(width) +
+                               "x" + std::to_string(height);
+      const std::vector<uint8_t> scalar = compress_image(rgba.data(), width, height, format, single_thread, false);
+      const std::vector<uint8_t> simd =
+          compress_image(rgba.data(), width, height, format, ThreadPool::shared(), true);
+      check(scalar.size() == compressed_size(format, width, height), name,
+            std::to_string(scalar.size()) + " bytes");
+      check(scalar == simd, name, "differs between SSE2 on the shared pool and scalar on one thread");
+
+      const std::vector<uint8_t> decoded = decompress_image(simd.data(), width, height, format);
+      const double psnr = compute_psnr(rgba.data(), decoded.data(), size_t(width) * height);
+      check(psnr > 30.0, name, "PSNR of " + std::to_string(psnr) + " dB");
+      if (format == BlockFormat::BC3) {
+        const double alpha_psnr = compute_psnr(rgba.data(), decoded.data(), size_t(width) * height, 4);
+        check(alpha_psnr > 30.0, name, "PSNR with alpha of " + std::to_string(alpha_psnr) + " dB");
+      }
+      checked++;
+    }
+  }
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << checked << " blocks and images checked" << std::endl;
+  return 0;
+}
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "dds.hpp"
+
+// Checks that DdsFile reads back what it wrote and rejects the files it must not use:
+//  - 2D textures of every format and a cubemap open with their size, format and the bytes of every level,
+//  - files of changed source images or of other parameters are stale, files without the record are not,
+//  - every truncation, a wrong magic or header size, empty, too large and volume textures, unknown formats and
+//    cubemaps with missing faces are rejected,
+//  - with any single header byte flipped the file is either rejected or its levels still lie within it.
+// Exits with 1 after printing the failures.
+// Usage: dds_test
+
+namespace {
+
+const std::string dds_file = "dds_test.dds";
+const std::string image_file = "dds_test.tga";
+
+/// Byte offsets of the header fields in the file, after the magic
+const size_t header_size_offset = 4;
+const size_t flags_offset = 8;
+const size_t height_offset = 12;
+const size_t width_offset = 16;
+const size_t mip_map_count_offset = 28;
+const size_t pixel_flags_offset = 80;
+const size_t four_cc_offset = 84;
+const size_t bit_masks_offset = 92;
+const size_t caps2_offset = 112;
+const size_t data_offset = 128;
+
+int failures = 0;
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+std::vector<char> read_bytes(const std::string &file_name) {
+  std::ifstream file(file_name, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void write_bytes(const std::string &file_name, const std::vector<char> &bytes) {
+  std::ofstream file(file_name, std::ios::binary | std::ios::trunc);
+  file.write(bytes.data(), bytes.size());
+}
+
+void set_word(std::vector<char> *bytes, size_t offset, uint32_t value) {
+  std::memcpy(bytes->data() + offset, &value, sizeof(value));
+}
+
+uint32_t get_word(const std::vector<char> &bytes, size_t offset) {
+  uint32_t value;
+  std::memcpy(&value, bytes.data() + offset, sizeof(value));
+  return value;
+}
+
+std::string format_name(DdsFormat format) {
+  const char *names[] = {"BC1", "BC3", "RGBA8", "BGRA8", "RGB8", "RG8", "R8"};
+  return names[static_cast<int>(format)];
+}
+
+/// Mip chain down to 1x1 with every byte numbered, so a level read from the wrong offset shows
+std::vector<std::vector<uint8_t>> make_levels(DdsFormat format, int width, int height, size_t faces) {
+  std::vector<std::vector<uint8_t>> levels;
+  uint8_t value = 0;
+  for (size_t face = 0; face < faces; face++) {
+    for (int w = width, h = height;; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+      const size_t size = is_block_compressed(format)
+                              ? size_t((w + 3) / 4) * ((h + 3) / 4) * (format == DdsFormat::BC1 ? 8 : 16)
+                              : size_t(w) * h * pixel_bytes(format);
+      std::vector<uint8_t> level(size);
+      for (uint8_t &byte : level) {
+        byte = value++;
+      }
+      levels.push_back(level);
+      if (w == 1 && h == 1) {
+        break;
+      }
+    }
+  }
+  return levels;
+}
+
+void check_contents(const std::string &name, const DdsFile *file, DdsFormat format, int width, int height,
+                    const std::vector<std::vector<uint8_t>> &levels, bool cubemap) {
+  check(file != nullptr, name, "written file does not open");
+  if (!file) {
+    return;
+  }
+  check(file->get_format() == format && file->get_width() == width && file->get_height() == height &&
+            file->is_cubemap() == cubemap,
+        name, "opens as " + format_name(file->get_format()) + " " + std::to_string(file->get_width()) + "x" +
+                  std::to_string(file->get_height()));
+  const size_t faces = cubemap ? 6 : 1;
+  const size_t level_count = levels.size() / faces;
+  for (size_t face = 0; face < (file->is_cubemap() ? 6 : 1); face++) {
+    const std::vector<DdsFile::Level> &read = file->get_levels(face);
+    check(read.size() == level_count, name, std::to_string(read.size()) + " levels");
+    for (size_t i = 0; i < std::min(read.size(), level_count); i++) {
+      const std::vector<uint8_t> &level = levels[face * level_count + i];
+      check(read[i].width == std::max(1, width >> i) && read[i].height == std::max(1, height >> i) &&
+                read[i].size == level.size() && std::equal(level.begin(), level.end(), read[i].data),
+            name, "face " + std::to_string(face) + " level " + std::to_string(i) + " changed");
+    }
+  }
+}
+
+/// Whether the levels of an accepted file lie within its 'file_size' bytes and have the sizes of their format.
+/// Touches every byte, so a level past the mapping faults here rather than in an upload.
+bool consistent(const DdsFile &file, size_t file_size) {
+  if (file.get_width() <= 0 || file.get_height() <= 0 || file.get_width() > 65536 || file.get_height() > 65536) {
+    return false;
+  }
+  size_t total = data_offset;
+  unsigned sum = 0;
+  for (size_t face = 0; face < (file.is_cubemap() ? 6 : 1); face++) {
+    for (const DdsFile::Level &level : file.get_levels(face)) {
+      const size_t size = is_block_compressed(file.get_format())
+                              ? size_t((level.width + 3) / 4) * ((level.height + 3) / 4) *
+                                    (file.get_format() == DdsFormat::BC1 ? 8 : 16)
+                              : size_t(level.width) * level.height * pixel_bytes(file.get_format());
+      total += level.size;
+      if (level.size != size || total > file_size) {
+        return false;
+      }
+      for (size_t i = 0; i < level.size; i++) {
+        sum += level.data[i];
+      }
+    }
+  }
+  // Keeps the reads from being optimized away
+  return sum != 0xffffffffu;
+}
+
+void check_rejected(const std::string &name, const std::vector<char> &bytes) {
+  write_bytes(dds_file, bytes);
+  check(!DdsFile::open(dds_file), name, "opens");
+}
+
+} // namespace
+
+int main() {
+  size_t checked = 0;
+  std::remove(DdsFile::path_for(image_file).c_str());
+  std::remove(dds_file.c_str());
+
+  // Odd sizes leave partial blocks and levels that stop shrinking in one direction first
+  for (DdsFormat format : {DdsFormat::BC1, DdsFormat::BC3, DdsFormat::RGBA8, DdsFormat::BGRA8, DdsFormat::RGB8,
+                           DdsFormat::RG8, DdsFormat::R8}) {
+    const std::vector<std::vector<uint8_t>> levels = make_levels(format, 13, 6, 1);
+    const std::string name = format_name(format) + " 13x6";
+    check(DdsFile::write(dds_file, format, 13, 6, levels), name, "not written");
+    check_contents(name, DdsFile::open(dds_file).get(), format, 13, 6, levels, false);
+    checked++;
+  }
+  const std::vector<std::vector<uint8_t>> single = make_levels(DdsFormat::RGBA8, 1, 1, 1);
+  check(DdsFile::write(dds_file, DdsFormat::RGBA8, 1, 1, single), "RGBA8 1x1", "not written");
+  check_contents("RGBA8 1x1", DdsFile::open(dds_file).get(), DdsFormat::RGBA8, 1, 1, single, false);
+  checked++;
+
+  const std::vector<std::vector<uint8_t>> cube_levels = make_levels(DdsFormat::BC1, 8, 8, 6);
+  check(DdsFile::write(dds_file, DdsFormat::BC1, 8, 8, cube_levels, {}, true), "BC1 cubemap", "not written");
+  check_contents("BC1 cubemap", DdsFile::open(dds_file).get(), DdsFormat::BC1, 8, 8, cube_levels, true);
+  checked++;
+  const std::vector<char> cube_bytes = read_bytes(dds_file);
+  std::vector<char> missing_face = cube_bytes;
+  set_word(&missing_face, caps2_offset, get_word(cube_bytes, caps2_offset) & ~0x8000u);
+  check_rejected("cubemap without a face", missing_face);
+
+  // The record of the source image makes the file stale once the image changes, but only for its own parameters
+  const std::vector<std::vector<uint8_t>> levels = make_levels(DdsFormat::BC3, 16, 16, 1);
+  const std::string source_file = DdsFile::path_for(image_file);
+  write_bytes(image_file, std::vector<char>(100, 'x'));
+  check(DdsFile::write(source_file, DdsFormat::BC3, 16, 16, levels, {image_file}, false, 5), source_file,
+        "not written");
+  check_contents(source_file, DdsFile::open_for(image_file, 5).get(), DdsFormat::BC3, 16, 16, levels, false);
+  check(!DdsFile::open_for(image_file, 6), source_file, "opens for other parameters");
+  check(!DdsFile::open_for_cubemap(std::vector<std::string>(6, image_file), 5), source_file, "opens as a cubemap");
+  write_bytes(image_file, std::vector<char>(101, 'x'));
+  check(!DdsFile::open_for(image_file, 5), source_file, "opens for a changed image");
+  check(DdsFile::open(source_file) != nullptr, source_file, "does not open without the source images");
+  std::remove(source_file.c_str());
+  checked++;
+
+  check(DdsFile::write(dds_file, DdsFormat::BC3, 16, 16, levels), dds_file, "not written");
+  const std::vector<char> bytes = read_bytes(dds_file);
+  // dds_test.dds is also the container next to dds_test.tga as other tools name it, they write no record
+  check(DdsFile::open_for(image_file, 7) != nullptr, image_file, "does not open the file of another tool");
+
+  size_t truncations = 0;
+  for (size_t size = 0; size < bytes.size(); size++) {
+    check_rejected("file truncated to " + std::to_string(size) + " bytes", std::vector<char>(bytes.begin(),
+                                                                                            bytes.begin() + size));
+    truncations++;
+  }
+
+  std::vector<char> broken = bytes;
+  broken[0] = 'X';
+  check_rejected("wrong magic", broken);
+  broken = bytes;
+  set_word(&broken, header_size_offset, 128);
+  check_rejected("wrong header size", broken);
+  for (uint32_t width : {0u, 65537u, 0x80000000u}) {
+    broken = bytes;
+    set_word(&broken, width_offset, width);
+    check_rejected("width " + std::to_string(width), broken);
+    broken = bytes;
+    set_word(&broken, height_offset, width);
+    check_rejected("height " + std::to_string(width), broken);
+  }
+  broken = bytes;
+  set_word(&broken, caps2_offset, 0x200000);
+  check_rejected("volume texture", broken);
+  broken = bytes;
+  std::memcpy(broken.data() + four_cc_offset, "DXT3", 4);
+  check_rejected("DXT3", broken);
+  broken = bytes;
+  set_word(&broken, mip_map_count_offset, 0xffffffffu);
+  check_rejected("more levels than the file has", broken);
+
+  check(DdsFile::write(dds_file, DdsFormat::RGBA8, 4, 4, make_levels(DdsFormat::RGBA8, 4, 4, 1)), dds_file,
+        "not written");
+  const std::vector<char> rgba_bytes = read_bytes(dds_file);
+  broken = rgba_bytes;
+  set_word(&broken, bit_masks_offset, 0x0000fff0);
+  check_rejected("unknown bit masks", broken);
+  broken = rgba_bytes;
+  set_word(&broken, pixel_flags_offset, get_word(rgba_bytes, pixel_flags_offset) | 0x20000);
+  check_rejected("luminance and RGB flags", broken);
+
+  size_t rejected = 0, accepted = 0;
+  for (const std::vector<char> *file : {&bytes, &cube_bytes}) {
+    for (size_t offset = 0; offset < data_offset; offset++) {
+      std::vector<char> corrupt = *file;
+      corrupt[offset] = static_cast<char>(corrupt[offset] ^ 0xff);
+      write_bytes(dds_file, corrupt);
+      const std::unique_ptr<DdsFile> opened = DdsFile::open(dds_file);
+      if (!opened) {
+        rejected++;
+        continue;
+      }
+      accepted++;
+      check(consistent(*opened, corrupt.size()), dds_file,
+            "inconsistent file opens with byte " + std::to_string(offset) + " flipped");
+    }
+  }
+  // The level count is only read with its flag set
+  broken = bytes;
+  set_word(&broken, flags_offset, get_word(bytes, flags_offset) & ~0x20000u);
+  write_bytes(dds_file, broken);
+  const std::unique_ptr<DdsFile> base_level = DdsFile::open(dds_file);
+  check(base_level && base_level->get_levels().size() == 1, "no level count", "not read as the base level alone");
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << checked << " files checked, " << truncations << " truncations rejected, " << rejected
+            << " flipped header bytes rejected, " << accepted << " accepted consistent" << std::endl;
+  return 0;
+}
@@ -0,0 +1,351 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stb_image.h>
+
+#include "image_decoder.hpp"
+
+// Checks decode_png and decode_tga on files written here from generated images:
+//  - PNG files with RGB and RGBA pixels, every row filter, odd widths and the data split over several IDAT chunks
+//    decode to the pixels they were written from, with SSE2 and scalar alike, and the same as with stb_image,
+//  - the same for TGA files of 24 and 32 bits, uncompressed and RLE with packets that run on into the next row,
+//    stored bottom up and top down,
+//  - files the decoders leave to stb_image (palettes, other bit depths, interlacing, color keys, unknown filters)
+//    and every truncation are rejected without touching the image.
+// Exits with 1 after printing the failures.
+// Usage: image_decoder_test
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+/// Small linear congruential generator, so the images are the same on every platform
+uint32_t next_random(uint32_t *state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+/// RGBA pixels with noise, smooth ramps and runs of one color that cross the rows, so every filter and packet
+/// type has something to do. Alpha is 255 for 'opaque' images.
+std::vector<uint8_t> make_pixels(int width, int height, bool opaque, uint32_t seed) {
+  std::vector<uint8_t> pixels(size_t(width) * height * 4);
+  for (size_t p = 0; p < size_t(width) * height; p++) {
+    uint8_t *pixel = &pixels[4 * p];
+    if ((p / 7) % 3 == 1) {
+      const uint8_t run[4] = {12, 200, 77, 128};
+      std::copy(run, run + 4, pixel);
+    } else {
+      const int x = static_cast<int>(p % width), y = static_cast<int>(p / width);
+      pixel[0] = static_cast<uint8_t>(next_random(&seed));
+      pixel[1] = static_cast<uint8_t>(9 * x + 5 * y);
+      pixel[2] = static_cast<uint8_t>(255 - 3 * x);
+      pixel[3] = static_cast<uint8_t>(next_random(&seed));
+    }
+    if (opaque) {
+      pixel[3] = 255;
+    }
+  }
+  return pixels;
+}
+
+void append_u32_be(std::vector<uint8_t> *bytes, uint32_t value) {
+  bytes->insert(bytes->end(), {uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value)});
+}
+
+void append_u16_le(std::vector<uint8_t> *bytes, uint32_t value) {
+  bytes->insert(bytes->end(), {uint8_t(value), uint8_t(value >> 8)});
+}
+
+uint32_t crc32(const uint8_t *data, size_t size) {
+  uint32_t crc = 0xffffffffu;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+void append_chunk(std::vector<uint8_t> *png, const char *type, const std::vector<uint8_t> &data) {
+  append_u32_be(png, static_cast<uint32_t>(data.size()));
+  const size_t start = png->size();
+  png->insert(png->end(), type, type + 4);
+  png->insert(png->end(), data.begin(), data.end());
+  append_u32_be(png, crc32(png->data() + start, png->size() - start));
+}
+
+/// zlib stream of stored deflate blocks, the decoders inflate it like any other
+std::vector<uint8_t> zlib_stored(const std::vector<uint8_t> &data) {
+  std::vector<uint8_t> stream = {0x78, 0x01};
+  size_t offset = 0;
+  do {
+    const size_t length = std::min<size_t>(data.size() - offset, 65535);
+    const bool last = offset + length == data.size();
+    stream.push_back(last ? 1 : 0);
+    stream.insert(stream.end(), {uint8_t(length), uint8_t(length >> 8), uint8_t(~length), uint8_t(~length >> 8)});
+    stream.insert(stream.end(), data.begin() + offset, data.begin() + offset + length);
+    offset += length;
+  } while (offset < data.size());
+
+  uint32_t a = 1, b = 0;
+  for (uint8_t byte : data) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  append_u32_be(&stream, (b << 16) | a);
+  return stream;
+}
+
+int paeth(int left, int up, int up_left) {
+  const int estimate = left + up - up_left;
+  const int to_left = std::abs(estimate - left), to_up = std::abs(estimate - up),
+            to_up_left = std::abs(estimate - up_left);
+  if (to_left <= to_up && to_left <= to_up_left) {
+    return left;
+  }
+  return to_up <= to_up_left ? up : up_left;
+}
+
+struct PngOptions {
+  int bit_depth = 8;
+  int color_type = 6;
+  int interlace = 0;
+  /// Filter of every row, the rows cycle through all five when negative
+  int filter = -1;
+  bool color_key = false;
+};
+
+/// PNG file of the RGBA pixels, RGB when the color type is 2
+std::vector<uint8_t> write_png(const std::vector<uint8_t> &rgba, int width, int height,
+                               const PngOptions &options = PngOptions()) {
+  const size_t channels = options.color_type == 2 ? 3 : 4;
+  const size_t row_bytes = channels * width;
+  std::vector<uint8_t> rows;
+  for (int y = 0; y < height; y++) {
+    std::vector<uint8_t> row, prior(row_bytes, 0);
+    for (int x = 0; x < width; x++) {
+      const uint8_t *pixel = &rgba[4 * (size_t(y) * width + x)];
+      row.insert(row.end(), pixel, pixel + channels);
+      if (y > 0) {
+        const uint8_t *above = pixel - 4 * width;
+        std::copy(above, above + channels, prior.begin() + channels * x);
+      }
+    }
+
+    const int filter = options.filter >= 0 ? options.filter : y % 5;
+    rows.push_back(static_cast<uint8_t>(filter));
+    for (size_t i = 0; i < row_bytes; i++) {
+      const int left = i >= channels ? row[i - channels] : 0, up = prior[i];
+      const int up_left = i >= channels ? prior[i - channels] : 0;
+      const int predictions[5] = {0, left, up, (left + up) / 2, paeth(left, up, up_left)};
+      rows.push_back(static_cast<uint8_t>(row[i] - (filter < 5 ? predictions[filter] : 0)));
+    }
+  }
+
+  std::vector<uint8_t> png = {137, 80, 78, 71, 13, 10, 26, 10};
+  std::vector<uint8_t> header;
+  append_u32_be(&header, width);
+  append_u32_be(&header, height);
+  header.insert(header.end(), {uint8_t(options.bit_depth), uint8_t(options.color_type), 0, 0,
+                               uint8_t(options.interlace)});
+  append_chunk(&png, "IHDR", header);
+  append_chunk(&png, "tEXt", {'C', 'o', 'm', 'm', 'e', 'n', 't', 0, 't', 'e', 's', 't'});
+  if (options.color_key) {
+    append_chunk(&png, "tRNS", {0, 12, 0, 200, 0, 77});
+  }
+  // Split into three IDAT chunks, the stream runs on across them
+  const std::vector<uint8_t> stream = zlib_stored(rows);
+  const size_t third = stream.size() / 3;
+  append_chunk(&png, "IDAT", std::vector<uint8_t>(stream.begin(), stream.begin() + third));
+  append_chunk(&png, "IDAT", std::vector<uint8_t>(stream.begin() + third, stream.begin() + 2 * third));
+  append_chunk(&png, "IDAT", std::vector<uint8_t>(stream.begin() + 2 * third, stream.end()));
+  append_chunk(&png, "IEND", {});
+  return png;
+}
+
+/// TGA file of the RGBA pixels, RLE compressed with 'rle'. Packets hold up to 128 pixels and do not stop at the
+/// end of a row.
+std::vector<uint8_t> write_tga(const std::vector<uint8_t> &rgba, int width, int height, int bits_per_pixel,
+                               bool rle, bool top_down) {
+  const std::vector<uint8_t> id = {'t', 'e', 's', 't'};
+  std::vector<uint8_t> tga = {uint8_t(id.size()), 0, uint8_t(rle ? 10 : 2), 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  append_u16_le(&tga, width);
+  append_u16_le(&tga, height);
+  tga.insert(tga.end(), {uint8_t(bits_per_pixel), uint8_t((top_down ? 0x20 : 0) | (bits_per_pixel == 32 ? 8 : 0))});
+  tga.insert(tga.end(), id.begin(), id.end());
+
+  // Pixels in file order as BGR or BGRA
+  const size_t bytes_per_pixel = bits_per_pixel / 8;
+  std::vector<std::vector<uint8_t>> pixels;
+  for (int row = 0; row < height; row++) {
+    const int y = top_down ? row : height - 1 - row;
+    for (int x = 0; x < width; x++) {
+      const uint8_t *pixel = &rgba[4 * (size_t(y) * width + x)];
+      std::vector<uint8_t> bgra = {pixel[2], pixel[1], pixel[0], pixel[3]};
+      bgra.resize(bytes_per_pixel);
+      pixels.push_back(bgra);
+    }
+  }
+
+  for (size_t p = 0; p < pixels.size();) {
+    if (!rle) {
+      tga.insert(tga.end(), pixels[p].begin(), pixels[p].end());
+      p++;
+      continue;
+    }
+    size_t run = 1;
+    while (p + run < pixels.size() && run < 128 && pixels[p + run] == pixels[p]) {
+      run++;
+    }
+    if (run > 1) {
+      tga.push_back(static_cast<uint8_t>(0x80 | (run - 1)));
+      tga.insert(tga.end(), pixels[p].begin(), pixels[p].end());
+    } else {
+      // Literal pixels up to the next run
+      while (p + run < pixels.size() && run < 128 &&
+             (p + run + 1 >= pixels.size() || pixels[p + run] != pixels[p + run + 1])) {
+        run++;
+      }
+      tga.push_back(static_cast<uint8_t>(run - 1));
+      for (size_t i = 0; i < run; i++) {
+        tga.insert(tga.end(), pixels[p + i].begin(), pixels[p + i].end());
+      }
+    }
+    p += run;
+  }
+  return tga;
+}
+
+using Decoder = bool (*)(const uint8_t *, size_t, Image *, bool);
+
+/// Decodes with both paths and compares with the pixels and with stb_image
+void check_decode(const std::string &name, Decoder decode, const std::vector<uint8_t> &file,
+                  const std::vector<uint8_t> &expected, int width, int height) {
+  int stb_width = 0, stb_height = 0, stb_channels = 0;
+  stbi_uc *stb = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &stb_width, &stb_height,
+                                       &stb_channels, 4);
+  check(stb && stb_width == width && stb_height == height && std::equal(expected.begin(), expected.end(), stb),
+        name, "stb_image does not read the written file");
+  stbi_image_free(stb);
+
+  for (bool simd : {false, true}) {
+    Image image;
+    const bool decoded = decode(file.data(), file.size(), &image, simd);
+    check(decoded && image.width == width && image.height == height && image.pixels == expected &&
+              image.pixel_format == GL_RGBA,
+          name, std::string(simd ? "SSE2" : "scalar") + (decoded ? " decodes other pixels" : " fails"));
+  }
+}
+
+/// Decoders must fail on the file and leave the image as it was
+void check_rejected(const std::string &name, Decoder decode, const std::vector<uint8_t> &file) {
+  for (bool simd : {false, true}) {
+    Image image;
+    image.width = 3;
+    check(!decode(file.data(), file.size(), &image, simd) && image.width == 3 && image.pixels.empty(), name,
+          std::string(simd ? "SSE2" : "scalar") + " decodes it");
+  }
+}
+
+} // namespace
+
+int main() {
+  size_t checked = 0;
+  const int sizes[][2] = {{1, 1}, {5, 3}, {13, 7}, {33, 4}, {64, 9}};
+  for (const auto &size : sizes) {
+    const int width = size[0], height = size[1];
+    const std::string dimensions = std::to_string(width) + "x" + std::to_string(height);
+
+    for (int color_type : {2, 6}) {
+      const std::vector<uint8_t> pixels = make_pixels(width, height, color_type == 2, uint32_t(width + color_type));
+      PngOptions options;
+      options.color_type = color_type;
+      check_decode("PNG " + dimensions + (color_type == 2 ? " RGB" : " RGBA"), decode_png,
+                   write_png(pixels, width, height, options), pixels, width, height);
+      // Every filter on every row, so each one also runs on the first row and with the left edge everywhere
+      for (int filter = 0; filter < 5; filter++) {
+        options.filter = filter;
+        check_decode("PNG " + dimensions + " color type " + std::to_string(color_type) + " filter " +
+                         std::to_string(filter),
+                     decode_png, write_png(pixels, width, height, options), pixels, width, height);
+      }
+      checked += 6;
+    }
+
+    for (int bits_per_pixel : {24, 32}) {
+      const std::vector<uint8_t> pixels = make_pixels(width, height, bits_per_pixel == 24, uint32_t(height));
+      for (int variant = 0; variant < 4; variant++) {
+        const bool rle = (variant & 1) != 0, top_down = (variant & 2) != 0;
+        const std::string name = "TGA " + dimensions + " " + std::to_string(bits_per_pixel) + " bits" +
+                                 (rle ? " RLE" : "") + (top_down ? " top down" : " bottom up");
+        check_decode(name, decode_tga, write_tga(pixels, width, height, bits_per_pixel, rle, top_down), pixels,
+                     width, height);
+        checked++;
+      }
+    }
+  }
+
+  const std::vector<uint8_t> pixels = make_pixels(13, 7, false, 1);
+  const std::vector<uint8_t> png = write_png(pixels, 13, 7);
+  size_t truncations = 0;
+  for (size_t size = 0; size < png.size(); size++) {
+    check_rejected("PNG truncated to " + std::to_string(size) + " bytes", decode_png,
+                   std::vector<uint8_t>(png.begin(), png.begin() + size));
+    truncations++;
+  }
+  PngOptions options;
+  options.color_type = 3;
+  check_rejected("PNG with a palette", decode_png, write_png(pixels, 13, 7, options));
+  options = PngOptions();
+  options.bit_depth = 16;
+  check_rejected("PNG of 16 bits", decode_png, write_png(pixels, 13, 7, options));
+  options = PngOptions();
+  options.interlace = 1;
+  check_rejected("interlaced PNG", decode_png, write_png(pixels, 13, 7, options));
+  options = PngOptions();
+  options.color_type = 2;
+  options.color_key = true;
+  check_rejected("PNG with a color key", decode_png, write_png(pixels, 13, 7, options));
+  options = PngOptions();
+  options.filter = 5;
+  check_rejected("PNG with filter 5", decode_png, write_png(pixels, 13, 7, options));
+
+  for (bool rle : {false, true}) {
+    const std::vector<uint8_t> tga = write_tga(pixels, 13, 7, 32, rle, false);
+    for (size_t size = 0; size < tga.size(); size++) {
+      check_rejected(std::string(rle ? "RLE " : "") + "TGA truncated to " + std::to_string(size) + " bytes",
+                     decode_tga, std::vector<uint8_t>(tga.begin(), tga.begin() + size));
+      truncations++;
+    }
+    std::vector<uint8_t> broken = tga;
+    broken[1] = 1;
+    check_rejected("TGA with a color map", decode_tga, broken);
+    broken = tga;
+    broken[16] = 16;
+    check_rejected("TGA of 16 bits", decode_tga, broken);
+    broken = tga;
+    broken[12] = broken[13] = 0;
+    check_rejected("TGA of width 0", decode_tga, broken);
+  }
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << checked << " files checked, " << truncations << " truncations rejected" << std::endl;
+  return 0;
+}
@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "mesh.hpp"
+#include "mesh_cache.hpp"
+#include "obj_loader.hpp"
+
+// Checks that MeshCache reads back what it wrote and rejects the files it must not use, on a generated OBJ file
+// with two materials and two shapes:
+//  - an up to date cache opens with the streams, submeshes, materials, levels, meshlets and shape table of the
+//    mesh, and the Kd, Ks, Ns and d values of the scene materials read back as the MTL file has them,
+//  - caches of other build flags and of changed source files are stale,
+//  - every truncation of the file is rejected,
+//  - with any single header byte flipped the cache is either rejected or still consistent: all ranges lie in
+//    their buffers and every index stays within the vertices of its submesh, so no draw reads past the file.
+// Exits with 1 after printing the failures.
+// Usage: mesh_cache_test
+
+namespace {
+
+const std::string obj_file = "mesh_cache_test.obj";
+const std::string mtl_file = "mesh_cache_test.mtl";
+const uint32_t build_flags = MESH_BUILD_OPTIMIZE | MESH_BUILD_LODS | MESH_BUILD_MESHLETS;
+
+int failures = 0;
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+/// Two spheres side by side as the shapes, their upper and lower halves with different materials
+void write_source_files() {
+  std::ofstream mtl(mtl_file);
+  mtl << "newmtl upper\nKd 1 0 0\nKs 0.5 0.25 0.125\nNs 20\n\nnewmtl lower\nKd 0 0 1\nd 0.5\n";
+
+  std::ofstream obj(obj_file);
+  obj << "mtllib " << mtl_file << "\n";
+  const int rings = 12, segments = 24;
+  const float pi = 3.14159265f;
+  for (int sphere = 0; sphere < 2; sphere++) {
+    obj << "o sphere" << sphere << "\n";
+    for (int r = 0; r <= rings; r++) {
+      const float theta = pi * r / rings;
+      for (int s = 0; s <= segments; s++) {
+        const float phi = 2.f * pi * s / segments;
+        const float x = std::sin(theta) * std::cos(phi), y = std::cos(theta), z = std::sin(theta) * std::sin(phi);
+        obj << "v " << x + 3.f * sphere << " " << y << " " << z << "\nvn " << x << " " << y << " " << z << "\nvt "
+            << float(s) / segments << " " << float(r) / rings << "\n";
+      }
+    }
+    const int base = 1 + sphere * (rings + 1) * (segments + 1);
+    for (int r = 0; r < rings; r++) {
+      if (r == 0 || r == rings / 2) {
+        obj << "usemtl " << (r == 0 ? "upper" : "lower") << "\n";
+      }
+      for (int s = 0; s < segments; s++) {
+        const int a = base + r * (segments + 1) + s, b = a + segments + 1;
+        obj << "f " << a << "/" << a << "/" << a << " " << b << "/" << b << "/" << b << " " << a + 1 << "/" << a + 1
+            << "/" << a + 1 << "\n";
+        obj << "f " << a + 1 << "/" << a + 1 << "/" << a + 1 << " " << b << "/" << b << "/" << b << " " << b + 1
+            << "/" << b + 1 << "/" << b + 1 << "\n";
+      }
+    }
+  }
+}
+
+std::vector<char> read_bytes(const std::string &file_name) {
+  std::ifstream file(file_name, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void write_bytes(const std::string &file_name, const std::vector<char> &bytes) {
+  std::ofstream file(file_name, std::ios::binary | std::ios::trunc);
+  file.write(bytes.data(), bytes.size());
+}
+
+uint32_t index_at(const MeshView &view, size_t i) {
+  return view.index_size == sizeof(uint16_t) ? static_cast<const uint16_t *>(view.indices)[i]
+                                             : static_cast<const uint32_t *>(view.indices)[i];
+}
+
+/// Whether everything a draw reads from the entry lies within its buffers. Touches every value of the views, so
+/// a pointer past the mapping faults here rather than in a draw.
+bool consistent(const MeshCache::Entry &entry) {
+  const MeshView &view = entry.view;
+  float sum = 0.f;
+  for (size_t i = 0; i < 3 * view.vertex_count; i++) {
+    sum += view.vertices[i] + (view.normals ? view.normals[i] : 0.f);
+  }
+  for (size_t i = 0; view.tex_coords && i < 2 * view.vertex_count; i++) {
+    sum += view.tex_coords[i];
+  }
+  uint32_t largest = 0;
+  for (size_t i = 0; i < view.index_count; i++) {
+    largest = std::max(largest, index_at(view, i));
+  }
+  if (std::isnan(sum) && largest == UINT32_MAX) {
+    // Keeps the reads from being optimized away
+    return false;
+  }
+
+  auto ranges_valid = [&](const std::vector<Submesh> &submeshes) {
+    for (const Submesh &submesh : submeshes) {
+      if (submesh.material_id < 0 || size_t(submesh.material_id) >= entry.materials.size() ||
+          submesh.first_index > view.index_count || submesh.index_count > view.index_count - submesh.first_index ||
+          submesh.base_vertex > view.vertex_count ||
+          submesh.vertex_count > view.vertex_count - submesh.base_vertex) {
+        return false;
+      }
+      for (size_t i = submesh.first_index; i < submesh.first_index + submesh.index_count; i++) {
+        if (index_at(view, i) >= submesh.vertex_count) {
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+  if (!ranges_valid(entry.submeshes)) {
+    return false;
+  }
+  for (const MeshLod &lod : entry.lods) {
+    if (!ranges_valid(lod.submeshes)) {
+      return false;
+    }
+  }
+  for (const Meshlet &meshlet : entry.meshlets) {
+    if (meshlet.submesh >= entry.submeshes.size()) {
+      return false;
+    }
+    const Submesh &submesh = entry.submeshes[meshlet.submesh];
+    if (meshlet.first_index < submesh.first_index ||
+        meshlet.first_index + 3 * size_t(meshlet.triangle_count) > submesh.first_index + submesh.index_count) {
+      return false;
+    }
+  }
+  for (const ShapeRange &range : entry.shape_ranges) {
+    if (range.shape >= entry.shape_names.size() || range.submesh >= entry.submeshes.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void check_contents(const MeshCache &cache, const MeshData &data) {
+  const std::string name = "cache of " + obj_file;
+  check(cache.get_meshes().size() == 1, name, std::to_string(cache.get_meshes().size()) + " meshes");
+  if (cache.get_meshes().size() != 1) {
+    return;
+  }
+  const MeshCache::Entry &entry = cache.get_meshes()[0];
+  const MeshView &view = entry.view;
+  check(view.vertex_count == data.vertex_count() &&
+            std::equal(data.vertices.begin(), data.vertices.end(), view.vertices) &&
+            std::equal(data.normals.begin(), data.normals.end(), view.normals) &&
+            std::equal(data.tex_coords.begin(), data.tex_coords.end(), view.tex_coords),
+        name, "vertices changed");
+  bool same_indices = view.index_count == data.indices.size();
+  for (size_t i = 0; same_indices && i < view.index_count; i++) {
+    same_indices = index_at(view, i) == data.indices[i];
+  }
+  check(same_indices, name, "indices changed");
+  check(view.index_size == (data.has_16bit_indices() ? sizeof(uint16_t) : sizeof(uint32_t)), name,
+        "index size " + std::to_string(view.index_size));
+
+  check(entry.submeshes.size() == data.submeshes.size() && entry.submeshes.size() == 2, name,
+        std::to_string(entry.submeshes.size()) + " submeshes");
+  for (size_t s = 0; s < std::min(entry.submeshes.size(), data.submeshes.size()); s++) {
+    const Submesh &a = entry.submeshes[s], &b = data.submeshes[s];
+    check(a.material_id == b.material_id && a.first_index == b.first_index && a.index_count == b.index_count &&
+              a.base_vertex == b.base_vertex && a.vertex_count == b.vertex_count,
+          name, "submesh " + std::to_string(s) + " changed");
+  }
+  check(entry.materials.size() == data.materials.size(), name, "materials changed");
+  for (size_t m = 0; m < std::min(entry.materials.size(), data.materials.size()); m++) {
+    const Material &a = entry.materials[m], &b = data.materials[m];
+    check(a.name == b.name && a.diffuse_texture == b.diffuse_texture && a.diffuse == b.diffuse &&
+              a.specular == b.specular && a.shininess == b.shininess && a.dissolve == b.dissolve,
+          name, "material " + std::to_string(m) + " changed");
+  }
+  check(entry.lods.size() == data.lods.size() && !entry.lods.empty(), name,
+        std::to_string(entry.lods.size()) + " levels of detail");
+  for (size_t l = 0; l < std::min(entry.lods.size(), data.lods.size()); l++) {
+    bool same = entry.lods[l].error == data.lods[l].error &&
+                entry.lods[l].submeshes.size() == data.lods[l].submeshes.size();
+    for (size_t s = 0; same && s < entry.lods[l].submeshes.size(); s++) {
+      same = entry.lods[l].submeshes[s].first_index == data.lods[l].submeshes[s].first_index &&
+             entry.lods[l].submeshes[s].index_count == data.lods[l].submeshes[s].index_count;
+    }
+    check(same, name, "level of detail " + std::to_string(l) + " changed");
+  }
+  check(entry.meshlets.size() == data.meshlets.size() && !entry.meshlets.empty() &&
+            std::memcmp(entry.meshlets.data(), data.meshlets.data(), data.meshlets.size() * sizeof(Meshlet)) == 0,
+        name, "meshlets changed");
+  check(entry.shape_names == data.shape_names && entry.shape_names.size() == 2, name, "shape names changed");
+  bool same_shapes = entry.shape_ranges.size() == data.shape_ranges.size();
+  for (size_t r = 0; same_shapes && r < entry.shape_ranges.size(); r++) {
+    const ShapeRange &a = entry.shape_ranges[r], &b = data.shape_ranges[r];
+    same_shapes = a.shape == b.shape && a.submesh == b.submesh && a.first_index == b.first_index &&
+                  a.index_count == b.index_count;
+  }
+  check(same_shapes, name, "shape ranges changed");
+  check(consistent(entry), name, "inconsistent as written");
+}
+
+/// The materials of a scene file come back from its cache with the values of the MTL file as tinyobj reads them
+void check_scene_materials(const std::string &file_name) {
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  std::vector<tinyobj::material_t> materials;
+  std::string err;
+  if (!load_obj(&attrib, &shapes, &materials, &err, file_name, "objects/")) {
+    check(false, file_name, err);
+    return;
+  }
+
+  Mesh::load_file(file_name, build_flags);
+  const std::unique_ptr<MeshCache> cache = MeshCache::open(file_name, build_flags);
+  check(cache && cache->get_meshes().size() == 1, file_name, "cache does not open");
+  if (!cache || cache->get_meshes().size() != 1) {
+    return;
+  }
+  const std::vector<Material> &cached = cache->get_meshes()[0].materials;
+  // The default material of faces without one comes after those of the file
+  check(cached.size() >= materials.size(), file_name, std::to_string(cached.size()) + " materials");
+  bool transparent = false;
+  for (size_t m = 0; m < std::min(cached.size(), materials.size()); m++) {
+    const tinyobj::material_t &source = materials[m];
+    const Material &material = cached[m];
+    check(material.name == source.name &&
+              material.diffuse == glm::vec3(source.diffuse[0], source.diffuse[1], source.diffuse[2]) &&
+              material.specular == glm::vec3(source.specular[0], source.specular[1], source.specular[2]) &&
+              material.shininess == source.shininess && material.dissolve == source.dissolve,
+          file_name, "material " + source.name + " changed");
+    transparent = transparent || material.dissolve == 0.f;
+  }
+  // exterior.mtl has materials with 'd 0', which must not fall back to the default of 1
+  check(transparent, file_name, "lost the dissolve of its transparent materials");
+}
+
+} // namespace
+
+int main() {
+  write_source_files();
+  std::remove(MeshCache::path_for(obj_file).c_str());
+
+  // The first load builds the mesh and writes the cache, which the second one takes
+  const MeshFile built = Mesh::load_file(obj_file, build_flags);
+  check(!built.cache && built.meshes.size() == 1, obj_file, "not built from the OBJ file");
+  const std::unique_ptr<MeshCache> cache = MeshCache::open(obj_file, build_flags);
+  check(cache != nullptr, obj_file, "written cache does not open");
+  if (!cache || built.meshes.size() != 1) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  check_contents(*cache, built.meshes[0]);
+  check(!MeshCache::open(obj_file, build_flags & ~MESH_BUILD_MESHLETS), obj_file,
+        "cache of other build flags opens");
+
+  const std::string cache_file = MeshCache::path_for(obj_file);
+  const std::vector<char> bytes = read_bytes(cache_file);
+  // Magic, version and build flags come before the offset of the data section, the header ends there
+  uint64_t header_size = 0;
+  std::memcpy(&header_size, bytes.data() + 16, sizeof(header_size));
+  check(header_size > 24 && header_size <= bytes.size(), obj_file, "header of " + std::to_string(header_size));
+  header_size = std::min<uint64_t>(header_size, bytes.size());
+
+  size_t truncations = 0;
+  for (size_t size = 0; size < bytes.size(); size += size < header_size ? 1 : 61) {
+    write_bytes(cache_file, std::vector<char>(bytes.begin(), bytes.begin() + size));
+    check(!MeshCache::open(obj_file, build_flags), obj_file,
+          "cache truncated to " + std::to_string(size) + " bytes opens");
+    truncations++;
+  }
+
+  size_t rejected = 0, accepted = 0;
+  for (size_t offset = 0; offset < header_size; offset++) {
+    std::vector<char> corrupt = bytes;
+    corrupt[offset] = static_cast<char>(corrupt[offset] ^ 0xff);
+    write_bytes(cache_file, corrupt);
+    const std::unique_ptr<MeshCache> opened = MeshCache::open(obj_file, build_flags);
+    if (!opened) {
+      rejected++;
+      continue;
+    }
+    accepted++;
+    for (const MeshCache::Entry &entry : opened->get_meshes()) {
+      check(consistent(entry), obj_file, "inconsistent cache opens with byte " + std::to_string(offset) + " flipped");
+    }
+  }
+
+  // A changed source file makes the cache stale
+  write_bytes(cache_file, bytes);
+  check(MeshCache::open(obj_file, build_flags) != nullptr, obj_file, "restored cache does not open");
+  std::ofstream(obj_file, std::ios::app) << "# changed\n";
+  check(!MeshCache::open(obj_file, build_flags), obj_file, "cache of a changed OBJ file opens");
+  write_source_files();
+  std::ofstream(mtl_file, std::ios::app) << "# changed\n";
+  check(!MeshCache::open(obj_file, build_flags), obj_file, "cache of a changed MTL file opens");
+
+  check_scene_materials("objects/exterior.obj");
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << truncations << " truncations rejected, " << rejected << " of " << header_size
+            << " flipped header bytes rejected, " << accepted << " accepted consistent" << std::endl;
+  return 0;
+}
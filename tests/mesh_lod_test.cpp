@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mesh_lod.hpp"
+#include "mesh_optimizer.hpp"
+#include "obj_loader.hpp"
+
+// Checks the level of detail chain and its selection:
+//  - select_lod switches to a coarser level at its distance and back below it, within the hysteresis band a
+//    drawn level stays and a finer one does not move up, and a camera inside the bounds gets the full detail,
+//  - build_lods on the scene meshes gives levels with fewer indices than the one before, errors that never
+//    shrink, and index ranges within the vertices of their submeshes.
+// Exits with 1 after printing the failures.
+// Usage: mesh_lod_test [file.obj ...]
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+size_t index_count(const std::vector<Submesh> &submeshes) {
+  size_t count = 0;
+  for (const Submesh &submesh : submeshes) {
+    count += submesh.index_count;
+  }
+  return count;
+}
+
+void check_selection() {
+  const std::vector<float> errors = {0.f, 0.01f, 0.04f, 0.1f};
+  LodSettings settings;
+  settings.max_pixel_error = 2.f;
+  settings.hysteresis = 0.2f;
+  const float scale = lod_projection_scale(0.8f, 1080.f);
+
+  for (size_t k = 1; k < errors.size(); k++) {
+    const std::string name = "level " + std::to_string(k);
+    // Level k projects to exactly the threshold at this distance, and to the reduced one a bit further away
+    const float switch_distance = errors[k] * scale / settings.max_pixel_error;
+    const float band_end = switch_distance / (1.f - settings.hysteresis);
+    const float inside_band = switch_distance * 1.05f, below = switch_distance * 0.95f, beyond = band_end * 1.05f;
+
+    check(select_lod(errors, k, inside_band, scale, settings) == k, name, "drawn level leaves inside the band");
+    check(select_lod(errors, k - 1, inside_band, scale, settings) == k - 1, name,
+          "finer level moves up inside the band");
+    check(select_lod(errors, k - 1, beyond, scale, settings) >= k, name, "finer level stays beyond the band");
+    check(select_lod(errors, k, below, scale, settings) == k - 1, name, "drawn level stays below its distance");
+    // Without hysteresis the two sides of the switch meet
+    LodSettings sharp = settings;
+    sharp.hysteresis = 0.f;
+    check(select_lod(errors, k - 1, inside_band, scale, sharp) == k, name, "does not switch without hysteresis");
+  }
+
+  for (size_t current = 0; current < errors.size(); current++) {
+    for (float distance : {0.f, -1.f}) {
+      check(select_lod(errors, current, distance, scale, settings) == 0, "distance " + std::to_string(distance),
+            "level " + std::to_string(current) + " is not dropped to the full detail");
+    }
+  }
+  check(select_lod(errors, 0, 1e9f, scale, settings) == errors.size() - 1, "far away", "not the coarsest level");
+  LodSettings full_detail = settings;
+  full_detail.max_pixel_error = 0.f;
+  check(select_lod(errors, 3, 1e9f, scale, full_detail) == 0, "max_pixel_error 0", "not the full detail");
+}
+
+/// Returns the number of levels
+size_t check_chain(const std::string &name, MeshData data) {
+  optimize_mesh(&data);
+  build_lods(&data);
+  check(!data.lods.empty(), name, "no levels of detail");
+
+  size_t previous_count = data.indices.size();
+  float previous_error = 0.f;
+  for (size_t l = 0; l < data.lods.size(); l++) {
+    const MeshLod &lod = data.lods[l];
+    const std::string label = name + " level " + std::to_string(l + 1);
+    const size_t count = index_count(lod.submeshes);
+    check(count < previous_count, label,
+          std::to_string(count) + " indices after " + std::to_string(previous_count));
+    check(lod.error >= previous_error, label,
+          "error " + std::to_string(lod.error) + " after " + std::to_string(previous_error));
+    check(lod.submeshes.size() == data.submeshes.size(), label, "submeshes changed");
+    for (size_t s = 0; s < std::min(lod.submeshes.size(), data.submeshes.size()); s++) {
+      const Submesh &range = lod.submeshes[s];
+      bool inside = range.first_index + range.index_count <= data.indices.size() && range.index_count % 3 == 0;
+      for (size_t i = range.first_index; inside && i < range.first_index + range.index_count; i++) {
+        inside = data.indices[i] < data.submeshes[s].vertex_count;
+      }
+      check(inside, label, "submesh " + std::to_string(s) + " leaves its vertices");
+    }
+    previous_count = count;
+    previous_error = lod.error;
+  }
+  return data.lods.size();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj", "objects/screen.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  check_selection();
+  size_t levels = 0;
+  for (const std::string &file_name : files) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\"));
+    if (!load_obj(&attrib, &shapes, &materials, &err, file_name, base_dir + "/")) {
+      std::cout << file_name << ": " << err << std::endl;
+      failures++;
+      continue;
+    }
+
+    levels += check_chain(file_name, build_material_batches(attrib, shapes, materials, base_dir));
+  }
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << levels << " levels of detail and the selection checked" << std::endl;
+  return 0;
+}
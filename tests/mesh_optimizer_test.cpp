@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mesh_optimizer.hpp"
+#include "obj_loader.hpp"
+
+// Checks optimize_mesh on the scene meshes:
+//  - the triangles of every submesh are the same after mapping the vertices back through the permutation of
+//    the vertex fetch step, only their order and the vertex they start with change,
+//  - the ACMR of analyze_vertex_cache is not worse than the one of the input, for every submesh and the mesh,
+//  - every index stays within the vertices of its submesh.
+// Exits with 1 after printing the failures.
+// Usage: mesh_optimizer_test [file.obj ...]
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+using Triangle = std::array<uint32_t, 3>;
+
+/// Triangles of the submesh in original vertex numbers, rotated to start with their smallest vertex so the
+/// winding is kept, and sorted
+std::vector<Triangle> triangles_of(const MeshData &data, const Submesh &submesh,
+                                   const std::vector<uint32_t> &original_vertex) {
+  std::vector<Triangle> triangles;
+  for (size_t i = submesh.first_index; i + 3 <= submesh.first_index + submesh.index_count; i += 3) {
+    Triangle triangle;
+    for (size_t c = 0; c < 3; c++) {
+      triangle[c] = original_vertex[submesh.base_vertex + data.indices[i + c]];
+    }
+    std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+    triangles.push_back(triangle);
+  }
+  std::sort(triangles.begin(), triangles.end());
+  return triangles;
+}
+
+float acmr_of(const MeshData &data, const Submesh &submesh) {
+  return analyze_vertex_cache(data.indices.data() + submesh.first_index, submesh.index_count, submesh.vertex_count)
+      .acmr;
+}
+
+size_t check_optimize(const std::string &name, MeshData data) {
+  // The vertex fetch step moves all attributes alike, so texture coordinates holding the vertex number tell
+  // where every vertex came from. Floats hold such integers exactly.
+  data.tex_coords.assign(2 * data.vertex_count(), 0.f);
+  for (size_t v = 0; v < data.vertex_count(); v++) {
+    data.tex_coords[2 * v] = static_cast<float>(v);
+  }
+  std::vector<uint32_t> identity(data.vertex_count());
+  for (size_t v = 0; v < identity.size(); v++) {
+    identity[v] = static_cast<uint32_t>(v);
+  }
+
+  const MeshData input = data;
+  std::vector<MeshStats> steps;
+  optimize_mesh(&data, &steps);
+
+  std::vector<uint32_t> original_vertex(data.vertex_count());
+  for (size_t v = 0; v < original_vertex.size(); v++) {
+    original_vertex[v] = static_cast<uint32_t>(data.tex_coords[2 * v]);
+  }
+
+  check(data.submeshes.size() == input.submeshes.size() && data.indices.size() == input.indices.size(), name,
+        "submeshes or index count changed");
+  check(steps.size() == 4 && steps.back().vertex_cache.acmr <= steps.front().vertex_cache.acmr, name,
+        "ACMR of the mesh got worse");
+  for (size_t s = 0; s < std::min(data.submeshes.size(), input.submeshes.size()); s++) {
+    const Submesh &submesh = data.submeshes[s];
+    const std::string label = name + " submesh " + std::to_string(s);
+
+    bool inside = submesh.first_index + submesh.index_count <= data.indices.size();
+    for (size_t i = submesh.first_index; inside && i < submesh.first_index + submesh.index_count; i++) {
+      inside = data.indices[i] < submesh.vertex_count;
+    }
+    check(inside, label, "indices leave the vertices of the submesh");
+    if (!inside) {
+      continue;
+    }
+
+    check(triangles_of(data, submesh, original_vertex) == triangles_of(input, input.submeshes[s], identity), label,
+          "triangles changed");
+    const float before = acmr_of(input, input.submeshes[s]), after = acmr_of(data, submesh);
+    check(after <= before, label, "ACMR " + std::to_string(after) + " after " + std::to_string(before));
+  }
+  return data.submeshes.size();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj", "objects/screen.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  size_t submeshes = 0;
+  for (const std::string &file_name : files) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\"));
+    if (!load_obj(&attrib, &shapes, &materials, &err, file_name, base_dir + "/")) {
+      std::cout << file_name << ": " << err << std::endl;
+      failures++;
+      continue;
+    }
+
+    submeshes += check_optimize(file_name, build_material_batches(attrib, shapes, materials, base_dir));
+  }
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << submeshes << " optimized submeshes checked" << std::endl;
+  return 0;
+}
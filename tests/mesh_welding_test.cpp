@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mesh_data.hpp"
+#include "obj_loader.hpp"
+
+// Checks that welding keeps the geometry, on a generated cube and on the scene meshes:
+//  - weld_shape gives one index per face corner, and the vertex of every index holds the position, normal and
+//    texture coordinate of its corner bit for bit,
+//  - no two welded vertices of a shape hold the same attributes,
+//  - build_material_batches keeps every triangle of the file with its material, the vertices of a submesh stay
+//    in its own block.
+// Exits with 1 after printing the failures.
+// Usage: mesh_welding_test [file.obj ...]
+
+namespace {
+
+int failures = 0;
+
+/// Position, normal and texture coordinate of a vertex or a face corner
+using Attributes = std::array<float, 8>;
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+bool same_bits(const Attributes &a, const Attributes &b) { return std::memcmp(a.data(), b.data(), sizeof(a)) == 0; }
+
+bool less_bits(const Attributes &a, const Attributes &b) { return std::memcmp(a.data(), b.data(), sizeof(a)) < 0; }
+
+/// What the corner looks like after welding, missing attributes are zero
+Attributes corner_attributes(const tinyobj::attrib_t &attrib, const tinyobj::index_t &corner) {
+  Attributes values = {};
+  for (int i = 0; i < 3; i++) {
+    values[i] = attrib.vertices[3 * corner.vertex_index + i];
+    if (!attrib.normals.empty() && corner.normal_index >= 0) {
+      values[3 + i] = attrib.normals[3 * corner.normal_index + i];
+    }
+  }
+  if (!attrib.texcoords.empty() && corner.texcoord_index >= 0) {
+    values[6] = attrib.texcoords[2 * corner.texcoord_index + 0];
+    values[7] = attrib.texcoords[2 * corner.texcoord_index + 1];
+  }
+  return values;
+}
+
+Attributes vertex_attributes(const MeshData &data, size_t vertex) {
+  Attributes values = {};
+  std::copy(data.vertices.begin() + 3 * vertex, data.vertices.begin() + 3 * vertex + 3, values.begin());
+  if (!data.normals.empty()) {
+    std::copy(data.normals.begin() + 3 * vertex, data.normals.begin() + 3 * vertex + 3, values.begin() + 3);
+  }
+  if (!data.tex_coords.empty()) {
+    std::copy(data.tex_coords.begin() + 2 * vertex, data.tex_coords.begin() + 2 * vertex + 2, values.begin() + 6);
+  }
+  return values;
+}
+
+/// Triangles as their three corners, sorted so both sides can be compared as multisets
+std::vector<std::array<Attributes, 3>> sorted_triangles(std::vector<std::array<Attributes, 3>> triangles) {
+  std::sort(triangles.begin(), triangles.end(),
+            [](const std::array<Attributes, 3> &a, const std::array<Attributes, 3> &b) {
+              for (int k = 0; k < 3; k++) {
+                if (!same_bits(a[k], b[k])) {
+                  return less_bits(a[k], b[k]);
+                }
+              }
+              return false;
+            });
+  return triangles;
+}
+
+void check_weld_shape(const std::string &name, const tinyobj::attrib_t &attrib, const tinyobj::shape_t &shape,
+                      size_t expected_vertices = 0) {
+  const MeshData data = weld_shape(attrib, shape);
+  const std::vector<tinyobj::index_t> &corners = shape.mesh.indices;
+  check(data.indices.size() == corners.size(), name,
+        std::to_string(data.indices.size()) + " indices for " + std::to_string(corners.size()) + " corners");
+  for (size_t c = 0; c < std::min(corners.size(), data.indices.size()); c++) {
+    check(data.indices[c] < data.vertex_count() &&
+              same_bits(vertex_attributes(data, data.indices[c]), corner_attributes(attrib, corners[c])),
+          name, "corner " + std::to_string(c) + " changed");
+  }
+
+  std::vector<Attributes> vertices;
+  for (size_t v = 0; v < data.vertex_count(); v++) {
+    vertices.push_back(vertex_attributes(data, v));
+  }
+  std::sort(vertices.begin(), vertices.end(), less_bits);
+  check(std::adjacent_find(vertices.begin(), vertices.end(), same_bits) == vertices.end(), name,
+        "vertices left unwelded");
+  if (expected_vertices > 0) {
+    check(data.vertex_count() == expected_vertices, name, std::to_string(data.vertex_count()) + " vertices");
+  }
+}
+
+void check_batches(const std::string &name, const tinyobj::attrib_t &attrib,
+                   const std::vector<tinyobj::shape_t> &shapes, const std::vector<tinyobj::material_t> &materials) {
+  const MeshData data = build_material_batches(attrib, shapes, materials, "");
+
+  // Triangles of every material of the file, faces without a valid one go to the default material after them
+  std::vector<std::vector<std::array<Attributes, 3>>> expected(materials.size() + 1);
+  for (const tinyobj::shape_t &shape : shapes) {
+    const tinyobj::index_t *corners = shape.mesh.indices.data();
+    for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); corners += shape.mesh.num_face_vertices[f++]) {
+      const int id = f < shape.mesh.material_ids.size() ? shape.mesh.material_ids[f] : -1;
+      const size_t material = id >= 0 && size_t(id) < materials.size() ? id : materials.size();
+      check(shape.mesh.num_face_vertices[f] == 3, name, "face " + std::to_string(f) + " is not a triangle");
+      expected[material].push_back(
+          {corner_attributes(attrib, corners[0]), corner_attributes(attrib, corners[1]),
+           corner_attributes(attrib, corners[2])});
+    }
+  }
+
+  std::vector<std::vector<std::array<Attributes, 3>>> welded(expected.size());
+  for (const Submesh &submesh : data.submeshes) {
+    const std::string label = name + " submesh " + std::to_string(submesh.material_id);
+    // The default material is stored after the others, only when faces use it
+    check(submesh.material_id >= 0 && size_t(submesh.material_id) < expected.size(), label, "unknown material");
+    if (submesh.material_id < 0 || size_t(submesh.material_id) >= expected.size()) {
+      continue;
+    }
+    for (size_t i = 0; i + 2 < submesh.index_count; i += 3) {
+      std::array<Attributes, 3> triangle;
+      for (int k = 0; k < 3; k++) {
+        const uint32_t index = data.indices[submesh.first_index + i + k];
+        check(index < submesh.vertex_count, label, "index outside of its vertices");
+        triangle[k] = vertex_attributes(data, submesh.base_vertex + (index < submesh.vertex_count ? index : 0));
+      }
+      welded[submesh.material_id].push_back(triangle);
+    }
+  }
+  for (size_t m = 0; m < expected.size(); m++) {
+    check(sorted_triangles(welded[m]) == sorted_triangles(expected[m]), name,
+          "triangles of material " + std::to_string(m) + " changed");
+  }
+}
+
+/// Unit cube with a normal per face and the four corners of the texture on every face
+void make_cube(tinyobj::attrib_t *attrib, tinyobj::shape_t *shape) {
+  for (int i = 0; i < 8; i++) {
+    attrib->vertices.insert(attrib->vertices.end(), {float(i & 1), float((i >> 1) & 1), float((i >> 2) & 1)});
+  }
+  const float normals[6][3] = {{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
+  for (const auto &normal : normals) {
+    attrib->normals.insert(attrib->normals.end(), normal, normal + 3);
+  }
+  attrib->texcoords = {0.f, 0.f, 1.f, 0.f, 1.f, 1.f, 0.f, 1.f};
+
+  // Corners of each face in order around it
+  const int faces[6][4] = {{0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6}};
+  shape->name = "cube";
+  for (int f = 0; f < 6; f++) {
+    for (int k : {0, 1, 2, 0, 2, 3}) {
+      tinyobj::index_t corner;
+      corner.vertex_index = faces[f][k];
+      corner.normal_index = f;
+      corner.texcoord_index = k;
+      shape->mesh.indices.push_back(corner);
+    }
+    shape->mesh.num_face_vertices.insert(shape->mesh.num_face_vertices.end(), {3, 3});
+    shape->mesh.material_ids.insert(shape->mesh.material_ids.end(), {f % 2, f % 2});
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj", "objects/screen.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  // Every face has its own normal, so the 36 corners weld into 4 vertices per face
+  tinyobj::attrib_t cube_attrib;
+  tinyobj::shape_t cube;
+  make_cube(&cube_attrib, &cube);
+  check_weld_shape(cube.name, cube_attrib, cube, 24);
+  check_batches(cube.name, cube_attrib, {cube}, std::vector<tinyobj::material_t>(2));
+  size_t checked = 1;
+
+  for (const std::string &file_name : files) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\"));
+    if (!load_obj(&attrib, &shapes, &materials, &err, file_name, base_dir + "/")) {
+      std::cout << file_name << ": " << err << std::endl;
+      failures++;
+      continue;
+    }
+
+    for (const tinyobj::shape_t &shape : shapes) {
+      check_weld_shape(file_name + " " + shape.name, attrib, shape);
+    }
+    check_batches(file_name, attrib, shapes, materials);
+    checked += shapes.size();
+  }
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << checked << " shapes checked" << std::endl;
+  return 0;
+}
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "mesh_optimizer.hpp"
+#include "meshlet.hpp"
+#include "obj_loader.hpp"
+
+// Checks build_meshlets and MeshletCuller on a generated sphere and on the scene meshes:
+//  - every meshlet has at most 64 distinct vertices and 124 triangles, and the meshlets of a submesh cover its
+//    triangles in index order,
+//  - the bounding sphere of a meshlet holds all of its vertices,
+//  - the normal cone is valid: the cutoff is in [0, 1], every triangle normal lies within the cone, and a
+//    meshlet the cone test rejects faces away from the eye with all of its triangles,
+//  - the frustum test never rejects a meshlet with a vertex inside the view volume,
+//  - the SSE2 and the scalar culling paths return the same meshlets.
+// Exits with 1 after printing the failures.
+// Usage: meshlet_test [file.obj ...]
+
+namespace {
+
+const size_t max_vertices = 64;
+const size_t max_triangles = 124;
+
+int failures = 0;
+
+struct View {
+  glm::vec3 eye;
+  glm::vec3 target;
+};
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+glm::vec3 position(const MeshData &data, const Submesh &range, uint32_t index) {
+  const float *values = data.vertices.data() + 3 * (range.base_vertex + index);
+  return glm::vec3(values[0], values[1], values[2]);
+}
+
+/// Closed sphere of 'rings' x 'segments' quads, counter-clockwise from outside
+MeshData make_sphere(int rings, int segments) {
+  MeshData data;
+  data.name = "sphere";
+  for (int r = 0; r <= rings; r++) {
+    const float theta = glm::pi<float>() * r / rings;
+    for (int s = 0; s <= segments; s++) {
+      const float phi = 2.f * glm::pi<float>() * s / segments;
+      const glm::vec3 point(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+      data.vertices.insert(data.vertices.end(), {point.x * 3.f, point.y * 3.f, point.z * 3.f});
+      data.normals.insert(data.normals.end(), {point.x, point.y, point.z});
+    }
+  }
+  for (int r = 0; r < rings; r++) {
+    for (int s = 0; s < segments; s++) {
+      const uint32_t a = r * (segments + 1) + s, b = a + segments + 1;
+      data.indices.insert(data.indices.end(), {a, a + 1, b, a + 1, b + 1, b});
+    }
+  }
+  return data;
+}
+
+void check_meshlets(const std::string &name, const MeshData &data, const std::vector<Meshlet> &meshlets) {
+  std::vector<Submesh> ranges = data.submeshes;
+  if (ranges.empty()) {
+    Submesh whole;
+    whole.index_count = data.indices.size();
+    whole.vertex_count = data.vertex_count();
+    ranges.push_back(whole);
+  }
+
+  std::vector<size_t> next_index(ranges.size());
+  for (size_t s = 0; s < ranges.size(); s++) {
+    next_index[s] = ranges[s].first_index;
+  }
+  for (size_t m = 0; m < meshlets.size(); m++) {
+    const Meshlet &meshlet = meshlets[m];
+    const std::string label = name + " meshlet " + std::to_string(m);
+    check(meshlet.submesh < ranges.size(), label, "submesh out of range");
+    if (meshlet.submesh >= ranges.size()) {
+      continue;
+    }
+    const Submesh &range = ranges[meshlet.submesh];
+    check(meshlet.first_index == next_index[meshlet.submesh], label, "does not continue its submesh");
+    next_index[meshlet.submesh] = meshlet.first_index + 3 * size_t(meshlet.triangle_count);
+    check(next_index[meshlet.submesh] <= range.first_index + range.index_count, label, "leaves its submesh");
+    check(meshlet.triangle_count > 0 && meshlet.triangle_count <= max_triangles, label,
+          std::to_string(meshlet.triangle_count) + " triangles");
+
+    std::vector<uint32_t> distinct(data.indices.begin() + meshlet.first_index,
+                                   data.indices.begin() + meshlet.first_index + 3 * meshlet.triangle_count);
+    std::sort(distinct.begin(), distinct.end());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+    check(distinct.size() == meshlet.vertex_count && distinct.size() <= max_vertices, label,
+          std::to_string(distinct.size()) + " vertices, " + std::to_string(meshlet.vertex_count) + " counted");
+
+    const float tolerance = 1e-5f * std::max(1.f, meshlet.radius + glm::length(meshlet.center));
+    float min_cosine = 1.f;
+    for (size_t i = 0; i < 3 * size_t(meshlet.triangle_count); i += 3) {
+      const uint32_t *triangle = data.indices.data() + meshlet.first_index + i;
+      glm::vec3 points[3];
+      for (int k = 0; k < 3; k++) {
+        points[k] = position(data, range, triangle[k]);
+        check(glm::length(points[k] - meshlet.center) <= meshlet.radius + tolerance, label,
+              "vertex outside of the bounding sphere");
+      }
+      const glm::vec3 normal = glm::cross(points[1] - points[0], points[2] - points[0]);
+      if (glm::length(normal) > 0.f) {
+        min_cosine = std::min(min_cosine, glm::dot(glm::normalize(normal), meshlet.cone_axis));
+      }
+    }
+
+    check(meshlet.cone_cutoff >= 0.f && meshlet.cone_cutoff <= 1.f, label,
+          "cone cutoff " + std::to_string(meshlet.cone_cutoff));
+    if (meshlet.cone_cutoff < 1.f) {
+      check(std::abs(glm::length(meshlet.cone_axis) - 1.f) < 1e-4f, label, "cone axis is not normalized");
+      const float cone_cosine = std::sqrt(1.f - meshlet.cone_cutoff * meshlet.cone_cutoff);
+      check(min_cosine >= cone_cosine - 1e-4f, label, "triangle normal outside of the cone");
+    }
+  }
+  for (size_t s = 0; s < ranges.size(); s++) {
+    check(next_index[s] == ranges[s].first_index + ranges[s].index_count / 3 * 3, name,
+          "submesh " + std::to_string(s) + " not covered");
+  }
+}
+
+void check_culling(const std::string &name, const MeshData &data, const std::vector<Meshlet> &meshlets,
+                   const std::vector<View> &views) {
+  std::vector<Submesh> ranges = data.submeshes;
+  if (ranges.empty()) {
+    ranges.push_back(Submesh());
+  }
+  const MeshletCuller culler(meshlets);
+  const glm::mat4 projection = glm::perspective(glm::radians(45.f), 16.f / 9.f, 0.1f, 500.f);
+
+  for (size_t v = 0; v < views.size(); v++) {
+    const glm::vec3 &eye = views[v].eye;
+    const glm::mat4 view_projection = projection * glm::lookAt(eye, views[v].target, glm::vec3(0.f, 1.f, 0.f));
+    const std::string label = name + " view " + std::to_string(v);
+
+    for (int mode = 0; mode < 3; mode++) {
+      MeshletCullSettings settings;
+      settings.frustum = mode != 1;
+      settings.backface = mode != 0;
+      MeshletCullSettings scalar_settings = settings;
+      scalar_settings.simd = false;
+      std::vector<uint32_t> visible, scalar_visible;
+      culler.cull(view_projection, eye, settings, &visible);
+      culler.cull(view_projection, eye, scalar_settings, &scalar_visible);
+      check(visible == scalar_visible, label, "SSE2 and scalar culling differ in mode " + std::to_string(mode));
+      if (mode == 2) {
+        continue;
+      }
+
+      std::vector<bool> kept(meshlets.size(), false);
+      for (uint32_t index : visible) {
+        kept[index] = true;
+      }
+      for (size_t m = 0; m < meshlets.size(); m++) {
+        if (kept[m]) {
+          continue;
+        }
+        const Meshlet &meshlet = meshlets[m];
+        const Submesh &range = ranges[meshlet.submesh];
+        for (size_t i = 0; i < 3 * size_t(meshlet.triangle_count); i += 3) {
+          const uint32_t *triangle = data.indices.data() + meshlet.first_index + i;
+          const glm::vec3 p0 = position(data, range, triangle[0]);
+          const glm::vec3 p1 = position(data, range, triangle[1]);
+          const glm::vec3 p2 = position(data, range, triangle[2]);
+          if (mode == 0) {
+            for (const glm::vec3 &point : {p0, p1, p2}) {
+              const glm::vec4 clip = view_projection * glm::vec4(point, 1.f);
+              const float w = clip.w * (1.f + 1e-4f);
+              check(!(std::abs(clip.x) < w && std::abs(clip.y) < w && std::abs(clip.z) < w), label,
+                    "frustum culled meshlet " + std::to_string(m) + " with a vertex in view");
+            }
+          } else {
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const glm::vec3 to_triangle = p0 - eye;
+            check(glm::dot(normal, to_triangle) >= -1e-4f * glm::length(normal) * glm::length(to_triangle), label,
+                  "cone culled meshlet " + std::to_string(m) + " with a triangle facing the eye");
+          }
+        }
+      }
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj", "objects/screen.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  // The turn inside the room and the outside views of meshlet_bench, plus views all around the sphere
+  std::vector<View> room_views, sphere_views;
+  for (int step = 0; step < 36; step++) {
+    const float angle = glm::radians(step * 10.f);
+    const glm::vec3 eye(0.f, 2.f, 20.f);
+    room_views.push_back({eye, eye + glm::vec3(std::sin(angle), 0.f, -std::cos(angle))});
+    sphere_views.push_back(
+        {glm::vec3(std::sin(angle) * 8.f, std::cos(angle * 3.f) * 4.f, std::cos(angle) * 8.f), glm::vec3(0.f)});
+  }
+  for (const glm::vec3 &eye : {glm::vec3(0.f, 10.f, 150.f), glm::vec3(120.f, 30.f, 20.f),
+                               glm::vec3(-80.f, 60.f, -90.f)}) {
+    room_views.push_back({eye, glm::vec3(0.f, 4.f, 20.f)});
+  }
+
+  const MeshData sphere = make_sphere(48, 96);
+  const std::vector<Meshlet> sphere_meshlets = build_meshlets(sphere, max_vertices, max_triangles);
+  check_meshlets(sphere.name, sphere, sphere_meshlets);
+  check_culling(sphere.name, sphere, sphere_meshlets, sphere_views);
+  size_t checked = sphere_meshlets.size();
+
+  for (const std::string &file_name : files) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\"));
+    if (!load_obj(&attrib, &shapes, &materials, &err, file_name, base_dir + "/")) {
+      std::cout << file_name << ": " << err << std::endl;
+      failures++;
+      continue;
+    }
+
+    MeshData data = build_material_batches(attrib, shapes, materials, base_dir);
+    optimize_mesh(&data);
+    const std::vector<Meshlet> meshlets = build_meshlets(data, max_vertices, max_triangles);
+    check_meshlets(file_name, data, meshlets);
+    check_culling(file_name, data, meshlets, room_views);
+    checked += meshlets.size();
+  }
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << checked << " meshlets checked" << std::endl;
+  return 0;
+}
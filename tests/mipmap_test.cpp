@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mipmap.hpp"
+
+// Checks generate_mipmaps and generate_cubemap_mipmaps on generated images:
+//  - the SSE2 and the scalar kernels give the same bytes for every level, with both filters, with and without
+//    sRGB and premultiplied alpha, at odd and one texel wide sizes, with one and with many threads,
+//  - the chain halves with the sizes rounded down until 1x1, and downsample_image gives its first level,
+//  - a solid color stays the same on every level, the box filter averages 2x2 texels, and the color of
+//    transparent texels does not bleed into the levels with premultiplied alpha,
+//  - the same for the levels of a cubemap, plain and prefiltered, and on every level of 2 texels and more the
+//    texels along an edge of a face match those across it on the neighbouring face, found with the cube map table
+//    of the OpenGL specification.
+// Exits with 1 after printing the failures.
+// Usage: mipmap_test
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+/// Small linear congruential generator, so the images are the same on every platform
+uint32_t next_random(uint32_t *state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+/// Noise over hard edges and partly transparent texels, where filters overshoot and weights matter the most
+Image make_image(int width, int height, uint32_t seed) {
+  Image image;
+  image.width = width;
+  image.height = height;
+  image.pixels.resize(size_t(width) * height * 4);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      unsigned char *pixel = &image.pixels[4 * (size_t(y) * width + x)];
+      pixel[0] = static_cast<unsigned char>(next_random(&seed));
+      pixel[1] = static_cast<unsigned char>((x / 3 + y / 2) % 2 ? 255 : 0);
+      pixel[2] = static_cast<unsigned char>(8 * x + 3 * y);
+      pixel[3] = static_cast<unsigned char>(x % 4 == 0 ? 0 : next_random(&seed));
+    }
+  }
+  return image;
+}
+
+Image make_solid_image(int width, int height, const unsigned char color[4]) {
+  Image image;
+  image.width = width;
+  image.height = height;
+  for (size_t p = 0; p < size_t(width) * height; p++) {
+    image.pixels.insert(image.pixels.end(), color, color + 4);
+  }
+  return image;
+}
+
+std::string describe(const MipSettings &settings) {
+  return std::string(settings.filter == MipFilter::Box ? "box" : "Lanczos") + (settings.srgb ? " sRGB" : "") +
+         (settings.premultiplied_alpha ? " premultiplied" : "");
+}
+
+bool same_levels(const std::vector<Image> &a, const std::vector<Image> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].width != b[i].width || a[i].height != b[i].height || a[i].pixels != b[i].pixels) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Level sizes halve with rounding down, never below 1, and end at 1x1
+bool valid_chain(const std::vector<Image> &levels, int width, int height) {
+  for (const Image &level : levels) {
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+    if (level.width != width || level.height != height || level.pixels.size() != size_t(width) * height * 4) {
+      return false;
+    }
+  }
+  return width == 1 && height == 1;
+}
+
+bool all_pixels(const Image &image, const unsigned char color[4]) {
+  for (size_t p = 0; p < image.pixels.size(); p += 4) {
+    if (!std::equal(color, color + 4, &image.pixels[p])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Direction through the point (s, t) in [-1, 1] of a cube face, by the cube map table of the OpenGL
+/// specification. A point past the edge of the face points into its neighbour.
+std::array<float, 3> cube_direction(int face, float s, float t) {
+  switch (face) {
+  case 0:
+    return {1.f, -t, -s};
+  case 1:
+    return {-1.f, -t, s};
+  case 2:
+    return {s, 1.f, t};
+  case 3:
+    return {s, -1.f, -t};
+  case 4:
+    return {s, -t, 1.f};
+  default:
+    return {-s, -t, -1.f};
+  }
+}
+
+/// Face and texel a direction is sampled from in a cube with faces 'size' texels across
+void cube_texel(const std::array<float, 3> &direction, int size, int *face, int *x, int *y) {
+  int axis = 0;
+  for (int i = 1; i < 3; i++) {
+    if (std::abs(direction[i]) > std::abs(direction[axis])) {
+      axis = i;
+    }
+  }
+  *face = 2 * axis + (direction[axis] < 0.f ? 1 : 0);
+  const float major = std::abs(direction[axis]);
+  const float sc[6] = {-direction[2], direction[2], direction[0], direction[0], direction[0], -direction[0]};
+  const float tc[6] = {-direction[1], -direction[1], direction[2], -direction[2], -direction[1], -direction[1]};
+  auto texel = [size](float coordinate) {
+    return std::min(std::max(int((coordinate + 1.f) * 0.5f * size), 0), size - 1);
+  };
+  *x = texel(sc[*face] / major);
+  *y = texel(tc[*face] / major);
+}
+
+/// Compares every border texel of every level of 2 texels and more with the texel across the edge on the
+/// neighbouring face, returns the number of pairs
+size_t check_seams(const std::string &name, const std::vector<std::vector<Image>> &levels) {
+  size_t pairs = 0;
+  for (size_t level = 0; levels.size() == 6 && level < levels[0].size(); level++) {
+    const int size = levels[0][level].width;
+    if (size < 2) {
+      continue;
+    }
+    // Half a texel past the edge is the center of the texel across it
+    const float across[2] = {-1.f - 1.f / size, 1.f + 1.f / size};
+    for (int face = 0; face < 6; face++) {
+      for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+          const float s = (x + 0.5f) * 2.f / size - 1.f, t = (y + 0.5f) * 2.f / size - 1.f;
+          std::vector<std::array<float, 3>> neighbours;
+          if (x == 0 || x == size - 1) {
+            neighbours.push_back(cube_direction(face, across[x == 0 ? 0 : 1], t));
+          }
+          if (y == 0 || y == size - 1) {
+            neighbours.push_back(cube_direction(face, s, across[y == 0 ? 0 : 1]));
+          }
+          for (const std::array<float, 3> &direction : neighbours) {
+            int other, other_x, other_y;
+            cube_texel(direction, size, &other, &other_x, &other_y);
+            const unsigned char *texel = &levels[face][level].pixels[4 * (size_t(y) * size + x)];
+            const unsigned char *other_texel = &levels[other][level].pixels[4 * (size_t(other_y) * size + other_x)];
+            bool same = other != face;
+            for (int c = 0; c < 4; c++) {
+              same = same && std::abs(int(texel[c]) - int(other_texel[c])) <= 1;
+            }
+            check(same, name,
+                  "level " + std::to_string(level + 1) + " face " + std::to_string(face) + " texel " +
+                      std::to_string(x) + "," + std::to_string(y) + " differs from face " + std::to_string(other));
+            pairs++;
+          }
+        }
+      }
+    }
+  }
+  return pairs;
+}
+
+} // namespace
+
+int main() {
+  ThreadPool single_thread(1);
+  size_t checked = 0, seam_pairs = 0;
+
+  std::vector<MipSettings> all_settings;
+  for (MipFilter filter : {MipFilter::Box, MipFilter::Lanczos}) {
+    for (int flags = 0; flags < 4; flags++) {
+      MipSettings settings;
+      settings.filter = filter;
+      settings.srgb = (flags & 1) != 0;
+      settings.premultiplied_alpha = (flags & 2) != 0;
+      all_settings.push_back(settings);
+    }
+  }
+
+  const int sizes[][2] = {{2, 2}, {5, 3}, {13, 7}, {64, 1}, {1, 9}, {16, 16}, {33, 20}};
+  for (const auto &size : sizes) {
+    const int width = size[0], height = size[1];
+    const Image image = make_image(width, height, uint32_t(width * 97 + height));
+    for (MipSettings settings : all_settings) {
+      const std::string name = std::to_string(width) + "x" + std::to_string(height) + " " + describe(settings);
+      settings.simd = false;
+      const std::vector<Image> scalar = generate_mipmaps(image, settings, single_thread);
+      settings.simd = true;
+      const std::vector<Image> simd = generate_mipmaps(image, settings, ThreadPool::shared());
+      check(valid_chain(scalar, width, height), name, std::to_string(scalar.size()) + " levels of wrong size");
+      check(same_levels(scalar, simd), name, "differs between SSE2 on the shared pool and scalar on one thread");
+      check(!simd.empty() && same_levels({downsample_image(image, settings)}, {simd[0]}), name,
+            "downsample_image differs from the first level");
+      checked++;
+    }
+  }
+  check(generate_mipmaps(make_image(1, 1, 1)).empty(), "1x1", "has levels");
+
+  const unsigned char color[4] = {200, 100, 30, 160};
+  for (const MipSettings &settings : all_settings) {
+    const std::vector<Image> levels = generate_mipmaps(make_solid_image(12, 5, color), settings);
+    bool solid = !levels.empty();
+    for (const Image &level : levels) {
+      solid = solid && all_pixels(level, color);
+    }
+    check(solid, "solid 12x5 " + describe(settings), "changes its color");
+  }
+
+  // In linear space without alpha weights the box filter is the rounded mean of the 2x2 texels
+  MipSettings box;
+  box.filter = MipFilter::Box;
+  box.srgb = false;
+  box.premultiplied_alpha = false;
+  Image quad;
+  quad.width = quad.height = 2;
+  quad.pixels = {0, 255, 1, 255, 10, 255, 2, 255, 20, 255, 3, 255, 31, 0, 6, 255};
+  const std::vector<Image> mean = generate_mipmaps(quad, box);
+  const std::vector<unsigned char> expected_mean = {15, 191, 3, 255};
+  check(mean.size() == 1 && mean[0].pixels == expected_mean, "box 2x2", "is not the mean");
+
+  // Opaque green next to transparent red, the red must not reach any level with premultiplied alpha
+  for (const MipSettings &settings : all_settings) {
+    if (!settings.premultiplied_alpha) {
+      continue;
+    }
+    Image cutout;
+    cutout.width = 16;
+    cutout.height = 16;
+    for (int p = 0; p < 256; p++) {
+      const bool opaque = (p % 16) < 7;
+      const unsigned char texel[4] = {static_cast<unsigned char>(opaque ? 0 : 255),
+                                      static_cast<unsigned char>(opaque ? 255 : 0), 0,
+                                      static_cast<unsigned char>(opaque ? 255 : 0)};
+      cutout.pixels.insert(cutout.pixels.end(), texel, texel + 4);
+    }
+    bool no_bleeding = true;
+    for (const Image &level : generate_mipmaps(cutout, settings)) {
+      for (size_t p = 0; p < level.pixels.size(); p += 4) {
+        no_bleeding = no_bleeding && (level.pixels[p + 3] == 0 || level.pixels[p] == 0);
+      }
+    }
+    check(no_bleeding, "cutout " + describe(settings), "transparent color bleeds");
+  }
+
+  for (bool prefilter : {false, true}) {
+    for (const MipSettings &mip : {all_settings[1], all_settings[7]}) {
+      const std::string name = std::string(prefilter ? "prefiltered" : "plain") + " cubemap " + describe(mip);
+      CubemapMipSettings settings;
+      settings.mip = mip;
+      settings.prefilter = prefilter;
+      settings.prefilter_samples = 16;
+      std::vector<Image> faces;
+      for (uint32_t face = 0; face < 6; face++) {
+        faces.push_back(make_image(8, 8, face + 1));
+      }
+      settings.mip.simd = false;
+      const std::vector<std::vector<Image>> scalar = generate_cubemap_mipmaps(faces, settings, single_thread);
+      settings.mip.simd = true;
+      const std::vector<std::vector<Image>> simd = generate_cubemap_mipmaps(faces, settings, ThreadPool::shared());
+      check(scalar.size() == 6 && simd.size() == 6, name, std::to_string(scalar.size()) + " faces");
+      for (size_t face = 0; face < std::min(scalar.size(), simd.size()); face++) {
+        check(valid_chain(scalar[face], 8, 8), name, "face " + std::to_string(face) + " has levels of wrong size");
+        check(same_levels(scalar[face], simd[face]), name,
+              "face " + std::to_string(face) + " differs between SSE2 and scalar");
+      }
+
+      // A cube of one color looks the same in every direction, so neither the seams nor the lobe change it
+      const std::vector<std::vector<Image>> solid =
+          generate_cubemap_mipmaps(std::vector<Image>(6, make_solid_image(8, 8, color)), settings);
+      bool same_color = solid.size() == 6;
+      for (const std::vector<Image> &levels : solid) {
+        for (const Image &level : levels) {
+          same_color = same_color && all_pixels(level, color);
+        }
+      }
+      check(same_color, name, "changes a solid color");
+
+      // Faces of 12 texels go down to 1x1 through the odd 3x3, every level of the faces meets at the edges
+      std::vector<Image> noise;
+      for (uint32_t face = 0; face < 6; face++) {
+        noise.push_back(make_image(12, 12, 10 * face + 7));
+      }
+      const std::vector<std::vector<Image>> seamless = generate_cubemap_mipmaps(noise, settings);
+      for (size_t face = 0; face < seamless.size(); face++) {
+        check(seamless[face].size() == 3 && valid_chain(seamless[face], 12, 12), name,
+              "12x12 face " + std::to_string(face) + " has " + std::to_string(seamless[face].size()) + " levels");
+      }
+      seam_pairs += check_seams(name, seamless);
+      checked++;
+    }
+  }
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << checked << " mip chains and " << seam_pairs << " texels across cube edges checked" << std::endl;
+  return 0;
+}
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "pixel_format.hpp"
+
+// Checks the pixel conversions on generated pixels against plain per pixel references:
+//  - the SSE2 and the scalar paths of classify_pixels, pack_pixels, expand_to_rgba, swap_red_blue and
+//    premultiply_alpha give the same result as the reference, at pixel counts that leave a tail after the
+//    vectors and past the chunk of classify_pixels, with the pixel that decides the content anywhere,
+//  - pack_channels picks the smallest format for gray, gray with alpha, opaque and transparent color images,
+//    packs their pixels and levels the same with both paths, and pack_cubemap_channels packs all faces alike.
+// Exits with 1 after printing the failures.
+// Usage: pixel_format_test
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+/// Small linear congruential generator, so the pixels are the same on every platform
+uint32_t next_random(uint32_t *state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+std::vector<uint8_t> random_bytes(size_t count, uint32_t seed) {
+  std::vector<uint8_t> bytes(count);
+  for (uint8_t &byte : bytes) {
+    byte = static_cast<uint8_t>(next_random(&seed));
+  }
+  return bytes;
+}
+
+/// Opaque gray pixels, 'gray' and 'opaque' false break that in the pixel 'odd'
+std::vector<uint8_t> make_pixels(size_t pixel_count, bool gray, bool opaque, size_t odd, uint32_t seed) {
+  std::vector<uint8_t> pixels = random_bytes(4 * pixel_count, seed);
+  for (size_t p = 0; p < pixel_count; p++) {
+    pixels[4 * p + 1] = pixels[4 * p + 2] = pixels[4 * p];
+    pixels[4 * p + 3] = 255;
+  }
+  if (odd < pixel_count) {
+    if (!gray) {
+      pixels[4 * odd + 1 + odd % 2] ^= 1;
+    }
+    if (!opaque) {
+      pixels[4 * odd + 3] = static_cast<uint8_t>(odd % 255);
+    }
+  }
+  return pixels;
+}
+
+std::string format_name(GLenum format) {
+  switch (format) {
+  case GL_RED:
+    return "GL_RED";
+  case GL_RG:
+    return "GL_RG";
+  case GL_RGB:
+    return "GL_RGB";
+  case GL_BGR:
+    return "GL_BGR";
+  case GL_BGRA:
+    return "GL_BGRA";
+  default:
+    return "GL_RGBA";
+  }
+}
+
+void check_classify(const std::string &name, size_t pixel_count) {
+  const size_t positions[] = {0, pixel_count / 2, pixel_count - 1, pixel_count};
+  for (size_t odd : positions) {
+    for (int content = 0; content < 4; content++) {
+      const bool gray = (content & 1) != 0, opaque = (content & 2) != 0;
+      const std::vector<uint8_t> pixels = make_pixels(pixel_count, gray, opaque, odd, uint32_t(pixel_count + odd));
+      // A content broken in a pixel past the end is not broken
+      const bool expected_gray = gray || odd >= pixel_count, expected_opaque = opaque || odd >= pixel_count;
+      for (bool simd : {false, true}) {
+        const PixelContent result = classify_pixels(pixels.data(), pixel_count, simd);
+        check(result.gray == expected_gray && result.opaque == expected_opaque, name,
+              std::string(simd ? "SSE2" : "scalar") + " classifies pixel " + std::to_string(odd) + " wrong");
+      }
+    }
+  }
+}
+
+void check_conversions(const std::string &name, size_t pixel_count) {
+  const std::vector<uint8_t> pixels = random_bytes(4 * pixel_count, uint32_t(pixel_count));
+
+  for (GLenum format : {GL_RED, GL_RG, GL_RGB, GL_BGR}) {
+    const size_t channels = channel_count(format);
+    std::vector<uint8_t> expected;
+    for (size_t p = 0; p < pixel_count; p++) {
+      const uint8_t *pixel = &pixels[4 * p];
+      if (format == GL_RG) {
+        expected.insert(expected.end(), {pixel[0], pixel[3]});
+      } else {
+        expected.insert(expected.end(), pixel, pixel + channels);
+      }
+    }
+    for (bool simd : {false, true}) {
+      // One byte more than needed, which must stay untouched
+      std::vector<uint8_t> packed(channels * pixel_count + 1, 0xab);
+      pack_pixels(pixels.data(), pixel_count, format, packed.data(), simd);
+      check(std::equal(expected.begin(), expected.end(), packed.begin()) && packed.back() == 0xab, name,
+            std::string(simd ? "SSE2" : "scalar") + " packs " + format_name(format) + " wrong");
+    }
+  }
+
+  for (int channels = 1; channels <= 4; channels++) {
+    std::vector<uint8_t> expected;
+    for (size_t p = 0; p < pixel_count; p++) {
+      const uint8_t *pixel = &pixels[channels * p];
+      if (channels < 3) {
+        expected.insert(expected.end(), {pixel[0], pixel[0], pixel[0], channels == 2 ? pixel[1] : uint8_t(255)});
+      } else {
+        expected.insert(expected.end(), {pixel[0], pixel[1], pixel[2], channels == 4 ? pixel[3] : uint8_t(255)});
+      }
+    }
+    for (bool simd : {false, true}) {
+      std::vector<uint8_t> rgba(4 * pixel_count + 1, 0xab);
+      expand_to_rgba(pixels.data(), channels, pixel_count, rgba.data(), simd);
+      check(std::equal(expected.begin(), expected.end(), rgba.begin()) && rgba.back() == 0xab, name,
+            std::string(simd ? "SSE2" : "scalar") + " expands " + std::to_string(channels) + " channels wrong");
+    }
+  }
+
+  std::vector<uint8_t> swapped = pixels, premultiplied = pixels;
+  for (size_t p = 0; p < pixel_count; p++) {
+    std::swap(swapped[4 * p], swapped[4 * p + 2]);
+    for (int c = 0; c < 3; c++) {
+      // c * a / 255 is never halfway between two integers, as 255 is odd
+      premultiplied[4 * p + c] = static_cast<uint8_t>((2 * pixels[4 * p + c] * pixels[4 * p + 3] + 255) / 510);
+    }
+  }
+  for (bool simd : {false, true}) {
+    std::vector<uint8_t> result = pixels;
+    result.push_back(0xab);
+    swap_red_blue(result.data(), pixel_count, simd);
+    check(std::equal(swapped.begin(), swapped.end(), result.begin()) && result.back() == 0xab, name,
+          std::string(simd ? "SSE2" : "scalar") + " swaps red and blue wrong");
+
+    result = pixels;
+    result.push_back(0xab);
+    premultiply_alpha(result.data(), pixel_count, simd);
+    check(std::equal(premultiplied.begin(), premultiplied.end(), result.begin()) && result.back() == 0xab, name,
+          std::string(simd ? "SSE2" : "scalar") + " premultiplies wrong");
+  }
+}
+
+Image make_image(int width, int height, bool gray, bool opaque, GLenum pixel_format, bool with_levels) {
+  Image image;
+  image.width = width;
+  image.height = height;
+  image.pixel_format = pixel_format;
+  const size_t odd = size_t(width) * height / 3;
+  if (!with_levels) {
+    image.pixels = make_pixels(size_t(width) * height, gray, opaque, odd, uint32_t(width));
+    return image;
+  }
+
+  // Only the last level breaks the content, so every level has to be classified
+  auto storage = std::make_shared<std::vector<std::vector<uint8_t>>>();
+  for (int w = width, h = height;; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+    const bool last = w == 1 && h == 1;
+    storage->push_back(make_pixels(size_t(w) * h, gray || !last, opaque || !last, 0, uint32_t(w + h)));
+    if (last) {
+      break;
+    }
+  }
+  for (size_t i = 0; i < storage->size(); i++) {
+    const std::vector<uint8_t> &level = (*storage)[i];
+    image.levels.push_back({std::max(1, width >> i), std::max(1, height >> i), level.data(), level.size()});
+  }
+  image.storage = storage;
+  return image;
+}
+
+/// The bytes of the pixels or of every level
+std::vector<uint8_t> image_bytes(const Image &image) {
+  std::vector<uint8_t> bytes(image.pixels.begin(), image.pixels.end());
+  for (const ImageLevel &level : image.levels) {
+    bytes.insert(bytes.end(), level.data, level.data + level.size);
+  }
+  return bytes;
+}
+
+void check_pack_channels() {
+  for (bool with_levels : {false, true}) {
+    for (GLenum pixel_format : {GLenum(GL_RGBA), GLenum(GL_BGRA)}) {
+      for (int content = 0; content < 4; content++) {
+        const bool gray = (content & 1) != 0, opaque = (content & 2) != 0;
+        const GLenum expected = gray ? (opaque ? GL_RED : GL_RG)
+                                     : (opaque ? (pixel_format == GL_RGBA ? GL_RGB : GL_BGR) : pixel_format);
+        const std::string name = std::string(with_levels ? "levels " : "pixels ") + format_name(pixel_format) +
+                                 (gray ? " gray" : " color") + (opaque ? " opaque" : " with alpha");
+        const Image image = make_image(13, 5, gray, opaque, pixel_format, with_levels);
+        const std::vector<uint8_t> original = image_bytes(image);
+
+        const Image scalar = pack_channels(image, false);
+        const Image simd = pack_channels(image, true);
+        check(scalar.pixel_format == expected && simd.pixel_format == expected, name,
+              "packs into " + format_name(scalar.pixel_format) + " and " + format_name(simd.pixel_format));
+        check(image_bytes(scalar) == image_bytes(simd), name, "differs between SSE2 and scalar");
+
+        const std::vector<uint8_t> packed = image_bytes(simd);
+        std::vector<uint8_t> repacked(original.size() / 4 * channel_count(expected));
+        pack_pixels(original.data(), original.size() / 4, expected, repacked.data(), false);
+        check(packed == repacked, name, "pixels changed");
+        check(simd.levels.size() == image.levels.size() && (with_levels || simd.levels.empty()), name,
+              "levels changed");
+      }
+    }
+  }
+
+  // One colored face makes all faces RGB
+  std::vector<Image> faces(6, make_image(4, 4, true, true, GL_RGBA, false));
+  faces[4] = make_image(4, 4, false, true, GL_RGBA, false);
+  for (bool simd : {false, true}) {
+    bool same_format = true;
+    for (const Image &face : pack_cubemap_channels(faces, simd)) {
+      same_format = same_format && face.pixel_format == GL_RGB && face.pixels.size() == 4 * 4 * 3;
+    }
+    check(same_format, "cubemap", std::string(simd ? "SSE2" : "scalar") + " packs the faces differently");
+  }
+}
+
+} // namespace
+
+int main() {
+  const size_t counts[] = {1, 3, 4, 5, 15, 16, 17, 31, 33, 100, 4095, 4096, 4097, 9000};
+  for (size_t pixel_count : counts) {
+    const std::string name = std::to_string(pixel_count) + " pixels";
+    check_classify(name, pixel_count);
+    check_conversions(name, pixel_count);
+  }
+  check_pack_channels();
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << sizeof(counts) / sizeof(counts[0]) << " pixel counts, 16 images and a cubemap checked" << std::endl;
+  return 0;
+}
@@ -0,0 +1,146 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "texture_cache.hpp"
+
+// Checks the bookkeeping of TextureCache with a deleter that records the textures instead of deleting them:
+//  - acquire of a cached key returns the same texture with a new reference, and 0 for other keys,
+//  - insert, acquire, retain, release and set_memory keep the counts and the memory of all and of the
+//    referenced textures consistent, and a key is cached only once,
+//  - the memory limit and trim delete only unreferenced textures, the one released first first, and no more
+//    than the limit asks for.
+// Exits with 1 after printing the failures.
+// Usage: texture_cache_test
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+void check_stats(const TextureCache &cache, const std::string &name, size_t textures, size_t referenced_textures,
+                 size_t memory, size_t referenced_memory) {
+  const TextureCacheStats stats = cache.get_stats();
+  check(stats.textures == textures && stats.referenced_textures == referenced_textures, name,
+        std::to_string(stats.textures) + " textures, " + std::to_string(stats.referenced_textures) + " referenced");
+  check(stats.memory == memory && stats.referenced_memory == referenced_memory, name,
+        std::to_string(stats.memory) + " bytes, " + std::to_string(stats.referenced_memory) + " referenced");
+}
+
+std::string describe(const std::vector<GLuint> &textures) {
+  std::string text = "deleted";
+  for (GLuint texture : textures) {
+    text += " " + std::to_string(texture);
+  }
+  return text;
+}
+
+void check_references() {
+  std::vector<GLuint> deleted;
+  TextureCache cache([&deleted](GLuint texture_id) { deleted.push_back(texture_id); });
+
+  check(cache.acquire("a") == 0, "empty", "acquires a texture");
+  cache.insert("a", 1, 100);
+  cache.insert("b", 2, 50);
+  check_stats(cache, "inserted", 2, 2, 150, 150);
+
+  check(cache.acquire("a") == 1 && cache.acquire("a") == 1, "acquire", "returns another texture");
+  check(cache.acquire("c") == 0, "acquire", "returns a texture of another key");
+  const TextureCacheStats counts = cache.get_stats();
+  check(counts.hits == 2 && counts.misses == 2, "acquire",
+        std::to_string(counts.hits) + " hits, " + std::to_string(counts.misses) + " misses");
+
+  bool thrown = false;
+  try {
+    cache.insert("a", 3, 10);
+  } catch (const std::string &) {
+    thrown = true;
+  }
+  check(thrown, "insert", "caches a key twice");
+
+  // Texture 1 has three references now
+  cache.release(1);
+  cache.release(1);
+  check_stats(cache, "released twice", 2, 2, 150, 150);
+  cache.release(1);
+  check_stats(cache, "released", 2, 1, 150, 50);
+  cache.release(1);
+  cache.release(7);
+  check_stats(cache, "released too often", 2, 1, 150, 50);
+
+  cache.set_memory(1, 40);
+  cache.set_memory(2, 70);
+  check_stats(cache, "resized", 2, 1, 110, 70);
+
+  // An unreferenced texture comes back with its memory
+  cache.retain(1);
+  check_stats(cache, "retained", 2, 2, 110, 110);
+  cache.release(1);
+  cache.release(2);
+  check_stats(cache, "unreferenced", 2, 0, 110, 0);
+  check(cache.acquire("b") == 2, "acquire", "does not return the unreferenced texture");
+  check_stats(cache, "acquired again", 2, 1, 110, 70);
+  check(deleted.empty(), "references", describe(deleted) + " under the limit");
+}
+
+void check_eviction() {
+  std::vector<GLuint> deleted;
+  TextureCache cache([&deleted](GLuint texture_id) { deleted.push_back(texture_id); });
+  for (GLuint texture_id = 1; texture_id <= 5; texture_id++) {
+    cache.insert("texture " + std::to_string(texture_id), texture_id, 100);
+  }
+  for (GLuint texture_id : {3, 1, 5}) {
+    cache.release(texture_id);
+  }
+  check_stats(cache, "released", 5, 2, 500, 200);
+
+  cache.set_memory_limit(350);
+  check(deleted == std::vector<GLuint>({3, 1}), "limit 350", describe(deleted));
+  check_stats(cache, "limit 350", 3, 2, 300, 200);
+  check(cache.acquire("texture 3") == 0 && cache.acquire("texture 2") == 2, "limit 350",
+        "acquire does not follow the deletions");
+  cache.release(2);
+  cache.release(2);
+
+  // Texture 2 was released after texture 5
+  cache.set_memory_limit(250);
+  check(deleted == std::vector<GLuint>({3, 1, 5}), "limit 250", describe(deleted));
+  check_stats(cache, "limit 250", 2, 1, 200, 100);
+
+  // Referenced textures stay above the limit
+  cache.set_memory_limit(1);
+  check(deleted == std::vector<GLuint>({3, 1, 5, 2}), "limit 1", describe(deleted));
+  check_stats(cache, "limit 1", 1, 1, 100, 100);
+  check(cache.get_stats().evictions == 4, "limit 1", std::to_string(cache.get_stats().evictions) + " evictions");
+
+  cache.set_memory_limit(0);
+  cache.insert("texture 6", 6, 1000);
+  cache.release(6);
+  check(deleted.size() == 4, "no limit", describe(deleted));
+  cache.trim();
+  check(deleted == std::vector<GLuint>({3, 1, 5, 2, 6}), "trim", describe(deleted));
+  check_stats(cache, "trim", 1, 1, 100, 100);
+  check(cache.get_stats().peak_memory == 1100, "trim", "peak memory " + std::to_string(cache.get_stats().peak_memory));
+}
+
+} // namespace
+
+int main() {
+  check_references();
+  check_eviction();
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "references and evictions checked" << std::endl;
+  return 0;
+}
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mesh_lod.hpp"
+#include "texel_density.hpp"
+#include "texture_residency.hpp"
+
+// Checks the plan of TextureResidency on tracked textures that do not exist in OpenGL, with end_frame:
+//  - under the budget every texture keeps the levels it needs, over it the least recently used textures lose
+//    their largest levels first, the larger one of textures used in the same frame first, and only as many as
+//    the budget asks for,
+//  - no texture loses its 'kept_levels' smallest levels and a texture used in the frame loses none, the frames
+//    that still end over the budget are counted,
+//  - a texture keeps a finer level it needed for 'keep_frames' frames before a coarser request counts, a finer
+//    request counts at once,
+//  - needed_level gives level 0 when a texel of level 0 covers a pixel and one level more for every doubling of
+//    the distance in uv_per_pixel, up to the last level above the 'kept_levels' smallest ones.
+// Exits with 1 after printing the failures.
+// Usage: texture_residency_test
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+/// Levels of a square texture whose level 0 is 2^(level_count - 1) texels across, 4 bytes per texel
+std::vector<size_t> level_sizes(size_t level_count) {
+  std::vector<size_t> sizes;
+  for (size_t level = 0; level < level_count; level++) {
+    const size_t width = size_t(1) << (level_count - 1 - level);
+    sizes.push_back(4 * width * width);
+  }
+  return sizes;
+}
+
+size_t sum(const std::vector<size_t> &sizes, size_t first, size_t end) {
+  size_t bytes = 0;
+  for (size_t i = first; i < end && i < sizes.size(); i++) {
+    bytes += sizes[i];
+  }
+  return bytes;
+}
+
+size_t planned_levels(const TextureResidency &residency, GLuint texture_id) {
+  for (const TextureResidencyEntry &entry : residency.get_report()) {
+    if (entry.texture_id == texture_id) {
+      return entry.planned_levels;
+    }
+  }
+  return size_t(-1);
+}
+
+const size_t large_levels = 10, small_levels = 9;
+
+struct Plan {
+  std::vector<size_t> levels;
+  size_t frames_over_budget = 0;
+};
+
+/// Textures 1 and 4 are last used in frame 1, texture 2 in frame 2 and texture 3 in frame 3, when the plan is
+/// checked. Texture 4 is smaller than the others.
+Plan plan_with_budget(size_t budget) {
+  TextureResidency residency;
+  for (GLuint texture_id : {1, 2, 3}) {
+    residency.track(texture_id, "large " + std::to_string(texture_id), level_sizes(large_levels));
+  }
+  residency.track(4, "small", level_sizes(small_levels));
+
+  for (GLuint texture_id : {1, 2, 3, 4}) {
+    residency.touch(texture_id);
+  }
+  residency.end_frame();
+  residency.touch(2);
+  residency.touch(3);
+  residency.end_frame();
+  residency.touch(3);
+  // The textures of the earlier frames all fit, the budget is for the last one
+  residency.set_budget(budget);
+  residency.end_frame();
+
+  Plan plan;
+  for (GLuint texture_id : {1, 2, 3, 4}) {
+    plan.levels.push_back(planned_levels(residency, texture_id));
+  }
+  plan.frames_over_budget = residency.get_stats().frames_over_budget;
+  return plan;
+}
+
+void check_plan(const std::string &name, size_t budget, const std::vector<size_t> &expected, bool over_budget) {
+  const Plan plan = plan_with_budget(budget);
+  std::string planned;
+  for (size_t levels : plan.levels) {
+    planned += " " + std::to_string(levels);
+  }
+  check(plan.levels == expected, name, "plans the levels" + planned);
+  check((plan.frames_over_budget > 0) == over_budget, name,
+        std::to_string(plan.frames_over_budget) + " frames over the budget");
+}
+
+void check_budget() {
+  const std::vector<size_t> large = level_sizes(large_levels), small = level_sizes(small_levels);
+  const size_t full = 3 * sum(large, 0, large.size()) + sum(small, 0, small.size());
+  const size_t large_max = large_levels - TextureResidency::kept_levels;
+  const size_t small_max = small_levels - TextureResidency::kept_levels;
+
+  check_plan("no budget", 0, {0, 0, 0, 0}, false);
+  check_plan("budget fits", full, {0, 0, 0, 0}, false);
+  // Textures 1 and 4 are the least recently used, 1 is the larger one
+  check_plan("one byte over", full - 1, {1, 0, 0, 0}, false);
+  check_plan("two levels over", full - large[0] - 1, {2, 0, 0, 0}, false);
+  check_plan("texture 1 reduced", full - sum(large, 0, large_max), {large_max, 0, 0, 0}, false);
+  check_plan("texture 4 next", full - sum(large, 0, large_max) - 1, {large_max, 0, 0, 1}, false);
+  check_plan("texture 2 next", full - sum(large, 0, large_max) - sum(small, 0, small_max) - 1,
+             {large_max, 1, 0, small_max}, false);
+  // Texture 3 is used in the frame
+  check_plan("over budget", 1, {large_max, large_max, 0, small_max}, true);
+}
+
+void check_keep_frames() {
+  TextureResidency residency;
+  residency.track(1, "texture", level_sizes(large_levels));
+  residency.touch(1);
+  residency.end_frame();
+
+  // A quarter of the texels of level 0 across a pixel, so level 2 is enough
+  const float coarse = std::ldexp(1.f, -int(large_levels) + 1 + 2);
+  check(TextureResidency::needed_level(large_levels, coarse) == 2, "keep frames", "level 2 not needed");
+  for (uint64_t frame = 2; frame <= TextureResidency::keep_frames + 5; frame++) {
+    residency.request(1, coarse);
+    residency.end_frame();
+    const size_t expected = frame - 1 > TextureResidency::keep_frames ? 2 : 0;
+    check(planned_levels(residency, 1) == expected, "frame " + std::to_string(frame),
+          "plans " + std::to_string(planned_levels(residency, 1)) + " levels");
+  }
+
+  residency.request(1, coarse / 2.f);
+  residency.end_frame();
+  check(planned_levels(residency, 1) == 1, "finer request", "does not count at once");
+  // Not requested nor bound, the needed level stays
+  residency.end_frame();
+  check(planned_levels(residency, 1) == 1, "unused", "changes the plan");
+}
+
+void check_needed_level() {
+  const size_t level_count = 12, size = size_t(1) << (level_count - 1);
+  const size_t max_level = level_count - TextureResidency::kept_levels;
+  for (size_t k = 0; k < level_count + 3; k++) {
+    const float uv = std::ldexp(1.f, int(k)) / float(size);
+    check(TextureResidency::needed_level(level_count, uv) == std::min(k, max_level),
+          "uv_per_pixel " + std::to_string(uv), "needs level " + std::to_string(TextureResidency::needed_level(
+                                                                     level_count, uv)));
+  }
+  check(TextureResidency::needed_level(level_count, 0.f) == 0, "uv_per_pixel 0", "is not level 0");
+  check(TextureResidency::needed_level(TextureResidency::kept_levels, 1.f) == 0, "kept levels", "are dropped");
+
+  TexelDensity density;
+  density.bounds_min = glm::vec3(-1.f);
+  density.bounds_max = glm::vec3(1.f);
+  density.uv_per_unit = 0.5f;
+  const float scale = lod_projection_scale(0.8f, 1080.f);
+  // At this distance a texel of level 0 covers a pixel
+  const float texel_distance = scale / (density.uv_per_unit * float(size));
+  // Above the top face of the bounds
+  const glm::vec3 nearest(0.3f, 1.f, 0.2f), direction(0.f, 1.f, 0.f);
+
+  const float exact = uv_per_pixel(density, nearest + direction * texel_distance, scale);
+  check(std::abs(exact * float(size) - 1.f) < 1e-4f, "texel distance", "uv_per_pixel " + std::to_string(exact));
+  check(TextureResidency::needed_level(level_count, exact) == 0, "texel distance", "does not need level 0");
+  check(uv_per_pixel(density, glm::vec3(0.5f), scale) == 0.f, "inside the bounds", "uv_per_pixel is not 0");
+
+  // Halfway between the doublings, so rounding does not matter
+  for (size_t k = 0; k < level_count; k++) {
+    const float distance = texel_distance * 1.5f * std::ldexp(1.f, int(k));
+    const size_t level = TextureResidency::needed_level(level_count,
+                                                        uv_per_pixel(density, nearest + direction * distance, scale));
+    check(level == std::min(k, max_level), "distance " + std::to_string(distance),
+          "needs level " + std::to_string(level));
+  }
+}
+
+} // namespace
+
+int main() {
+  check_budget();
+  check_keep_frames();
+  check_needed_level();
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "8 budgets, the kept levels and the needed levels checked" << std::endl;
+  return 0;
+}
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "obj_loader.hpp"
+#include "vertex_format.hpp"
+
+// Checks the compact vertex encodings:
+//  - every half float survives half_to_float and float_to_half, floats between halves round to the nearest,
+//    values past 65504 become infinity and values below the smallest subnormal become zero,
+//  - pack_snorm_10_10_10_2 keeps -1, 0 and 1 exact, rounds to the nearest of the 511 steps, clamps outside of
+//    [-1, 1], and unpack_snorm_10_10_10_2 maps -512 to -1 like OpenGL,
+//  - measure_quantization_error of the compact scene meshes stays below the bounds of the encodings: the
+//    diagonal of the bounds / 65535 for positions and 1 / 511 for every normal component.
+// Exits with 1 after printing the failures.
+// Usage: vertex_format_test [file.obj ...]
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &name, const std::string &what) {
+  if (!condition) {
+    if (failures < 20) {
+      std::cout << name << ": " << what << std::endl;
+    }
+    failures++;
+  }
+}
+
+uint32_t bits_of(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+void check_half() {
+  for (uint32_t bits = 0; bits <= 0xffff; bits++) {
+    const uint16_t half = static_cast<uint16_t>(bits);
+    const float value = half_to_float(half);
+    if ((half & 0x7c00) == 0x7c00 && (half & 0x3ff) != 0) {
+      check(std::isnan(value) && std::isnan(half_to_float(float_to_half(value))), "half " + std::to_string(bits),
+            "NaN is lost");
+      continue;
+    }
+    check(float_to_half(value) == half, "half " + std::to_string(bits), "does not survive the round trip");
+  }
+
+  struct Case {
+    float value;
+    uint16_t half;
+  };
+  const float infinity = std::numeric_limits<float>::infinity();
+  const Case cases[] = {
+      {0.f, 0x0000},           {-0.f, 0x8000},        {1.f, 0x3c00},         {-1.f, 0xbc00},
+      {65504.f, 0x7bff},       {-65504.f, 0xfbff},    {65519.f, 0x7bff},     {65520.f, 0x7c00},
+      {1e6f, 0x7c00},          {-1e6f, 0xfc00},       {infinity, 0x7c00},    {-infinity, 0xfc00},
+      // Smallest subnormal, largest subnormal and smallest normal half
+      {std::ldexp(1.f, -24), 0x0001},                 {std::ldexp(1023.f, -24), 0x03ff},
+      {std::ldexp(1.f, -14), 0x0400},                 {-std::ldexp(1.f, -24), 0x8001},
+      // Halfway cases round to even, below half of the smallest subnormal is zero
+      {std::ldexp(1.f, -25), 0x0000},                 {std::ldexp(3.f, -25), 0x0002},
+      {std::ldexp(1.f, -26), 0x0000},                 {std::ldexp(1.5f, -25), 0x0001},
+      {1.f + std::ldexp(1.f, -11), 0x3c00},           {1.f + std::ldexp(3.f, -11), 0x3c02},
+      {std::numeric_limits<float>::denorm_min(), 0x0000},
+  };
+  for (const Case &c : cases) {
+    const std::string name = "float " + std::to_string(c.value) + " (" + std::to_string(bits_of(c.value)) + ")";
+    check(float_to_half(c.value) == c.half, name, "converts to " + std::to_string(float_to_half(c.value)));
+  }
+  check(std::isnan(half_to_float(float_to_half(std::numeric_limits<float>::quiet_NaN()))), "NaN", "is lost");
+
+  // Floats between the halves are at most half a step off, relative for normal and absolute for subnormal halves
+  for (float magnitude = 1e-9f; magnitude < 70000.f; magnitude *= 1.0001f) {
+    for (float value : {magnitude, -magnitude}) {
+      const float decoded = half_to_float(float_to_half(value));
+      if (magnitude > 65504.f) {
+        check(std::isinf(decoded) || std::abs(decoded) == 65504.f, "float " + std::to_string(value),
+              "is not clamped");
+        continue;
+      }
+      const float bound = std::max(magnitude * std::ldexp(1.f, -11), std::ldexp(1.f, -25));
+      check(std::abs(decoded - value) <= bound, "float " + std::to_string(value),
+            "converts to " + std::to_string(decoded));
+    }
+  }
+}
+
+void check_snorm() {
+  struct Case {
+    float value;
+    int quantized;
+  };
+  const Case cases[] = {{0.f, 0}, {1.f, 511}, {-1.f, -511}, {2.f, 511}, {-5.f, -511}, {0.5f, 256}, {-0.5f, -256}};
+  for (const Case &c : cases) {
+    for (int component = 0; component < 3; component++) {
+      glm::vec3 value(0.f);
+      value[component] = c.value;
+      const uint32_t packed = pack_snorm_10_10_10_2(value);
+      const uint32_t expected = (static_cast<uint32_t>(c.quantized) & 0x3ff) << (10 * component);
+      check(packed == expected, "snorm " + std::to_string(c.value), "packs component " + std::to_string(component) +
+                                                                        " to " + std::to_string(packed));
+      check(unpack_snorm_10_10_10_2(packed) == glm::clamp(value, -1.f, 1.f) || std::abs(c.value) == 0.5f,
+            "snorm " + std::to_string(c.value), "changes in component " + std::to_string(component));
+    }
+  }
+  check(unpack_snorm_10_10_10_2(0x200) == glm::vec3(-1.f, 0.f, 0.f), "snorm -512", "is not -1");
+
+  // Every code except -512 survives the round trip, values between the codes are at most half a step off
+  for (int quantized = -511; quantized <= 511; quantized++) {
+    const uint32_t bits = static_cast<uint32_t>(quantized) & 0x3ff;
+    const uint32_t packed = bits | (bits << 10) | (bits << 20);
+    check(pack_snorm_10_10_10_2(unpack_snorm_10_10_10_2(packed)) == packed, "snorm " + std::to_string(quantized),
+          "does not survive the round trip");
+  }
+  for (float value = -1.f; value <= 1.f; value += 0.000731f) {
+    const glm::vec3 decoded = unpack_snorm_10_10_10_2(pack_snorm_10_10_10_2(glm::vec3(value, -value, value * 0.3f)));
+    check(std::abs(decoded.x - value) <= 0.5f / 511.f + 1e-6f && std::abs(decoded.y + value) <= 0.5f / 511.f + 1e-6f,
+          "snorm " + std::to_string(value), "converts to " + std::to_string(decoded.x));
+  }
+}
+
+void check_mesh(const std::string &name, const MeshData &data) {
+  std::vector<uint16_t> short_indices;
+  const MeshView view = make_mesh_view(data, &short_indices);
+  glm::vec3 offset, scale;
+  const std::vector<CompactVertex> compact = compact_vertices(view, &offset, &scale);
+  const QuantizationError error = measure_quantization_error(view, compact, offset, scale);
+
+  const float position_bound = glm::length(scale) / 65535.f;
+  check(error.position <= position_bound, name,
+        "position error " + std::to_string(error.position) + " above " + std::to_string(position_bound));
+  check(error.position_relative <= 1.f / 65535.f, name,
+        "relative position error " + std::to_string(error.position_relative));
+
+  // measure_quantization_error gives the angle, the components are compared here
+  float normal_error = 0.f;
+  for (size_t v = 0; view.normals && v < view.vertex_count; v++) {
+    const glm::vec3 normal(view.normals[3 * v], view.normals[3 * v + 1], view.normals[3 * v + 2]);
+    if (glm::length(normal) > 0.f) {
+      const glm::vec3 difference = glm::abs(unpack_snorm_10_10_10_2(compact[v].normal) - glm::normalize(normal));
+      normal_error = std::max(normal_error, std::max(difference.x, std::max(difference.y, difference.z)));
+    }
+  }
+  check(normal_error <= 1.f / 511.f, name, "normal component error " + std::to_string(normal_error));
+  check(error.normal_degrees <= glm::degrees(std::sqrt(3.f) / 511.f), name,
+        "normal error " + std::to_string(error.normal_degrees) + " degrees");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files = {"objects/interior_preview.obj", "objects/Windows.obj", "objects/screen.obj"};
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+  }
+
+  check_half();
+  check_snorm();
+  for (const std::string &file_name : files) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\"));
+    if (!load_obj(&attrib, &shapes, &materials, &err, file_name, base_dir + "/")) {
+      std::cout << file_name << ": " << err << std::endl;
+      failures++;
+      continue;
+    }
+
+    check_mesh(file_name, build_material_batches(attrib, shapes, materials, base_dir));
+  }
+
+  if (failures > 0) {
+    std::cout << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "65536 halves, 1023 snorm codes and " << files.size() << " meshes checked" << std::endl;
+  return 0;
+}
@@ -2,15 +2,31 @@
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
 #include <string>
-#include <sstream>
+#include <iostream>
 
 using namespace std;
 
+namespace {
+
+/// Sets the int uniform unless 'current' says it already holds the value
+void set_uniform_if_changed(GLint location, int value, int *current) {
+  if (*current != value) {
+    glUniform1i(location, value);
+    *current = value;
+    render_stats().uniform_calls += 1;
+  }
+}
+
+} // namespace
+
 void Application::init() {
   // Enable depth and blend testing
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_BLEND);
+  // The skybox levels match across the face edges, filter across them as well
+  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
   // Set clear values
   glClearColor(0.1f, 0.1f, 0.1f, .0f);
@@ -30,57 +46,121 @@ void Application::init() {
   view_matrix_loc = program->get_uniform_location("view_matrix");
   projection_matrix_loc = program->get_uniform_location("projection_matrix");
   eye_pos_loc = program->get_uniform_location("eye_pos");
+  position_offset_loc = program->get_uniform_location("position_offset");
+  position_scale_loc = program->get_uniform_location("position_scale");
 
   /// LIGHTS
-  // Pointlights
+  // One uniform buffer instead of a uniform per member, the constant parameters are uploaded once
+  light_buffer = make_unique<UniformBuffer>(sizeof(LightBlock), light_block_binding);
+  program->bind_uniform_block("Lights", light_block_binding);
+
+  // Point lights
   for (int i = 0; i < NR_POINT_LIGHTS; ++i) {
-      point_lights_pos_loc[i] = program->get_uniform_location(cycle_concat(i, "point_lights[", "].position"));
-      point_lights_ambient_loc[i] = program->get_uniform_location(cycle_concat(i, "point_lights[", "].ambient"));
-      point_lights_diffuse_loc[i] = program->get_uniform_location(cycle_concat(i, "point_lights[", "].diffuse"));
-      point_lights_specular_loc[i] = program->get_uniform_location(cycle_concat(i, "point_lights[", "].specular"));
-      point_lights_attenuation_constant_loc[i] = program->get_uniform_location(cycle_concat(i, "point_lights[", "].constant"));
-      point_lights_attenuation_linear_loc[i] = program->get_uniform_location(cycle_concat(i, "point_lights[", "].linear"));
-      point_lights_attenuation_quadratic_loc[i] = program->get_uniform_location(cycle_concat(i, "point_lights[", "].quadratic"));
+      lights.point_lights[i].position = point_lights_positions[i];
+      lights.point_lights[i].constant = 1.f;
+      lights.point_lights[i].linear = 0.014f;
+      lights.point_lights[i].quadratic = 0.0007f;
   }
 
   // Direction light
-  dir_light_dir_loc = program->get_uniform_location("dir_light.direction");
-  dir_light_ambient_loc = program->get_uniform_location("dir_light.ambient");
-  dir_light_diffuse_loc = program->get_uniform_location("dir_light.diffuse");
-  dir_light_specular_loc = program->get_uniform_location("dir_light.specular");
+  lights.dir_light.direction = glm::vec3(-50.f, -52.f, -316.f);
 
   // Spot lights
   for (int i = 0; i < NR_SPOT_LIGHTS; ++i) {
-      spot_lights_pos_loc[i] = program->get_uniform_location(cycle_concat(i, "spot_lights[", "].position"));
-      spot_lights_dir_loc[i] = program->get_uniform_location(cycle_concat(i, "spot_lights[", "].direction"));
-      spot_lights_cut_off_loc[i] = program->get_uniform_location(cycle_concat(i, "spot_lights[", "].cut_off"));
-      spot_lights_outer_cut_off_loc[i] = program->get_uniform_location(cycle_concat(i, "spot_lights[", "].outer_cut_off"));
-      spot_lights_attenuation_constant_loc[i] = program->get_uniform_location(cycle_concat(i, "spot_lights[", "].constant"));
-      spot_lights_attenuation_linear_loc[i] = program->get_uniform_location(cycle_concat(i, "spot_lights[", "].linear"));
-      spot_lights_attenuation_quadratic_loc[i] = program->get_uniform_location(cycle_concat(i, "spot_lights[", "].quadratic"));
-      spot_lights_ambient_loc[i] = program->get_uniform_location(cycle_concat(i, "spot_lights[", "].ambient"));
-      spot_lights_diffuse_loc[i] = program->get_uniform_location(cycle_concat(i, "spot_lights[", "].diffuse"));
-      spot_lights_specular_loc[i] = program->get_uniform_location(cycle_concat(i, "spot_lights[", "].specular"));
+      SpotLightStd140 &light = lights.spot_lights[i];
+      light.position = spot_lights_positions[i];
+      light.direction = spot_lights_directions[i];
+      if (i == SCREEN_SPOT_LIGHT) {
+          light.cut_off = glm::cos(glm::radians(20.f));
+          light.outer_cut_off = glm::cos(glm::radians(80.f));
+          light.constant = 1.f;
+          light.linear = 0.022f;
+          light.quadratic = 0.0019f;
+          light.ambient = screen_light_color * 0.2f;
+          light.specular = screen_light_color * 0.8f;
+      } else {
+          light.cut_off = glm::cos(glm::radians(10.5f));
+          light.outer_cut_off = glm::cos(glm::radians(30.5f));
+          light.constant = 1.f;
+          light.linear = 0.09f;
+          light.quadratic = 0.032f;
+          light.ambient = spot_lights_colors * 0.2f;
+          light.diffuse = spot_lights_colors * 0.5f;
+          light.specular = spot_lights_colors * 0.8f;
+      }
   }
 
   /// OBJECTS
-  for (auto const& o : obj) {
-      o->create_vao(position_loc, normal_loc, texture_coordinate_loc);
-  }
-  for (auto const& window : windows) {
-      window->create_vao(position_loc, normal_loc, texture_coordinate_loc);
-  }
-  for (const auto& scr : screen) {
-      scr->create_vao(position_loc, normal_loc, texture_coordinate_loc);
+  // Material textures come from BC1/BC3 files next to the images, encoded on the first run
+  if (!set_texture_compression(true)) {
+    std::cout << "S3TC texture compression is not supported, textures stay uncompressed" << std::endl;
   }
+  // Decode tasks copy the images into pixel buffers, the uploads per frame then only start the copies from them
+  loader.enable_texture_streaming();
+  loader.set_virtual_texture_size(virtual_texture_size);
+  TextureResidency::shared().set_budget(texture_memory_budget);
+  TextureResidency::shared().set_streaming(true);
+  loader.load_meshes(&obj, "objects/interior_preview.obj", position_loc, normal_loc, texture_coordinate_loc,
+                     mesh_build_flags);
+  loader.load_meshes(&windows, "objects/Windows.obj", position_loc, normal_loc, texture_coordinate_loc,
+                     mesh_build_flags);
+  loader.load_meshes(&screen, "objects/screen.obj", position_loc, normal_loc, texture_coordinate_loc,
+                     mesh_build_flags);
 
   /// MATERIALS
   material_diffuse_loc = program->get_uniform_location("material.diffuse");
   material_specular_loc = program->get_uniform_location("material.specular");
   material_shininess_loc = program->get_uniform_location("material.shininess");
+  material_packed_loc = program->get_uniform_location("material.packed");
+  material_diffuse_array_loc = program->get_uniform_location("material.diffuse_array");
+  material_layer_loc = program->get_uniform_location("material.layer");
+  material_atlas_rect_loc = program->get_uniform_location("material.atlas_rect");
+  material_video_loc = program->get_uniform_location("material.video");
+  material_video_y_loc = program->get_uniform_location("material.video_y");
+  material_video_u_loc = program->get_uniform_location("material.video_u");
+  material_video_v_loc = program->get_uniform_location("material.video_v");
+  material_paged_loc = program->get_uniform_location("material.paged");
+  virtual_map_physical_loc = program->get_uniform_location("virtual_map.physical");
+  virtual_map_indirection_loc = program->get_uniform_location("virtual_map.indirection");
+  virtual_map_size_loc = program->get_uniform_location("virtual_map.size");
+  virtual_map_levels_loc = program->get_uniform_location("virtual_map.levels");
+  virtual_map_page_content_loc = program->get_uniform_location("virtual_map.page_content");
+  virtual_map_page_border_loc = program->get_uniform_location("virtual_map.page_border");
+  virtual_map_physical_size_loc = program->get_uniform_location("virtual_map.physical_size");
+
+  ///--------------------------------------------///
+  /// FEEDBACK PROGRAM
+  // Same attribute locations as the main program, so it draws with the VAOs of the meshes
+  feedback_program = make_unique<ShaderProgram>(
+      "shaders/main.vert", "shaders/feedback.frag",
+      std::vector<GLuint>{GLuint(position_loc), GLuint(normal_loc), GLuint(texture_coordinate_loc)},
+      std::vector<std::string>{"position", "normal", "texture_coordinate"});
+  feedback_projection_matrix_loc = feedback_program->get_uniform_location("projection_matrix");
+  feedback_view_matrix_loc = feedback_program->get_uniform_location("view_matrix");
+  feedback_model_matrix_loc = feedback_program->get_uniform_location("model_matrix");
+  feedback_position_offset_loc = feedback_program->get_uniform_location("position_offset");
+  feedback_position_scale_loc = feedback_program->get_uniform_location("position_scale");
+  feedback_texture_loc = feedback_program->get_uniform_location("feedback_texture");
+  feedback_size_loc = feedback_program->get_uniform_location("virtual_map.size");
+  feedback_levels_loc = feedback_program->get_uniform_location("virtual_map.levels");
+  feedback_page_content_loc = feedback_program->get_uniform_location("virtual_map.page_content");
+  feedback_level_bias_loc = feedback_program->get_uniform_location("level_bias");
+
+  for (const std::string &file : screen_video_files) {
+    try {
+      std::unique_ptr<VideoSource> source(new VideoSource(file));
+      screen_video = std::unique_ptr<VideoTexture>(new VideoTexture(std::move(source)));
+      std::cout << "Screen video " << file << ": " << screen_video->get_source().get_width() << "x"
+                << screen_video->get_source().get_height() << " at " << screen_video->get_source().get_fps()
+                << " fps" << std::endl;
+      break;
+    } catch (const std::string &) {
+      // Not there, the screen keeps its image
+    }
+  }
 
   // Windows
-  windows_texture = load_texture_2d("objects/WindowsSurface_Color.png");
+  windows_texture = loader.load_texture_2d("objects/WindowsSurface_Color.png");
 
 
   ///--------------------------------------------///
@@ -110,14 +190,15 @@ void Application::init() {
   int exterior_position_loc = exterior_program->get_attribute_location("position");
   int exterior_normal_loc = exterior_program->get_attribute_location("normal");
 
-  for (const auto& ext : exterior) {
-      ext->create_vao(exterior_position_loc, exterior_normal_loc);
-  }
+  loader.load_meshes(&exterior, "objects/exterior.obj", exterior_position_loc, exterior_normal_loc, -1,
+                     mesh_build_flags);
 
   /// MATRICES
   exterior_projection_matrix_loc = exterior_program->get_uniform_location("projection_matrix");
   exterior_view_matrix_loc = exterior_program->get_uniform_location("view_matrix");
   exterior_model_matrix_loc = exterior_program->get_uniform_location("model_matrix");
+  exterior_position_offset_loc = exterior_program->get_uniform_location("position_offset");
+  exterior_position_scale_loc = exterior_program->get_uniform_location("position_scale");
 
   exterior_skybox_loc = exterior_program->get_uniform_location("skybox");
   exterior_eye_pos_loc = exterior_program->get_uniform_location("eye_pos");
@@ -134,13 +215,55 @@ void Application::init() {
 
   /// TEXTURES
   skybox_skybox_loc = skybox_program->get_uniform_location("skybox");
-  skybox_texture = load_texture_cubemap(faces);
+  skybox_texture = loader.load_texture_cubemap(faces);
 
   /// OBJECTS
   skybox.create_vao(skybox_position_loc);
+
+  glGenQueries(1, &objects_time_query);
+}
+
+double Application::milliseconds_since_start() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
 }
 
 void Application::render() {
+    // Uploads bind textures, so they go before the bindings are reset
+    loader.process_uploads(upload_budget_milliseconds);
+    // Plans the levels of the textures by what the last frame drew with them
+    TextureResidency::shared().update();
+    if (screen_video) {
+        screen_video->update(glfwGetTime());
+    }
+    // Pages asked for by the feedback of a few frames ago
+    if (virtual_feedback && virtual_feedback->read(&page_requests)) {
+        for (const PageRequest &request : page_requests) {
+            if (request.texture >= 0 && size_t(request.texture) < virtual_textures.size()) {
+                virtual_textures[request.texture]->request(request.level, request.x, request.y);
+            }
+        }
+    }
+    for (const auto &texture : virtual_textures) {
+        texture->update(virtual_pages_per_frame);
+    }
+
+    last_frame_stats = render_stats();
+    render_stats().reset();
+    const auto frame_start = std::chrono::steady_clock::now();
+    reset_texture_bindings();
+
+    // Result of the previous frame, never wait for the GPU
+    if (objects_time_pending) {
+        GLint available = 0;
+        glGetQueryObjectiv(objects_time_query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(objects_time_query, GL_QUERY_RESULT, &nanoseconds);
+            objects_gpu_milliseconds = nanoseconds / 1e6;
+            objects_time_pending = false;
+        }
+    }
+
     // Clear the screen
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -149,6 +272,9 @@ void Application::render() {
     float current_frame = app_time_s;
     delta_time = current_frame - last_frame;
     last_frame = current_frame;
+    if (first_frame_rendered && !fully_loaded) {
+        longest_loading_frame_milliseconds = std::max(longest_loading_frame_milliseconds, delta_time * 1000.0);
+    }
 
     // Animated colors
     std::vector<glm::vec3> point_lights_colors = {
@@ -159,6 +285,36 @@ void Application::render() {
     projection_matrix = glm::perspective(glm::radians(camera.get_zoom()), float(window.get_width()) / float(window.get_height()), 0.1f, 500.0f);
     view_matrix = camera.get_view_matrix();
 
+    // Coarser levels of detail as long as their error stays below a pixel
+    LodSettings frame_lod_settings = lod_settings;
+    if (!lods_enabled) {
+        frame_lod_settings.max_pixel_error = 0.f;
+    }
+    projection_scale = lod_projection_scale(glm::radians(camera.get_zoom()), float(window.get_height()));
+    for (const auto &meshes : {&obj, &screen, &windows}) {
+        for (const auto &mesh : *meshes) {
+            mesh->select_lod(camera.get_position(), projection_scale, frame_lod_settings);
+        }
+    }
+
+    // Back faces are drawn (GL_CULL_FACE is off), so only the frustum culls the meshlets
+    const glm::mat4 view_projection = projection_matrix * view_matrix;
+    MeshletCullSettings cull_settings;
+    cull_settings.backface = false;
+    for (const auto &meshes : {&obj, &screen, &windows}) {
+        for (const auto &mesh : *meshes) {
+            if (!meshlet_culling_enabled) {
+                mesh->reset_meshlet_culling();
+            } else {
+                mesh->cull_meshlets(view_projection, camera.get_position(), cull_settings);
+            }
+        }
+    }
+
+    if (virtual_feedback) {
+        draw_virtual_feedback();
+    }
+
     ///--------------------------------------------///
     /// LIGHTS PROGRAM
 
@@ -166,29 +322,28 @@ void Application::render() {
 
     glUniformMatrix4fv(lights_projection_matrix_loc, 1, GL_FALSE, glm::value_ptr(projection_matrix));
     glUniformMatrix4fv(lights_view_matrix_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
+    render_stats().uniform_calls += 2;
 
     // Point lights
     for (int i = 0; i < NR_POINT_LIGHTS; ++i) {
-        lights_sphere.bind_vao();
-
         glUniform3fv(bulb_color_loc, 1, glm::value_ptr(point_lights_colors[i] * 2.f));
 
         model_matrix = glm::translate(glm::mat4(), point_lights_positions[i]);
         model_matrix = glm::scale(model_matrix, glm::vec3(4.f));
         glUniformMatrix4fv(lights_model_matrix_loc, 1, GL_FALSE, glm::value_ptr(model_matrix));
+        render_stats().uniform_calls += 2;
 
         lights_sphere.draw();
     }
 
     // Spot lights
     for (int i = 0; i < NR_SPOT_LIGHTS-1; ++i) {
-        lights_cube.bind_vao();
-
         glUniform3fv(bulb_color_loc, 1, glm::value_ptr(spot_lights_colors));
 
         model_matrix = glm::translate(glm::mat4(), spot_lights_positions[i]);
         model_matrix = glm::scale(model_matrix, glm::vec3(.2f));
         glUniformMatrix4fv(lights_model_matrix_loc, 1, GL_FALSE, glm::value_ptr(model_matrix));
+        render_stats().uniform_calls += 2;
 
         lights_cube.draw();
     }
@@ -201,106 +356,79 @@ void Application::render() {
     glUniformMatrix4fv(projection_matrix_loc, 1, GL_FALSE, glm::value_ptr(projection_matrix));
     glUniformMatrix4fv(view_matrix_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
     glUniform3fv(eye_pos_loc, 1, glm::value_ptr(camera.get_position()));
+    render_stats().uniform_calls += 3;
 
     /// LIGHTS
-    // Point lights
+    // Only the animated colors change from frame to frame, the buffer uploads just their rows
     for (int i = 0; i < NR_POINT_LIGHTS; ++i) {
-        glUniform3fv(point_lights_pos_loc[i], 1, glm::value_ptr(point_lights_positions[i]));
-        glUniform1f(point_lights_attenuation_constant_loc[i], 1.f);
-        glUniform1f(point_lights_attenuation_linear_loc[i], 0.014f);
-        glUniform1f(point_lights_attenuation_quadratic_loc[i], 0.0007f);
-        glUniform3fv(point_lights_ambient_loc[i], 1, glm::value_ptr(point_lights_colors[i] * 0.2f));
-        glUniform3fv(point_lights_diffuse_loc[i], 1, glm::value_ptr(point_lights_colors[i]));
-        glUniform3fv(point_lights_specular_loc[i], 1, glm::value_ptr(point_lights_colors[i]));
+        lights.point_lights[i].ambient = point_lights_colors[i] * 0.2f;
+        lights.point_lights[i].diffuse = point_lights_colors[i];
+        lights.point_lights[i].specular = point_lights_colors[i];
     }
 
-    // Direction light
-    glUniform3f(dir_light_dir_loc, -50.f, -52.f, -316.f);
     glm::vec3 dir_light_color = {44 / 255.f, 104 / 255.f, 195 / 255.f};
     if (dir_light_off) { dir_light_color *= 0.f; };
-    glUniform3fv(dir_light_ambient_loc, 1, glm::value_ptr(dir_light_color * 0.2f));
-    glUniform3fv(dir_light_diffuse_loc, 1, glm::value_ptr(dir_light_color * 0.9f));
-    glUniform3fv(dir_light_specular_loc, 1, glm::value_ptr(dir_light_color * 0.8f));
+    lights.dir_light.ambient = dir_light_color * 0.2f;
+    lights.dir_light.diffuse = dir_light_color * 0.9f;
+    lights.dir_light.specular = dir_light_color * 0.8f;
 
-    // Spot lights
-    for (int i = 0; i < NR_SPOT_LIGHTS; ++i) {
-        glUniform3fv(spot_lights_pos_loc[i], 1, glm::value_ptr(spot_lights_positions[i]));
-        glUniform3fv(spot_lights_dir_loc[i], 1, glm::value_ptr(spot_lights_directions[i]));
-        if (i == 4) {
-            glUniform1f(spot_lights_cut_off_loc[i], glm::cos(glm::radians(20.f)));
-            glUniform1f(spot_lights_outer_cut_off_loc[i], glm::cos(glm::radians(80.f)));
-            glUniform1f(spot_lights_attenuation_constant_loc[i], 1.f);
-            glUniform1f(spot_lights_attenuation_linear_loc[i], 0.022f);
-            glUniform1f(spot_lights_attenuation_quadratic_loc[i], 0.0019f);
-
-            glm::vec3 screen_color {164 / 255.f, 80 / 255.f, 1 / 255.f};
-            glUniform3fv(spot_lights_ambient_loc[i], 1, glm::value_ptr(screen_color * 0.2f));
-            glUniform3fv(spot_lights_diffuse_loc[i], 1, glm::value_ptr(screen_color *
-                                                                       sin(app_time_s * 4) +
-                                                                       screen_color * 0.5f));
-            glUniform3fv(spot_lights_specular_loc[i], 1, glm::value_ptr(screen_color * 0.8f));
-        } else {
-            glUniform1f(spot_lights_cut_off_loc[i], glm::cos(glm::radians(10.5f)));
-            glUniform1f(spot_lights_outer_cut_off_loc[i], glm::cos(glm::radians(30.5f)));
-            glUniform1f(spot_lights_attenuation_constant_loc[i], 1.f);
-            glUniform1f(spot_lights_attenuation_linear_loc[i], 0.09f);
-            glUniform1f(spot_lights_attenuation_quadratic_loc[i], 0.032f);
-            glUniform3fv(spot_lights_ambient_loc[i], 1, glm::value_ptr(spot_lights_colors * 0.2f));
-            glUniform3fv(spot_lights_diffuse_loc[i], 1, glm::value_ptr(spot_lights_colors * 0.5f));
-            glUniform3fv(spot_lights_specular_loc[i], 1, glm::value_ptr(spot_lights_colors * 0.8f));
-        }
-    }
+    lights.spot_lights[SCREEN_SPOT_LIGHT].diffuse = screen_light_color * sin(app_time_s * 4) + screen_light_color * 0.5f;
 
-    /// OBJECTS
-    for (const auto& o : obj) {
-        o->bind_vao();
+    light_buffer->get_data().write(0, lights);
+    light_buffer->update();
 
-        /// Material properties
-        // Diffuse
-        glUniform1i(material_diffuse_loc, 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, o->get_texture_id());
+    /// OBJECTS
+    if (!objects_time_pending) {
+        glBeginQuery(GL_TIME_ELAPSED, objects_time_query);
+    }
 
-        // Specular
-        // no specular map
-        glUniform1f(material_shininess_loc, 1.f);
+    const auto objects_start = std::chrono::steady_clock::now();
+
+    // Diffuse and specular maps are both read from unit 0, the texture arrays from unit 1
+    glUniform1i(material_diffuse_loc, 0);
+    glUniform1i(material_specular_loc, 0);
+    glUniform1i(material_diffuse_array_loc, 1);
+    // The YUV planes of the screen video use units 2 to 4
+    glUniform1i(material_video_y_loc, 2);
+    glUniform1i(material_video_u_loc, 3);
+    glUniform1i(material_video_v_loc, 4);
+    // Virtual textures use units 5 and 6
+    glUniform1i(virtual_map_physical_loc, 5);
+    glUniform1i(virtual_map_indirection_loc, 6);
+    glUniform1f(virtual_map_page_content_loc, float(PageFile::page_content));
+    glUniform1f(virtual_map_page_border_loc, float(PageFile::page_border));
+    material_uniforms = MaterialUniforms();
+    // No specular map
+    glUniform1f(material_shininess_loc, 1.f);
+
+    model_matrix = glm::mat4(1.f);
+    glUniformMatrix4fv(model_matrix_loc, 1, GL_FALSE, glm::value_ptr(model_matrix));
+    render_stats().uniform_calls += 12;
 
-        /// Model
-        model_matrix = glm::mat4(1.f);
-        glUniformMatrix4fv(model_matrix_loc, 1, GL_FALSE, glm::value_ptr(model_matrix));
-        o->draw();
+    for (const auto& o : obj) {
+        draw_by_material(*o);
     }
 
     glBlendEquation(GL_FUNC_ADD);
     glBlendColor(1.f, 1.f, 1.f, 1.f);
     // Screen
+    glBlendFunc(GL_CONSTANT_COLOR, GL_SRC_COLOR);
     for (const auto& scr : screen) {
-        scr->bind_vao();
-
-        glBlendFunc(GL_CONSTANT_COLOR, GL_SRC_COLOR);
-        glUniform1i(material_diffuse_loc, 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, scr->get_texture_id());
-
-        model_matrix = glm::translate(glm::mat4(), glm::vec3(0.f, 0.f, 0.f));
-        glUniformMatrix4fv(model_matrix_loc, 1, GL_FALSE, glm::value_ptr(model_matrix));
-
-        scr->draw();
+        draw_by_material(*scr, screen_video && screen_video->has_frame() ? screen_video.get() : nullptr);
     }
 
     // Windows
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     for (const auto& window : windows) {
-        window->bind_vao();
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-        glUniform1i(material_diffuse_loc, 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, window->get_texture_id());
+        draw_by_material(*window);
+    }
 
-        model_matrix = glm::mat4(1.f);
-        glUniformMatrix4fv(model_matrix_loc, 1, GL_FALSE, glm::value_ptr(model_matrix));
-        window->draw();
+    if (!objects_time_pending) {
+        glEndQuery(GL_TIME_ELAPSED);
+        objects_time_pending = true;
     }
+    objects_cpu_milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - objects_start).count();
 
     ///--------------------------------------------///
     /// EXTERIOR PROGRAM
@@ -309,16 +437,17 @@ void Application::render() {
     glUniformMatrix4fv(exterior_projection_matrix_loc, 1, GL_FALSE, glm::value_ptr(projection_matrix));
     glUniformMatrix4fv(exterior_view_matrix_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
 
-    for (const auto& ext : exterior) {
-        ext->bind_vao();
-
-        glUniform1i(exterior_skybox_loc, 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture);
+    glUniform1i(exterior_skybox_loc, 0);
+    bind_texture(0, GL_TEXTURE_CUBE_MAP, skybox_texture);
 
-        exterior_model_matrix = glm::mat4();
-        glUniformMatrix4fv(exterior_model_matrix_loc, 1, GL_FALSE, glm::value_ptr(exterior_model_matrix));
+    exterior_model_matrix = glm::mat4();
+    glUniformMatrix4fv(exterior_model_matrix_loc, 1, GL_FALSE, glm::value_ptr(exterior_model_matrix));
+    render_stats().uniform_calls += 4;
 
+    for (const auto& ext : exterior) {
+        glUniform3fv(exterior_position_offset_loc, 1, glm::value_ptr(ext->get_position_offset()));
+        glUniform3fv(exterior_position_scale_loc, 1, glm::value_ptr(ext->get_position_scale()));
+        render_stats().uniform_calls += 2;
         ext->draw();
     }
 
@@ -332,14 +461,246 @@ void Application::render() {
     view_matrix = glm::mat4(glm::mat3(view_matrix));
     glUniformMatrix4fv(skybox_view_matrix_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
 
-    skybox.bind_vao();
     glUniform1i(skybox_skybox_loc, 0);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture);
+    render_stats().uniform_calls += 3;
+    bind_texture(0, GL_TEXTURE_CUBE_MAP, skybox_texture);
     skybox.draw();
 
     glDepthFunc(GL_LESS);
+    render_stats().cpu_milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+
+    if (!first_frame_rendered) {
+        first_frame_rendered = true;
+        std::cout << "Time to first frame: " << milliseconds_since_start() << " ms" << std::endl;
+    }
+    if (!fully_loaded && loader.is_finished()) {
+        fully_loaded = true;
+        std::cout << "Time to fully loaded: " << milliseconds_since_start() << " ms, longest frame while loading: "
+                  << longest_loading_frame_milliseconds << " ms" << std::endl;
+
+        size_t file_bytes = 0, decoded_bytes = 0;
+        double decode_milliseconds = 0.0;
+        for (const ImageDecodeStats &stats : loader.get_decode_stats()) {
+            file_bytes += stats.file_bytes;
+            decoded_bytes += stats.decoded_bytes;
+            decode_milliseconds += stats.decode_milliseconds;
+        }
+        std::cout << "Decoded " << loader.get_decode_stats().size() << " images, " << file_bytes / 1024 << " KiB into "
+                  << decoded_bytes / 1024 << " KiB in " << decode_milliseconds << " ms of decode time" << std::endl;
+        std::cout << "Texture cache: " << TextureCache::shared().get_stats() << std::endl;
+        const TextureStreamStats stream_stats = loader.get_stream_stats();
+        std::cout << "Streamed " << stream_stats.images << " images (" << stream_stats.bytes / 1024
+                  << " KiB) through pixel buffers, " << stream_stats.rejected << " too large, waited "
+                  << stream_stats.buffer_waits << " times for a buffer" << std::endl;
+    }
+    update_texture_arrays();
+    update_virtual_textures();
+}
+
+void Application::update_texture_arrays() {
+    if (!fully_loaded) {
+        return;
+    }
+    const std::vector<std::unique_ptr<Mesh>> *mesh_lists[] = {&obj, &screen, &windows};
+
+    if (!texture_arrays_requested) {
+        texture_arrays_requested = true;
+        // Virtual textures are too large to be packed
+        std::vector<std::string> virtual_paths;
+        for (const auto &entry : loader.get_virtual_textures()) {
+            virtual_paths.push_back(entry.first);
+        }
+        for (const auto *meshes : mesh_lists) {
+            for (const std::string &path : Mesh::texture_paths(*meshes)) {
+                if (std::find(packed_texture_paths.begin(), packed_texture_paths.end(), path) ==
+                        packed_texture_paths.end() &&
+                    std::find(virtual_paths.begin(), virtual_paths.end(), path) == virtual_paths.end()) {
+                    packed_texture_paths.push_back(path);
+                }
+            }
+        }
+        if (packed_texture_paths.empty()) {
+            std::cout << "No textures to pack into texture arrays, all are virtual" << std::endl;
+        }
+        loader.load_texture_arrays(&texture_arrays, &packed_textures, packed_texture_paths);
+        return;
+    }
+
+    if (packed_by_texture.empty() && !packed_textures.empty()) {
+        for (const auto *meshes : mesh_lists) {
+            for (const auto &mesh : *meshes) {
+                for (const Material &material : mesh->get_materials()) {
+                    const size_t index = std::find(packed_texture_paths.begin(), packed_texture_paths.end(),
+                                                   material.diffuse_texture) - packed_texture_paths.begin();
+                    if (index < packed_textures.size() && packed_textures[index].layer >= 0) {
+                        packed_by_texture[material.texture_id] = packed_textures[index];
+                    }
+                }
+            }
+        }
+        std::cout << "Packed " << packed_texture_paths.size() << " textures into " << texture_arrays.size()
+                  << " texture arrays" << std::endl;
+    }
+}
+
+void Application::update_virtual_textures() {
+    if (!fully_loaded) {
+        return;
+    }
+
+    if (!virtual_textures_requested) {
+        virtual_textures_requested = true;
+        for (const auto &entry : loader.get_virtual_textures()) {
+            // The feedback encoding has room for 15 textures
+            if (pending_page_files.size() == 15) {
+                std::cout << "Too many virtual textures, " << entry.first << " stays a placeholder" << std::endl;
+                continue;
+            }
+            const std::string path = entry.first;
+            pending_page_files.push_back(
+                {entry.second, path, ThreadPool::shared().submit([path]() { return PageFile::open_for(path); })});
+        }
+    }
+
+    for (auto pending = pending_page_files.begin(); pending != pending_page_files.end();) {
+        if (pending->file.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++pending;
+            continue;
+        }
+        try {
+            virtual_by_texture[pending->texture_id] = virtual_textures.size();
+            virtual_textures.push_back(make_unique<VirtualTexture>(pending->file.get()));
+            virtual_texture_paths.push_back(pending->path);
+            const VirtualTexture &texture = *virtual_textures.back();
+            std::cout << "Virtual texture " << pending->path << ": " << texture.get_file().get_width() << "x"
+                      << texture.get_file().get_height() << ", " << texture.get_memory() / 1024
+                      << " KiB of video memory instead of " << texture.get_file().get_total_bytes() / 1024 << " KiB"
+                      << std::endl;
+        } catch (const std::string &error) {
+            virtual_by_texture.erase(pending->texture_id);
+            std::cout << "Could not load the virtual texture " << pending->path << ": " << error << std::endl;
+        }
+        pending = pending_page_files.erase(pending);
+    }
+
+    if (!virtual_textures.empty() && !virtual_feedback) {
+        virtual_feedback = make_unique<VirtualTextureFeedback>();
+    }
+}
+
+void Application::draw_virtual_feedback() {
+    virtual_feedback->begin(window.get_width(), window.get_height());
+    feedback_program->use();
+
+    glUniformMatrix4fv(feedback_projection_matrix_loc, 1, GL_FALSE, glm::value_ptr(projection_matrix));
+    glUniformMatrix4fv(feedback_view_matrix_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
+    glUniformMatrix4fv(feedback_model_matrix_loc, 1, GL_FALSE, glm::value_ptr(glm::mat4(1.f)));
+    glUniform1f(feedback_level_bias_loc, virtual_feedback->get_level_bias());
+    glUniform1f(feedback_page_content_loc, float(PageFile::page_content));
+    render_stats().uniform_calls += 5;
+
+    // The blended screen and windows hide nothing behind them
+    for (const auto &o : obj) {
+        draw_feedback(*o, true);
+    }
+    for (const auto &meshes : {&screen, &windows}) {
+        for (const auto &mesh : *meshes) {
+            draw_feedback(*mesh, false);
+        }
+    }
+
+    virtual_feedback->end();
+}
+
+void Application::draw_feedback(Mesh &mesh, bool occluder) {
+    mesh.bind_vao();
+
+    glUniform3fv(feedback_position_offset_loc, 1, glm::value_ptr(mesh.get_position_offset()));
+    glUniform3fv(feedback_position_scale_loc, 1, glm::value_ptr(mesh.get_position_scale()));
+    render_stats().uniform_calls += 2;
+
+    const auto &materials = mesh.get_materials();
+    const auto &submeshes = mesh.get_submeshes();
+    for (size_t s = 0; s < submeshes.size(); ++s) {
+        const Material &material = materials[submeshes[s].material_id];
+        const auto paged = virtual_by_texture.find(material.texture_id);
+        if (paged == virtual_by_texture.end()) {
+            if (!occluder) {
+                continue;
+            }
+            glUniform1i(feedback_texture_loc, -1);
+            render_stats().uniform_calls += 1;
+        } else {
+            const PageFile &file = virtual_textures[paged->second]->get_file();
+            glUniform1i(feedback_texture_loc, GLint(paged->second));
+            glUniform2f(feedback_size_loc, float(file.get_width()), float(file.get_height()));
+            glUniform1i(feedback_levels_loc, file.get_level_count());
+            render_stats().uniform_calls += 3;
+        }
+        mesh.draw_submesh(s);
+    }
+}
+
+void Application::draw_by_material(Mesh &mesh, const VideoTexture *video) {
+    mesh.bind_vao();
+
+    set_uniform_if_changed(material_video_loc, video ? 1 : 0, &material_uniforms.video);
+    if (video) {
+        video->bind(2);
+    }
+
+    glUniform3fv(position_offset_loc, 1, glm::value_ptr(mesh.get_position_offset()));
+    glUniform3fv(position_scale_loc, 1, glm::value_ptr(mesh.get_position_scale()));
+    render_stats().uniform_calls += 2;
+
+    // Only the uniforms that differ from the previous submesh are set, consecutive submeshes often share them
+    const auto &materials = mesh.get_materials();
+    const auto &submeshes = mesh.get_submeshes();
+    for (size_t s = 0; s < submeshes.size(); ++s) {
+        const Material &material = materials[submeshes[s].material_id];
+
+        const auto paged = virtual_by_texture.find(material.texture_id);
+        const auto packed =
+            texture_arrays_enabled ? packed_by_texture.find(material.texture_id) : packed_by_texture.end();
+        set_uniform_if_changed(material_paged_loc, paged != virtual_by_texture.end() ? 1 : 0,
+                               &material_uniforms.paged);
+        if (paged != virtual_by_texture.end()) {
+            const VirtualTexture &texture = *virtual_textures[paged->second];
+            texture.bind(5, 6);
+            set_uniform_if_changed(material_packed_loc, 0, &material_uniforms.packed);
+            if (material_uniforms.paged_texture != material.texture_id) {
+                glUniform2f(virtual_map_size_loc, float(texture.get_file().get_width()),
+                            float(texture.get_file().get_height()));
+                glUniform1i(virtual_map_levels_loc, texture.get_file().get_level_count());
+                glUniform1f(virtual_map_physical_size_loc, float(texture.get_physical_size()));
+                material_uniforms.paged_texture = material.texture_id;
+                render_stats().uniform_calls += 3;
+            }
+        } else if (packed != packed_by_texture.end()) {
+            const PackedTexture &place = packed->second;
+            // The image covers 'scale' of the layer, so a pixel spans less of the layer's coordinates
+            TextureResidency::shared().request(texture_arrays[place.array],
+                                               mesh.uv_per_pixel(s, camera.get_position(), projection_scale) *
+                                                   std::max(place.scale.x, place.scale.y));
+            bind_texture(1, GL_TEXTURE_2D_ARRAY, texture_arrays[place.array]);
+            set_uniform_if_changed(material_packed_loc, 1, &material_uniforms.packed);
+            if (material_uniforms.packed_texture != material.texture_id) {
+                glUniform1f(material_layer_loc, float(place.layer));
+                glUniform4f(material_atlas_rect_loc, place.offset.x, place.offset.y, place.scale.x, place.scale.y);
+                material_uniforms.packed_texture = material.texture_id;
+                render_stats().uniform_calls += 2;
+            }
+        } else {
+            // The mip level the submesh needs at its distance, finer ones are streamed in
+            TextureResidency::shared().request(material.texture_id,
+                                               mesh.uv_per_pixel(s, camera.get_position(), projection_scale));
+            bind_texture(0, GL_TEXTURE_2D, material.texture_id);
+            set_uniform_if_changed(material_packed_loc, 0, &material_uniforms.packed);
+        }
 
+        mesh.draw_submesh(s);
+    }
 }
 
 void Application::on_mouse_position(double x, double y) { camera.on_mouse_move(x, y); }
@@ -360,6 +721,47 @@ void Application::on_key(int key, int scancode, int actions, int mods) {
   case GLFW_KEY_2:
     dir_light_off = false;
     break;
+  case GLFW_KEY_O:
+    if (actions == GLFW_PRESS) {
+      lods_enabled = !lods_enabled;
+      std::cout << "Levels of detail " << (lods_enabled ? "on" : "off") << std::endl;
+    }
+    break;
+  case GLFW_KEY_C:
+    if (actions == GLFW_PRESS) {
+      meshlet_culling_enabled = !meshlet_culling_enabled;
+      std::cout << "Meshlet culling " << (meshlet_culling_enabled ? "on" : "off") << std::endl;
+    }
+    break;
+  case GLFW_KEY_T:
+    if (actions == GLFW_PRESS) {
+      texture_arrays_enabled = !texture_arrays_enabled;
+      std::cout << "Texture arrays " << (texture_arrays_enabled ? "on" : "off") << std::endl;
+    }
+    break;
+  case GLFW_KEY_P:
+    if (actions == GLFW_PRESS) {
+      std::cout << "Last frame: " << last_frame_stats << ", objects CPU time: " << objects_cpu_milliseconds
+                << " ms, objects GPU time: " << objects_gpu_milliseconds << " ms" << std::endl;
+      if (screen_video) {
+        std::cout << "Screen video: " << screen_video->get_stats() << std::endl;
+      }
+      for (size_t i = 0; i < virtual_textures.size(); i++) {
+        std::cout << "Virtual texture " << virtual_texture_paths[i] << ": " << virtual_textures[i]->get_stats()
+                  << std::endl;
+      }
+      std::cout << "Texture residency: " << TextureResidency::shared().get_stats() << std::endl;
+      for (const TextureResidencyEntry &entry : TextureResidency::shared().get_report()) {
+        if (entry.fixed) {
+          std::cout << "  " << entry.file_name << ": " << entry.memory / 1024 << " KiB, fixed" << std::endl;
+          continue;
+        }
+        std::cout << "  " << entry.file_name << ": " << entry.memory / 1024 << " of " << entry.full_memory / 1024
+                  << " KiB, " << entry.dropped_levels << " levels dropped (" << entry.needed_levels
+                  << " needed), last used in frame " << entry.last_used_frame << std::endl;
+      }
+    }
+    break;
   default:
     camera.on_key(key, delta_time);
   }
@@ -371,9 +773,3 @@ void Application::on_resize(int width, int height) {
   // Set the area into which we render
   glViewport(0, 0, width, height);
 }
-
-std::string Application::cycle_concat(int i, const char* first, const char* second) {
-    std::stringstream ss;
-    ss << first << i << second;
-    return ss.str();
-}
@@ -2,13 +2,25 @@
 
 #include <glad/glad.h>
 
+#include <chrono>
+#include <future>
 #include <string>
+#include <unordered_map>
 
+#include "asset_loader.hpp"
 #include "mesh.hpp"
 #include "program.hpp"
 #include "window.hpp"
 #include "camera.hpp"
 #include "texture.hpp"
+#include "texture_array.hpp"
+#include "texture_cache.hpp"
+#include "texture_residency.hpp"
+#include "video_texture.hpp"
+#include "virtual_texture.hpp"
+#include "render_stats.hpp"
+#include "light_block.hpp"
+#include "uniform_buffer.hpp"
 
 class Application {
 public:
@@ -34,10 +46,43 @@ public:
   Window window;
 
 private:
+  // Startup metrics, measured from the creation of the window
+  const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+  bool first_frame_rendered = false;
+  bool fully_loaded = false;
+  // Frame time spikes while the assets stream in
+  double longest_loading_frame_milliseconds = 0.0;
+  double milliseconds_since_start() const;
+
+  // Meshes and textures are loaded in the background, their GL uploads take at most this long per frame
+  AssetLoader loader;
+  const double upload_budget_milliseconds = 4.0;
+  // Video memory of the file textures, unused ones lose their largest levels and the finer ones stream in
+  const size_t texture_memory_budget = size_t(16) << 20;
+
   Camera camera;
   float delta_time = 0.f;
   float last_frame = 0.f;
+  // Counters of the previous frame, printed with P
+  RenderStats last_frame_stats;
+  // GPU time of the main program's objects, measured with a timer query and read one frame later
+  GLuint objects_time_query = 0;
+  bool objects_time_pending = false;
+  double objects_gpu_milliseconds = 0.0;
+  // CPU time of issuing the main program's objects
+  double objects_cpu_milliseconds = 0.0;
+
+  // Build options of the OBJ meshes, compact vertices halve the vertex buffers
+  const static uint32_t mesh_build_flags =
+      MESH_BUILD_OPTIMIZE | MESH_BUILD_COMPACT_VERTICES | MESH_BUILD_LODS | MESH_BUILD_MESHLETS;
+  // Levels of detail of the OBJ meshes are picked by their projected error every frame, O toggles them
+  LodSettings lod_settings;
+  bool lods_enabled = true;
+  // Meshlets outside of the view are skipped, C toggles it
+  bool meshlet_culling_enabled = true;
   GLint eye_pos_loc = -1;
+  // Pixels per unit at distance 1 in this frame, for the levels of detail and the mip levels of the textures
+  float projection_scale = 1.f;
 
   glm::mat4 projection_matrix, view_matrix, model_matrix;
   GLint view_matrix_loc = -1;
@@ -48,34 +93,27 @@ private:
   ///
   std::unique_ptr<ShaderProgram> program;
   GLint model_matrix_loc = -1;
+  GLint position_offset_loc = -1;
+  GLint position_scale_loc = -1;
 
   /// LIGHTS
+  // Parameters of all lights in the Lights block. init() sets them, render() changes the animated colors, and
+  // only the rows that changed are uploaded.
+  LightBlock lights;
+  std::unique_ptr<UniformBuffer> light_buffer;
 
   // Point lights
-  const static int NR_POINT_LIGHTS = 2;
+  const static int NR_POINT_LIGHTS = light_block_point_lights;
   glm::vec3 point_lights_positions[NR_POINT_LIGHTS] = {
       glm::vec3(-28.49f, .0f, 44.27f),
       glm::vec3(28.49f, .0f, 44.27f)
   };
 
-
-  GLint point_lights_pos_loc[NR_POINT_LIGHTS];
-  GLint point_lights_attenuation_constant_loc[NR_POINT_LIGHTS];
-  GLint point_lights_attenuation_linear_loc[NR_POINT_LIGHTS];
-  GLint point_lights_attenuation_quadratic_loc[NR_POINT_LIGHTS];
-  GLint point_lights_ambient_loc[NR_POINT_LIGHTS];
-  GLint point_lights_diffuse_loc[NR_POINT_LIGHTS];
-  GLint point_lights_specular_loc[NR_POINT_LIGHTS];
-
   // Direction light
   bool dir_light_off = false;
-  GLint dir_light_dir_loc = -1;
-  GLint dir_light_ambient_loc = -1;
-  GLint dir_light_diffuse_loc = -1;
-  GLint dir_light_specular_loc = -1;
 
   // Spot lights
-  const static int NR_SPOT_LIGHTS = 5;
+  const static int NR_SPOT_LIGHTS = light_block_spot_lights;
 
   glm::vec3 spot_lights_positions[NR_SPOT_LIGHTS] = {
       glm::vec3(-19.6f, 11.5f, -8.2f),
@@ -94,30 +132,109 @@ private:
   };
 
   glm::vec3 spot_lights_colors {215 / 255.f, 237 / 255.f, 244 / 255.f};
-
-  GLint spot_lights_pos_loc[NR_SPOT_LIGHTS];
-  GLint spot_lights_dir_loc[NR_SPOT_LIGHTS];
-  GLint spot_lights_cut_off_loc[NR_SPOT_LIGHTS];
-  GLint spot_lights_outer_cut_off_loc[NR_SPOT_LIGHTS];
-  GLint spot_lights_attenuation_constant_loc[NR_SPOT_LIGHTS];
-  GLint spot_lights_attenuation_linear_loc[NR_SPOT_LIGHTS];
-  GLint spot_lights_attenuation_quadratic_loc[NR_SPOT_LIGHTS];
-  GLint spot_lights_ambient_loc[NR_SPOT_LIGHTS];
-  GLint spot_lights_diffuse_loc[NR_SPOT_LIGHTS];
-  GLint spot_lights_specular_loc[NR_SPOT_LIGHTS];
+  // The spot light of the screen, its diffuse color pulses
+  const static int SCREEN_SPOT_LIGHT = 4;
+  glm::vec3 screen_light_color {164 / 255.f, 80 / 255.f, 1 / 255.f};
 
 
   /// MATERIALS
   GLint material_diffuse_loc = -1;
   GLint material_specular_loc = -1;
   GLint material_shininess_loc = -1;
+  GLint material_packed_loc = -1;
+  GLint material_diffuse_array_loc = -1;
+  GLint material_layer_loc = -1;
+  GLint material_atlas_rect_loc = -1;
+  GLint material_video_loc = -1;
+  GLint material_video_y_loc = -1;
+  GLint material_video_u_loc = -1;
+  GLint material_video_v_loc = -1;
+  GLint material_paged_loc = -1;
+  GLint virtual_map_physical_loc = -1;
+  GLint virtual_map_indirection_loc = -1;
+  GLint virtual_map_size_loc = -1;
+  GLint virtual_map_levels_loc = -1;
+  GLint virtual_map_page_content_loc = -1;
+  GLint virtual_map_page_border_loc = -1;
+  GLint virtual_map_physical_size_loc = -1;
+
+  // Material uniforms as draw_by_material last set them, reset before the objects are drawn
+  struct MaterialUniforms {
+    int video = -1;
+    int paged = -1;
+    int packed = -1;
+    // The texture whose virtual map and whose layer and atlas rect are set
+    GLuint paged_texture = 0;
+    GLuint packed_texture = 0;
+  };
+  MaterialUniforms material_uniforms;
+
+  // Once everything is loaded the textures of the objects are packed into texture arrays, so consecutive
+  // materials only change the layer uniform instead of the binding. T toggles them. Their levels are streamed
+  // like those of the 2D textures.
+  std::vector<GLuint> texture_arrays;
+  std::vector<PackedTexture> packed_textures;
+  std::vector<std::string> packed_texture_paths;
+  bool texture_arrays_requested = false;
+  std::unordered_map<GLuint, PackedTexture> packed_by_texture;
+  bool texture_arrays_enabled = true;
+  /// Packs the textures of the objects, then maps the material textures to their places once uploaded
+  void update_texture_arrays();
+
+  // The screen plays the first of these videos that exists, otherwise it keeps its still image
+  const std::string screen_video_files[2] = {"objects/screen.y4m", "objects/screen/%04d.png"};
+  std::unique_ptr<VideoTexture> screen_video;
+
+  // Material textures at least this large are not uploaded whole but paged in as the feedback pass asks for them
+  const int virtual_texture_size = 8192;
+  const size_t virtual_pages_per_frame = 16;
+  std::unique_ptr<VirtualTextureFeedback> virtual_feedback;
+  std::vector<std::unique_ptr<VirtualTexture>> virtual_textures;
+  std::vector<std::string> virtual_texture_paths;
+  std::unordered_map<GLuint, size_t> virtual_by_texture;
+  // Page files being built or mapped on the pool, with the placeholder texture of the material and the image
+  struct PendingPageFile {
+    GLuint texture_id;
+    std::string path;
+    std::future<std::shared_ptr<PageFile>> file;
+  };
+  std::vector<PendingPageFile> pending_page_files;
+  bool virtual_textures_requested = false;
+  std::vector<PageRequest> page_requests;
+  /// Opens the page files of the textures the loader left to virtual texturing and creates their textures
+  void update_virtual_textures();
+  /// Renders which pages the visible texels need, see VirtualTextureFeedback
+  void draw_virtual_feedback();
+  /// Draws the submeshes for the feedback pass. Occluders draw all of them, the others only those with a virtual
+  /// texture.
+  void draw_feedback(Mesh &mesh, bool occluder);
+
+  /// Draws the submeshes of the mesh, binding the texture and setting the uniforms of each material. With a
+  /// video all of them show its current frame instead.
+  void draw_by_material(Mesh &mesh, const VideoTexture *video = nullptr);
 
   GLuint windows_texture = 0;
 
-  /// OBJECTS
+  /// OBJECTS, empty until loaded
   // for faster loading use "objects/interior_preview.obj"
-  std::vector<std::unique_ptr<Mesh>> obj = Mesh::from_file("objects/interior_preview.obj");
-  std::vector<std::unique_ptr<Mesh>> windows = Mesh::from_file("objects/Windows.obj");
+  std::vector<std::unique_ptr<Mesh>> obj;
+  std::vector<std::unique_ptr<Mesh>> windows;
+
+
+  ///--------------------------------------------///
+  /// FEEDBACK PROGRAM
+  /// Pages of the virtual textures, drawn with the vertex shader of the main program
+  std::unique_ptr<ShaderProgram> feedback_program;
+  GLint feedback_projection_matrix_loc = -1;
+  GLint feedback_view_matrix_loc = -1;
+  GLint feedback_model_matrix_loc = -1;
+  GLint feedback_position_offset_loc = -1;
+  GLint feedback_position_scale_loc = -1;
+  GLint feedback_texture_loc = -1;
+  GLint feedback_size_loc = -1;
+  GLint feedback_levels_loc = -1;
+  GLint feedback_page_content_loc = -1;
+  GLint feedback_level_bias_loc = -1;
 
 
   ///--------------------------------------------///
@@ -138,7 +255,7 @@ private:
   /// OBJECTS
   Mesh lights_cube = Mesh::cube();
   Mesh lights_sphere = Mesh::sphere();
-  std::vector<std::unique_ptr<Mesh>> screen = Mesh::from_file("objects/screen.obj");
+  std::vector<std::unique_ptr<Mesh>> screen;
 
 
   ///--------------------------------------------///
@@ -150,11 +267,13 @@ private:
   GLint exterior_projection_matrix_loc = -1;
   GLint exterior_view_matrix_loc = -1;
   GLint exterior_model_matrix_loc = -1;
+  GLint exterior_position_offset_loc = -1;
+  GLint exterior_position_scale_loc = -1;
 
   GLint exterior_skybox_loc = -1;
   GLint exterior_eye_pos_loc = -1;
 
-  std::vector<std::unique_ptr<Mesh>> exterior = Mesh::from_file("objects/exterior.obj");
+  std::vector<std::unique_ptr<Mesh>> exterior;
 
 
   ///--------------------------------------------///
@@ -200,6 +319,4 @@ private:
     Application *this_pointer = static_cast<Application *>(glfwGetWindowUserPointer(window));
     this_pointer->on_resize(width, height);
   }
-
-  static std::string cycle_concat(int i, const char* first, const char* second);
 };
@@ -4,6 +4,10 @@ uniform mat4 projection_matrix;
 uniform mat4 view_matrix;
 uniform mat4 model_matrix;
 
+// Compact meshes store positions normalized to their bounds, float meshes use offset 0 and scale 1
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+
 in vec3 position;
 in vec3 normal;
 
@@ -12,7 +16,9 @@ out vec3 vert_normal;
 
 void main()
 {
+    vec3 object_position = position_offset + position * position_scale;
+
     vert_normal = mat3(transpose(inverse(model_matrix))) * normal;
-    vert_pos = vec3(model_matrix * vec4(position, 1.0));
-    gl_Position = projection_matrix * view_matrix * model_matrix * vec4(position, 1.0);
+    vert_pos = vec3(model_matrix * vec4(object_position, 1.0));
+    gl_Position = projection_matrix * view_matrix * model_matrix * vec4(object_position, 1.0);
 }
@@ -0,0 +1,44 @@
+#version 330
+
+// Writes the virtual texture page each pixel needs, see VirtualTextureFeedback for the encoding
+
+struct VirtualMap {
+    vec2 size;
+    int levels;
+    float page_content;
+};
+
+// Index of the virtual texture of the material, -1 for materials without one
+uniform int feedback_texture;
+uniform VirtualMap virtual_map;
+// The framebuffer is smaller than the window, this brings the level back to what the window needs
+uniform float level_bias;
+
+in vec3 vert_pos;
+in vec3 vert_normal;
+in vec2 vert_tex_coord;
+
+out vec4 feedback;
+
+void main()
+{
+    if (feedback_texture < 0) {
+        feedback = vec4(0.0);
+        return;
+    }
+
+    vec2 texels = vert_tex_coord * virtual_map.size;
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + level_bias;
+    int level = int(clamp(floor(lod), 0.0, float(virtual_map.levels - 1)));
+
+    vec2 wrapped = 1.0 - abs(mod(vert_tex_coord, 2.0) - 1.0);
+    vec2 level_texels = wrapped * virtual_map.size / exp2(float(level));
+    ivec2 last_page = ivec2(ceil(virtual_map.size / exp2(float(level)) / virtual_map.page_content)) - 1;
+    ivec2 page = min(ivec2(level_texels / virtual_map.page_content), last_page);
+
+    int high_bits = ((page.x >> 8) & 15) | (((page.y >> 8) & 15) << 4);
+    int level_and_texture = level | ((feedback_texture + 1) << 4);
+    feedback = vec4(float(page.x & 255), float(page.y & 255), float(high_bits), float(level_and_texture)) / 255.0;
+}
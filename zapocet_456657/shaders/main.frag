@@ -4,8 +4,35 @@ struct Material {
     sampler2D diffuse;
     sampler2D specular;
     float shininess;
+    // Set when the diffuse map is packed into a layer of diffuse_array, atlas_rect is its offset and scale there
+    bool packed;
+    sampler2DArray diffuse_array;
+    float layer;
+    vec4 atlas_rect;
+    // Set for the video on the screen, its colour comes from the YUV planes instead of the diffuse map
+    bool video;
+    sampler2D video_y;
+    sampler2D video_u;
+    sampler2D video_v;
+    // Set when the diffuse map is a virtual texture, sampled through virtual_map
+    bool paged;
 };
 
+// Pages of a virtual texture: the indirection texture maps every page of every level to its place in the
+// physical texture, see VirtualTexture
+struct VirtualMap {
+    sampler2D physical;
+    sampler2D indirection;
+    // Texels of level 0
+    vec2 size;
+    int levels;
+    float page_content;
+    float page_border;
+    float physical_size;
+};
+
+// The lights are members of the Lights block, laid out as LightBlock of light_block.hpp. Every vec3 starts a row
+// of 16 bytes in std140, the floats fill the rest of those rows.
 struct DirLight {
     vec3 direction;
 
@@ -16,39 +43,39 @@ struct DirLight {
 
 struct PointLight {
     vec3 position;
-
     float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cut_off;
+    vec3 direction;
     float outer_cut_off;
-
-    float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float constant;
     vec3 diffuse;
+    float linear;
     vec3 specular;
+    float quadratic;
 };
 
 #define NR_POINT_LIGHTS 2
 #define NR_SPOT_LIGHTS 5
 
+layout(std140) uniform Lights {
+    DirLight dir_light;
+    PointLight point_lights[NR_POINT_LIGHTS];
+    SpotLight spot_lights[NR_SPOT_LIGHTS];
+};
+
 uniform vec3 eye_pos;
 uniform Material material;
-uniform DirLight dir_light;
-uniform PointLight point_lights[NR_POINT_LIGHTS];
-uniform SpotLight spot_lights[NR_SPOT_LIGHTS];
+uniform VirtualMap virtual_map;
 
 in vec3 vert_pos;
 in vec3 vert_normal;
@@ -56,6 +83,14 @@ in vec2 vert_tex_coord;
 
 out vec4 final_color;
 
+// Sampled once in main
+vec4 diffuse_texel;
+vec4 specular_texel;
+
+vec4 sample_packed_diffuse();
+vec4 sample_video();
+vec4 sample_virtual_diffuse();
+
 vec3 calc_dir_light(DirLight light, vec3 normal, vec3 view_dir);
 vec3 calc_point_light(PointLight light, vec3 normal, vec3 vert_pos, vec3 view_dir);
 vec3 calc_spot_light(SpotLight light, vec3 normal, vec3 vert_pos, vec3 view_dir);
@@ -63,6 +98,21 @@ vec3 calc_spot_light(SpotLight light, vec3 normal, vec3 vert_pos, vec3 view_dir)
 void main()
 {
     // properties
+    if (material.video) {
+        diffuse_texel = sample_video();
+        specular_texel = diffuse_texel;
+    } else if (material.paged) {
+        diffuse_texel = sample_virtual_diffuse();
+        specular_texel = diffuse_texel;
+    } else if (material.packed) {
+        diffuse_texel = sample_packed_diffuse();
+        // The specular map is the diffuse one in this scene
+        specular_texel = diffuse_texel;
+    } else {
+        diffuse_texel = texture(material.diffuse, vert_tex_coord);
+        specular_texel = texture(material.specular, vert_tex_coord);
+    }
+
     vec3 normal = normalize(vert_normal);
     vec3 view_dir = normalize(eye_pos - vert_pos);
 
@@ -81,7 +131,7 @@ void main()
         result += calc_spot_light(spot_lights[i], normal, vert_pos, view_dir);
     }
 
-    final_color = vec4(result, texture(material.diffuse, vert_tex_coord).w);
+    final_color = vec4(result, diffuse_texel.w);
 }
 
 vec3 calc_dir_light(DirLight light, vec3 normal, vec3 view_dir) {
@@ -95,9 +145,9 @@ vec3 calc_dir_light(DirLight light, vec3 normal, vec3 view_dir) {
     float spec = pow(max(dot(view_dir, reflect_dir), 0.0), material.shininess);
 
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, vert_tex_coord));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, vert_tex_coord));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, vert_tex_coord));
+    vec3 ambient = light.ambient * vec3(diffuse_texel);
+    vec3 diffuse = light.diffuse * diff * vec3(diffuse_texel);
+    vec3 specular = light.specular * spec * vec3(specular_texel);
 
     return (ambient + diffuse + specular);
 }
@@ -117,9 +167,9 @@ vec3 calc_point_light(PointLight light, vec3 normal, vec3 vert_pos, vec3 view_di
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
 
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, vert_tex_coord));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, vert_tex_coord));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, vert_tex_coord));
+    vec3 ambient = light.ambient * vec3(diffuse_texel);
+    vec3 diffuse = light.diffuse * diff * vec3(diffuse_texel);
+    vec3 specular = light.specular * spec * vec3(specular_texel);
 
     ambient *= attenuation;
     diffuse *= attenuation;
@@ -148,9 +198,9 @@ vec3 calc_spot_light(SpotLight light, vec3 normal, vec3 vert_pos, vec3 view_dir)
     float intensity = clamp((theta - light.outer_cut_off) / epsilon, 0.0, 1.0);
 
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, vert_tex_coord));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, vert_tex_coord));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, vert_tex_coord));
+    vec3 ambient = light.ambient * vec3(diffuse_texel);
+    vec3 diffuse = light.diffuse * diff * vec3(diffuse_texel);
+    vec3 specular = light.specular * spec * vec3(specular_texel);
 
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
@@ -158,3 +208,48 @@ vec3 calc_spot_light(SpotLight light, vec3 normal, vec3 vert_pos, vec3 view_dir)
 
     return (ambient + diffuse + specular);
 }
+
+// Mirrored repeat inside the atlas rectangle, as the separate textures wrap. The gradients come from the unwrapped
+// coordinates, so the mip level does not jump at the mirror lines.
+vec4 sample_packed_diffuse() {
+    vec2 wrapped = 1.0 - abs(mod(vert_tex_coord, 2.0) - 1.0);
+    // Bilinear filtering must not reach the atlas neighbours
+    vec2 half_texel = 0.5 / (vec2(textureSize(material.diffuse_array, 0).xy) * material.atlas_rect.zw);
+    wrapped = clamp(wrapped, half_texel, 1.0 - half_texel);
+
+    vec2 coord = material.atlas_rect.xy + wrapped * material.atlas_rect.zw;
+    return textureGrad(material.diffuse_array, vec3(coord, material.layer), dFdx(vert_tex_coord) * material.atlas_rect.zw,
+                       dFdy(vert_tex_coord) * material.atlas_rect.zw);
+}
+
+// BT.601 limited range YUV to RGB, the chroma planes have half the resolution and are filtered bilinearly
+vec4 sample_video() {
+    vec3 yuv = vec3(texture(material.video_y, vert_tex_coord).r, texture(material.video_u, vert_tex_coord).r,
+                    texture(material.video_v, vert_tex_coord).r);
+    yuv = yuv * 255.0 - vec3(16.0, 128.0, 128.0);
+    vec3 rgb = mat3(1.164, 1.164, 1.164, 0.0, -0.392, 2.017, 1.596, -0.813, 0.0) * yuv / 255.0;
+    return vec4(clamp(rgb, 0.0, 1.0), 1.0);
+}
+
+// The level comes from the derivatives like the feedback pass computes it. Pages that are not resident yet are
+// replaced by their nearest resident ancestor, which the indirection texture points to.
+vec4 sample_virtual_diffuse() {
+    vec2 texels = vert_tex_coord * virtual_map.size;
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+    int level = int(clamp(floor(lod), 0.0, float(virtual_map.levels - 1)));
+
+    vec2 wrapped = 1.0 - abs(mod(vert_tex_coord, 2.0) - 1.0);
+    vec2 level_texels = wrapped * virtual_map.size / exp2(float(level));
+    ivec2 last_page = ivec2(ceil(virtual_map.size / exp2(float(level)) / virtual_map.page_content)) - 1;
+    ivec2 page = min(ivec2(level_texels / virtual_map.page_content), last_page);
+    vec4 entry = floor(texelFetch(virtual_map.indirection, page, level) * 255.0 + 0.5);
+
+    // Inside the page of the resident level
+    vec2 resident_texels = level_texels / exp2(entry.b - float(level));
+    vec2 in_page = resident_texels - floor(resident_texels / virtual_map.page_content) * virtual_map.page_content;
+    float page_size = virtual_map.page_content + 2.0 * virtual_map.page_border;
+    vec2 coord = (entry.rg * page_size + virtual_map.page_border + in_page) / virtual_map.physical_size;
+    return textureLod(virtual_map.physical, coord, 0.0);
+}
@@ -4,6 +4,10 @@ uniform mat4 projection_matrix;
 uniform mat4 view_matrix;
 uniform mat4 model_matrix;
 
+// Compact meshes store positions normalized to their bounds, float meshes use offset 0 and scale 1
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+
 in vec3 position;
 in vec3 normal;
 in vec2 texture_coordinate;
@@ -14,9 +18,11 @@ out vec2 vert_tex_coord;
 
 void main()
 {
-    vert_pos = vec3(model_matrix * vec4(position, 1.0));
+    vec3 object_position = position_offset + position * position_scale;
+
+    vert_pos = vec3(model_matrix * vec4(object_position, 1.0));
     vert_normal = inverse(transpose(mat3(model_matrix))) * normal;
     vert_tex_coord = texture_coordinate;
 
-    gl_Position = projection_matrix * view_matrix * model_matrix * vec4(position, 1.0);
+    gl_Position = projection_matrix * view_matrix * model_matrix * vec4(object_position, 1.0);
 }